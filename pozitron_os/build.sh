@@ -22,7 +22,8 @@ nasm -f elf32 main_system/src/core/isr_asm.asm -o main_system/build/isr_asm.o
 nasm -f elf32 main_system/src/core/irq_asm.asm -o main_system/build/irq_asm.o
 
 echo "3/11 [Main_system]Compiling С files..."
-CFLAGS="-m32 -ffreestanding -w -O1 -Wall -I./main_system/include"
+# EXTRA_CFLAGS - доп. флаги ядра, например -DEXT2_DIR_BENCHMARK=1 для crash_test.sh
+CFLAGS="-m32 -ffreestanding -w -O1 -Wall -I./main_system/include ${EXTRA_CFLAGS:-}"
 
 # Ядро и утилиты
 gcc $CFLAGS -c main_system/src/kernel/main.c -o main_system/build/main.o
@@ -43,6 +44,7 @@ gcc $CFLAGS -c main_system/src/kernel/semaphore.c -o main_system/build/semaphore
 gcc $CFLAGS -c main_system/src/drivers/serial.c -o main_system/build/serial.o
 gcc $CFLAGS -c main_system/src/drivers/vga.c -o main_system/build/vga.o
 gcc $CFLAGS -c main_system/src/drivers/vesa.c -o main_system/build/vesa.o
+gcc $CFLAGS -c main_system/src/drivers/bga.c -o main_system/build/bga.o
 gcc $CFLAGS -c main_system/src/drivers/keyboard.c -o main_system/build/keyboard.o
 gcc $CFLAGS -c main_system/src/drivers/mouse.c -o main_system/build/mouse.o
 gcc $CFLAGS -c main_system/src/drivers/timer.c -o main_system/build/timer.o
@@ -66,6 +68,8 @@ gcc $CFLAGS -c main_system/src/core/isr.c -o main_system/build/isr.o
 # GUI
 gcc $CFLAGS -c main_system/src/gui/core.c -o main_system/build/core.o
 gcc $CFLAGS -c main_system/src/gui/wm.c -o main_system/build/wm.o
+gcc $CFLAGS -c main_system/src/gui/compositor.c -o main_system/build/compositor.o
+gcc $CFLAGS -c main_system/src/gui/frame.c -o main_system/build/frame.o
 gcc $CFLAGS -c main_system/src/gui/wget.c -o main_system/build/wget.o
 gcc $CFLAGS -c main_system/src/gui/taskbar.c -o main_system/build/taskbar.o
 gcc $CFLAGS -c main_system/src/gui/shutdown.c -o main_system/build/shutdown.o
@@ -75,10 +79,19 @@ gcc $CFLAGS -c main_system/src/gui/setup.c -o main_system/build/setup.o
 gcc $CFLAGS -c main_system/src/lib/string.c -o main_system/build/string.o
 gcc $CFLAGS -c main_system/src/lib/mini_printf.c -o main_system/build/mini_printf.o
 gcc $CFLAGS -c main_system/src/lib/math.c -o main_system/build/math.o
+gcc $CFLAGS -c main_system/src/lib/crc32.c -o main_system/build/crc32.o
+gcc $CFLAGS -c main_system/src/lib/region.c -o main_system/build/region.o
 
 # FS
 gcc $CFLAGS -c main_system/src/fs/vfs.c -o main_system/build/vfs.o
 gcc $CFLAGS -c main_system/src/fs/ext2.c -o main_system/build/ext2.o
+gcc $CFLAGS -c main_system/src/fs/ext2_hash.c -o main_system/build/ext2_hash.o
+gcc $CFLAGS -c main_system/src/fs/ext2_journal.c -o main_system/build/ext2_journal.o
+gcc $CFLAGS -c main_system/src/fs/bcache.c -o main_system/build/bcache.o
+gcc $CFLAGS -c main_system/src/fs/dcache.c -o main_system/build/dcache.o
+gcc $CFLAGS -c main_system/src/fs/icache.c -o main_system/build/icache.o
+gcc $CFLAGS -c main_system/src/fs/pcache.c -o main_system/build/pcache.o
+gcc $CFLAGS -c main_system/src/fs/mmap.c -o main_system/build/mmap.o
 
 echo "4/11 [Main_system]Linking..."
 ld -m elf_i386 -T main_system/linker.ld -o main_system/build/kernel.bin \
@@ -106,11 +119,14 @@ ld -m elf_i386 -T main_system/linker.ld -o main_system/build/kernel.bin \
     main_system/build/keyboard.o \
     main_system/build/mouse.o \
     main_system/build/vesa.o \
+    main_system/build/bga.o \
     main_system/build/ports.o \
     main_system/build/cursor.o \
     main_system/build/event.o \
     main_system/build/core.o \
     main_system/build/wm.o \
+    main_system/build/compositor.o \
+    main_system/build/frame.o \
     main_system/build/wget.o \
     main_system/build/taskbar.o \
     main_system/build/cmos.o \
@@ -119,6 +135,8 @@ ld -m elf_i386 -T main_system/linker.ld -o main_system/build/kernel.bin \
     main_system/build/shutdown.o \
     main_system/build/string.o \
     main_system/build/math.o \
+    main_system/build/crc32.o \
+    main_system/build/region.o \
     main_system/build/pci.o \
     main_system/build/scheduler.o \
     main_system/build/paging.o \
@@ -129,7 +147,14 @@ ld -m elf_i386 -T main_system/linker.ld -o main_system/build/kernel.bin \
     main_system/build/ahci.o \
     main_system/build/disk.o \
     main_system/build/ext2.o \
+    main_system/build/ext2_hash.o \
+    main_system/build/ext2_journal.o \
     main_system/build/vfs.o \
+    main_system/build/bcache.o \
+    main_system/build/dcache.o \
+    main_system/build/icache.o \
+    main_system/build/pcache.o \
+    main_system/build/mmap.o \
     main_system/build/setup.o \
     -nostdlib
 
@@ -181,7 +206,7 @@ sudo partprobe "$LOOP_DEV"
 sleep 2
 
 sudo mkfs.fat -F32 -s 1 -f 2 -S 512 -n "LIMINE" "${LOOP_DEV}p1"
-sudo mkfs.ext2 -F -L "ROOTFS" "${LOOP_DEV}p2"
+sudo mkfs.ext3 -F -L "ROOTFS" "${LOOP_DEV}p2"
 
 mkdir -p main_system/mnt_system
 sudo mount "${LOOP_DEV}p1" main_system/mnt_system
@@ -0,0 +1,195 @@
+#!/bin/bash
+
+# Проверка журнала ext2 на сбой посреди записи.
+# Каждый раунд: загрузка образа в QEMU, kill -9 в случайный момент записи при загрузке,
+# затем два e2fsck -fn по разделу rootfs:
+#   - после проигрывания лога хостовым e2fsck (лог записан в формате JBD, упорядоченный режим);
+#   - после проигрывания лога самим ядром при следующей загрузке.
+#
+# Запись при загрузке короткая, поэтому образ лучше собрать с замером каталога и
+# проверкой повторного использования блоков:
+#   EXTRA_CFLAGS="-DEXT2_DIR_BENCHMARK=1 -DEXT2_REUSE_STRESS=1" ./build.sh
+# Кроме e2fsck проверяются файлы /reuse/d*: освобождённые косвенные блоки
+# сразу уходят под их данные, и лог не должен проиграть старые копии поверх
+#
+# Использование: ./crash_test.sh [образ]
+#   ROUNDS       - число раундов (5)
+#   KILL_MS      - окно, в котором выбирается момент убийства, мс (4000)
+#   BOOT_TIMEOUT - сколько ждать строки в журнале COM1, с (120)
+#   QEMU         - qemu-system-i386
+
+set -u
+
+IMG=${1:-main_system/system.img}
+ROUNDS=${ROUNDS:-5}
+KILL_MS=${KILL_MS:-4000}
+BOOT_TIMEOUT=${BOOT_TIMEOUT:-120}
+QEMU=${QEMU:-qemu-system-i386}
+
+if [ ! -f "$IMG" ]; then
+    echo "  ERROR: image $IMG not found, run ./build.sh first"
+    exit 1
+fi
+
+for tool in "$QEMU" e2fsck debugfs od dd; do
+    if ! command -v "$tool" > /dev/null 2>&1; then
+        echo "  ERROR: $tool not found"
+        exit 1
+    fi
+done
+
+WORK=$(mktemp -d)
+QEMU_PID=""
+
+cleanup() {
+    if [ -n "$QEMU_PID" ]; then
+        kill -9 "$QEMU_PID" 2>/dev/null
+        wait "$QEMU_PID" 2>/dev/null
+    fi
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+# Раздел rootfs - вторая запись MBR (build.sh: FAT32 + EXT2)
+PART_START=$(od -An -tu4 -j 470 -N 4 "$IMG" | tr -d ' ')
+PART_COUNT=$(od -An -tu4 -j 474 -N 4 "$IMG" | tr -d ' ')
+
+if [ -z "$PART_START" ] || [ "$PART_START" -eq 0 ] || [ "$PART_COUNT" -eq 0 ]; then
+    echo "  ERROR: no rootfs partition in MBR of $IMG"
+    exit 1
+fi
+
+boot() {
+    "$QEMU" -m 512 -drive file="$1",format=raw,if=ide \
+        -serial file:"$2" -display none -no-reboot > /dev/null 2>&1 &
+    QEMU_PID=$!
+}
+
+kill_qemu() {
+    kill -9 "$QEMU_PID" 2>/dev/null
+    wait "$QEMU_PID" 2>/dev/null
+    QEMU_PID=""
+}
+
+# Ждёт строку в журнале COM1; 1 - QEMU вышел или время кончилось
+wait_for() {
+    local log=$1 pattern=$2
+    local ticks=$((BOOT_TIMEOUT * 10))
+
+    while [ $ticks -gt 0 ]; do
+        if grep -q "$pattern" "$log" 2>/dev/null; then
+            return 0
+        fi
+        if ! kill -0 "$QEMU_PID" 2>/dev/null; then
+            return 1
+        fi
+        sleep 0.1
+        ticks=$((ticks - 1))
+    done
+    return 1
+}
+
+extract_rootfs() {
+    dd if="$1" of="$2" bs=512 skip="$PART_START" count="$PART_COUNT" status=none
+}
+
+# e2fsck -fn ничего не меняет; код 0 - ФС согласована
+check_fs() {
+    local part=$1 what=$2
+
+    if e2fsck -fn "$part" > "$WORK/fsck.log" 2>&1; then
+        echo "  [$what] e2fsck -fn: clean"
+        return 0
+    fi
+    echo "  [$what] e2fsck -fn: ERRORS"
+    cat "$WORK/fsck.log"
+    return 1
+}
+
+# Файлы данных ext2_reuse_stress целиком из байта 0xA5 (EXT2_STRESS_FILL)
+check_reuse() {
+    local part=$1 what=$2
+    local bad=0
+
+    rm -rf "$WORK/reuse"
+    mkdir "$WORK/reuse"
+    debugfs -R "rdump /reuse $WORK/reuse" "$part" > /dev/null 2>&1
+    [ -d "$WORK/reuse/reuse" ] || return 0
+
+    for f in "$WORK"/reuse/reuse/d*; do
+        [ -f "$f" ] || continue
+        if [ "$(tr -d '\245' < "$f" | wc -c)" -ne 0 ]; then
+            echo "  [$what] $(basename "$f"): foreign data in file"
+            bad=1
+        fi
+    done
+    if [ $bad -eq 0 ]; then
+        echo "  [$what] /reuse data: intact"
+    fi
+    return $bad
+}
+
+failed=0
+
+for round in $(seq 1 "$ROUNDS"); do
+    echo "Round $round/$ROUNDS"
+    cp "$IMG" "$WORK/round.img"
+    rm -f "$WORK/crash.log" "$WORK/replay.log"
+
+    # 1. Сбой посреди записи
+    boot "$WORK/round.img" "$WORK/crash.log"
+    if ! wait_for "$WORK/crash.log" "=== EXT2 TEST ==="; then
+        echo "  ERROR: kernel did not reach the write test"
+        kill_qemu
+        cat "$WORK/crash.log"
+        exit 1
+    fi
+
+    delay=$((RANDOM * 32768 + RANDOM))
+    delay=$((delay % KILL_MS))
+    sleep "$((delay / 1000)).$(printf '%03d' $((delay % 1000)))"
+    kill_qemu
+
+    if grep -q "=== END OF EXT2 TEST ===" "$WORK/crash.log"; then
+        echo "  Killed after $delay ms, writes had already finished"
+    else
+        echo "  Killed after $delay ms, mid-write"
+    fi
+    grep "\[JBD\]" "$WORK/crash.log" | tail -n 3 | sed 's/^/    /'
+
+    # 2. Лог проигрывает e2fsck хоста: проверяет формат лога и порядок записи
+    extract_rootfs "$WORK/round.img" "$WORK/host.ext"
+    e2fsck -fy -E journal_only "$WORK/host.ext" > "$WORK/host_replay.log" 2>&1
+    check_fs "$WORK/host.ext" "host replay" || failed=1
+    check_reuse "$WORK/host.ext" "host replay" || failed=1
+
+    # 3. Лог проигрывает ядро при монтировании; QEMU убивается сразу после открытия
+    # журнала, до новых операций
+    boot "$WORK/round.img" "$WORK/replay.log"
+    if ! wait_for "$WORK/replay.log" "\[JBD\] Journal:"; then
+        echo "  ERROR: kernel did not open the journal after the crash"
+        kill_qemu
+        grep "\[JBD\]\|\[EXT2\]\|\[VFS\]" "$WORK/replay.log"
+        failed=1
+        continue
+    fi
+    kill_qemu
+
+    if grep -q "\[JBD\] Recovery failed" "$WORK/replay.log"; then
+        echo "  ERROR: kernel journal recovery failed"
+        failed=1
+        continue
+    fi
+    grep "\[JBD\] Recovered" "$WORK/replay.log" | sed 's/^/    /'
+
+    extract_rootfs "$WORK/round.img" "$WORK/kernel.ext"
+    check_fs "$WORK/kernel.ext" "kernel replay" || failed=1
+    check_reuse "$WORK/kernel.ext" "kernel replay" || failed=1
+done
+
+if [ $failed -ne 0 ]; then
+    echo "CRASH TEST FAILED"
+    exit 1
+fi
+
+echo "CRASH TEST PASSED ($ROUNDS rounds)"
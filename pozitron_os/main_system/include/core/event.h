@@ -75,6 +75,8 @@ typedef struct {
 void event_init(void);
 void event_post(event_t event);
 int event_poll(event_t* event);
+// Следующее событие без извлечения из очереди
+int event_peek(event_t* event);
 int event_available(void);
 void event_clear(void);
 
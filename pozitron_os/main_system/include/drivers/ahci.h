@@ -84,10 +84,15 @@ struct ahci_port {
     char serial[21];
     char firmware[9];
     uint8_t lba48_supported;
+    uint32_t probe_ms;       // Время от начала сброса порта до IDENTIFY
 };
 
 // Функции
-void ahci_init(void);
+// known_disks - жёстких дисков, уже найденных другими драйверами (CD-ROM не в счёт):
+// с ними медленные порты не ждём
+void ahci_init(int known_disks);
+void ahci_probe_start(void);
+int ahci_probe_poll(void);
 int ahci_read_sectors(int port, uint64_t lba, uint32_t count, void* buffer);
 int ahci_write_sectors(int port, uint64_t lba, uint32_t count, void* buffer);
 int ahci_flush_cache(int port);
@@ -86,6 +86,7 @@ typedef struct ata_device {
     
     uint8_t lba48_supported;
     uint8_t dma_supported;
+    uint32_t probe_ms;       // Время обнаружения от сброса канала
 } ata_device_t;
 
 // Структура канала (полная, без forward declaration проблем)
@@ -97,6 +98,7 @@ struct ata_channel {
     uint8_t chanid;
     uint32_t pci_bdf;
     struct ata_pci_device* pci_dev;
+    uint32_t probe_start;    // Тик начала сброса канала
 };
 
 // Функции
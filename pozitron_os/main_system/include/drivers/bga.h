@@ -0,0 +1,46 @@
+#ifndef BGA_H
+#define BGA_H
+
+#include <stdint.h>
+
+// Bochs Graphics Adapter (DISPI): QEMU -vga std / bochs-display, Bochs, VirtualBox VBoxVGA.
+// Режим меняется записью в регистры без BIOS; виртуальный экран может быть выше
+// видимого, а видимое окно сдвигается смещением по Y
+#define BGA_IOPORT_INDEX        0x01CE
+#define BGA_IOPORT_DATA         0x01CF
+
+#define BGA_INDEX_ID            0x0
+#define BGA_INDEX_XRES          0x1
+#define BGA_INDEX_YRES          0x2
+#define BGA_INDEX_BPP           0x3
+#define BGA_INDEX_ENABLE        0x4
+#define BGA_INDEX_BANK          0x5
+#define BGA_INDEX_VIRT_WIDTH    0x6
+#define BGA_INDEX_VIRT_HEIGHT   0x7
+#define BGA_INDEX_X_OFFSET      0x8
+#define BGA_INDEX_Y_OFFSET      0x9
+#define BGA_INDEX_VIDEO_MEMORY  0xA     // Видеопамять в блоках по 64 КБ (QEMU)
+
+#define BGA_ID0                 0xB0C0
+#define BGA_ID5                 0xB0C5
+
+#define BGA_DISABLED            0x00
+#define BGA_ENABLED             0x01
+#define BGA_GETCAPS             0x02    // Чтение XRES/YRES/BPP отдаёт максимумы
+#define BGA_LFB_ENABLED         0x40
+#define BGA_NOCLEARMEM          0x80
+
+uint16_t bga_read(uint16_t index);
+void bga_write(uint16_t index, uint16_t value);
+
+// 1 - адаптер отвечает своим ID
+uint8_t bga_detect(void);
+// Объём видеопамяти в байтах; 0 - адаптер его не сообщает
+uint32_t bga_vram_size(void);
+// Режим с виртуальной высотой virt_height (не меньше height); 1 - адаптер его принял.
+// Высоту, на которую не хватило видеопамяти, адаптер урезает молча: см. BGA_INDEX_VIRT_HEIGHT
+uint8_t bga_set_mode(uint32_t width, uint32_t height, uint32_t bpp, uint32_t virt_height);
+// Первая видимая строка виртуального экрана
+void bga_set_y_offset(uint32_t y);
+
+#endif
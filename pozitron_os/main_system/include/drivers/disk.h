@@ -1,19 +1,33 @@
 #pragma once
 #include <stdint.h>
 
+#define DISK_MAX_DISKS       32
+#define DISK_MAX_PARTITIONS  16
+
 typedef enum {
     DISK_TYPE_NONE = 0,
     DISK_TYPE_ATA,
     DISK_TYPE_ATAPI,
     DISK_TYPE_SATA,
-    DISK_TYPE_AHCI
+    DISK_TYPE_AHCI,
+    DISK_TYPE_PARTITION
 } disk_type_t;
 
+typedef enum {
+    DISK_SCHEME_NONE = 0,
+    DISK_SCHEME_MBR,
+    DISK_SCHEME_GPT
+} disk_scheme_t;
+
+struct disk;
+
 typedef struct disk_partition {
-    uint8_t  type;
-    uint32_t start_lba;
-    uint32_t sector_count;
+    uint8_t  type;              // Тип MBR (для GPT - эквивалент по GUID типа)
+    uint64_t start_lba;
+    uint64_t sector_count;
     uint8_t  bootable;
+    uint8_t  type_guid[16];     // Только для GPT
+    struct disk* dev;           // Блочное устройство раздела
 } disk_partition_t;
 
 typedef struct disk {
@@ -31,20 +45,27 @@ typedef struct disk {
     void* private_data;
     int private_id;
     
-    uint64_t partition_offset;
-    disk_partition_t partitions[16];
+    disk_scheme_t scheme;
+    disk_partition_t partitions[DISK_MAX_PARTITIONS];
     int partition_count;
+    
+    struct disk* parent;        // Для разделов - физический диск
+    uint64_t start_lba;         // Для разделов - смещение на физическом диске
+    
+    uint32_t probe_ms;          // Время обнаружения устройства при загрузке
 } disk_t;
 
 void disk_init(void);
+void disk_poll(void);
 disk_t* disk_get(int index);
 int disk_get_count(void);
 void disk_dump_all(void);
 
 int disk_read_partition(disk_t* disk, int part_index, uint64_t lba, uint32_t count, void* buffer);
 int disk_write_partition(disk_t* disk, int part_index, uint64_t lba, uint32_t count, void* buffer);
-int disk_get_partition_offset(disk_t* disk, int part_index);
+uint64_t disk_get_partition_offset(disk_t* disk, int part_index);
 int disk_find_partition_by_type(disk_t* disk, uint8_t type);
+disk_t* disk_get_partition(disk_t* disk, int part_index);
 
 static inline int disk_read(disk_t* disk, uint64_t lba, uint32_t count, void* buffer) {
     if (!disk || !disk->read) return -1;
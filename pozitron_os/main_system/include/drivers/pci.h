@@ -9,6 +9,7 @@ typedef struct {
     uint8_t func;
 } pci_device_t;
 
+void pci_init(void);
 uint32_t pci_read32(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset);
 uint16_t pci_read16(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset);
 uint8_t pci_read8(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset);
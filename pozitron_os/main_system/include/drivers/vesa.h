@@ -15,6 +15,7 @@ struct fb_info {
     uint32_t bpp;
     uint32_t pitch;
     uint8_t found;
+    uint32_t vram_size;             // Сколько видеопамяти отображать в адресное пространство
 };
 
 // Dirty rectangle
@@ -56,7 +57,12 @@ struct fb_info* vesa_get_info(void);
 // Drawing primitives
 void vesa_put_pixel(uint32_t x, uint32_t y, color_t color);
 color_t vesa_get_pixel(uint32_t x, uint32_t y);
+// Прямоугольник цели рисования в 0xRRGGBB, w точек на строку out; точки за краем не трогаются
+void vesa_read_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, color_t* out);
+// 1-битная маска шириной 16 точек (старший бит - левая точка): единицы цветом color
+void vesa_draw_mask16(uint32_t x, uint32_t y, const uint16_t* rows, uint32_t h, color_t color);
 void vesa_draw_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, color_t color);
+void vesa_fill_span(uint32_t x, uint32_t y, uint32_t w, color_t color);
 void vesa_draw_line(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2, color_t color);
 void vesa_draw_circle(uint32_t cx, uint32_t cy, uint32_t radius, color_t color);
 void vesa_fill(color_t color);
@@ -67,11 +73,29 @@ void vesa_draw_char(uint32_t x, uint32_t y, uint16_t unicode, color_t fg, color_
 void vesa_draw_text(uint32_t x, uint32_t y, const char* text, color_t fg, color_t bg);
 void vesa_draw_text_cp866(uint32_t x, uint32_t y, const char* text, color_t fg, color_t bg);
 void vesa_draw_text_rus(uint32_t x, uint32_t y, const char* text, color_t fg, color_t bg);
+// Строка без переноса: не больше len байт UTF-8 до конца строки или '\n', отсечение одно на всю строку
+void vesa_draw_text_run(uint32_t x, uint32_t y, const char* text, uint32_t len, color_t fg, color_t bg);
+
+#define VESA_TEXT_RUN_MAX   128     // Глифов в одном проходе вывода строки
+#define GLYPH_LUT_SLOTS     8       // Пар (fg, bg) с готовыми таблицами строк глифа, по 8 КБ
 
 // ===== ENHANCED FUNCTIONS =====
 // Mode management
 void vesa_list_modes(void);
+// Смена режима через DISPI (QEMU/Bochs/VirtualBox); на других адаптерах - только текущий.
+// Экранный и фоновый буферы пересоздаются, поверхности окон остаются в старом формате,
+// поэтому режим меняется до запуска GUI
 int vesa_set_mode(uint32_t width, uint32_t height, uint32_t bpp);
+
+// DISPI: режим при загрузке (0 - как выставил загрузчик) и переключение страниц:
+// рисование идёт в скрытую половину видеопамяти, вывод кадра - смена смещения по Y
+#define VESA_DISPI              1
+#define VESA_DISPI_WIDTH        0
+#define VESA_DISPI_HEIGHT       0
+#define VESA_DISPI_BPP          0
+#define VESA_VRAM_MAP_MAX       (16 * 1024 * 1024)  // Больше видеопамяти не отображается
+
+uint8_t vesa_is_page_flipping(void);
 void vesa_print_info(void);
 
 // Color conversion
@@ -89,10 +113,38 @@ void vesa_blit_alpha(uint32_t dst_x, uint32_t dst_y,
                     uint32_t src_x, uint32_t src_y, uint32_t blit_width, uint32_t blit_height,
                     uint8_t alpha);
 
+// Полупрозрачная заливка одним цветом (alpha 0-255)
+void vesa_fill_alpha(uint32_t x, uint32_t y, uint32_t w, uint32_t h, color_t color, uint8_t alpha);
+// Смешивание цветов: alpha 0 - bg, 255 - fg
+color_t vesa_blend_color(color_t bg, color_t fg, uint8_t alpha);
+
 // Special effects
 void vesa_draw_gradient(uint32_t x, uint32_t y, uint32_t w, uint32_t h,
                        color_t color1, color_t color2, uint8_t vertical);
 
+// Замер полноэкранной заливки при загрузке: put_pixel против span-движка
+#define VESA_FILL_BENCHMARK 0
+#define VESA_BENCH_MS 500
+
+void vesa_fill_benchmark(void);
+
+// ===== SURFACES =====
+// Внеэкранная поверхность в формате кадра (тот же bpp), строки с шагом pitch
+typedef struct vesa_surface {
+    uint8_t* pixels;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pitch;
+} vesa_surface_t;
+
+vesa_surface_t* vesa_surface_create(uint32_t width, uint32_t height);
+void vesa_surface_destroy(vesa_surface_t* surface);
+// Примитивы рисуют в surface, экранная точка (x, y) попадает в её левый верхний угол; NULL - экран
+void vesa_set_target(vesa_surface_t* surface, int32_t x, int32_t y);
+// Экранный прямоугольник из поверхности, лежащей в (sx, sy), копируется в экранный буфер
+void vesa_surface_present(const vesa_surface_t* surface, int32_t sx, int32_t sy,
+                          uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+
 // ===== DOUBLE BUFFERING =====
 int vesa_enable_double_buffer(void);
 void vesa_disable_double_buffer(void);
@@ -105,21 +157,48 @@ void vesa_swap_buffers(void);
 void vesa_clear_back_buffer(color_t color);
 
 // ===== DIRTY RECTANGLES =====
-#define MAX_DIRTY_RECTS 32
+// Урон хранится точной областью (lib/region.h). Цена копирования прямоугольника -
+// пиксели плюс накладные в пикселях на строку и на прямоугольник; если один
+// ограничивающий прямоугольник не дороже точных, область сводится к нему
+#define DAMAGE_ROW_COST     16
+#define DAMAGE_RECT_COST    256
+#define DAMAGE_MAX_RECTS    64
+
+// Строки короче копируются rep movsl, длиннее - потоковыми записями SSE2
+#define PRESENT_STREAM_MIN  256
+
+typedef struct vesa_frame_stats {
+    uint32_t frames;
+    uint32_t pixels;                // Скопировано в текущем кадре
+    uint32_t rects;
+    uint32_t last_pixels;           // Скопировано за последний кадр: фон, окна, вывод на экран
+    uint32_t last_rects;            // Прямоугольников урона за последний кадр
+    uint32_t avg_pixels;
+    uint32_t peak_pixels;
+    uint32_t vram_bytes;            // Записано в видеопамять в текущем кадре
+    uint32_t last_vram_bytes;
+    uint32_t skipped;               // Кадров без урона: вывод пропущен
+} vesa_frame_stats_t;
 
 void vesa_init_dirty(void);
 void vesa_mark_dirty(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+// Экранный буфер уже готов, нужно только вывести на экран (курсор, панель задач)
+void vesa_mark_present(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
 void vesa_mark_dirty_all(void);
+// Вывод изменившихся строк экранного буфера; без урона ничего не копируется
 void vesa_update_dirty(void);
 void vesa_clear_dirty(void);
 uint32_t vesa_get_dirty_count(void);
 void vesa_debug_dirty(void);
 uint8_t vesa_get_dirty_rect(uint32_t index, uint32_t* x, uint32_t* y, uint32_t* w, uint32_t* h);
+void vesa_get_frame_stats(vesa_frame_stats_t* stats);
+void vesa_dump_frame_stats(void);
 
 // ===== BACKGROUND CACHING =====
 void vesa_cache_background(void);
 void vesa_restore_background(void);
 void vesa_restore_background_dirty(void);
+void vesa_restore_background_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
 void vesa_free_background_cache(void);
 uint8_t vesa_is_background_cached(void);
 
@@ -0,0 +1,70 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include <stdint.h>
+#include "drivers/disk.h"
+
+#define BCACHE_DEFAULT_LIMIT  (4 * 1024 * 1024)
+#define BCACHE_HASH_SIZE      1024
+
+#define BCACHE_FLUSH_INTERVAL_MS  5000
+#define BCACHE_DIRTY_RATIO        50     // % лимита, после которого сбрасываем принудительно
+#define BCACHE_MAX_IO_SECTORS     128    // Максимум секторов в одной объединённой записи
+
+#define BCACHE_VALID  0x01
+#define BCACHE_DIRTY  0x02
+#define BCACHE_PINNED 0x04   // Метаданные открытой транзакции журнала: на место до коммита не пишутся
+
+typedef struct bcache_buf {
+    disk_t*  disk;
+    uint64_t lba;
+    uint32_t size;
+    uint8_t* data;
+    uint32_t refcount;
+    uint8_t  flags;
+    struct bcache_buf* hash_next;
+    struct bcache_buf* lru_prev;
+    struct bcache_buf* lru_next;
+} bcache_buf_t;
+
+typedef struct bcache_stats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t readahead;
+    uint32_t evictions;
+    uint32_t writes;
+    uint32_t flushes;
+    uint32_t buffers;
+    uint32_t dirty;
+    uint32_t dirty_bytes;
+    uint32_t bytes;
+    uint32_t limit;
+} bcache_stats_t;
+
+void bcache_init(uint32_t limit);
+void bcache_set_limit(uint32_t limit);
+void bcache_set_writeback(uint8_t enabled);
+uint8_t bcache_is_writeback(void);
+
+// Буфер без чтения с диска (для полной перезаписи блока)
+bcache_buf_t* bcache_get(disk_t* disk, uint64_t lba, uint32_t size);
+// Буфер с гарантированно актуальными данными
+bcache_buf_t* bcache_read(disk_t* disk, uint64_t lba, uint32_t size);
+// Есть ли в кэше актуальная (возможно, грязная) копия блока
+int bcache_cached(disk_t* disk, uint64_t lba);
+int bcache_readahead(disk_t* disk, uint64_t lba, uint32_t count, uint32_t size);
+int bcache_write(bcache_buf_t* buf);
+void bcache_release(bcache_buf_t* buf);
+
+// Закрепление держит ссылку; грязный закреплённый буфер пропускается сбросом
+void bcache_pin(bcache_buf_t* buf);
+void bcache_unpin(bcache_buf_t* buf);
+
+int bcache_sync(disk_t* disk);
+void bcache_flusher_poll(void);
+void bcache_invalidate(disk_t* disk);
+
+void bcache_get_stats(bcache_stats_t* stats);
+void bcache_dump_stats(void);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef DCACHE_H
+#define DCACHE_H
+
+#include <stdint.h>
+#include "fs/vfs.h"
+
+#define DCACHE_SIZE        1024    // Записей в пуле
+#define DCACHE_HASH_SIZE   512
+#define DCACHE_NAME_INLINE 48      // Более длинные имена не кэшируются
+
+typedef struct dentry {
+    struct vfs_superblock* sb;
+    uint32_t parent;                 // Номер inode родительского каталога
+    uint32_t hash;
+    uint8_t  name_len;
+    char     name[DCACHE_NAME_INLINE];
+    struct vfs_inode* inode;         // Ссылка из icache; NULL - отрицательная запись
+    struct dentry* hash_next;
+    struct dentry* lru_prev;
+    struct dentry* lru_next;
+} dentry_t;
+
+typedef struct dcache_stats {
+    uint32_t hits;
+    uint32_t negative_hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t invalidations;
+    uint32_t entries;
+} dcache_stats_t;
+
+void dcache_init(void);
+
+// Возвращает 1 и *inode (NULL для отрицательной записи) при попадании, 0 при промахе
+int dcache_lookup(struct vfs_inode* dir, const char* name, uint32_t len, struct vfs_inode** inode);
+void dcache_add(struct vfs_inode* dir, const char* name, uint32_t len, struct vfs_inode* inode);
+void dcache_invalidate(struct vfs_inode* dir, const char* name, uint32_t len);
+void dcache_purge_dir(struct vfs_superblock* sb, uint32_t dir_ino);
+void dcache_purge_sb(struct vfs_superblock* sb);
+
+void dcache_get_stats(dcache_stats_t* stats);
+void dcache_dump_stats(void);
+
+#endif
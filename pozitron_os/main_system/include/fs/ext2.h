@@ -31,6 +31,22 @@
 #define EXT2_S_IWOTH 0x0002
 #define EXT2_S_IXOTH 0x0001
 
+#define EXT2_READAHEAD_MIN 4     // Начальное окно упреждающего чтения (блоков)
+#define EXT2_READAHEAD_MAX 64    // Максимальное окно по умолчанию
+
+#define EXT2_MAP_CACHE     8     // Серий блоков в кэше отображения на inode
+#define EXT2_PREALLOC_DEFAULT 8  // Окно предвыделения, если s_prealloc_blocks не задан
+#define EXT2_DIRECT_ALIGN  4     // Выравнивание буфера для чтения полных блоков мимо кэша (DMA)
+
+#ifndef EXT2_DIR_BENCHMARK
+#define EXT2_DIR_BENCHMARK 0     // Замер создания/поиска 10000 записей при загрузке (crash_test.sh включает)
+#endif
+#ifndef EXT2_REUSE_STRESS
+#define EXT2_REUSE_STRESS 0      // Повторное использование освобождённых косвенных блоков под данные (crash_test.sh)
+#endif
+#define EXT2_STRESS_FILL   0xA5  // Байт данных в файлах ext2_reuse_stress
+#define EXT2_META_SYNC_MS  5000  // Суперблок и таблица групп пишутся не чаще раза за интервал
+
 #define EXT2_FT_UNKNOWN  0
 #define EXT2_FT_REG_FILE 1
 #define EXT2_FT_DIR      2
@@ -78,10 +94,56 @@ struct ext2_superblock {
     uint32_t s_algo_bitmap;
     uint8_t  s_prealloc_blocks;
     uint8_t  s_prealloc_dir_blocks;
-    uint16_t s_padding;
-    uint8_t  s_reserved[204];
+    uint16_t s_reserved_gdt_blocks;
+    uint8_t  s_journal_uuid[16];
+    uint32_t s_journal_inum;
+    uint32_t s_journal_dev;
+    uint32_t s_last_orphan;
+    uint32_t s_hash_seed[4];
+    uint8_t  s_def_hash_version;
+    uint8_t  s_jnl_backup_type;
+    uint16_t s_desc_size;
+    uint32_t s_default_mount_opts;
+    uint32_t s_first_meta_bg;
+    uint32_t s_mkfs_time;
+    uint32_t s_jnl_blocks[17];
+    uint32_t s_blocks_count_hi;
+    uint32_t s_r_blocks_count_hi;
+    uint32_t s_free_blocks_hi;
+    uint16_t s_min_extra_isize;
+    uint16_t s_want_extra_isize;
+    uint32_t s_flags;
+    uint8_t  s_reserved[56];
 } __attribute__((packed));
 
+// Возможности ФС
+#define EXT2_FEATURE_COMPAT_HAS_JOURNAL 0x0004
+#define EXT2_FEATURE_COMPAT_DIR_INDEX  0x0020
+#define EXT2_FEATURE_INCOMPAT_RECOVER  0x0004  // В журнале могут быть непроигранные транзакции
+#define EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER 0x0001  // Копии суперблока только в группах 0, 1 и степенях 3, 5, 7
+
+// s_state
+#define EXT2_VALID_FS                  0x0001  // Размонтирована чисто
+#define EXT2_ERROR_FS                  0x0002
+
+// s_flags
+#define EXT2_FLAGS_SIGNED_HASH         0x0001
+#define EXT2_FLAGS_UNSIGNED_HASH       0x0002
+
+// i_flags
+#define EXT2_INDEX_FL                  0x00001000
+
+// Хэши имён в HTree (dx_root_info.hash_version)
+#define EXT2_DX_HASH_LEGACY            0
+#define EXT2_DX_HASH_HALF_MD4          1
+#define EXT2_DX_HASH_TEA               2
+#define EXT2_DX_HASH_LEGACY_UNSIGNED   3
+#define EXT2_DX_HASH_HALF_MD4_UNSIGNED 4
+#define EXT2_DX_HASH_TEA_UNSIGNED      5
+
+#define EXT2_DX_MAX_LEVELS             2       // Корень + один промежуточный уровень, как в ext3
+#define EXT2_DX_BLOCK_MASK             0x00FFFFFF
+
 struct ext2_group_desc {
     uint32_t bg_block_bitmap;
     uint32_t bg_inode_bitmap;
@@ -122,6 +184,52 @@ struct ext2_dir_entry {
     char     name[255];
 } __attribute__((packed));
 
+// Минимальная длина записи каталога с именем длины len
+#define EXT2_DIR_REC_LEN(len) (((len) + 8 + 3) & ~3)
+
+// HTree: блок 0 индексированного каталога - "." и ".." с dx_root_info за ними
+struct ext2_dx_root_info {
+    uint32_t reserved_zero;
+    uint8_t  hash_version;
+    uint8_t  info_length;
+    uint8_t  indirect_levels;
+    uint8_t  unused_flags;
+} __attribute__((packed));
+
+struct ext2_dx_entry {
+    uint32_t hash;
+    uint32_t block;         // Логический номер блока каталога
+} __attribute__((packed));
+
+// Занимает поле hash нулевой записи каждого узла
+struct ext2_dx_countlimit {
+    uint16_t limit;
+    uint16_t count;
+} __attribute__((packed));
+
+// Непрерывная серия: логические блоки [lblock, lblock + len) лежат подряд с pblock
+struct ext2_extent {
+    uint32_t lblock;
+    uint32_t pblock;
+    uint32_t len;               // 0 - слот свободен
+};
+
+// Часть inode, принадлежащая ext2 (vfs_inode->private_data)
+struct ext2_inode_info {
+    struct ext2_inode raw;      // Копия inode с диска, пишется лениво через icache
+    struct ext2_extent map[EXT2_MAP_CACHE];
+    uint8_t map_next;           // Следующий слот для замены
+    uint32_t group;             // Группа, где лежит inode - туда же идут его блоки
+    uint32_t last_block;        // Последний выделенный блок, цель для следующего
+    uint32_t prealloc_block;    // Окно предвыделения: занятые в карте, но ещё не использованные блоки
+    uint32_t prealloc_count;
+    uint32_t dir_hint;          // Каталог: блоки до этого заполнены, вставка ищет место с него
+    uint8_t unlinked;           // Последняя ссылка снята в этом сеансе - ext2_ifree удаляет inode
+};
+
+#define EXT2_I(inode) ((struct ext2_inode_info*)(inode)->private_data)
+#define EXT2_SB(sb)   ((struct ext2_private*)(sb)->private_data)
+
 struct ext2_private {
     struct ext2_superblock sb;
     uint32_t block_size;
@@ -132,12 +240,30 @@ struct ext2_private {
     struct ext2_group_desc* groups;
     uint8_t* block_buf;
     uint8_t* inode_buf;
-    uint8_t* bitmap_buf;
+    uint32_t orlov_rotor;       // Сдвиг поиска группы для каталогов верхнего уровня
     disk_t* disk;
+    struct vfs_superblock* vsb;
+    struct ext2_journal* journal; // NULL - ФС без журнала, метаданные пишутся напрямую
+    uint32_t* gdt_dirty;        // Битовая карта изменённых блоков таблицы групп
+    uint8_t sb_dirty;           // Счётчики суперблока расходятся с диском
+    uint32_t meta_tick;         // Срок сброса суперблока и таблицы групп
+    struct ext2_private* next;  // Список смонтированных ФС для ext2_poll
 };
 
 void ext2_init(void);
 int ext2_format(disk_t* disk);
 int ext2_check(disk_t* disk);
+void ext2_set_readahead_max(uint32_t blocks);
+// Переносит изменённые суперблок и таблицу групп в буферы (через журнал, если он есть)
+int ext2_flush_meta(struct ext2_private* priv);
+// Возвращает блоки в битовые карты немедленно (журнал - после коммита)
+void ext2_release_blocks(struct ext2_private* priv, uint32_t block, uint32_t count);
+// Периодический сброс метаданных и коммит журналов, вызывается из главного цикла ядра
+void ext2_poll(void);
+
+int ext2_dirhash(const char* name, uint32_t len, uint32_t version,
+                 const uint32_t* seed, uint32_t* hash, uint32_t* minor_hash);
+void ext2_dir_benchmark(const char* path, uint32_t count);
+void ext2_reuse_stress(const char* path, uint32_t rounds);
 
 #endif
\ No newline at end of file
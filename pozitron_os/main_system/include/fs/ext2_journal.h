@@ -0,0 +1,95 @@
+#ifndef EXT2_JOURNAL_H
+#define EXT2_JOURNAL_H
+
+#include <stdint.h>
+#include "fs/bcache.h"
+
+// Журнал в формате JBD (ext3): все поля на диске big-endian
+
+#define JBD_MAGIC               0xC03B3998
+
+#define JBD_DESCRIPTOR_BLOCK    1
+#define JBD_COMMIT_BLOCK        2
+#define JBD_SUPERBLOCK_V1       3
+#define JBD_SUPERBLOCK_V2       4
+#define JBD_REVOKE_BLOCK        5
+
+#define JBD_FLAG_ESCAPE         1       // Первое слово блока совпадало с JBD_MAGIC и обнулено
+#define JBD_FLAG_SAME_UUID      2       // За тегом нет UUID
+#define JBD_FLAG_DELETED        4
+#define JBD_FLAG_LAST_TAG       8
+
+#define JBD_FEATURE_INCOMPAT_REVOKE 0x00000001
+
+#define EXT2_JOURNAL_COMMIT_MS  5000    // Пакетный коммит: не реже, чем раз в 5 секунд
+
+// Резерв блоков метаданных на операцию
+#define EXT2_CREDITS_INODE      1       // Запись inode
+#define EXT2_CREDITS_DIROP      24      // Запись каталога с индексом, inode, битовые карты, дескрипторы
+#define EXT2_CREDITS_WRITE      16      // Кусок записи: косвенные блоки, карты и дескрипторы групп
+#define EXT2_WRITE_CHUNK_BLOCKS 256     // Столько блоков данных пишется под одним резервом
+
+struct jbd_header {
+    uint32_t h_magic;
+    uint32_t h_blocktype;
+    uint32_t h_sequence;
+} __attribute__((packed));
+
+struct jbd_superblock {
+    struct jbd_header s_header;
+    uint32_t s_blocksize;
+    uint32_t s_maxlen;              // Блоков в журнале
+    uint32_t s_first;               // Первый блок лога
+    uint32_t s_sequence;            // Первая ожидаемая транзакция
+    uint32_t s_start;               // Начало лога; 0 - журнал пуст
+    uint32_t s_errno;
+    uint32_t s_feature_compat;
+    uint32_t s_feature_incompat;
+    uint32_t s_feature_ro_compat;
+    uint8_t  s_uuid[16];
+    uint32_t s_nr_users;
+    uint32_t s_dynsuper;
+    uint32_t s_max_transaction;
+    uint32_t s_max_trans_data;
+} __attribute__((packed));
+
+// Тег дескриптора; в JBD2 t_flags - младшие 16 бит, старшие (контрольная сумма) у нас нули
+struct jbd_block_tag {
+    uint32_t t_blocknr;
+    uint32_t t_flags;
+} __attribute__((packed));
+
+struct jbd_revoke_header {
+    struct jbd_header r_header;
+    uint32_t r_count;               // Занято байт в блоке, включая заголовок
+} __attribute__((packed));
+
+struct ext2_private;
+
+// Открытие журнала при монтировании: map - физические блоки журнала (владение передаётся).
+// Незавершённый лог проигрывается на место; *replayed - было ли что проигрывать
+int ext2_journal_load(struct ext2_private* priv, uint32_t* map, uint32_t blocks, int* replayed);
+// Чистое закрытие: коммит, сброс на место и пустой лог
+void ext2_journal_release(struct ext2_private* priv);
+
+// Операция ФС: коммит не случится между start и stop. credits - сколько блоков
+// метаданных операция может изменить; не влезают в транзакцию - коммит до начала
+void ext2_journal_start(struct ext2_private* priv, uint32_t credits);
+void ext2_journal_stop(struct ext2_private* priv);
+// Пакет операций: коммиты только по заполнению, а не после каждой операции
+void ext2_journal_batch(struct ext2_private* priv, int begin);
+
+// Вместо bcache_write для метаданных; без журнала - обычная запись
+int ext2_journal_dirty(struct ext2_private* priv, bcache_buf_t* b);
+// Освобождённый блок метаданных: старые копии из журнала не проигрываются
+void ext2_journal_revoke(struct ext2_private* priv, uint32_t block);
+// Освобождение блоков откладывается до коммита транзакции: раньше их нельзя отдать под
+// данные, иначе после сбоя старая копия из лога ляжет поверх. -1 - журнала нет или нет
+// памяти, блоки освобождаются сразу
+int ext2_journal_free(struct ext2_private* priv, uint32_t block, uint32_t count);
+
+int ext2_journal_commit(struct ext2_private* priv);
+// Периодический коммит, вызывается из главного цикла ядра
+void ext2_journal_poll(void);
+
+#endif
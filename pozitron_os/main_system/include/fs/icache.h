@@ -0,0 +1,38 @@
+#ifndef ICACHE_H
+#define ICACHE_H
+
+#include <stdint.h>
+#include "fs/vfs.h"
+
+#define ICACHE_HASH_SIZE   256
+#define ICACHE_MAX_UNUSED  512     // Сколько неиспользуемых inode держим в памяти
+
+typedef struct icache_stats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t writebacks;
+    uint32_t cached;
+    uint32_t unused;
+    uint32_t dirty;
+} icache_stats_t;
+
+void icache_init(void);
+
+// Возвращает inode со ссылкой (освобождать через icache_put), читая с диска только при промахе
+struct vfs_inode* icache_get(struct vfs_superblock* sb, uint32_t ino);
+void icache_hold(struct vfs_inode* inode);
+void icache_put(struct vfs_inode* inode);
+
+void icache_mark_dirty(struct vfs_inode* inode);
+// Переносит грязный inode в буферный кэш (на диск его отнесёт сброс bcache);
+// при ошибке inode остаётся грязным
+int icache_write(struct vfs_inode* inode);
+
+int icache_sync(struct vfs_superblock* sb);
+void icache_purge_sb(struct vfs_superblock* sb);
+
+void icache_get_stats(icache_stats_t* stats);
+void icache_dump_stats(void);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef MMAP_H
+#define MMAP_H
+
+#include <stdint.h>
+#include "fs/vfs.h"
+#include "fs/pcache.h"
+
+// Отображение файла: [start, start + pages * PAGE_SIZE) в окне PAGING_MMAP_BASE
+typedef struct vfs_vma {
+    uint32_t start;
+    uint32_t pages;
+    uint32_t pgoff;                 // Первая страница файла
+    uint32_t flags;                 // VFS_MAP_SHARED / VFS_MAP_PRIVATE
+    struct vfs_inode* inode;        // Ссылка из icache на время отображения
+    pcache_page_t** cache;          // Страницы кэша, стоящие в PTE; NULL - нет или частная копия
+    struct vfs_vma* next;           // Список упорядочен по start
+} vfs_vma_t;
+
+typedef struct mmap_stats {
+    uint32_t mappings;
+    uint32_t faults;
+    uint32_t cow_copies;
+} mmap_stats_t;
+
+// Вызывается из page_fault_handler: 0 - страница подставлена, -1 - настоящая ошибка
+int vfs_mmap_fault(uint32_t addr, int write);
+
+void mmap_get_stats(mmap_stats_t* stats);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef PCACHE_H
+#define PCACHE_H
+
+#include <stdint.h>
+#include "fs/vfs.h"
+
+#define PCACHE_HASH_SIZE   256
+#define PCACHE_MAX_UNUSED  256     // Неотображённых страниц держим в памяти (1 МБ)
+
+// Страница файла в памяти; data выровнена на PAGE_SIZE и отображена тождественно
+typedef struct pcache_page {
+    struct vfs_inode* inode;        // Без ссылки: icache_free снимает страницы; NULL - выброшена из хэша
+    uint32_t index;                 // Номер страницы в файле
+    uint8_t* data;
+    uint32_t refcount;              // Отображения и прочие пользователи
+    struct pcache_page* hash_next;
+    struct pcache_page* lru_prev;   // Список неиспользуемых (refcount == 0)
+    struct pcache_page* lru_next;
+} pcache_page_t;
+
+typedef struct pcache_stats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t cached;
+    uint32_t unused;
+} pcache_stats_t;
+
+void pcache_init(void);
+
+// Возвращает страницу со ссылкой, читая её из файла при промахе; хвост за i_size обнулён
+pcache_page_t* pcache_get(struct vfs_inode* inode, uint32_t index);
+void pcache_put(pcache_page_t* page);
+
+// Запись через vfs_write: обновляет закэшированные страницы, чтобы отображения видели данные
+void pcache_update(struct vfs_inode* inode, uint32_t offset, const void* buf, uint32_t len);
+// Усечение, освобождение inode, размонтирование: страницы уходят из хэша,
+// отображённые живут до последнего put
+void pcache_invalidate(struct vfs_inode* inode);
+void pcache_purge_sb(struct vfs_superblock* sb);
+
+void pcache_get_stats(pcache_stats_t* stats);
+void pcache_dump_stats(void);
+
+#endif
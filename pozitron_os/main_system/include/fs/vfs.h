@@ -30,6 +30,14 @@
 #define FS_O_APPEND     0x0400
 #define FS_O_DIRECTORY  0x1000
 
+// vfs_mmap: страницы общие с кэшем и только для чтения / копия при первой записи
+#define VFS_MAP_SHARED  0x01
+#define VFS_MAP_PRIVATE 0x02
+
+// Состояние inode в кэше
+#define FS_I_DIRTY      0x01
+#define FS_I_HASHED     0x02
+
 struct vfs_dirent {
     uint32_t d_ino;
     uint8_t  d_type;
@@ -64,7 +72,10 @@ typedef struct vfs_inode_operations {
 typedef struct vfs_superblock_operations {
     int (*read_inode)(struct vfs_superblock* sb, uint32_t ino, struct vfs_inode** inode);
     int (*write_inode)(struct vfs_superblock* sb, struct vfs_inode* inode);
+    void (*free_inode)(struct vfs_inode* inode);
     int (*sync)(struct vfs_superblock* sb);
+    void (*put_super)(struct vfs_superblock* sb);   // Последнее слово ФС перед освобождением
+    void (*batch)(struct vfs_superblock* sb, int begin); // Пакет операций: без необязательных сбросов
 } vfs_superblock_operations_t;
 
 struct vfs_inode {
@@ -82,11 +93,26 @@ struct vfs_inode {
     struct vfs_superblock* sb;
     vfs_file_operations_t* fops;
     vfs_inode_operations_t* iops;
+    
+    uint32_t        i_count;        // Ссылки: открытые файлы, dentry, s_root
+    uint32_t        i_state;
+    struct vfs_inode* i_hash_next;
+    struct vfs_inode* i_lru_prev;   // Список неиспользуемых (i_count == 0)
+    struct vfs_inode* i_lru_next;
+    uint32_t        i_pages;        // Страниц в pcache; ссылок они не держат
+};
+
+// Состояние упреждающего чтения файла (в блоках ФС)
+struct vfs_readahead {
+    uint32_t        next_block;     // Блок, с которого ожидается следующее чтение
+    uint32_t        window;         // Текущий размер окна
+    uint32_t        ra_end;         // До этого блока данные уже запрошены
 };
 
 struct vfs_file {
     uint32_t        f_flags;
     uint32_t        f_pos;
+    struct vfs_readahead f_ra;
     struct vfs_inode* f_inode;
     void*           private_data;
     vfs_file_operations_t* fops;
@@ -124,20 +150,36 @@ int vfs_umount(const char* mountpoint);
 
 int vfs_open(const char* path, int flags, struct vfs_file** file);
 int vfs_close(struct vfs_file* file);
+int vfs_fsync(struct vfs_file* file);
+int vfs_sync(void);
 int vfs_read(struct vfs_file* file, void* buf, uint32_t size, uint32_t* bytes_read);
 int vfs_write(struct vfs_file* file, const void* buf, uint32_t size, uint32_t* bytes_written);
 int vfs_lseek(struct vfs_file* file, uint32_t offset, int whence);
 int vfs_readdir(struct vfs_file* file, struct vfs_dirent* dirent, uint32_t* bytes_read);
 
+// Отображает файл в окно ядра; страницы читаются при первом обращении (offset кратен странице)
+void* vfs_mmap(struct vfs_file* file, uint32_t offset, uint32_t length, int flags);
+int vfs_munmap(void* addr, uint32_t length);
+
 int vfs_stat(const char* path, struct vfs_inode** inode);
 int vfs_mkdir(const char* path, uint32_t mode);
 int vfs_mkdir_p(const char* path, uint32_t mode);
 int vfs_rmdir(const char* path);
 int vfs_unlink(const char* path);
+int vfs_rename(const char* old_path, const char* new_path);
 int vfs_exists(const char* path);
 int vfs_copy_file(const char* src, const char* dst);
 int vfs_copy_dir(const char* src, const char* dst);
 int vfs_copy_template(const char* src, const char* dst);
+// Копирование дерева одним пакетом: каталоги разрешаются один раз, сброс на диск - в конце
+int vfs_copy_tree(const char* src, const char* dst);
+
+// Пакет операций: между begin и commit vfs_close/vfs_mkdir не синхронизируют ФС,
+// commit делает один общий vfs_sync. Пакеты могут вкладываться. Это не одна транзакция:
+// каждая операция в ext2 берёт свой handle, пакет лишь снимает коммиты по soft_limit
+// и таймеру, а по заполнению (hard_limit) журнал коммитит и внутри пакета
+void vfs_batch_begin(void);
+int vfs_batch_commit(void);
 int vfs_write_config(const char* path, const char* key, const char* value);
 char* vfs_read_config(const char* path, const char* key);
 
@@ -0,0 +1,19 @@
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include "gui.h"
+
+// Тень окна с заголовком: полосы справа и снизу
+#define COMPOSITOR_SHADOW_OFFSET 2
+#define COMPOSITOR_SHADOW_COLOR  0x888888
+#define COMPOSITOR_DESKTOP_COLOR 0xC0C0C0
+#define COMPOSITOR_MAX_WINDOWS   64
+
+// Кадр: перерисовка изменившихся окон в их поверхности и сборка экрана по повреждённым областям
+void compositor_render(void);
+// Окно уничтожается: его место на экране повреждено, поверхность освобождается
+void compositor_forget(Window* window);
+// Окно под точкой по видимым областям последнего кадра; 0 - области устарели
+uint8_t compositor_window_at(uint32_t x, uint32_t y, Window** hit);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef GUI_FRAME_H
+#define GUI_FRAME_H
+
+#include <stdint.h>
+#include "core/event.h"
+
+// Темп кадров главного цикла: кадр рисуется только при вводе, уроне, анимации или по сроку,
+// но не чаще FRAME_RATE раз в секунду
+#define FRAME_RATE          60
+#define FRAME_IDLE_TICKS    25      // Кадр-пульс без повода: часы, сроки уведомлений
+
+// Таймер анимации: шаг раз в period тиков, пока активен
+typedef struct frame_timer {
+    uint32_t period;
+    uint32_t next_tick;
+    uint8_t active;
+    struct frame_timer* next;
+} frame_timer_t;
+
+typedef struct frame_stats {
+    uint32_t frames;
+    uint32_t wakeups;               // Проходов главного цикла
+    uint32_t skipped;               // Проходов без повода для кадра
+    uint32_t deferred;              // Кадр нужен, но упёрся в потолок частоты
+    uint32_t input_events;
+    uint32_t coalesced;             // Промежуточных движений мыши, слитых со следующим
+    uint32_t last_us;               // Время кадра, мкс; 0 - нет TSC
+    uint32_t avg_us;
+    uint32_t max_us;
+    uint32_t last_latency_ms;       // От первого необработанного ввода до вывода кадра
+    uint32_t avg_latency_ms;
+    uint32_t max_latency_ms;
+} frame_stats_t;
+
+void frame_init(void);
+
+// Событие из очереди: 1 - движение мыши поглощено следующим в очереди, обрабатывать не нужно
+uint8_t frame_coalesce(const event_t* event);
+void frame_input(const event_t* event);
+
+// Кадр на следующем проходе цикла или не раньше тика tick
+void frame_request(void);
+void frame_request_at(uint32_t tick);
+
+// Пора ли рисовать; при 1 кадр обязательно закрывается frame_end
+uint8_t frame_begin(void);
+void frame_end(void);
+
+// Таймеры анимаций держат кадры, пока активны
+void frame_timer_start(frame_timer_t* timer, uint32_t period);
+void frame_timer_stop(frame_timer_t* timer);
+uint8_t frame_timer_active(const frame_timer_t* timer);
+// Сколько шагов прошло с прошлого вызова; пропущенные кадры догоняются числом шагов
+uint32_t frame_timer_steps(frame_timer_t* timer);
+
+void frame_get_stats(frame_stats_t* out);
+void frame_dump_stats(void);
+
+#endif
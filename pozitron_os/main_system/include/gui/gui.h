@@ -4,6 +4,7 @@
 #include "../kernel/types.h"
 #include "../drivers/vesa.h"
 #include "../core/event.h"
+#include "../lib/region.h"
 
 #define TEXT_ALIGN_LEFT     0x00
 #define TEXT_ALIGN_CENTER   0x01
@@ -196,6 +197,12 @@ struct Window {
     uint8_t in_taskbar : 1;
     uint8_t is_resizing : 1;
     Widget* focused_widget;
+    vesa_surface_t* surface;        // Содержимое окна; перерисовывается только по needs_redraw
+    int32_t shown_x, shown_y;       // Место окна на экране после последней композиции
+    uint32_t shown_width, shown_height;
+    int32_t shown_z;
+    uint8_t shown;
+    region_t visible_region;        // Не закрытая другими окнами часть (без тени), для отсечения и попадания
 };
 
 #define TASKBAR_HEIGHT 32
@@ -246,6 +253,8 @@ struct Window {
 #define SCROLLBAR_HANDLE_HOVER 0x606060
 #define SCROLLBAR_BUTTON_COLOR 0xE0E0E0
 
+#define INPUT_BLINK_TICKS 50        // Полпериода мигания курсора ввода
+
 #define WINDOW_REGISTRY_SIZE 256
 #define IS_VALID_WINDOW_PTR(win) \
     ((win) != NULL && (win)->id != 0 && \
@@ -260,6 +269,7 @@ void gui_init(uint32_t screen_width, uint32_t screen_height);
 void gui_shutdown(void);
 void gui_handle_event(event_t* event);
 void gui_render(void);
+void gui_draw_window(Window* window);
 void gui_force_redraw(void);
 void gui_register_window(Window* window);
 void gui_unregister_window(uint32_t window_id);
@@ -307,6 +317,7 @@ void wm_minimize_window(Window* window);
 void wm_maximize_window(Window* window);
 void wm_restore_window(Window* window);
 void wm_resize_window(Window* window, uint32_t width, uint32_t height);
+uint32_t wm_resize_edge_at(Window* window, int32_t mx, int32_t my);
 void wm_start_resize(Window* window, uint32_t corner, int32_t mouse_x, int32_t mouse_y);
 void wm_do_resize(Window* window, int32_t mouse_x, int32_t mouse_y);
 void wm_end_resize(Window* window);
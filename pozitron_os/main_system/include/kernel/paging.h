@@ -18,6 +18,11 @@
 #define PAGE_DIRTY     0x40
 #define PAGE_SIZE_4MB  0x80
 #define PAGE_GLOBAL    0x100
+#define PAGE_PRIVATE   0x200   // Бит ОС: частная копия страницы файла (vfs_mmap)
+
+// Окно для отображений файлов; таблицы страниц создаются заранее и общие для всех каталогов
+#define PAGING_MMAP_BASE 0x90000000
+#define PAGING_MMAP_SIZE 0x04000000
 
 typedef struct {
     uint32_t entries[1024];
@@ -33,6 +38,8 @@ void paging_switch_directory(page_directory_t* dir);
 void paging_map_page(page_directory_t* dir, uint32_t virt, uint32_t phys, uint32_t flags);
 void paging_unmap_page(page_directory_t* dir, uint32_t virt);
 uint32_t paging_get_physical(page_directory_t* dir, uint32_t virt);
+uint32_t paging_get_entry(page_directory_t* dir, uint32_t virt);
+uint32_t paging_mmap_window(void);
 void page_fault_handler(registers_t* r);
 
 extern page_directory_t* current_directory;
@@ -5,6 +5,7 @@
 #include "drivers/timer.h"
 
 #define MS_TO_TICKS(ms) ((ms) / 10)
+#define TICKS_TO_MS(t)  ((t) * 10)
 
 static inline uint32_t timer_calc_ms(uint32_t ms) {
     return timer_get_ticks() + MS_TO_TICKS(ms);
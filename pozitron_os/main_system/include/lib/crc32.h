@@ -0,0 +1,11 @@
+#ifndef LIB_CRC32_H
+#define LIB_CRC32_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// CRC-32 (IEEE 802.3, полином 0xEDB88320), как в GPT и zlib
+uint32_t crc32(const void* data, size_t len);
+uint32_t crc32_update(uint32_t crc, const void* data, size_t len);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef LIB_REGION_H
+#define LIB_REGION_H
+
+#include <stdint.h>
+
+// Прямоугольник полуоткрытый: [x1, x2) x [y1, y2)
+typedef struct region_rect {
+    int32_t x1, y1;
+    int32_t x2, y2;
+} region_rect_t;
+
+// Область - список непересекающихся прямоугольников, разбитый на полосы (как в X11):
+// прямоугольники отсортированы по y, затем по x; в полосе у всех одинаковые y1/y2,
+// соседи в полосе не соприкасаются, одинаковые смежные полосы склеены.
+typedef struct region {
+    region_rect_t* rects;
+    uint32_t count;
+    uint32_t capacity;
+    region_rect_t extents;          // Ограничивающий прямоугольник; пустой при count == 0
+} region_t;
+
+void region_init(region_t* region);
+void region_free(region_t* region);
+void region_clear(region_t* region);
+
+// Операции возвращают 0 или -1 при нехватке памяти; dst может совпадать с a или b
+int region_copy(region_t* dst, const region_t* src);
+int region_set_rect(region_t* region, int32_t x, int32_t y, uint32_t w, uint32_t h);
+int region_union(region_t* dst, const region_t* a, const region_t* b);
+int region_intersect(region_t* dst, const region_t* a, const region_t* b);
+int region_subtract(region_t* dst, const region_t* a, const region_t* b);
+
+int region_union_rect(region_t* region, int32_t x, int32_t y, uint32_t w, uint32_t h);
+int region_intersect_rect(region_t* region, int32_t x, int32_t y, uint32_t w, uint32_t h);
+int region_subtract_rect(region_t* region, int32_t x, int32_t y, uint32_t w, uint32_t h);
+
+uint8_t region_is_empty(const region_t* region);
+uint32_t region_area(const region_t* region);
+uint8_t region_contains_point(const region_t* region, int32_t x, int32_t y);
+
+#endif
@@ -51,6 +51,21 @@ int event_poll(event_t* event) {
     return result;
 }
 
+int event_peek(event_t* event) {
+    int result = 0;
+    
+    asm volatile("cli");
+    
+    if (queue_count > 0) {
+        *event = event_queue[queue_head];
+        result = 1;
+    }
+    
+    asm volatile("sti");
+    
+    return result;
+}
+
 int event_available(void) {
     int available;
     asm volatile("cli");
@@ -16,6 +16,21 @@
 #define AHCI_TIMEOUT_FLUSH    60000
 #define AHCI_RESET_TIMEOUT    5000
 #define AHCI_LINK_TIMEOUT     100
+#define AHCI_BOOT_BUDGET      2000   // Сколько ждать медленные порты, когда диск уже найден
+
+// Состояния опроса порта при загрузке
+#define AHCI_PROBE_RESET      0
+#define AHCI_PROBE_LINK       1
+#define AHCI_PROBE_READY      2
+#define AHCI_PROBE_DONE       3
+#define AHCI_PROBE_FAILED     4
+
+struct ahci_probe {
+    uint32_t pnr;
+    uint8_t  state;
+    uint32_t start;      // Тик начала опроса
+    uint32_t end;        // Дедлайн текущей стадии
+};
 
 static struct ahci_port ahci_ports[32];
 static int ahci_port_count = 0;
@@ -24,6 +39,10 @@ static uint32_t ahci_iobase = 0;
 static uint32_t ahci_caps = 0;
 static uint32_t ahci_ports_impl = 0;
 
+static struct ahci_probe ahci_probes[32];
+static int ahci_probe_count = 0;
+static uint8_t ahci_probe_started = 0;
+
 static void ahci_delay(void) {
     io_wait();  // outb(0x80, 0)
     io_wait();
@@ -204,26 +223,30 @@ static int ahci_flush_command(struct ahci_port* port) {
     return ahci_command(port, 0, 0, NULL, 0, 1);
 }
 
-static void ahci_port_reset(uint32_t pnr) {
+// Останов движков порта без ожидания; завершение проверяется в ahci_probe_step
+static int ahci_port_stopped(uint32_t pnr) {
+    uint32_t val = ahci_port_readl(pnr, PORT_CMD);
+    if (!(val & (PORT_CMD_FIS_RX | PORT_CMD_START | PORT_CMD_LIST_ON | PORT_CMD_FIS_ON)))
+        return 1;
+    val &= ~(PORT_CMD_FIS_RX | PORT_CMD_START);
+    ahci_port_writel(pnr, PORT_CMD, val);
+    return 0;
+}
+
+static void ahci_port_spin_up(uint32_t pnr) {
     uint32_t val;
-    uint32_t end = timer_calc_ms(AHCI_RESET_TIMEOUT);
     
-    for (;;) {
-        val = ahci_port_readl(pnr, PORT_CMD);
-        if (!(val & (PORT_CMD_FIS_RX | PORT_CMD_START | PORT_CMD_LIST_ON | PORT_CMD_FIS_ON)))
-            break;
-        val &= ~(PORT_CMD_FIS_RX | PORT_CMD_START);
-        ahci_port_writel(pnr, PORT_CMD, val);
-        if (timer_check_ms(end)) break;
-        ahci_delay();
-        yield();
-    }
     ahci_port_writel(pnr, PORT_IRQ_MASK, 0);
     val = ahci_port_readl(pnr, PORT_IRQ_STAT);
     if (val)
         ahci_port_writel(pnr, PORT_IRQ_STAT, val);
     
-    ahci_delay();
+    val = ahci_port_readl(pnr, PORT_CMD);
+    val |= PORT_CMD_FIS_RX;
+    ahci_port_writel(pnr, PORT_CMD, val);
+    
+    val |= PORT_CMD_SPIN_UP;
+    ahci_port_writel(pnr, PORT_CMD, val);
 }
 
 static void ata_fix_string(uint8_t* str, int len) {
@@ -252,8 +275,9 @@ static void ahci_free_port_resources(struct ahci_port* port) {
     }
 }
 
-static int ahci_port_setup(uint32_t pnr) {
-    uint32_t cmd, stat, tf;
+// Вызывается, когда линк поднят и устройство сняло BSY
+static int ahci_port_identify(uint32_t pnr) {
+    uint32_t cmd;
     uint16_t buffer[256];
     struct ahci_port* port = &ahci_ports[ahci_port_count];
     int rc;
@@ -267,34 +291,6 @@ static int ahci_port_setup(uint32_t pnr) {
     port->fis = NULL;
     
     cmd = ahci_port_readl(pnr, PORT_CMD);
-    cmd |= PORT_CMD_FIS_RX;
-    ahci_port_writel(pnr, PORT_CMD, cmd);
-    
-    cmd |= PORT_CMD_SPIN_UP;
-    ahci_port_writel(pnr, PORT_CMD, cmd);
-    
-    uint32_t end = timer_calc_ms(AHCI_LINK_TIMEOUT);
-    for (;;) {
-        stat = ahci_port_readl(pnr, PORT_SCR_STAT);
-        if ((stat & 0x07) == 0x03) break;
-        if (timer_check_ms(end)) return -1;
-        ahci_delay();
-        yield();
-    }
-    
-    uint32_t err = ahci_port_readl(pnr, PORT_SCR_ERR);
-    if (err)
-        ahci_port_writel(pnr, PORT_SCR_ERR, err);
-    
-    end = timer_calc_ms(AHCI_TIMEOUT_NORMAL);
-    for (;;) {
-        tf = ahci_port_readl(pnr, PORT_TFDATA);
-        if (!(tf & (ATA_CB_STAT_BSY | ATA_CB_STAT_DRQ))) break;
-        if (timer_check_ms(end)) return -1;
-        ahci_delay();
-        yield();
-    }
-    
     cmd |= PORT_CMD_START;
     ahci_port_writel(pnr, PORT_CMD, cmd);
     ahci_delay();
@@ -382,94 +378,129 @@ static int ahci_port_setup(uint32_t pnr) {
     return 0;
 }
 
-static void ahci_cleanup_ports(void) {
-    for (int i = 0; i < ahci_port_count; i++) {
-        ahci_free_port_resources(&ahci_ports[i]);
-        memset(&ahci_ports[i], 0, sizeof(struct ahci_port));
+// Продвигает опрос порта на одну стадию, не блокируясь
+static void ahci_probe_step(struct ahci_probe* p) {
+    uint32_t pnr = p->pnr;
+    
+    switch (p->state) {
+    case AHCI_PROBE_RESET:
+        if (ahci_port_stopped(pnr) || timer_check_ms(p->end)) {
+            ahci_port_spin_up(pnr);
+            p->state = AHCI_PROBE_LINK;
+            p->end = timer_calc_ms(AHCI_LINK_TIMEOUT);
+        }
+        break;
+        
+    case AHCI_PROBE_LINK:
+        if ((ahci_port_readl(pnr, PORT_SCR_STAT) & 0x07) == 0x03) {
+            uint32_t err = ahci_port_readl(pnr, PORT_SCR_ERR);
+            if (err)
+                ahci_port_writel(pnr, PORT_SCR_ERR, err);
+            p->state = AHCI_PROBE_READY;
+            p->end = timer_calc_ms(AHCI_TIMEOUT_NORMAL);
+        } else if (timer_check_ms(p->end)) {
+            p->state = AHCI_PROBE_FAILED;
+        }
+        break;
+        
+    case AHCI_PROBE_READY:
+        if (!(ahci_port_readl(pnr, PORT_TFDATA) & (ATA_CB_STAT_BSY | ATA_CB_STAT_DRQ))) {
+            if (ahci_port_count < 32 && ahci_port_identify(pnr) == 0) {
+                ahci_ports[ahci_port_count].probe_ms = TICKS_TO_MS(timer_get_ticks() - p->start);
+                ahci_port_count++;
+                p->state = AHCI_PROBE_DONE;
+            } else {
+                p->state = AHCI_PROBE_FAILED;
+            }
+        } else if (timer_check_ms(p->end)) {
+            p->state = AHCI_PROBE_FAILED;
+        }
+        break;
     }
+}
+
+// Запускает сброс всех портов с линком сразу; дальше их опрашивает ahci_probe_poll
+void ahci_probe_start(void) {
+    if (ahci_probe_started) return;
+    ahci_probe_started = 1;
+    
     ahci_port_count = 0;
+    ahci_probe_count = 0;
+    memset(ahci_ports, 0, sizeof(ahci_ports));
+    
+    pci_device_t dev;
+    if (pci_find_all_class(0x01, 0x06, 0x01, &dev, 1) == 0)
+        return;
+    
+    pci_enable_bus_master(dev.bus, dev.device, dev.func);
+    pci_enable_memory_space(dev.bus, dev.device, dev.func);
+    
+    ahci_iobase = pci_read32(dev.bus, dev.device, dev.func, 0x24) & 0xFFFFFFF0;
+    
+    ahci_writel(HOST_CTL, ahci_readl(HOST_CTL) | HOST_CTL_AHCI_EN);
+    
+    ahci_caps = ahci_readl(HOST_CAP);
+    ahci_ports_impl = ahci_readl(HOST_PORTS_IMPL);
+    
+    uint32_t max_ports = ahci_caps & 0x1F;
+    
+    for (uint32_t pnr = 0; pnr <= max_ports && ahci_probe_count < 32; pnr++) {
+        if (!(ahci_ports_impl & (1 << pnr))) continue;
+        
+        uint32_t ssts = ahci_port_readl(pnr, PORT_SCR_STAT);
+        if ((ssts & 0x0F) != 0x03) continue;
+        
+        struct ahci_probe* p = &ahci_probes[ahci_probe_count++];
+        p->pnr = pnr;
+        p->state = AHCI_PROBE_RESET;
+        p->start = timer_get_ticks();
+        p->end = timer_calc_ms(AHCI_RESET_TIMEOUT);
+        ahci_port_stopped(pnr);
+    }
 }
 
-static void ahci_scan_pci(void) {
-    for (int bus = 0; bus < 256; bus++) {
-        for (int dev = 0; dev < 32; dev++) {
-            for (int func = 0; func < 8; func++) {
-                uint16_t vendor = pci_read16(bus, dev, func, 0);
-                if (vendor == 0xFFFF) continue;
-                
-                uint8_t class = pci_read8(bus, dev, func, 0x0B);
-                uint8_t subclass = pci_read8(bus, dev, func, 0x0A);
-                uint8_t prog_if = pci_read8(bus, dev, func, 0x09);
-                
-                if (class == 0x01 && subclass == 0x06 && prog_if == 0x01) {
-                    pci_enable_bus_master(bus, dev, func);
-                    pci_enable_memory_space(bus, dev, func);
-                    
-                    ahci_iobase = pci_read32(bus, dev, func, 0x24) & 0xFFFFFFF0;
-                    
-                    ahci_writel(HOST_CTL, ahci_readl(HOST_CTL) | HOST_CTL_AHCI_EN);
-                    
-                    ahci_caps = ahci_readl(HOST_CAP);
-                    ahci_ports_impl = ahci_readl(HOST_PORTS_IMPL);
-                    
-                    uint32_t max_ports = ahci_caps & 0x1F;
-                    
-                    for (uint32_t pnr = 0; pnr <= max_ports && ahci_port_count < 32; pnr++) {
-                        if (!(ahci_ports_impl & (1 << pnr))) continue;
-                        
-                        uint32_t ssts = ahci_port_readl(pnr, PORT_SCR_STAT);
-                        uint32_t sstatus = ssts & 0x0F;
-                        
-                        if (sstatus != 0x03) continue;
-                        
-                        ahci_port_reset(pnr);
-                        if (ahci_port_setup(pnr) == 0) {
-                            ahci_port_count++;
-                        }
-                    }
-                    
-                    return;
-                }
-            }
-        }
+// Один проход по всем незавершённым портам; возвращает число ещё не готовых
+int ahci_probe_poll(void) {
+    int pending = 0;
+    
+    for (int i = 0; i < ahci_probe_count; i++) {
+        struct ahci_probe* p = &ahci_probes[i];
+        if (p->state == AHCI_PROBE_DONE || p->state == AHCI_PROBE_FAILED) continue;
+        
+        ahci_probe_step(p);
+        
+        if (p->state != AHCI_PROBE_DONE && p->state != AHCI_PROBE_FAILED)
+            pending++;
     }
+    return pending;
 }
 
-static int ahci_check_pci_present(void) {
-    for (int bus = 0; bus < 256; bus++) {
-        for (int dev = 0; dev < 32; dev++) {
-            for (int func = 0; func < 8; func++) {
-                uint16_t vendor = pci_read16(bus, dev, func, 0);
-                if (vendor == 0xFFFF) continue;
-                
-                uint8_t class = pci_read8(bus, dev, func, 0x0B);
-                uint8_t subclass = pci_read8(bus, dev, func, 0x0A);
-                uint8_t prog_if = pci_read8(bus, dev, func, 0x09);
-                
-                if (class == 0x01 && subclass == 0x06 && prog_if == 0x01)
-                    return 1;
-            }
-        }
+// Приводы CD не в счёт: корень на них не монтируется
+static int ahci_hard_disks(void) {
+    int count = 0;
+    for (int i = 0; i < ahci_port_count; i++) {
+        if (ahci_ports[i].present && !ahci_ports[i].atapi) count++;
     }
-    return 0;
+    return count;
 }
 
-void ahci_init(void) {
+void ahci_init(int known_disks) {
     if (ahci_initialized) return;
     
-    if (!ahci_check_pci_present()) {
-        ahci_initialized = 1;
-        return;
-    }
-    
-    ahci_port_count = 0;
-    memset(ahci_ports, 0, sizeof(ahci_ports));
+    ahci_probe_start();
     
-    ahci_scan_pci();
+    // Ждём все порты, но если жёсткий диск уже есть (свой или ATA), медленные доопрашиваются после загрузки
+    uint32_t budget = timer_calc_ms(AHCI_BOOT_BUDGET);
+    while (ahci_probe_poll() > 0) {
+        if (known_disks + ahci_hard_disks() > 0 && timer_check_ms(budget)) {
+            serial_puts("[AHCI] Slow ports deferred until after boot\n");
+            break;
+        }
+        ahci_delay();
+        yield();
+    }
     
     ahci_initialized = 1;
-    if (ahci_port_count == 0)
-        ahci_cleanup_ports();
 }
 
 int ahci_read_sectors(int port, uint64_t lba, uint32_t count, void* buffer) {
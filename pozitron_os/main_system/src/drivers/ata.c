@@ -442,6 +442,7 @@ static void ata_detect_channel(struct ata_channel* chan) {
         if (ret == 0 && ata_device_count < 4) {
             ata_device_t* adrive = &ata_devices[ata_device_count];
             init_atadrive(adrive, chan, slave, buffer, 1);
+            adrive->probe_ms = TICKS_TO_MS(timer_get_ticks() - chan->probe_start);
             ata_device_count++;
             serial_puts("[ATA] Found ATAPI: ");
             serial_puts(adrive->model);
@@ -453,6 +454,7 @@ static void ata_detect_channel(struct ata_channel* chan) {
         if (ret == 0 && ata_device_count < 4) {
             ata_device_t* adrive = &ata_devices[ata_device_count];
             init_atadrive(adrive, chan, slave, buffer, 0);
+            adrive->probe_ms = TICKS_TO_MS(timer_get_ticks() - chan->probe_start);
             ata_device_count++;
             serial_puts("[ATA] Found ATA: ");
             serial_puts(adrive->model);
@@ -467,28 +469,14 @@ static void ata_detect_channel(struct ata_channel* chan) {
     }
 }
 
-static int powerup_await_non_bsy(uint16_t base) {
-    uint8_t status;
-    uint32_t end = timer_calc_ms(IDE_TIMEOUT);
-    
-    for (;;) {
-        status = inb(base + ATA_CB_STAT);
-        if (status == 0xFF) return -1;
-        if (!(status & ATA_CB_STAT_BSY)) break;
-        if (timer_check_ms(end)) return -1;
-        yield();
-    }
-    return status;
-}
-
-static void ata_init_channel(struct ata_pci_device* pci, int irq,
-                             uint32_t port1, uint32_t port2, uint32_t master) {
+static struct ata_channel* ata_init_channel(struct ata_pci_device* pci, int irq,
+                                            uint32_t port1, uint32_t port2, uint32_t master) {
     static int chanid = 0;
     
     struct ata_channel* chan = (struct ata_channel*)kmalloc(sizeof(struct ata_channel));
     if (!chan) {
         serial_puts("[ATA] Failed to allocate channel\n");
-        return;
+        return NULL;
     }
     
     chan->chanid = chanid++;
@@ -498,6 +486,7 @@ static void ata_init_channel(struct ata_pci_device* pci, int irq,
     chan->iobase1 = port1;
     chan->iobase2 = port2;
     chan->iomaster = master;
+    chan->probe_start = 0;
     
     serial_puts("[ATA] Channel ");
     serial_puts_num(chan->chanid);
@@ -509,95 +498,143 @@ static void ata_init_channel(struct ata_pci_device* pci, int irq,
     serial_puts_num(irq);
     serial_puts("\n");
     
-    ata_reset_port(port2);
+    return chan;
+}
+
+// Сброс и ожидание раскрутки идут для всех каналов одновременно:
+// общий таймаут вместо IDE_TIMEOUT на каждый канал по очереди
+static void ata_probe_channels(struct ata_channel** chans, int count) {
+    uint8_t pending[4];
+    int left = 0;
+    
+    for (int i = 0; i < count; i++) {
+        chans[i]->probe_start = timer_get_ticks();
+        outb(chans[i]->iobase2 + ATA_CB_DC, ATA_CB_DC_HD15 | ATA_CB_DC_NIEN | ATA_CB_DC_SRST);
+    }
+    udelay(10);
+    for (int i = 0; i < count; i++) {
+        outb(chans[i]->iobase2 + ATA_CB_DC, ATA_CB_DC_HD15 | ATA_CB_DC_NIEN);
+    }
+    mdelay(10);
     
-    int status = powerup_await_non_bsy(port1);
-    if (status < 0) {
-        serial_puts("[ATA] No devices on channel\n");
-        kfree(chan);
-        return;
+    for (int i = 0; i < count; i++) {
+        pending[i] = 1;
+        left++;
     }
     
-    if (ata_channel_count < 4) {
-        ata_channels[ata_channel_count++] = chan;
+    uint32_t end = timer_calc_ms(IDE_TIMEOUT);
+    while (left > 0) {
+        for (int i = 0; i < count; i++) {
+            if (!pending[i]) continue;
+            
+            uint8_t status = inb(chans[i]->iobase1 + ATA_CB_STAT);
+            if (status == 0xFF) {
+                serial_puts("[ATA] No devices on channel ");
+                serial_puts_num(chans[i]->chanid);
+                serial_puts("\n");
+                kfree(chans[i]);
+                chans[i] = NULL;
+                pending[i] = 0;
+                left--;
+            } else if (!(status & ATA_CB_STAT_BSY)) {
+                pending[i] = 0;
+                left--;
+            }
+        }
+        if (left == 0) break;
+        
+        if (timer_check_ms(end)) {
+            for (int i = 0; i < count; i++) {
+                if (!pending[i]) continue;
+                serial_puts("[ATA] Channel ");
+                serial_puts_num(chans[i]->chanid);
+                serial_puts(" stuck busy, skipping\n");
+                kfree(chans[i]);
+                chans[i] = NULL;
+            }
+            break;
+        }
+        yield();
     }
     
-    ata_detect_channel(chan);
+    for (int i = 0; i < count; i++) {
+        if (!chans[i]) continue;
+        if (ata_channel_count < 4) {
+            ata_channels[ata_channel_count++] = chans[i];
+        }
+        ata_detect_channel(chans[i]);
+    }
 }
 
-static void ata_scan_pci(void) {
-    for (int bus = 0; bus < 256; bus++) {
-        for (int dev = 0; dev < 32; dev++) {
-            for (int func = 0; func < 8; func++) {
-                uint16_t vendor = pci_read16(bus, dev, func, 0);
-                if (vendor == 0xFFFF) continue;
-                
-                uint8_t class = pci_read8(bus, dev, func, 0x0B);
-                uint8_t subclass = pci_read8(bus, dev, func, 0x0A);
-                
-                if (class == 0x01 && subclass == 0x01) {
-                    uint8_t prog_if = pci_read8(bus, dev, func, 0x09);
-                    
-                    serial_puts("[ATA] Found PCI IDE at ");
-                    serial_puts_num(bus);
-                    serial_puts(":");
-                    serial_puts_num(dev);
-                    serial_puts(".");
-                    serial_puts_num(func);
-                    serial_puts("\n");
-                    
-                    pci_enable_bus_master(bus, dev, func);
-                    pci_enable_io_space(bus, dev, func);
-                    
-                    uint8_t pciirq = pci_read8(bus, dev, func, 0x3C);
-                    int master = 0;
-                    
-                    if (prog_if & 0x80) {
-                        uint32_t bar4 = pci_read32(bus, dev, func, 0x20);
-                        if (bar4 & 1) {
-                            master = bar4 & 0xFFFC;
-                        }
-                    }
-                    
-                    uint32_t port1, port2, irq1, port3, port4, irq2;
-                    
-                    if (prog_if & 1) {
-                        port1 = pci_read32(bus, dev, func, 0x10) & 0xFFFC;
-                        port2 = pci_read32(bus, dev, func, 0x14) & 0xFFFC;
-                        irq1 = pciirq;
-                    } else {
-                        port1 = PORT_ATA1_CMD_BASE;
-                        port2 = PORT_ATA1_CTRL_BASE;
-                        irq1 = 14;
-                    }
-                    
-                    if (prog_if & 4) {
-                        port3 = pci_read32(bus, dev, func, 0x18) & 0xFFFC;
-                        port4 = pci_read32(bus, dev, func, 0x1C) & 0xFFFC;
-                        irq2 = pciirq;
-                    } else {
-                        port3 = PORT_ATA2_CMD_BASE;
-                        port4 = PORT_ATA2_CTRL_BASE;
-                        irq2 = 15;
-                    }
-                    
-                    struct ata_pci_device pci_dev;
-                    pci_dev.bus = bus;
-                    pci_dev.device = dev;
-                    pci_dev.function = func;
-                    
-                    ata_init_channel(&pci_dev, irq1, port1, port2, master);
-                    ata_init_channel(&pci_dev, irq2, port3, port4, master ? master + 8 : 0);
-                    
-                    return;
-                }
+static void ata_scan_pci(pci_device_t* pdev) {
+    static struct ata_pci_device pci_dev;
+    struct ata_channel* chans[4];
+    int count = 0;
+    
+    if (pdev) {
+        uint8_t bus = pdev->bus, dev = pdev->device, func = pdev->func;
+        uint8_t prog_if = pci_read8(bus, dev, func, 0x09);
+        
+        serial_puts("[ATA] Found PCI IDE at ");
+        serial_puts_num(bus);
+        serial_puts(":");
+        serial_puts_num(dev);
+        serial_puts(".");
+        serial_puts_num(func);
+        serial_puts("\n");
+        
+        pci_enable_bus_master(bus, dev, func);
+        pci_enable_io_space(bus, dev, func);
+        
+        uint8_t pciirq = pci_read8(bus, dev, func, 0x3C);
+        int master = 0;
+        
+        if (prog_if & 0x80) {
+            uint32_t bar4 = pci_read32(bus, dev, func, 0x20);
+            if (bar4 & 1) {
+                master = bar4 & 0xFFFC;
             }
         }
+        
+        uint32_t port1, port2, irq1, port3, port4, irq2;
+        
+        if (prog_if & 1) {
+            port1 = pci_read32(bus, dev, func, 0x10) & 0xFFFC;
+            port2 = pci_read32(bus, dev, func, 0x14) & 0xFFFC;
+            irq1 = pciirq;
+        } else {
+            port1 = PORT_ATA1_CMD_BASE;
+            port2 = PORT_ATA1_CTRL_BASE;
+            irq1 = 14;
+        }
+        
+        if (prog_if & 4) {
+            port3 = pci_read32(bus, dev, func, 0x18) & 0xFFFC;
+            port4 = pci_read32(bus, dev, func, 0x1C) & 0xFFFC;
+            irq2 = pciirq;
+        } else {
+            port3 = PORT_ATA2_CMD_BASE;
+            port4 = PORT_ATA2_CTRL_BASE;
+            irq2 = 15;
+        }
+        
+        pci_dev.bus = bus;
+        pci_dev.device = dev;
+        pci_dev.function = func;
+        
+        chans[count] = ata_init_channel(&pci_dev, irq1, port1, port2, master);
+        if (chans[count]) count++;
+        chans[count] = ata_init_channel(&pci_dev, irq2, port3, port4, master ? master + 8 : 0);
+        if (chans[count]) count++;
+    } else {
+        serial_puts("[ATA] No PCI IDE found, trying legacy ports\n");
+        chans[count] = ata_init_channel(NULL, 14, PORT_ATA1_CMD_BASE, PORT_ATA1_CTRL_BASE, 0);
+        if (chans[count]) count++;
+        chans[count] = ata_init_channel(NULL, 15, PORT_ATA2_CMD_BASE, PORT_ATA2_CTRL_BASE, 0);
+        if (chans[count]) count++;
     }
     
-    serial_puts("[ATA] No PCI IDE found, trying legacy ports\n");
-    ata_init_channel(NULL, 14, PORT_ATA1_CMD_BASE, PORT_ATA1_CTRL_BASE, 0);
-    ata_init_channel(NULL, 15, PORT_ATA2_CMD_BASE, PORT_ATA2_CTRL_BASE, 0);
+    ata_probe_channels(chans, count);
 }
 
 void ata_init(void) {
@@ -611,33 +648,14 @@ void ata_init(void) {
     ata_channel_count = 0;
     spinup_end = timer_calc_ms(IDE_TIMEOUT);
     
-    int ata_controller_found = 0;
-    for (int bus = 0; bus < 256; bus++) {
-        for (int dev = 0; dev < 32; dev++) {
-            for (int func = 0; func < 8; func++) {
-                uint16_t vendor = pci_read16(bus, dev, func, 0);
-                if (vendor == 0xFFFF) continue;
-
-                uint8_t class = pci_read8(bus, dev, func, 0x0B);
-                uint8_t subclass = pci_read8(bus, dev, func, 0x0A);
-                
-                if (class == 0x01 && subclass == 0x01) {
-                    ata_controller_found = 1;
-                    break;
-                }
-            }
-            if (ata_controller_found) break;
-        }
-        if (ata_controller_found) break;
-    }
-    
-    if (!ata_controller_found) {
+    pci_device_t pdev;
+    if (pci_find_all_class(0x01, 0x01, 0xFF, &pdev, 1) == 0) {
         serial_puts("[ATA] No IDE controller found, skipping\n");
         ata_initialized = 1;
         return;
     }
     
-    ata_scan_pci();
+    ata_scan_pci(&pdev);
     
     if (ata_device_count == 0) {
         for (int i = 0; i < ata_channel_count; i++) {
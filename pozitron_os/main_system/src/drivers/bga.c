@@ -0,0 +1,66 @@
+#include "drivers/bga.h"
+#include "drivers/serial.h"
+#include "kernel/ports.h"
+
+static uint16_t bga_id = 0;
+
+uint16_t bga_read(uint16_t index) {
+    outw(BGA_IOPORT_INDEX, index);
+    return inw(BGA_IOPORT_DATA);
+}
+
+void bga_write(uint16_t index, uint16_t value) {
+    outw(BGA_IOPORT_INDEX, index);
+    outw(BGA_IOPORT_DATA, value);
+}
+
+uint8_t bga_detect(void) {
+    uint16_t id = bga_read(BGA_INDEX_ID);
+    
+    // На других адаптерах порты не заняты и читаются как 0xFFFF
+    if (id < BGA_ID0 || id > BGA_ID5) return 0;
+    
+    if (id != bga_id) {
+        bga_id = id;
+        serial_puts("[BGA] DISPI adapter, ID 0x");
+        serial_puts_num_hex(id);
+        serial_puts(", ");
+        serial_puts_num(bga_vram_size() / 1024);
+        serial_puts(" KB video memory\n");
+    }
+    return 1;
+}
+
+uint32_t bga_vram_size(void) {
+    // Регистр объёма появился в ревизии 0xB0C5
+    if (bga_id < BGA_ID5) return 0;
+    return (uint32_t)bga_read(BGA_INDEX_VIDEO_MEMORY) * 64 * 1024;
+}
+
+uint8_t bga_set_mode(uint32_t width, uint32_t height, uint32_t bpp, uint32_t virt_height) {
+    if (!bga_id || virt_height < height) return 0;
+    
+    // Геометрия меняется только при выключенном адаптере
+    bga_write(BGA_INDEX_ENABLE, BGA_DISABLED);
+    bga_write(BGA_INDEX_XRES, width);
+    bga_write(BGA_INDEX_YRES, height);
+    bga_write(BGA_INDEX_BPP, bpp);
+    bga_write(BGA_INDEX_ENABLE, BGA_ENABLED | BGA_LFB_ENABLED);
+    
+    // Виртуальный экран выставляется после включения: включение его сбрасывает
+    bga_write(BGA_INDEX_VIRT_WIDTH, width);
+    bga_write(BGA_INDEX_VIRT_HEIGHT, virt_height);
+    bga_write(BGA_INDEX_X_OFFSET, 0);
+    bga_write(BGA_INDEX_Y_OFFSET, 0);
+    
+    if (bga_read(BGA_INDEX_XRES) != width || bga_read(BGA_INDEX_YRES) != height ||
+        bga_read(BGA_INDEX_BPP) != bpp) {
+        serial_puts("[BGA] Mode rejected by adapter\n");
+        return 0;
+    }
+    return 1;
+}
+
+void bga_set_y_offset(uint32_t y) {
+    bga_write(BGA_INDEX_Y_OFFSET, y);
+}
@@ -2,8 +2,12 @@
 #include "drivers/serial.h"
 #include "drivers/timer.h"
 #include "gui/gui.h"
+#include <stddef.h>
 
-static uint32_t cursor_backup[16 * 16];
+// Фон под курсором вместе с обводкой: на точку шире битмапа с каждой стороны
+#define CURSOR_BACKUP_SIZE 18
+
+static color_t cursor_backup[CURSOR_BACKUP_SIZE * CURSOR_BACKUP_SIZE];
 static uint32_t cursor_x = 400;
 static uint32_t cursor_y = 300;
 static uint8_t cursor_visible = 1;
@@ -235,146 +239,49 @@ static const uint16_t* get_cursor_bitmap(cursor_type_t type) {
 }
 
 // ============ СОХРАНЕНИЕ/ВОССТАНОВЛЕНИЕ ФОНА ============
+// Формат кадра разбирает vesa: фон хранится в 0xRRGGBB
 static void cursor_save_background(uint32_t x, uint32_t y) {
-    struct fb_info* fb = vesa_get_info();
-    if(!fb || !fb->found || !cursor_enabled) return;
-    
-    uint32_t bytes_per_pixel = fb->bpp / 8;
-    uint8_t* buffer;
-    
-    if (vesa_is_double_buffer_enabled()) {
-        buffer = (uint8_t*)vesa_get_back_buffer();
-    } else {
-        buffer = (uint8_t*)fb->address;
-    }
-    
-    if (!buffer) return;
+    if (!cursor_enabled) return;
     
-    for(int dy = 0; dy < 16; dy++) {
-        uint32_t py = y + dy;
-        if(py >= fb->height) {
-            for(int dx = 0; dx < 16; dx++) {
-                cursor_backup[dy * 16 + dx] = 0;
-            }
-            continue;
-        }
-        
-        for(int dx = 0; dx < 16; dx++) {
-            uint32_t px = x + dx;
-            if(px >= fb->width) {
-                cursor_backup[dy * 16 + dx] = 0;
-                continue;
-            }
-            
-            uint32_t offset = py * fb->pitch + px * bytes_per_pixel;
-            
-            if (bytes_per_pixel == 4) {
-                cursor_backup[dy * 16 + dx] = *(uint32_t*)(buffer + offset);
-            } else if (bytes_per_pixel == 3) {
-                uint32_t b = buffer[offset];
-                uint32_t g = buffer[offset + 1];
-                uint32_t r = buffer[offset + 2];
-                cursor_backup[dy * 16 + dx] = (r << 16) | (g << 8) | b;
-            } else {
-                cursor_backup[dy * 16 + dx] = 0;
-            }
-        }
-    }
+    vesa_read_rect(x - 1, y - 1, CURSOR_BACKUP_SIZE, CURSOR_BACKUP_SIZE, cursor_backup);
 }
 
 static void cursor_restore_background(uint32_t x, uint32_t y) {
-    struct fb_info* fb = vesa_get_info();
-    if(!fb || !fb->found || !cursor_enabled || !cursor_is_drawn) return;
-    
-    uint32_t bytes_per_pixel = fb->bpp / 8;
-    uint8_t* buffer;
-    
-    if (vesa_is_double_buffer_enabled()) {
-        buffer = (uint8_t*)vesa_get_back_buffer();
-    } else {
-        buffer = (uint8_t*)fb->address;
-    }
-    
-    if (!buffer) return;
-    
-    for(int dy = 0; dy < 16; dy++) {
-        uint32_t py = y + dy;
-        if(py >= fb->height) continue;
-        
-        for(int dx = 0; dx < 16; dx++) {
-            uint32_t px = x + dx;
-            if(px >= fb->width) continue;
-            
-            uint32_t offset = py * fb->pitch + px * bytes_per_pixel;
-            uint32_t color = cursor_backup[dy * 16 + dx];
-            
-            if (bytes_per_pixel == 4) {
-                *(uint32_t*)(buffer + offset) = color;
-            } else if (bytes_per_pixel == 3) {
-                buffer[offset] = color & 0xFF;
-                buffer[offset + 1] = (color >> 8) & 0xFF;
-                buffer[offset + 2] = (color >> 16) & 0xFF;
-            }
-        }
-    }
+    if (!cursor_enabled || !cursor_is_drawn) return;
     
+    vesa_blit(x - 1, y - 1, cursor_backup, CURSOR_BACKUP_SIZE, CURSOR_BACKUP_SIZE,
+              0, 0, CURSOR_BACKUP_SIZE, CURSOR_BACKUP_SIZE);
     cursor_is_drawn = 0;
 }
 
 // ============ ОПРЕДЕЛЕНИЕ ТИПА КУРСОРА ============
-static cursor_type_t determine_cursor_type(void) {
-    if (!gui_state.initialized || !gui_state.focused_window) {
-        return CURSOR_DEFAULT;
+static cursor_type_t cursor_for_edge(uint32_t edge) {
+    switch (edge) {
+        case 1: case 4: return CURSOR_RESIZE_NWSE;
+        case 2: case 3: return CURSOR_RESIZE_NESW;
+        case 5: case 6: return CURSOR_RESIZE_EW;
+        case 7: case 8: return CURSOR_RESIZE_NS;
+        default:        return CURSOR_DEFAULT;
     }
+}
+
+static cursor_type_t determine_cursor_type(void) {
+    if (!gui_state.initialized) return CURSOR_DEFAULT;
     
-    Window* win = gui_state.focused_window;
     uint32_t mx, my;
     vesa_get_cursor_pos(&mx, &my);
     
-    if (win->resizing) {
-        switch (win->resize_corner) {
-            case 1: return CURSOR_RESIZE_NWSE;
-            case 2: return CURSOR_RESIZE_NESW;
-            case 3: return CURSOR_RESIZE_NESW;
-            case 4: return CURSOR_RESIZE_NWSE;
-            case 5:
-            case 6:
-                return CURSOR_RESIZE_EW;
-            case 8:
-                return CURSOR_RESIZE_NS;
-        }
+    Window* focused = gui_state.focused_window;
+    if (focused && IS_VALID_WINDOW_PTR(focused) && focused->resizing) {
+        return cursor_for_edge(focused->resize_corner);
     }
     
-    if (win->resizable && !win->maximized && !win->minimized) {
-        uint32_t corner_size = 12;
-        uint32_t edge_size = 8;
-        uint32_t title_h = win->title_height;
-        
-        // Проверяем углы
-        if (mx <= win->x + corner_size && my <= win->y + corner_size) {
-            return CURSOR_RESIZE_NWSE;
-        }
-        if (mx >= win->x + win->width - corner_size && my <= win->y + corner_size) {
-            return CURSOR_RESIZE_NESW;
-        }
-        if (mx <= win->x + corner_size && my >= win->y + win->height - corner_size) {
-            return CURSOR_RESIZE_NESW;
-        }
-        if (mx >= win->x + win->width - corner_size && my >= win->y + win->height - corner_size) {
-            return CURSOR_RESIZE_NWSE;
-        }
-        
-        // Проверяем стороны (ТОЛЬКО если не в углах)
-        if (mx <= win->x + edge_size && my > win->y + title_h) {
-            return CURSOR_RESIZE_EW;  // левый край
-        }
-        if (mx >= win->x + win->width - edge_size && my > win->y + title_h) {
-            return CURSOR_RESIZE_EW;  // правый край
-        }
-        if (my >= win->y + win->height - edge_size) {
-            return CURSOR_RESIZE_NS;  // нижний край
-        }
-    }
+    // Окно, которое видно под курсором (по видимым областям компоновщика), а не фокусное
+    Window* win = wm_find_window_at(mx, my);
+    if (!win) return CURSOR_DEFAULT;
+    
+    uint32_t edge = wm_resize_edge_at(win, mx, my);
+    if (edge) return cursor_for_edge(edge);
     
     // Проверяем заголовок для перемещения
     if (win->has_titlebar && win->movable && !win->maximized) {
@@ -437,107 +344,55 @@ static void cursor_draw(uint32_t x, uint32_t y, cursor_type_t type) {
     struct fb_info* fb = vesa_get_info();
     if(!fb || !fb->found) return;
     
-    uint32_t bytes_per_pixel = fb->bpp / 8;
-    uint8_t* buffer;
-    
-    if (vesa_is_double_buffer_enabled()) {
-        buffer = (uint8_t*)vesa_get_back_buffer();
-    } else {
-        buffer = (uint8_t*)fb->address;
-    }
-    
-    if (!buffer) return;
-    
     const uint16_t* bitmap = get_cursor_bitmap(type);
     
     // Сохраняем фон
     cursor_save_background(x, y);
     
-    // === СНАЧАЛА ЧЁРНАЯ ОБВОДКА ===
-    for(int dy = 0; dy < 16; dy++) {
-        uint16_t row = bitmap[dy];
-        uint32_t py = y + dy;
-        if(py >= fb->height) continue;
-        
-        for(int dx = 0; dx < 16; dx++) {
-            if(row & (1 << (15 - dx))) {
-                uint32_t px = x + dx;
-                if(px >= fb->width) continue;
-                
-                // Рисуем чёрный контур вокруг белого
-                if(px + 1 < fb->width) {
-                    uint32_t offset_r = py * fb->pitch + (px + 1) * bytes_per_pixel;
-                    if (bytes_per_pixel == 4) {
-                        *(uint32_t*)(buffer + offset_r) = 0x000000;
-                    } else {
-                        buffer[offset_r] = 0x00;
-                        buffer[offset_r + 1] = 0x00;
-                        buffer[offset_r + 2] = 0x00;
-                    }
-                }
-                if(py + 1 < fb->height) {
-                    uint32_t offset_d = (py + 1) * fb->pitch + px * bytes_per_pixel;
-                    if (bytes_per_pixel == 4) {
-                        *(uint32_t*)(buffer + offset_d) = 0x000000;
-                    } else {
-                        buffer[offset_d] = 0x00;
-                        buffer[offset_d + 1] = 0x00;
-                        buffer[offset_d + 2] = 0x00;
-                    }
-                }
-                if(px > 0) {
-                    uint32_t offset_l = py * fb->pitch + (px - 1) * bytes_per_pixel;
-                    if (bytes_per_pixel == 4) {
-                        *(uint32_t*)(buffer + offset_l) = 0x000000;
-                    } else {
-                        buffer[offset_l] = 0x00;
-                        buffer[offset_l + 1] = 0x00;
-                        buffer[offset_l + 2] = 0x00;
-                    }
-                }
-                if(py > 0) {
-                    uint32_t offset_u = (py - 1) * fb->pitch + px * bytes_per_pixel;
-                    if (bytes_per_pixel == 4) {
-                        *(uint32_t*)(buffer + offset_u) = 0x000000;
-                    } else {
-                        buffer[offset_u] = 0x00;
-                        buffer[offset_u + 1] = 0x00;
-                        buffer[offset_u + 2] = 0x00;
-                    }
-                }
-            }
-        }
-    }
-    
-    // === ПОТОМ БЕЛЫЙ КУРСОР ===
-    for(int dy = 0; dy < 16; dy++) {
-        uint16_t row = bitmap[dy];
-        uint32_t py = y + dy;
-        if(py >= fb->height) continue;
-        
-        for(int dx = 0; dx < 16; dx++) {
-            if(row & (1 << (15 - dx))) {
-                uint32_t px = x + dx;
-                if(px >= fb->width) continue;
-                
-                uint32_t offset = py * fb->pitch + px * bytes_per_pixel;
-                
-                if (bytes_per_pixel == 4) {
-                    *(uint32_t*)(buffer + offset) = 0xFFFFFF;
-                } else {
-                    buffer[offset] = 0xFF;
-                    buffer[offset + 1] = 0xFF;
-                    buffer[offset + 2] = 0xFF;
-                }
-            }
-        }
-    }
+    // Чёрная обводка - битмап, сдвинутый на точку в четыре стороны, поверх него белый курсор
+    vesa_draw_mask16(x + 1, y, bitmap, 16, 0x000000);
+    vesa_draw_mask16(x - 1, y, bitmap, 16, 0x000000);
+    vesa_draw_mask16(x, y + 1, bitmap, 16, 0x000000);
+    vesa_draw_mask16(x, y - 1, bitmap, 16, 0x000000);
+    vesa_draw_mask16(x, y, bitmap, 16, 0xFFFFFF);
     
     last_cursor_x = x;
     last_cursor_y = y;
     cursor_is_drawn = 1;
 }
 
+// ============ ВЫВОД НА ЭКРАН ============
+// Курсор снимается и рисуется заново каждый кадр; на экран уходит только смена места или вида
+static uint32_t shown_x = 0;
+static uint32_t shown_y = 0;
+static cursor_type_t shown_type = CURSOR_DEFAULT;
+static uint8_t shown_drawn = 0;
+
+static void cursor_mark_present(uint32_t x, uint32_t y) {
+    // Обводка выходит на точку за квадрат 16x16
+    uint32_t x0 = x ? x - 1 : 0;
+    uint32_t y0 = y ? y - 1 : 0;
+    vesa_mark_present(x0, y0, 18, 18);
+}
+
+static void cursor_sync_present(void) {
+    if (!vesa_is_double_buffer_enabled()) return;
+    
+    if (shown_drawn == cursor_is_drawn &&
+        (!cursor_is_drawn || (shown_x == last_cursor_x && shown_y == last_cursor_y &&
+                              shown_type == current_cursor))) {
+        return;
+    }
+    
+    if (shown_drawn) cursor_mark_present(shown_x, shown_y);
+    if (cursor_is_drawn) cursor_mark_present(last_cursor_x, last_cursor_y);
+    
+    shown_x = last_cursor_x;
+    shown_y = last_cursor_y;
+    shown_type = current_cursor;
+    shown_drawn = cursor_is_drawn;
+}
+
 // ============ ПУБЛИЧНЫЕ ФУНКЦИИ ============
 void vesa_cursor_init(void) {
     struct fb_info* fb = vesa_get_info();
@@ -560,7 +415,10 @@ void vesa_cursor_init(void) {
 }
 
 void vesa_cursor_update(void) {
-    if (!cursor_enabled) return;
+    if (!cursor_enabled) {
+        cursor_sync_present();
+        return;
+    }
     
     struct fb_info* fb = vesa_get_info();
     if(!fb || !fb->found) return;
@@ -596,6 +454,8 @@ void vesa_cursor_update(void) {
         
         cursor_need_update = 0;
     }
+    
+    cursor_sync_present();
 }
 
 void vesa_set_cursor_pos(uint32_t x, uint32_t y) {
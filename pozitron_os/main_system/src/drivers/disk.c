@@ -1,13 +1,19 @@
 #include "drivers/disk.h"
 #include "drivers/ata.h"
 #include "drivers/ahci.h"
+#include "drivers/pci.h"
 #include "drivers/serial.h"
+#include "kernel/memory.h"
 #include "lib/string.h"
+#include "lib/crc32.h"
+#include "kernel/timer_utils.h"
 #include <stdio.h>
 
-static disk_t disks[16];
+static disk_t disks[DISK_MAX_DISKS];
 static int disk_count = 0;
 static uint8_t disk_initialized = 0;
+static int ahci_registered = 0;     // Сколько AHCI портов уже стали дисками
+static uint8_t ahci_pending = 0;    // Есть порты, отложенные после загрузки
 
 static int disk_ahci_read(disk_t* disk, uint64_t lba, uint32_t count, void* buffer) {
     return ahci_read_sectors(disk->private_id, lba, count, buffer);
@@ -36,12 +42,235 @@ static int disk_ata_flush(disk_t* disk) {
     return ata_flush_cache(dev);
 }
 
+// ============ GPT ============
+
+#define GPT_SIGNATURE_LO 0x20494645   // "EFI "
+#define GPT_SIGNATURE_HI 0x54524150   // "PART"
+#define GPT_MAX_ENTRIES_BYTES (128 * 128)
+
+typedef struct gpt_header {
+    uint32_t signature_lo;
+    uint32_t signature_hi;
+    uint32_t revision;
+    uint32_t header_size;
+    uint32_t header_crc32;
+    uint32_t reserved;
+    uint64_t my_lba;
+    uint64_t alternate_lba;
+    uint64_t first_usable_lba;
+    uint64_t last_usable_lba;
+    uint8_t  disk_guid[16];
+    uint64_t entries_lba;
+    uint32_t num_entries;
+    uint32_t entry_size;
+    uint32_t entries_crc32;
+} __attribute__((packed)) gpt_header_t;
+
+typedef struct gpt_entry {
+    uint8_t  type_guid[16];
+    uint8_t  unique_guid[16];
+    uint64_t first_lba;
+    uint64_t last_lba;
+    uint64_t attributes;
+    uint16_t name[36];
+} __attribute__((packed)) gpt_entry_t;
+
+// GUID типов в порядке байт на диске и соответствующие им типы MBR
+static const struct {
+    uint8_t guid[16];
+    uint8_t mbr_type;
+} gpt_type_map[] = {
+    // Linux filesystem data 0FC63DAF-8483-4772-8E79-3D69D8477DE4
+    { { 0xAF, 0x3D, 0xC6, 0x0F, 0x83, 0x84, 0x72, 0x47,
+        0x8E, 0x79, 0x3D, 0x69, 0xD8, 0x47, 0x7D, 0xE4 }, 0x83 },
+    // EFI System C12A7328-F81F-11D2-BA4B-00A0C93EC93B
+    { { 0x28, 0x73, 0x2A, 0xC1, 0x1F, 0xF8, 0xD2, 0x11,
+        0xBA, 0x4B, 0x00, 0xA0, 0xC9, 0x3E, 0xC9, 0x3B }, 0xEF },
+    // Microsoft basic data EBD0A0A2-B9E5-4433-87C0-68B6B72699C7
+    { { 0xA2, 0xA0, 0xD0, 0xEB, 0xE5, 0xB9, 0x33, 0x44,
+        0x87, 0xC0, 0x68, 0xB6, 0xB7, 0x26, 0x99, 0xC7 }, 0x07 },
+    // Linux swap 0657FD6D-A4AB-43C4-84E5-0933C84B4F4F
+    { { 0x6D, 0xFD, 0x57, 0x06, 0xAB, 0xA4, 0xC4, 0x43,
+        0x84, 0xE5, 0x09, 0x33, 0xC8, 0x4B, 0x4F, 0x4F }, 0x82 },
+};
+
+static uint8_t gpt_guid_to_mbr_type(const uint8_t* guid) {
+    for (uint32_t i = 0; i < sizeof(gpt_type_map) / sizeof(gpt_type_map[0]); i++) {
+        if (memcmp(guid, gpt_type_map[i].guid, 16) == 0) return gpt_type_map[i].mbr_type;
+    }
+    return 0xDA;    // Неизвестный тип данных
+}
+
+static int disk_add_partition(disk_t* disk, uint8_t type, uint64_t start, uint64_t count, uint8_t bootable) {
+    disk_partition_t* part;
+    
+    if (disk->partition_count >= DISK_MAX_PARTITIONS) return -1;
+    if (count == 0) return -1;
+    if (disk->sectors && start + count > disk->sectors) {
+        serial_puts("[DISK] Partition exceeds disk size, ignored\n");
+        return -1;
+    }
+    
+    part = &disk->partitions[disk->partition_count];
+    memset(part, 0, sizeof(disk_partition_t));
+    part->type = type;
+    part->start_lba = start;
+    part->sector_count = count;
+    part->bootable = bootable;
+    disk->partition_count++;
+    
+    serial_puts("[DISK] Partition ");
+    serial_puts_num(disk->partition_count - 1);
+    serial_puts(": type=0x");
+    serial_puts_num_hex(type);
+    serial_puts(" start=");
+    serial_puts_num_ulong(start);
+    serial_puts(" size=");
+    serial_puts_num_ulong(count);
+    serial_puts(" sectors");
+    if (bootable) serial_puts(" BOOT");
+    serial_puts("\n");
+    
+    return disk->partition_count - 1;
+}
+
+static int gpt_read_header(disk_t* disk, uint64_t lba, gpt_header_t* hdr, uint8_t* sector) {
+    uint32_t crc;
+    
+    if (disk->read(disk, lba, 1, sector) != 0) return -1;
+    
+    memcpy(hdr, sector, sizeof(gpt_header_t));
+    
+    if (hdr->signature_lo != GPT_SIGNATURE_LO || hdr->signature_hi != GPT_SIGNATURE_HI) return -1;
+    if (hdr->header_size < sizeof(gpt_header_t) || hdr->header_size > 512) return -1;
+    if (hdr->my_lba != lba) return -1;
+    
+    crc = hdr->header_crc32;
+    ((gpt_header_t*)sector)->header_crc32 = 0;
+    if (crc32(sector, hdr->header_size) != crc) {
+        serial_puts("[DISK] GPT header CRC mismatch at LBA ");
+        serial_puts_num_ulong(lba);
+        serial_puts("\n");
+        return -1;
+    }
+    
+    if (hdr->entry_size < sizeof(gpt_entry_t) || (hdr->entry_size % 8) != 0) return -1;
+    if (hdr->num_entries == 0) return -1;
+    // Деление, а не умножение: произведение в 32 битах может переполниться
+    if (hdr->num_entries > GPT_MAX_ENTRIES_BYTES / hdr->entry_size) return -1;
+    
+    return 0;
+}
+
+static int gpt_read_entries(disk_t* disk, gpt_header_t* hdr, uint8_t* entries) {
+    uint32_t bytes = hdr->num_entries * hdr->entry_size;
+    uint32_t sectors = (bytes + 511) / 512;
+    
+    if (disk->read(disk, hdr->entries_lba, sectors, entries) != 0) return -1;
+    
+    if (crc32(entries, bytes) != hdr->entries_crc32) {
+        serial_puts("[DISK] GPT entry array CRC mismatch\n");
+        return -1;
+    }
+    
+    return 0;
+}
+
+static int disk_parse_gpt(disk_t* disk) {
+    gpt_header_t hdr;
+    uint8_t sector[512];
+    uint8_t* entries;
+    uint32_t count;
+    static const uint8_t zero_guid[16] = { 0 };
+    
+    entries = kmalloc_aligned(GPT_MAX_ENTRIES_BYTES, 512);
+    if (!entries) return -1;
+    
+    // Основной заголовок в LBA 1, резервный - в последнем секторе диска
+    if (gpt_read_header(disk, 1, &hdr, sector) != 0 || gpt_read_entries(disk, &hdr, entries) != 0) {
+        serial_puts("[DISK] Primary GPT invalid, trying backup header\n");
+        if (disk->sectors < 2 ||
+            gpt_read_header(disk, disk->sectors - 1, &hdr, sector) != 0 ||
+            gpt_read_entries(disk, &hdr, entries) != 0) {
+            serial_puts("[DISK] No valid GPT found\n");
+            kfree_aligned(entries);
+            return -1;
+        }
+    }
+    
+    // Не дальше того, что прочитано в буфер
+    count = hdr.num_entries;
+    if (count > GPT_MAX_ENTRIES_BYTES / hdr.entry_size) count = GPT_MAX_ENTRIES_BYTES / hdr.entry_size;
+    
+    serial_puts("[DISK] Valid GPT found, ");
+    serial_puts_num(hdr.num_entries);
+    serial_puts(" entries\n");
+    
+    disk->scheme = DISK_SCHEME_GPT;
+    disk->partition_count = 0;
+    
+    for (uint32_t i = 0; i < count && disk->partition_count < DISK_MAX_PARTITIONS; i++) {
+        gpt_entry_t* e = (gpt_entry_t*)(entries + i * hdr.entry_size);
+        int idx;
+        
+        if (memcmp(e->type_guid, zero_guid, 16) == 0) continue;
+        if (e->last_lba < e->first_lba) continue;
+        if (e->first_lba < hdr.first_usable_lba || e->last_lba > hdr.last_usable_lba) continue;
+        
+        idx = disk_add_partition(disk, gpt_guid_to_mbr_type(e->type_guid),
+                                 e->first_lba, e->last_lba - e->first_lba + 1,
+                                 (e->attributes & (1ULL << 2)) ? 1 : 0);
+        if (idx >= 0) {
+            memcpy(disk->partitions[idx].type_guid, e->type_guid, 16);
+        }
+    }
+    
+    kfree_aligned(entries);
+    return 0;
+}
+
+// ============ MBR ============
+
+static int mbr_is_extended(uint8_t type) {
+    return type == 0x05 || type == 0x0F || type == 0x85;
+}
+
+// Проходит цепочку EBR расширенного раздела и добавляет логические разделы
+static void disk_parse_ebr(disk_t* disk, uint32_t ext_start, uint32_t ext_size) {
+    uint8_t ebr[512];
+    uint32_t next = 0;
+    int guard = 0;
+    
+    while (guard++ < 64 && disk->partition_count < DISK_MAX_PARTITIONS) {
+        uint64_t ebr_lba = (uint64_t)ext_start + next;
+        
+        if (disk->read(disk, ebr_lba, 1, ebr) != 0) break;
+        if (ebr[510] != 0x55 || ebr[511] != 0xAA) break;
+        
+        uint8_t type = ebr[446 + 4];
+        uint32_t rel_start = *(uint32_t*)(ebr + 446 + 8);
+        uint32_t count = *(uint32_t*)(ebr + 446 + 12);
+        
+        if (type != 0x00 && count > 0) {
+            disk_add_partition(disk, type, ebr_lba + rel_start, count, ebr[446] == 0x80 ? 1 : 0);
+        }
+        
+        uint8_t next_type = ebr[462 + 4];
+        uint32_t next_rel = *(uint32_t*)(ebr + 462 + 8);
+        
+        if (!mbr_is_extended(next_type) || next_rel == 0 || next_rel <= next || next_rel >= ext_size) break;
+        next = next_rel;
+    }
+}
+
 static void disk_parse_mbr(disk_t* disk) {
     uint8_t mbr[512];
     
+    disk->scheme = DISK_SCHEME_NONE;
+    disk->partition_count = 0;
+    
     if (disk->type == DISK_TYPE_ATAPI) {
         serial_puts("[DISK] Skipping MBR parse for ATAPI device\n");
-        disk->partition_count = 0;
         return;
     }
     
@@ -49,7 +278,6 @@ static void disk_parse_mbr(disk_t* disk) {
     
     if (disk->read(disk, 0, 1, mbr) != 0) {
         serial_puts("[DISK] Failed to read MBR\n");
-        disk->partition_count = 0;
         return;
     }
     
@@ -59,13 +287,20 @@ static void disk_parse_mbr(disk_t* disk) {
         serial_puts(" 0x");
         serial_puts_num_hex(mbr[511]);
         serial_puts(")\n");
-        disk->partition_count = 0;
         return;
     }
     
-    serial_puts("[DISK] Valid MBR found\n");
+    // Защитный MBR - настоящая таблица разделов в GPT
+    for (int i = 0; i < 4; i++) {
+        if (mbr[446 + i * 16 + 4] == 0xEE) {
+            serial_puts("[DISK] Protective MBR found\n");
+            if (disk_parse_gpt(disk) == 0) return;
+            break;
+        }
+    }
     
-    disk->partition_count = 0;
+    serial_puts("[DISK] Valid MBR found\n");
+    disk->scheme = DISK_SCHEME_MBR;
     
     for (int i = 0; i < 4; i++) {
         uint32_t offset = 446 + i * 16;
@@ -74,58 +309,92 @@ static void disk_parse_mbr(disk_t* disk) {
         uint32_t start_lba = *(uint32_t*)(mbr + offset + 8);
         uint32_t sector_count = *(uint32_t*)(mbr + offset + 12);
         
-        if (type != 0x00 && sector_count > 0) {
-            disk->partitions[disk->partition_count].type = type;
-            disk->partitions[disk->partition_count].start_lba = start_lba;
-            disk->partitions[disk->partition_count].sector_count = sector_count;
-            disk->partitions[disk->partition_count].bootable = bootable == 0x80 ? 1 : 0;
-            disk->partition_count++;
-            
-            serial_puts("[DISK] Partition ");
-            serial_puts_num(disk->partition_count - 1);
-            serial_puts(": type=0x");
-            serial_puts_num_hex(type);
-            serial_puts(" start=");
-            serial_puts_num(start_lba);
-            serial_puts(" size=");
-            serial_puts_num(sector_count);
-            serial_puts(" sectors");
-            if (disk->partitions[disk->partition_count - 1].bootable) serial_puts(" BOOT");
-            serial_puts("\n");
-            
-            if (disk->partition_count >= 16) break;
+        if (type == 0x00 || type == 0xEE || sector_count == 0) continue;
+        
+        if (mbr_is_extended(type)) {
+            disk_parse_ebr(disk, start_lba, sector_count);
+            continue;
         }
+        
+        disk_add_partition(disk, type, start_lba, sector_count, bootable == 0x80 ? 1 : 0);
+    }
+}
+
+// ============ БЛОЧНЫЕ УСТРОЙСТВА РАЗДЕЛОВ ============
+
+static int disk_part_read(disk_t* disk, uint64_t lba, uint32_t count, void* buffer) {
+    if (lba + count > disk->sectors) {
+        serial_puts("[DISK] Partition read out of bounds\n");
+        return -1;
+    }
+    return disk->parent->read(disk->parent, disk->start_lba + lba, count, buffer);
+}
+
+static int disk_part_write(disk_t* disk, uint64_t lba, uint32_t count, void* buffer) {
+    if (lba + count > disk->sectors) {
+        serial_puts("[DISK] Partition write out of bounds\n");
+        return -1;
+    }
+    return disk->parent->write(disk->parent, disk->start_lba + lba, count, buffer);
+}
+
+static int disk_part_flush(disk_t* disk) {
+    if (!disk->parent->flush) return 0;
+    return disk->parent->flush(disk->parent);
+}
+
+static void disk_register_partitions(disk_t* parent) {
+    for (int p = 0; p < parent->partition_count && disk_count < DISK_MAX_DISKS; p++) {
+        disk_partition_t* part = &parent->partitions[p];
+        disk_t* disk = &disks[disk_count];
+        
+        memset(disk, 0, sizeof(disk_t));
+        disk->id = disk_count;
+        disk->type = DISK_TYPE_PARTITION;
+        disk->sectors = part->sector_count;
+        disk->sector_size = parent->sector_size;
+        disk->read = disk_part_read;
+        disk->write = disk_part_write;
+        disk->flush = disk_part_flush;
+        disk->private_id = p;
+        disk->parent = parent;
+        disk->start_lba = part->start_lba;
+        memcpy(disk->model, parent->model, 40);
+        memcpy(disk->serial, parent->serial, 20);
+        
+        part->dev = disk;
+        disk_count++;
     }
 }
 
 int disk_read_partition(disk_t* disk, int part_index, uint64_t lba, uint32_t count, void* buffer) {
     if (!disk || part_index < 0 || part_index >= disk->partition_count) return -1;
     
-    uint64_t real_lba = (uint64_t)disk->partitions[part_index].start_lba + lba;
+    disk_partition_t* part = &disk->partitions[part_index];
     
-    if (real_lba + count > (uint64_t)disk->partitions[part_index].start_lba + disk->partitions[part_index].sector_count) {
+    if (lba + count > part->sector_count) {
         serial_puts("[DISK] Partition read out of bounds\n");
         return -1;
     }
     
-    return disk->read(disk, real_lba, count, buffer);
+    return disk->read(disk, part->start_lba + lba, count, buffer);
 }
 
 int disk_write_partition(disk_t* disk, int part_index, uint64_t lba, uint32_t count, void* buffer) {
     if (!disk || part_index < 0 || part_index >= disk->partition_count) return -1;
     
-    uint64_t real_lba = (uint64_t)disk->partitions[part_index].start_lba + lba;
+    disk_partition_t* part = &disk->partitions[part_index];
     
-    if (real_lba + count > (uint64_t)disk->partitions[part_index].start_lba + disk->partitions[part_index].sector_count) {
+    if (lba + count > part->sector_count) {
         serial_puts("[DISK] Partition write out of bounds\n");
         return -1;
     }
     
-    return disk->write(disk, real_lba, count, buffer);
+    return disk->write(disk, part->start_lba + lba, count, buffer);
 }
 
-int disk_get_partition_offset(disk_t* disk, int part_index) {
-    if (!disk || part_index < 0 || part_index >= disk->partition_count) return -1;
+uint64_t disk_get_partition_offset(disk_t* disk, int part_index) {
+    if (!disk || part_index < 0 || part_index >= disk->partition_count) return 0;
     return disk->partitions[part_index].start_lba;
 }
 
@@ -141,6 +410,59 @@ int disk_find_partition_by_type(disk_t* disk, uint8_t type) {
     return -1;
 }
 
+disk_t* disk_get_partition(disk_t* disk, int part_index) {
+    if (!disk || part_index < 0 || part_index >= disk->partition_count) return NULL;
+    return disk->partitions[part_index].dev;
+}
+
+static disk_t* disk_register_ahci(int i) {
+    struct ahci_port* port = ahci_get_port(i);
+    if (!port || !port->present || disk_count >= DISK_MAX_DISKS) return NULL;
+    
+    disk_t* disk = &disks[disk_count];
+    disk->id = disk_count;
+    disk->type = port->atapi ? DISK_TYPE_ATAPI : DISK_TYPE_AHCI;
+    disk->sectors = port->sectors;
+    disk->sector_size = port->sector_size;
+    disk->read = disk_ahci_read;
+    disk->write = disk_ahci_write;
+    disk->flush = disk_ahci_flush;
+    disk->private_data = port;
+    disk->private_id = i;
+    disk->partition_count = 0;
+    disk->probe_ms = port->probe_ms;
+    
+    memcpy(disk->model, port->model, 40);
+    memcpy(disk->serial, port->serial, 20);
+    
+    disk_parse_mbr(disk);
+    
+    disk_count++;
+    
+    serial_puts("[DISK] Registered AHCI disk: ");
+    serial_puts(disk->model);
+    if (!port->atapi) {
+        serial_puts(" (");
+        serial_puts_num_ulong(disk->sectors / 2 / 1024);
+        serial_puts(" MB)");
+    }
+    serial_puts("\n");
+    return disk;
+}
+
+static void disk_probe_report(int physical_count) {
+    serial_puts("[DISK] Probe times:\n");
+    for (int i = 0; i < physical_count; i++) {
+        serial_puts("  Disk ");
+        serial_puts_num(i);
+        serial_puts(" (");
+        serial_puts(disks[i].model);
+        serial_puts("): ");
+        serial_puts_num(disks[i].probe_ms);
+        serial_puts(" ms\n");
+    }
+}
+
 void disk_init(void) {
     if (disk_initialized) return;
     
@@ -149,10 +471,18 @@ void disk_init(void) {
     disk_count = 0;
     memset(disks, 0, sizeof(disks));
     
+    uint32_t start = timer_get_ticks();
+    
+    // PCI перечисляется один раз, дальше драйверы ищут контроллеры в кэше
+    pci_init();
+    
+    // Сброс AHCI портов запускается до ATA: линки поднимаются, пока ждём IDE каналы
+    ahci_probe_start();
     ata_init();
     
     int ata_devices = ata_get_device_count();
-    for (int i = 0; i < ata_devices && disk_count < 16; i++) {
+    int hard_disks = 0;
+    for (int i = 0; i < ata_devices && disk_count < DISK_MAX_DISKS; i++) {
         ata_device_t* dev = ata_get_device(i);
         if (!dev || !dev->present) continue;
         
@@ -166,8 +496,8 @@ void disk_init(void) {
         disk->flush = disk_ata_flush;
         disk->private_data = dev;
         disk->private_id = i;
-        disk->partition_offset = 0;
         disk->partition_count = 0;
+        disk->probe_ms = dev->probe_ms;
         
         memcpy(disk->model, dev->model, 40);
         memcpy(disk->serial, dev->serial, 20);
@@ -175,58 +505,64 @@ void disk_init(void) {
         disk_parse_mbr(disk);
         
         disk_count++;
+        if (dev->type != ATA_DEV_ATAPI) hard_disks++;
         
         serial_puts("[DISK] Registered ATA disk: ");
         serial_puts(disk->model);
         serial_puts("\n");
     }
     
-    ahci_init();
+    // CD-ROM загрузки не заменяет корневой диск: медленный AHCI порт с ним всё равно ждём
+    ahci_init(hard_disks);
     
     int ahci_ports = ahci_get_port_count();
-    for (int i = 0; i < ahci_ports && disk_count < 16; i++) {
-        struct ahci_port* port = ahci_get_port(i);
-        if (!port || !port->present) continue;
-        
-        disk_t* disk = &disks[disk_count];
-        disk->id = disk_count;
-        disk->type = port->atapi ? DISK_TYPE_ATAPI : DISK_TYPE_AHCI;
-        disk->sectors = port->sectors;
-        disk->sector_size = port->sector_size;
-        disk->read = disk_ahci_read;
-        disk->write = disk_ahci_write;
-        disk->flush = disk_ahci_flush;
-        disk->private_data = port;
-        disk->private_id = i;
-        disk->partition_offset = 0;
-        disk->partition_count = 0;
-        
-        memcpy(disk->model, port->model, 40);
-        memcpy(disk->serial, port->serial, 20);
-        
-        disk_parse_mbr(disk);
-        
-        disk_count++;
-        
-        serial_puts("[DISK] Registered AHCI disk: ");
-        serial_puts(disk->model);
-        if (!port->atapi) {
-            serial_puts(" (");
-            serial_puts_num_ulong(disk->sectors / 2 / 1024);
-            serial_puts(" MB)");
-        }
-        serial_puts("\n");
+    for (int i = 0; i < ahci_ports; i++) {
+        disk_register_ahci(i);
+    }
+    ahci_registered = ahci_ports;
+    ahci_pending = ahci_probe_poll() > 0;
+    
+    // Разделы регистрируются после всех физических дисков, чтобы не сдвигать их номера
+    int physical_count = disk_count;
+    for (int i = 0; i < physical_count; i++) {
+        disk_register_partitions(&disks[i]);
     }
     
     disk_initialized = 1;
     
-    serial_puts("[DISK] Subsystem initialized, found ");
-    serial_puts_num(disk_count);
-    serial_puts(" disks\n");
+    disk_probe_report(physical_count);
+    
+    serial_puts("[DISK] Subsystem initialized in ");
+    serial_puts_num(TICKS_TO_MS(timer_get_ticks() - start));
+    serial_puts(" ms, found ");
+    serial_puts_num(physical_count);
+    serial_puts(" disks, ");
+    serial_puts_num(disk_count - physical_count);
+    serial_puts(" partitions\n");
+}
+
+// Доопрос портов, не успевших к концу загрузки; вызывается из главного цикла
+void disk_poll(void) {
+    if (!ahci_pending) return;
+    
+    ahci_pending = ahci_probe_poll() > 0;
+    
+    int ahci_ports = ahci_get_port_count();
+    for (; ahci_registered < ahci_ports; ahci_registered++) {
+        disk_t* disk = disk_register_ahci(ahci_registered);
+        if (!disk) continue;
+        
+        serial_puts("[DISK] Late disk ");
+        serial_puts_num(disk->id);
+        serial_puts(" probed in ");
+        serial_puts_num(disk->probe_ms);
+        serial_puts(" ms\n");
+        disk_register_partitions(disk);
+    }
 }
 
 disk_t* disk_get(int index) {
-    if (index >= disk_count) return NULL;
+    if (index < 0 || index >= disk_count) return NULL;
     return &disks[index];
 }
 
@@ -248,6 +584,12 @@ void disk_dump_all(void) {
             case DISK_TYPE_ATAPI: serial_puts("ATAPI (CD/DVD)"); break;
             case DISK_TYPE_AHCI: serial_puts("AHCI (SATA)"); break;
             case DISK_TYPE_SATA: serial_puts("SATA"); break;
+            case DISK_TYPE_PARTITION:
+                serial_puts("Partition ");
+                serial_puts_num(d->private_id);
+                serial_puts(" of disk ");
+                serial_puts_num(d->parent->id);
+                break;
             default: serial_puts("Unknown");
         }
         serial_puts("\n  Size: ");
@@ -267,16 +609,16 @@ void disk_dump_all(void) {
         }
         
         if (d->partition_count > 0) {
-            serial_puts("  Partitions:\n");
+            serial_puts(d->scheme == DISK_SCHEME_GPT ? "  Partitions (GPT):\n" : "  Partitions (MBR):\n");
             for (int p = 0; p < d->partition_count; p++) {
                 serial_puts("    ");
                 serial_puts_num(p);
                 serial_puts(": type=0x");
                 serial_puts_num_hex(d->partitions[p].type);
                 serial_puts(" start=");
-                serial_puts_num(d->partitions[p].start_lba);
+                serial_puts_num_ulong(d->partitions[p].start_lba);
                 serial_puts(" size=");
-                serial_puts_num(d->partitions[p].sector_count);
+                serial_puts_num_ulong(d->partitions[p].sector_count);
                 if (d->partitions[p].bootable) serial_puts(" BOOT");
                 serial_puts("\n");
             }
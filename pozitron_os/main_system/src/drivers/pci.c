@@ -131,6 +131,10 @@ static void pci_build_cache(void) {
     serial_puts(" devices\n");
 }
 
+void pci_init(void) {
+    pci_build_cache();
+}
+
 // ==================== PCI DEVICE FINDING ====================
 
 pci_device_t pci_find_class(uint8_t class, uint8_t subclass, uint8_t prog_if) {
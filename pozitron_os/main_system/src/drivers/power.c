@@ -3,6 +3,7 @@
 #include "drivers/ports.h"
 #include "drivers/vesa.h"
 #include "kernel/memory.h"
+#include "fs/vfs.h"
 #include <stddef.h>
 
 // ============ АПМ (Advanced Power Management) ============
@@ -129,6 +130,10 @@ static void efi_shutdown(void) {
 void shutdown_computer(void) {
     serial_puts("\n=== SHUTDOWN SEQUENCE STARTED ===\n");
     
+    // 0. Сбрасываем кэш файловых систем на диск
+    serial_puts("[POWER] Flushing filesystem buffers...\n");
+    vfs_sync();
+    
     // 1. Сохраняем время RTC перед выключением
     serial_puts("[POWER] Saving RTC time...\n");
     
@@ -1,10 +1,13 @@
 #include "drivers/vesa.h"
 #include "drivers/serial.h"
 #include "drivers/ports.h"
+#include "drivers/bga.h"
 #include <stdint.h>
 #include <stddef.h>
 #include "kernel/memory.h"
 #include "kernel/multiboot.h"
+#include "kernel/timer_utils.h"
+#include "lib/region.h"
 
 // Шрифт 8x16 (первые 128 символов ASCII)
 static const uint8_t font_8x16[2048] = {
@@ -400,7 +403,6 @@ static const uint8_t font_8x16_rus[1024] = {
 
 // ===== ГЛОБАЛЬНЫЕ ПЕРЕМЕННЫЕ И СТРУКТУРЫ =====
 
-#define MAX_DIRTY_RECTS 32
 #define BACKGROUND_CACHED 1
 
 struct vbe_mode_info {
@@ -430,144 +432,485 @@ static struct fb_info fb = {0};
 static void* back_buffer = NULL;  // Изменено с uint32_t* на void*
 static uint8_t double_buffer_enabled = 0;
 
-// Dirty rectangles
-static dirty_rect_t dirty_rects[MAX_DIRTY_RECTS];
-static uint32_t dirty_count = 0;
+// Область урона: что в экранном буфере нужно перерисовать (сбрасывает компоновщик)
+static region_t damage;
+// Что изменилось в экранном буфере с прошлого вывода на экран
+static region_t present;
+// При переключении страниц: на что скрытая страница отстаёт от заднего буфера (вывод прошлого кадра)
+static region_t lag;
 static uint8_t dirty_system_initialized = 0;
+static vesa_frame_stats_t frame_stats;
 
 // Кэшированный фон
 static uint32_t* background_cache = NULL;
 static uint8_t background_cached = 0;
 
+// Цель рисования примитивов: NULL - экран, иначе поверхность, лежащая на экране в (target_x, target_y)
+static vesa_surface_t* target = NULL;
+static int32_t target_x = 0, target_y = 0;
+
+// SSE2 включается в vesa_init; xmm-регистры трогают только ядра смешивания из потока GUI,
+// поэтому планировщик их не сохраняет
+static uint8_t use_sse2 = 0;
+
+// Режим, выставленный загрузчиком, и его список режимов VBE
+static multiboot_info_t* boot_info = NULL;
+
+// Адаптер DISPI: режим меняется на ходу. При переключении страниц видеопамять -
+// две страницы по fb.height строк; рисование идёт в back_buffer в ОЗУ, а кадр
+// собирается на скрытой странице и показывается записью в регистр
+static uint8_t dispi = 0;
+static uint8_t page_flip = 0;
+static uint32_t front_page = 0;
+
+// ===== SPAN-ДВИЖОК =====
+
+// Цвет, заранее разложенный под формат кадра: заливка не ветвится по bpp на каждой точке
+typedef struct {
+    uint32_t word[3];       // 32 бит: word[0]; 16 бит: две точки в word[0]; 24 бит: 4 точки в 12 байтах
+    uint32_t bytes_pp;
+} span_pattern_t;
+
+static inline uint32_t to_rgb565(color_t c) {
+    return (((c >> 19) & 0x1F) << 11) | (((c >> 10) & 0x3F) << 5) | ((c >> 3) & 0x1F);
+}
+
+static inline color_t from_rgb565(uint32_t v) {
+    uint32_t r = (v >> 11) & 0x1F, g = (v >> 5) & 0x3F, b = v & 0x1F;
+    return (((r << 3) | (r >> 2)) << 16) | (((g << 2) | (g >> 4)) << 8) | ((b << 3) | (b >> 2));
+}
+
+static void span_pattern(color_t color, span_pattern_t* p) {
+    uint32_t r = (color >> 16) & 0xFF;
+    uint32_t g = (color >> 8) & 0xFF;
+    uint32_t b = color & 0xFF;
+    
+    p->bytes_pp = fb.bpp / 8;
+    
+    if (p->bytes_pp == 4) {
+        p->word[0] = color;
+    } else if (p->bytes_pp == 3) {
+        // b g r b | g r b g | r b g r
+        p->word[0] = b | (g << 8) | (r << 16) | (b << 24);
+        p->word[1] = g | (r << 8) | (b << 16) | (g << 24);
+        p->word[2] = r | (b << 8) | (g << 16) | (r << 24);
+    } else {
+        uint32_t rgb565 = to_rgb565(color);
+        p->word[0] = rgb565 | (rgb565 << 16);
+    }
+}
+
+// Операции над отрезком строки в одном формате кадра. Набор выбирается один раз под bpp
+// режима (select_backend), поэтому во внутренних циклах нет ветвлений по формату
+typedef struct {
+    uint32_t bytes_pp;
+    void (*fill_span)(uint8_t* dst, uint32_t count, const span_pattern_t* p);
+    void (*copy_span)(uint8_t* dst, const color_t* src, uint32_t count);    // 0xRRGGBB -> кадр
+    void (*read_span)(color_t* dst, const uint8_t* src, uint32_t count);    // Кадр -> 0xRRGGBB
+    void (*blend_span)(uint8_t* dst, const color_t* src, uint32_t count, uint32_t a);
+    void (*blend_color_span)(uint8_t* dst, color_t color, uint32_t count, uint32_t a);
+    // Строка 1-битной маски, старший бит - левая точка: единицы цветом p, нули не трогаются
+    void (*put_glyph_row)(uint8_t* dst, uint8_t bits, uint32_t count, const span_pattern_t* p);
+} pixel_backend_t;
+
+static const pixel_backend_t* backend = NULL;
+
+static inline void fill_dwords(void* dst, uint32_t value, uint32_t count) {
+    asm volatile (
+        "rep stosl\n"
+        : "+D" (dst), "+c" (count)
+        : "a" (value)
+        : "memory"
+    );
+}
+
+static inline void copy_row(void* dst, const void* src, uint32_t bytes) {
+    uint32_t words = bytes / 4;
+    uint32_t rem = bytes % 4;
+    
+    asm volatile (
+        "rep movsl\n"
+        "movl %3, %%ecx\n"
+        "rep movsb\n"
+        : "+D" (dst), "+S" (src), "+c" (words)
+        : "r" (rem)
+        : "memory"
+    );
+}
+
+typedef char v16qi __attribute__((vector_size(16)));
+typedef short v8hi __attribute__((vector_size(16)));
+typedef unsigned short v8hu __attribute__((vector_size(16)));
+typedef long long v2di __attribute__((vector_size(16)));
+typedef long long v2di_u __attribute__((vector_size(16), __may_alias__, aligned(1)));
+
+// Строка в видеопамять: середина - movntdq мимо кэша, чтобы вывод кадра не вытеснял
+// из него рабочие данные; голова до выравнивания на 16 и хвост - обычным rep movs
+__attribute__((target("sse2")))
+static void stream_row(uint8_t* dst, const uint8_t* src, uint32_t bytes) {
+    uint32_t head = (16 - ((uint32_t)dst & 15)) & 15;
+    if (head > bytes) head = bytes;
+    
+    copy_row(dst, src, head);
+    dst += head;
+    src += head;
+    bytes -= head;
+    
+    for (; bytes >= 64; bytes -= 64, dst += 64, src += 64) {
+        v2di a = (v2di)((const v2di_u*)src)[0];
+        v2di b = (v2di)((const v2di_u*)src)[1];
+        v2di c = (v2di)((const v2di_u*)src)[2];
+        v2di d = (v2di)((const v2di_u*)src)[3];
+        __builtin_ia32_movntdq((v2di*)dst, a);
+        __builtin_ia32_movntdq((v2di*)dst + 1, b);
+        __builtin_ia32_movntdq((v2di*)dst + 2, c);
+        __builtin_ia32_movntdq((v2di*)dst + 3, d);
+    }
+    for (; bytes >= 16; bytes -= 16, dst += 16, src += 16) {
+        __builtin_ia32_movntdq((v2di*)dst, (v2di)*(const v2di_u*)src);
+    }
+    
+    copy_row(dst, src, bytes);
+}
+
+// Копирование в видеопамять с учётом в статистике; короткие строки - rep movsl
+static uint8_t present_streamed = 0;
+
+static void present_row(uint8_t* dst, const uint8_t* src, uint32_t bytes) {
+    if (use_sse2 && bytes >= PRESENT_STREAM_MIN) {
+        stream_row(dst, src, bytes);
+        present_streamed = 1;
+    } else {
+        copy_row(dst, src, bytes);
+    }
+    frame_stats.vram_bytes += bytes;
+}
+
+// Потоковые записи идут через буферы объединения записи: sfence перед следующим кадром
+static void present_done(void) {
+    if (present_streamed) {
+        asm volatile ("sfence" ::: "memory");
+        present_streamed = 0;
+    }
+}
+
+// Прямоугольник в буфере base с шагом строки stride; координаты уже отсечены
+static void span_fill_rect(uint8_t* base, uint32_t stride, uint32_t x, uint32_t y,
+                           uint32_t w, uint32_t h, const span_pattern_t* p) {
+    uint8_t* row = base + y * stride + x * p->bytes_pp;
+    
+    // Строки без зазора - одна длинная заливка
+    if (w * p->bytes_pp == stride) {
+        backend->fill_span(row, w * h, p);
+        return;
+    }
+    
+    for (uint32_t i = 0; i < h; i++) {
+        backend->fill_span(row, w, p);
+        row += stride;
+    }
+}
+
+static inline uint8_t* page_address(uint32_t page) {
+    return (uint8_t*)fb.address + page * fb.height * fb.pitch;
+}
+
+// Видимая страница видеопамяти
+static inline uint8_t* front_buffer(void) {
+    return page_flip ? page_address(front_page) : (uint8_t*)fb.address;
+}
+
+// Экранный буфер: задний, если он есть, иначе видеопамять
+static inline uint8_t* screen_buffer(void) {
+    if (double_buffer_enabled && back_buffer) return (uint8_t*)back_buffer;
+    return front_buffer();
+}
+
+// Куда рисуют примитивы
+static inline uint8_t* draw_target(void) {
+    return target ? target->pixels : screen_buffer();
+}
+
+static inline uint32_t target_pitch(void) {
+    return target ? target->pitch : fb.pitch;
+}
+
+// Отсечение по цели рисования. Экранные координаты (отрицательные приходят как большие
+// беззнаковые) переводятся в координаты цели; 0 - ничего не видно
+static int clip_rect(uint32_t* x, uint32_t* y, uint32_t* w, uint32_t* h) {
+    uint32_t width = target ? target->width : fb.width;
+    uint32_t height = target ? target->height : fb.height;
+    int32_t lx = (int32_t)*x - target_x;
+    int32_t ly = (int32_t)*y - target_y;
+    
+    if (*w == 0 || *h == 0) return 0;
+    if (lx < 0) {
+        if ((uint32_t)-lx >= *w) return 0;
+        *w -= (uint32_t)-lx;
+        lx = 0;
+    }
+    if (ly < 0) {
+        if ((uint32_t)-ly >= *h) return 0;
+        *h -= (uint32_t)-ly;
+        ly = 0;
+    }
+    if ((uint32_t)lx >= width || (uint32_t)ly >= height) return 0;
+    if (*w > width - lx) *w = width - lx;
+    if (*h > height - ly) *h = height - ly;
+    
+    *x = lx;
+    *y = ly;
+    return 1;
+}
+
 // ===== СИСТЕМА DIRTY RECTANGLES =====
 
 void vesa_init_dirty(void) {
-    dirty_count = 0;
+    // Запас под прямоугольники сразу: при нехватке памяти урон сводится
+    // к ограничивающему прямоугольнику без нового выделения
+    region_set_rect(&damage, 0, 0, 1, 1);
+    region_clear(&damage);
+    region_set_rect(&present, 0, 0, 1, 1);
+    region_clear(&present);
+    if (lag.capacity == 0) {
+        region_set_rect(&lag, 0, 0, 1, 1);
+        region_clear(&lag);
+    }
     dirty_system_initialized = 1;
     serial_puts("[VESA] Dirty rectangles system initialized\n");
 }
 
-// ИСПРАВЛЕННАЯ ФУНКЦИЯ vesa_mark_dirty - с ограничением размера
-void vesa_mark_dirty(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
-    if (!dirty_system_initialized) return;
+// Цена копирования прямоугольника в пикселях: сами пиксели и накладные на строку и на вызов
+static uint32_t copy_cost(uint32_t w, uint32_t h) {
+    return w * h + h * DAMAGE_ROW_COST + DAMAGE_RECT_COST;
+}
+
+// Несколько точных прямоугольников или один ограничивающий - что дешевле скопировать
+static void damage_simplify(region_t* region) {
+    if (region->count < 2) return;
     
-    if (x >= fb.width) return;
-    if (y >= fb.height) return;
-    if (x + w > fb.width) w = fb.width - x;
-    if (y + h > fb.height) h = fb.height - y;
-    if (w == 0 || h == 0) return;
+    region_rect_t box = region->extents;
+    uint32_t bbox_cost = copy_cost(box.x2 - box.x1, box.y2 - box.y1);
+    uint32_t precise_cost = 0;
     
-    if (w > 200) {
-        x = x + (w - 200) / 2;
-        w = 200;
+    for (uint32_t i = 0; i < region->count; i++) {
+        region_rect_t* r = &region->rects[i];
+        precise_cost += copy_cost(r->x2 - r->x1, r->y2 - r->y1);
     }
-    if (h > 200) {
-        y = y + (h - 200) / 2;
-        h = 200;
+    
+    if (bbox_cost <= precise_cost || region->count > DAMAGE_MAX_RECTS) {
+        region_set_rect(region, box.x1, box.y1, box.x2 - box.x1, box.y2 - box.y1);
+    }
+}
+
+static void damage_add(region_t* region, uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    if (region_union_rect(region, x, y, w, h) != 0) {
+        // Нет памяти под полосы: один прямоугольник в уже выделенном месте
+        int32_t x1 = region->count && region->extents.x1 < (int32_t)x ? region->extents.x1 : (int32_t)x;
+        int32_t y1 = region->count && region->extents.y1 < (int32_t)y ? region->extents.y1 : (int32_t)y;
+        int32_t x2 = region->count && region->extents.x2 > (int32_t)(x + w) ? region->extents.x2 : (int32_t)(x + w);
+        int32_t y2 = region->count && region->extents.y2 > (int32_t)(y + h) ? region->extents.y2 : (int32_t)(y + h);
+        region_set_rect(region, x1, y1, x2 - x1, y2 - y1);
+        return;
     }
     
-    for (uint32_t i = 0; i < dirty_count; i++) {
-        dirty_rect_t* r = &dirty_rects[i];
-        
-        if (x >= r->x && y >= r->y && 
-            x + w <= r->x + r->w && y + h <= r->y + r->h) {
-            return;
-        }
-        
-        if (r->x >= x && r->y >= y && 
-            r->x + r->w <= x + w && r->y + r->h <= y + h) {
-            r->x = x; r->y = y; r->w = w; r->h = h;
-            return;
-        }
+    damage_simplify(region);
+}
+
+// Обрезка по экрану; 0 - пусто
+static uint8_t clip_to_screen(uint32_t x, uint32_t y, uint32_t* w, uint32_t* h) {
+    if (x >= fb.width || y >= fb.height) return 0;
+    if (*w > fb.width - x) *w = fb.width - x;
+    if (*h > fb.height - y) *h = fb.height - y;
+    return *w != 0 && *h != 0;
+}
+
+void vesa_mark_dirty(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    if (!dirty_system_initialized) return;
+    if (!clip_to_screen(x, y, &w, &h)) return;
+    
+    damage_add(&damage, x, y, w, h);
+    damage_add(&present, x, y, w, h);
+}
+
+void vesa_mark_present(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    if (!dirty_system_initialized) return;
+    if (!clip_to_screen(x, y, &w, &h)) return;
+    
+    damage_add(&present, x, y, w, h);
+}
+
+void vesa_mark_dirty_all(void) {
+    if (!dirty_system_initialized) return;
+    
+    region_set_rect(&damage, 0, 0, fb.width, fb.height);
+    region_set_rect(&present, 0, 0, fb.width, fb.height);
+}
+
+// Конец кадра: то, что накопилось в frame_stats.pixels, становится статистикой кадра
+static void frame_end(void) {
+    frame_stats.frames++;
+    frame_stats.last_pixels = frame_stats.pixels;
+    frame_stats.last_rects = frame_stats.rects;
+    frame_stats.last_vram_bytes = frame_stats.vram_bytes;
+    if (frame_stats.pixels > frame_stats.peak_pixels) frame_stats.peak_pixels = frame_stats.pixels;
+    // Скользящее среднее с весом 1/8, без 64-битного деления
+    frame_stats.avg_pixels += (int32_t)(frame_stats.pixels - frame_stats.avg_pixels) / 8;
+    frame_stats.pixels = 0;
+    frame_stats.rects = 0;
+    frame_stats.vram_bytes = 0;
+}
+
+// Прямоугольники области из одного кадрового буфера в другой
+static void copy_region(uint8_t* dst_base, const uint8_t* src_base, const region_t* region) {
+    uint32_t bytes_per_pixel = fb.bpp / 8;
+    
+    for (uint32_t i = 0; i < region->count; i++) {
+        const region_rect_t* r = &region->rects[i];
+        uint32_t row_bytes = (r->x2 - r->x1) * bytes_per_pixel;
+        uint32_t offset = r->y1 * fb.pitch + r->x1 * bytes_per_pixel;
+        const uint8_t* src = src_base + offset;
+        uint8_t* dst = dst_base + offset;
         
-        if (x < r->x + r->w && x + w > r->x &&
-            y < r->y + r->h && y + h > r->y) {
-            uint32_t new_x = (x < r->x) ? x : r->x;
-            uint32_t new_y = (y < r->y) ? y : r->y;
-            uint32_t new_w = ((x + w > r->x + r->w) ? x + w : r->x + r->w) - new_x;
-            uint32_t new_h = ((y + h > r->y + r->h) ? y + h : r->y + r->h) - new_y;
-            
-            if (new_w > 200) new_w = 200;
-            if (new_h > 200) new_h = 200;
-            
-            r->x = new_x; r->y = new_y; r->w = new_w; r->h = new_h;
-            return;
+        // Полосы во всю ширину без зазора в питче - одним куском
+        if (row_bytes == fb.pitch) {
+            present_row(dst, src, row_bytes * (r->y2 - r->y1));
+        } else {
+            for (int32_t y = r->y1; y < r->y2; y++) {
+                present_row(dst, src, row_bytes);
+                src += fb.pitch;
+                dst += fb.pitch;
+            }
         }
+        frame_stats.pixels += (r->x2 - r->x1) * (r->y2 - r->y1);
     }
+    present_done();
+}
+
+static void copy_frame(uint8_t* dst, const uint8_t* src) {
+    uint32_t row_bytes = fb.width * (fb.bpp / 8);
+    
+    frame_stats.pixels += fb.width * fb.height;
     
-    if (dirty_count < MAX_DIRTY_RECTS) {
-        dirty_rects[dirty_count].x = x;
-        dirty_rects[dirty_count].y = y;
-        dirty_rects[dirty_count].w = w;
-        dirty_rects[dirty_count].h = h;
-        dirty_count++;
+    // Питч без зазора - весь кадр одним куском
+    if (row_bytes == fb.pitch) {
+        present_row(dst, src, row_bytes * fb.height);
     } else {
-        vesa_mark_dirty_all();
+        for (uint32_t y = 0; y < fb.height; y++) {
+            present_row(dst, src, row_bytes);
+            src += fb.pitch;
+            dst += fb.pitch;
+        }
     }
+    present_done();
 }
 
-void vesa_mark_dirty_all(void) {
-    if (!dirty_system_initialized) return;
-    
-    dirty_count = 1;
-    dirty_rects[0].x = 0;
-    dirty_rects[0].y = 0;
-    dirty_rects[0].w = fb.width;
-    dirty_rects[0].h = fb.height;
+static inline uint8_t* hidden_page(void) {
+    return page_address(front_page ^ 1);
 }
 
-static inline void fast_copy(uint32_t* dst, uint32_t* src, uint32_t words) {
-    asm volatile (
-        "rep movsl\n"
-        : "+D" (dst), "+S" (src), "+c" (words)
-        : 
-        : "memory"
-    );
+// Скрытая страница уходит на экран одной записью в регистр; бывшая видимая
+// становится скрытой и отстаёт на изменения этого кадра (lag)
+static void flip_pages(void) {
+    front_page ^= 1;
+    bga_set_y_offset(front_page * fb.height);
 }
 
+// Вывод кадра по урону: только изменившиеся строки; кадр без урона не трогает видеопамять
 void vesa_update_dirty(void) {
     if (!dirty_system_initialized || !double_buffer_enabled || !back_buffer || !fb.found) {
         return;
     }
     
-    uint32_t bytes_per_pixel = fb.bpp / 8;
+    if (present.count == 0) {
+        frame_stats.skipped++;
+        frame_end();
+        return;
+    }
     
-    for (uint32_t i = 0; i < dirty_count; i++) {
-        dirty_rect_t* r = &dirty_rects[i];
-        
-        for (uint32_t y = r->y; y < r->y + r->h && y < fb.height; y++) {
-            uint8_t* src = (uint8_t*)back_buffer + y * fb.pitch + r->x * bytes_per_pixel;
-            uint8_t* dst = (uint8_t*)fb.address + y * fb.pitch + r->x * bytes_per_pixel;
-            uint32_t bytes = r->w * bytes_per_pixel;
-            
-            for (uint32_t b = 0; b < bytes; b++) {
-                dst[b] = src[b];
-            }
+    if (page_flip) {
+        // Скрытая страница догоняет прошлый кадр и получает этот. Источник - задний
+        // буфер в кэшируемой ОЗУ: видеопамять только пишется, обратно не читается
+        if (region_union(&lag, &lag, &present) != 0) {
+            region_set_rect(&lag, 0, 0, fb.width, fb.height);
         }
+        damage_simplify(&lag);
+        copy_region(hidden_page(), back_buffer, &lag);
+        flip_pages();
+        if (region_copy(&lag, &present) != 0) region_set_rect(&lag, 0, 0, fb.width, fb.height);
+    } else {
+        copy_region((uint8_t*)fb.address, back_buffer, &present);
     }
     
-    vesa_clear_dirty();
+    region_clear(&present);
+    frame_end();
 }
 
 void vesa_clear_dirty(void) {
-    dirty_count = 0;
+    frame_stats.rects += damage.count;
+    region_clear(&damage);
 }
 
 uint32_t vesa_get_dirty_count(void) {
-    return dirty_count;
+    return damage.count;
 }
 
 uint8_t vesa_get_dirty_rect(uint32_t index, uint32_t* x, uint32_t* y, uint32_t* w, uint32_t* h) {
-    if (index >= dirty_count) return 0;
+    if (index >= damage.count) return 0;
     
-    if (x) *x = dirty_rects[index].x;
-    if (y) *y = dirty_rects[index].y;
-    if (w) *w = dirty_rects[index].w;
-    if (h) *h = dirty_rects[index].h;
+    region_rect_t* r = &damage.rects[index];
+    if (x) *x = r->x1;
+    if (y) *y = r->y1;
+    if (w) *w = r->x2 - r->x1;
+    if (h) *h = r->y2 - r->y1;
     
     return 1;
 }
 
+void vesa_debug_dirty(void) {
+    serial_puts("[VESA] Damage: ");
+    serial_puts_num(damage.count);
+    serial_puts(" rects, ");
+    serial_puts_num(region_area(&damage));
+    serial_puts(" px\n");
+    
+    for (uint32_t i = 0; i < damage.count; i++) {
+        region_rect_t* r = &damage.rects[i];
+        serial_puts("  (");
+        serial_puts_num(r->x1);
+        serial_puts(",");
+        serial_puts_num(r->y1);
+        serial_puts(") ");
+        serial_puts_num(r->x2 - r->x1);
+        serial_puts("x");
+        serial_puts_num(r->y2 - r->y1);
+        serial_puts("\n");
+    }
+}
+
+void vesa_get_frame_stats(vesa_frame_stats_t* stats) {
+    if (stats) *stats = frame_stats;
+}
+
+void vesa_dump_frame_stats(void) {
+    serial_puts("\n=== FRAME STATS ===\n");
+    serial_puts("  Frames:      ");
+    serial_puts_num(frame_stats.frames);
+    serial_puts("\n  Last frame:  ");
+    serial_puts_num(frame_stats.last_pixels);
+    serial_puts(" px in ");
+    serial_puts_num(frame_stats.last_rects);
+    serial_puts(" rects\n  Average:     ");
+    serial_puts_num(frame_stats.avg_pixels);
+    serial_puts(" px\n  Peak:        ");
+    serial_puts_num(frame_stats.peak_pixels);
+    serial_puts(" px\n  To VRAM:     ");
+    serial_puts_num(frame_stats.last_vram_bytes);
+    serial_puts(" bytes last frame\n  Skipped:     ");
+    serial_puts_num(frame_stats.skipped);
+    serial_puts(" frames without damage\n===================\n");
+}
+
 // ===== СИСТЕМА КЭШИРОВАНИЯ ФОНА =====
 
 void vesa_cache_background(void) {
@@ -589,28 +932,11 @@ void vesa_cache_background(void) {
         return;
     }
     
-    uint32_t bg_color = 0xC0C0C0;  // Светло-серый
-    uint8_t r = (bg_color >> 16) & 0xFF;
-    uint8_t g = (bg_color >> 8) & 0xFF;
-    uint8_t b = bg_color & 0xFF;
+    span_pattern_t pat;
+    span_pattern(0xC0C0C0, &pat);  // Светло-серый
     
-    uint32_t bytes_per_pixel = fb.bpp / 8;
-    uint8_t* cache = (uint8_t*)background_cache;
-    
-    if (fb.bpp == 32) {
-        // 32-бит: пишем uint32_t
-        uint32_t* cache32 = (uint32_t*)cache;
-        for (uint32_t i = 0; i < fb.width * fb.height; i++) {
-            cache32[i] = bg_color;
-        }
-    } else if (fb.bpp == 24) {
-        // 24-бит: пишем 3 байта на пиксель
-        for (uint32_t i = 0; i < buffer_size; i += 3) {
-            cache[i] = b;
-            cache[i + 1] = g;
-            cache[i + 2] = r;
-        }
-    }
+    // Кэш хранится без питча: все строки подряд
+    backend->fill_span((uint8_t*)background_cache, fb.width * fb.height, &pat);
     
     background_cached = 1;
     serial_puts("[VESA] Background cached (");
@@ -621,37 +947,61 @@ void vesa_cache_background(void) {
 void vesa_restore_background(void) {
     if (!background_cached || !background_cache || !back_buffer) return;
     
-    size_t total_pixels = fb.width * fb.height;
-    fast_copy((uint32_t*)back_buffer, background_cache, total_pixels);
+    uint32_t row_bytes = fb.width * (fb.bpp / 8);
+    uint8_t* bb = (uint8_t*)back_buffer;
+    uint8_t* cache = (uint8_t*)background_cache;
+    
+    frame_stats.pixels += fb.width * fb.height;
+    
+    if (row_bytes == fb.pitch) {
+        copy_row(bb, cache, row_bytes * fb.height);
+        return;
+    }
+    
+    for (uint32_t y = 0; y < fb.height; y++) {
+        copy_row(bb + y * fb.pitch, cache + y * row_bytes, row_bytes);
+    }
 }
 
 void vesa_restore_background_dirty(void) {
-    if (!background_cached || !background_cache || !back_buffer || dirty_count == 0) return;
+    if (!background_cached || !background_cache || !back_buffer || damage.count == 0) return;
     
     uint32_t bytes_per_pixel = fb.bpp / 8;
     uint8_t* bb = (uint8_t*)back_buffer;
     uint8_t* cache = (uint8_t*)background_cache;
     
-    uint32_t cursor_x, cursor_y, cursor_w, cursor_h;
-    vesa_cursor_get_area(&cursor_x, &cursor_y, &cursor_w, &cursor_h);
-    
-    for (uint32_t i = 0; i < dirty_count; i++) {
-        dirty_rect_t* r = &dirty_rects[i];
+    for (uint32_t i = 0; i < damage.count; i++) {
+        region_rect_t* r = &damage.rects[i];
+        uint32_t row_bytes = (r->x2 - r->x1) * bytes_per_pixel;
         
-        for (uint32_t y = r->y; y < r->y + r->h && y < fb.height; y++) {
+        for (int32_t y = r->y1; y < r->y2; y++) {
             // cache: храним построчно без питча (width * bytes_per_pixel)
-            uint32_t cache_offset = y * fb.width * bytes_per_pixel + r->x * bytes_per_pixel;
+            uint32_t cache_offset = y * fb.width * bytes_per_pixel + r->x1 * bytes_per_pixel;
             
             // back buffer: с учетом питча!
-            uint32_t bb_offset = y * fb.pitch + r->x * bytes_per_pixel;
-            
-            uint32_t copy_bytes = r->w * bytes_per_pixel;
+            uint32_t bb_offset = y * fb.pitch + r->x1 * bytes_per_pixel;
             
-            for (uint32_t x = 0; x < copy_bytes; x++) {
-                bb[bb_offset + x] = cache[cache_offset + x];
-            }
+            copy_row(bb + bb_offset, cache + cache_offset, row_bytes);
         }
+        frame_stats.pixels += (r->x2 - r->x1) * (r->y2 - r->y1);
+    }
+}
+
+void vesa_restore_background_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    if (!background_cached || !background_cache || !back_buffer) return;
+    if (!clip_to_screen(x, y, &w, &h)) return;
+    
+    uint32_t bytes_per_pixel = fb.bpp / 8;
+    uint32_t row_bytes = fb.width * bytes_per_pixel;
+    uint8_t* bb = (uint8_t*)back_buffer + y * fb.pitch + x * bytes_per_pixel;
+    uint8_t* cache = (uint8_t*)background_cache + y * row_bytes + x * bytes_per_pixel;
+    
+    for (uint32_t row = 0; row < h; row++) {
+        copy_row(bb, cache, w * bytes_per_pixel);
+        bb += fb.pitch;
+        cache += row_bytes;
     }
+    frame_stats.pixels += w * h;
 }
 
 void vesa_free_background_cache(void) {
@@ -711,9 +1061,17 @@ int vesa_enable_double_buffer(void) {
         return 0;
     }
     
-    size_t buffer_size = fb.width * fb.height * (fb.bpp / 8);
+    if (back_buffer) {
+        double_buffer_enabled = 1;
+        return 1;
+    }
+    
+    // Строки заднего буфера идут с тем же питчем, что и в видеопамяти
+    size_t buffer_size = fb.pitch * fb.height;
     
     // ВАЖНО: выделяем как void*, никаких кастов!
+    // И при переключении страниц рисование идёт в ОЗУ: смешивание и вывод читают
+    // задний буфер, а чтение некэшируемой видеопамяти стоит как сама отрисовка
     back_buffer = kmalloc(buffer_size);
     
     if (!back_buffer) {
@@ -724,23 +1082,20 @@ int vesa_enable_double_buffer(void) {
     }
     
     // Очищаем буфер
-    uint8_t* buf = (uint8_t*)back_buffer;
-    for (size_t i = 0; i < buffer_size; i++) {
-        buf[i] = 0;
-    }
+    fill_dwords(back_buffer, 0, buffer_size / 4);
+    // Содержимое страниц видеопамяти неизвестно - первый вывод переписывает скрытую целиком
+    if (page_flip) region_set_rect(&lag, 0, 0, fb.width, fb.height);
     
     double_buffer_enabled = 1;
-    serial_puts("[VESA] Double buffering enabled (");
+    serial_puts(page_flip ? "[VESA] Page flipping enabled (" : "[VESA] Double buffering enabled (");
     serial_puts_num(buffer_size);
     serial_puts(" bytes)\n");
     return 1;
 }
 
 void vesa_disable_double_buffer(void) {
-    if (back_buffer) {
-        kfree(back_buffer);
-        back_buffer = NULL;
-    }
+    if (back_buffer) kfree(back_buffer);
+    back_buffer = NULL;
     double_buffer_enabled = 0;
     serial_puts("[VESA] Double buffering disabled\n");
 }
@@ -748,78 +1103,56 @@ void vesa_disable_double_buffer(void) {
 void vesa_swap_buffers(void) {
     if (!double_buffer_enabled || !back_buffer || !fb.found) return;
     
-    uint8_t* fb_ptr = (uint8_t*)fb.address;
-    uint8_t* bb_ptr = (uint8_t*)back_buffer;
-    
-    if (fb.bpp == 32) {
-        // 32-бит: rep movsl (быстро)
-        uint32_t* dst = (uint32_t*)fb_ptr;
-        uint32_t* src = (uint32_t*)bb_ptr;
-        uint32_t words = fb.width * fb.height;
-        asm volatile ("rep movsl" : "+D"(dst), "+S"(src), "+c"(words) : : "memory");
+    if (page_flip) {
+        copy_frame(hidden_page(), back_buffer);
+        flip_pages();
+        region_set_rect(&lag, 0, 0, fb.width, fb.height);
     } else {
-        // 24-бит: копируем по 4 байта, пока можно
-        uint32_t bytes_per_line = fb.width * 3;
-        uint32_t pitch_diff = fb.pitch - bytes_per_line;
-        
-        for (uint32_t y = 0; y < fb.height; y++) {
-            // Копируем строку по 4 байта
-            uint32_t words = bytes_per_line / 4;
-            uint32_t* dst = (uint32_t*)fb_ptr;
-            uint32_t* src = (uint32_t*)bb_ptr;
-            asm volatile ("rep movsl" : "+D"(dst), "+S"(src), "+c"(words) : : "memory");
-            
-            // Остаток 0-3 байта
-            uint32_t rem = bytes_per_line % 4;
-            uint8_t* dst8 = (uint8_t*)dst;
-            uint8_t* src8 = (uint8_t*)src;
-            for (uint32_t i = 0; i < rem; i++) dst8[i] = src8[i];
-            
-            fb_ptr += fb.pitch;
-            bb_ptr += bytes_per_line;
-        }
+        copy_frame((uint8_t*)fb.address, back_buffer);
     }
+    
+    if (dirty_system_initialized) region_clear(&present);
+    frame_end();
 }
 
 void vesa_clear_back_buffer(uint32_t color) {
     if (!double_buffer_enabled || !back_buffer) return;
     
-    uint32_t bytes_per_pixel = fb.bpp / 8;
-    size_t buffer_size = fb.width * fb.height * bytes_per_pixel;
-    uint8_t* buf = (uint8_t*)back_buffer;
-    
-    // Разбиваем цвет на байты
-    uint8_t r = (color >> 16) & 0xFF;
-    uint8_t g = (color >> 8) & 0xFF;
-    uint8_t b = color & 0xFF;
-    
-    if (bytes_per_pixel == 4) {
-        // 32-бит: пишем uint32_t
-        uint32_t* buf32 = (uint32_t*)back_buffer;
-        size_t total_pixels = fb.width * fb.height;
-        for (size_t i = 0; i < total_pixels; i++) {
-            buf32[i] = color;
-        }
-    } else if (bytes_per_pixel == 3) {
-        // 24-бит: пишем 3 байта на пиксель
-        for (size_t i = 0; i < buffer_size; i += 3) {
-            buf[i] = b;
-            buf[i + 1] = g;
-            buf[i + 2] = r;
-        }
-    } else if (bytes_per_pixel == 2) {
-        // 16-бит: RGB565
-        uint16_t rgb565 = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
-        uint16_t* buf16 = (uint16_t*)back_buffer;
-        size_t total_pixels = fb.width * fb.height;
-        for (size_t i = 0; i < total_pixels; i++) {
-            buf16[i] = rgb565;
-        }
-    }
+    span_pattern_t pat;
+    span_pattern(color, &pat);
+    span_fill_rect((uint8_t*)back_buffer, fb.pitch, 0, 0, fb.width, fb.height, &pat);
 }
 
 // ===== ИНИЦИАЛИЗАЦИЯ =====
 
+static void dispi_init(void);
+static void select_backend(void);
+
+#define CPUID_EDX_FXSR  (1 << 24)
+#define CPUID_EDX_SSE2  (1 << 26)
+
+static void enable_sse2(void) {
+    uint32_t eax, ebx, ecx, edx;
+    uint32_t cr0, cr4;
+    
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    if ((edx & (CPUID_EDX_FXSR | CPUID_EDX_SSE2)) != (CPUID_EDX_FXSR | CPUID_EDX_SSE2)) {
+        serial_puts("[VESA] SSE2 not available, using scalar blending\n");
+        return;
+    }
+    
+    // CR0: EM=0, MP=1; CR4: OSFXSR и OSXMMEXCPT
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    cr0 = (cr0 & ~(1u << 2)) | (1u << 1);
+    asm volatile("mov %0, %%cr0" : : "r"(cr0));
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= (1u << 9) | (1u << 10);
+    asm volatile("mov %0, %%cr4" : : "r"(cr4));
+    
+    use_sse2 = 1;
+    serial_puts("[VESA] SSE2 blending enabled\n");
+}
+
 int vesa_init(multiboot_info_t* mb_info) {
     serial_puts("[VESA] Initializing...\n");
     
@@ -878,6 +1211,13 @@ int vesa_init(multiboot_info_t* mb_info) {
     }
     
 init_systems:
+    boot_info = mb_info;
+    fb.vram_size = fb.pitch * fb.height;
+#if VESA_DISPI
+    dispi_init();
+#endif
+    enable_sse2();
+    select_backend();
     vesa_fill(0x000000);
     
     if (vesa_enable_double_buffer()) {
@@ -903,98 +1243,141 @@ init_systems:
 // ===== ПРИМИТИВЫ РИСОВАНИЯ =====
 
 void vesa_put_pixel(uint32_t x, uint32_t y, color_t color) {
-    if(!fb.found || x >= fb.width || y >= fb.height) return;
+    uint32_t w = 1, h = 1;
+    if (!fb.found || !clip_rect(&x, &y, &w, &h)) return;
     
-    uint8_t* buffer;
-    if (double_buffer_enabled && back_buffer) {
-        buffer = (uint8_t*)back_buffer;
-    } else {
-        buffer = (uint8_t*)fb.address;
-    }
-    
-    uint32_t bytes_per_pixel = fb.bpp / 8;
-    uint32_t offset = y * fb.pitch + x * bytes_per_pixel;
-    
-    if (bytes_per_pixel == 4) {
-        // 32-бит
-        uint32_t* buf32 = (uint32_t*)buffer;
-        buf32[y * (fb.pitch / 4) + x] = color;
-    } else if (bytes_per_pixel == 3) {
-        // 24-бит
-        buffer[offset] = color & 0xFF;          // Blue
-        buffer[offset + 1] = (color >> 8) & 0xFF;  // Green
-        buffer[offset + 2] = (color >> 16) & 0xFF; // Red
-    } else if (bytes_per_pixel == 2) {
-        // 16-бит
-        uint16_t* buf16 = (uint16_t*)buffer;
-        uint8_t r = (color >> 16) & 0xFF;
-        uint8_t g = (color >> 8) & 0xFF;
-        uint8_t b = color & 0xFF;
-        uint16_t rgb565 = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
-        buf16[y * (fb.pitch / 2) + x] = rgb565;
-    }
+    backend->copy_span(draw_target() + y * target_pitch() + x * backend->bytes_pp, &color, 1);
 }
 
 color_t vesa_get_pixel(uint32_t x, uint32_t y) {
-    if(!fb.found || x >= fb.width || y >= fb.height) return 0;
+    uint32_t w = 1, h = 1;
+    color_t color = 0;
     
-    uint32_t bytes_per_pixel = fb.bpp / 8;
+    if (!fb.found || !clip_rect(&x, &y, &w, &h)) return 0;
     
-    if (double_buffer_enabled && back_buffer) {
-        uint8_t* buf = (uint8_t*)back_buffer;
-        uint32_t offset = y * fb.pitch + x * bytes_per_pixel;
-        
-        if (bytes_per_pixel == 4) {
-            return ((uint32_t*)buf)[y * (fb.pitch / 4) + x];
-        } else if (bytes_per_pixel == 3) {
-            uint32_t b = buf[offset];
-            uint32_t g = buf[offset + 1];
-            uint32_t r = buf[offset + 2];
-            return (r << 16) | (g << 8) | b;
-        }
-    }
+    backend->read_span(&color, draw_target() + y * target_pitch() + x * backend->bytes_pp, 1);
+    return color;
+}
+
+void vesa_read_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, color_t* out) {
+    int32_t lx = (int32_t)x - target_x;
+    int32_t ly = (int32_t)y - target_y;
+    uint32_t stride = w;
     
-    return 0;
+    if (!fb.found || !out || !clip_rect(&x, &y, &w, &h)) return;
+    
+    // Срезанное слева и сверху сдвигает и приёмник
+    out += (y - ly) * stride + (x - lx);
+    
+    uint32_t pitch = target_pitch();
+    const uint8_t* row = draw_target() + y * pitch + x * backend->bytes_pp;
+    
+    for (uint32_t i = 0; i < h; i++) {
+        backend->read_span(out, row, w);
+        out += stride;
+        row += pitch;
+    }
+}
+
+void vesa_draw_mask16(uint32_t x, uint32_t y, const uint16_t* rows, uint32_t h, color_t color) {
+    int32_t lx = (int32_t)x - target_x;
+    int32_t ly = (int32_t)y - target_y;
+    uint32_t w = 16;
+    
+    if (!fb.found || !rows || !clip_rect(&x, &y, &w, &h)) return;
+    
+    uint32_t col0 = x - lx;
+    uint32_t row0 = y - ly;
+    uint32_t bytes_pp = backend->bytes_pp;
+    uint32_t pitch = target_pitch();
+    uint8_t* row = draw_target() + y * pitch + x * bytes_pp;
+    span_pattern_t pat;
+    span_pattern(color, &pat);
+    
+    // Строка маски - две строки глифа по 8 точек
+    for (uint32_t i = 0; i < h; i++, row += pitch) {
+        uint16_t bits = (uint16_t)(rows[row0 + i] << col0);
+        backend->put_glyph_row(row, bits >> 8, w < 8 ? w : 8, &pat);
+        if (w > 8) backend->put_glyph_row(row + 8 * bytes_pp, bits & 0xFF, w - 8, &pat);
+    }
 }
 
 void vesa_draw_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, color_t color) {
-    if(!fb.found) return;
-    
-    uint32_t max_x = (x + w > fb.width) ? fb.width : x + w;
-    uint32_t max_y = (y + h > fb.height) ? fb.height : y + h;
+    if (!fb.found || !clip_rect(&x, &y, &w, &h)) return;
     
-    for(uint32_t dy = y; dy < max_y; dy++) {
-        for(uint32_t dx = x; dx < max_x; dx++) {
-            vesa_put_pixel(dx, dy, color);
-        }
+    span_pattern_t pat;
+    span_pattern(color, &pat);
+    span_fill_rect(draw_target(), target_pitch(), x, y, w, h, &pat);
+}
+
+void vesa_fill_span(uint32_t x, uint32_t y, uint32_t w, color_t color) {
+    vesa_draw_rect(x, y, w, 1, color);
+}
+
+// Горизонтальный отрезок [x0, x1] в координатах цели с отсечением; концы в любом порядке
+static void line_span(uint8_t* base, int x0, int x1, int y, const span_pattern_t* p) {
+    int width = target ? (int)target->width : (int)fb.width;
+    int height = target ? (int)target->height : (int)fb.height;
+    
+    if (x0 > x1) {
+        int t = x0;
+        x0 = x1;
+        x1 = t;
     }
+    if (y < 0 || y >= height || x1 < 0 || x0 >= width) return;
+    if (x0 < 0) x0 = 0;
+    if (x1 >= width) x1 = width - 1;
+    
+    backend->fill_span(base + y * target_pitch() + x0 * p->bytes_pp, x1 - x0 + 1, p);
 }
 
 void vesa_draw_line(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2, color_t color) {
     if(!fb.found) return;
     
+    uint8_t* base = draw_target();
+    span_pattern_t pat;
+    span_pattern(color, &pat);
+    
+    // Вертикаль: одна точка на строку, без Брезенхэма
+    if (x1 == x2) {
+        uint32_t top = (y1 < y2) ? y1 : y2;
+        vesa_draw_rect(x1, top, 1, ((y1 < y2) ? y2 - y1 : y1 - y2) + 1, color);
+        return;
+    }
+    
+    int x = (int)x1 - target_x, y = (int)y1 - target_y;
+    int end_x = (int)x2 - target_x, end_y = (int)y2 - target_y;
     int dx = (x2 > x1) ? (int)(x2 - x1) : (int)(x1 - x2);
     int dy = (y2 > y1) ? (int)(y2 - y1) : (int)(y1 - y2);
     int sx = (x1 < x2) ? 1 : -1;
     int sy = (y1 < y2) ? 1 : -1;
     int err = dx - dy;
+    int run_x = x;
     
+    // Точки одной строки собираются в отрезок и выводятся одной заливкой
     while(1) {
-        if(x1 < fb.width && y1 < fb.height) {
-            vesa_put_pixel(x1, y1, color);
+        if(x == end_x && y == end_y) {
+            line_span(base, run_x, x, y, &pat);
+            break;
         }
         
-        if(x1 == x2 && y1 == y2) break;
-        
+        int nx = x, ny = y;
         int e2 = err * 2;
         if(e2 > -dy) {
             err -= dy;
-            x1 += sx;
+            nx += sx;
         }
         if(e2 < dx) {
             err += dx;
-            y1 += sy;
+            ny += sy;
+        }
+        
+        if (ny != y) {
+            line_span(base, run_x, x, y, &pat);
+            run_x = nx;
         }
+        x = nx;
+        y = ny;
     }
 }
 
@@ -1005,28 +1388,530 @@ void vesa_fill(color_t color) {
         vesa_clear_back_buffer(color);
         vesa_mark_dirty_all();
     } else {
-        uint32_t bytes_per_pixel = fb.bpp / 8;
-        uint8_t* buf = (uint8_t*)fb.address;
-        size_t buffer_size = fb.height * fb.pitch;
-        
-        uint8_t r = (color >> 16) & 0xFF;
-        uint8_t g = (color >> 8) & 0xFF;
-        uint8_t b = color & 0xFF;
-        
-        if (bytes_per_pixel == 4) {
-            uint32_t* buf32 = (uint32_t*)buf;
-            size_t total_pixels = fb.width * fb.height;
-            for (size_t i = 0; i < total_pixels; i++) {
-                buf32[i] = color;
-            }
-        } else if (bytes_per_pixel == 3) {
-            for (size_t i = 0; i < buffer_size; i += 3) {
-                buf[i] = b;
-                buf[i + 1] = g;
-                buf[i + 2] = r;
-            }
+        span_pattern_t pat;
+        span_pattern(color, &pat);
+        span_fill_rect(front_buffer(), fb.pitch, 0, 0, fb.width, fb.height, &pat);
+    }
+}
+
+// ===== СМЕШИВАНИЕ И БЛИТ =====
+
+// Альфа 0-255 -> вес 0-256: смешивание сдвигом на 8 вместо деления на 255
+static inline uint32_t alpha_weight(uint8_t alpha) {
+    return alpha + (alpha >> 7);
+}
+
+// d + (s - d) * a / 256 сразу для R и B, затем для G
+static inline color_t blend_px(color_t d, color_t s, uint32_t a) {
+    uint32_t na = 256 - a;
+    uint32_t rb = (((s & 0xFF00FF) * a + (d & 0xFF00FF) * na) >> 8) & 0xFF00FF;
+    uint32_t g = (((s & 0x00FF00) * a + (d & 0x00FF00) * na) >> 8) & 0x00FF00;
+    return rb | g;
+}
+
+color_t vesa_blend_color(color_t bg, color_t fg, uint8_t alpha) {
+    return blend_px(bg, fg, alpha_weight(alpha));
+}
+
+// 4 точки за итерацию: байты распаковываются в слова, pmullw на вес, psrlw 8, упаковка обратно.
+// Возвращает, сколько точек обработано; хвост (< 4) досчитывает скалярный код
+__attribute__((target("sse2")))
+static uint32_t sse2_blend_row(uint32_t* dst, const uint32_t* src, uint32_t n, uint32_t a) {
+    v16qi zero = {0};
+    v8hu va = {a, a, a, a, a, a, a, a};
+    v8hu vna = (v8hu){256, 256, 256, 256, 256, 256, 256, 256} - va;
+    uint32_t i;
+    
+    for (i = 0; i + 4 <= n; i += 4) {
+        v16qi s = (v16qi)*(const v2di_u*)(src + i);
+        v16qi d = (v16qi)*(const v2di_u*)(dst + i);
+        v8hu lo = (v8hu)__builtin_ia32_punpcklbw128(s, zero) * va +
+                  (v8hu)__builtin_ia32_punpcklbw128(d, zero) * vna;
+        v8hu hi = (v8hu)__builtin_ia32_punpckhbw128(s, zero) * va +
+                  (v8hu)__builtin_ia32_punpckhbw128(d, zero) * vna;
+        lo = lo >> 8;
+        hi = hi >> 8;
+        *(v2di_u*)(dst + i) = (v2di_u)__builtin_ia32_packuswb128((v8hi)lo, (v8hi)hi);
+    }
+    return i;
+}
+
+// То же для одного цвета: вклад источника s * a считается один раз
+__attribute__((target("sse2")))
+static uint32_t sse2_blend_const_row(uint32_t* dst, color_t color, uint32_t n, uint32_t a) {
+    v16qi zero = {0};
+    v8hu va = {a, a, a, a, a, a, a, a};
+    v8hu vna = (v8hu){256, 256, 256, 256, 256, 256, 256, 256} - va;
+    v16qi s = (v16qi)(__attribute__((vector_size(16))) uint32_t){color, color, color, color};
+    v8hu sa = (v8hu)__builtin_ia32_punpcklbw128(s, zero) * va;
+    uint32_t i;
+    
+    for (i = 0; i + 4 <= n; i += 4) {
+        v16qi d = (v16qi)*(const v2di_u*)(dst + i);
+        v8hu lo = (sa + (v8hu)__builtin_ia32_punpcklbw128(d, zero) * vna) >> 8;
+        v8hu hi = (sa + (v8hu)__builtin_ia32_punpckhbw128(d, zero) * vna) >> 8;
+        *(v2di_u*)(dst + i) = (v2di_u)__builtin_ia32_packuswb128((v8hi)lo, (v8hi)hi);
+    }
+    return i;
+}
+
+// ===== ФОРМАТЫ ТОЧЕК =====
+
+// 32 бит: точка - слово, старший байт не используется
+static void fill_span32(uint8_t* dst, uint32_t count, const span_pattern_t* p) {
+    fill_dwords(dst, p->word[0], count);
+}
+
+static void copy_span32(uint8_t* dst, const color_t* src, uint32_t count) {
+    copy_row(dst, src, count * 4);
+}
+
+static void read_span32(color_t* dst, const uint8_t* src, uint32_t count) {
+    const uint32_t* s = (const uint32_t*)src;
+    for (uint32_t i = 0; i < count; i++) dst[i] = s[i] & 0xFFFFFF;
+}
+
+static void blend_span32(uint8_t* dst, const color_t* src, uint32_t count, uint32_t a) {
+    uint32_t* d = (uint32_t*)dst;
+    for (uint32_t i = 0; i < count; i++) d[i] = blend_px(d[i], src[i], a);
+}
+
+static void blend_color_span32(uint8_t* dst, color_t color, uint32_t count, uint32_t a) {
+    uint32_t* d = (uint32_t*)dst;
+    for (uint32_t i = 0; i < count; i++) d[i] = blend_px(d[i], color, a);
+}
+
+// Хвост (< 4 точек) после ядра SSE2 - скалярный
+static void blend_span32_sse2(uint8_t* dst, const color_t* src, uint32_t count, uint32_t a) {
+    uint32_t i = sse2_blend_row((uint32_t*)dst, src, count, a);
+    blend_span32(dst + i * 4, src + i, count - i, a);
+}
+
+static void blend_color_span32_sse2(uint8_t* dst, color_t color, uint32_t count, uint32_t a) {
+    uint32_t i = sse2_blend_const_row((uint32_t*)dst, color, count, a);
+    blend_color_span32(dst + i * 4, color, count - i, a);
+}
+
+static void put_glyph_row32(uint8_t* dst, uint8_t bits, uint32_t count, const span_pattern_t* p) {
+    uint32_t* d = (uint32_t*)dst;
+    for (uint32_t i = 0; i < count; i++, bits <<= 1) {
+        if (bits & 0x80) d[i] = p->word[0];
+    }
+}
+
+// 24 бит: b g r без выравнивания
+static inline color_t load24(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16);
+}
+
+static inline void store24(uint8_t* p, color_t c) {
+    p[0] = c & 0xFF;
+    p[1] = (c >> 8) & 0xFF;
+    p[2] = (c >> 16) & 0xFF;
+}
+
+static void fill_span24(uint8_t* dst, uint32_t count, const span_pattern_t* p) {
+    const uint8_t* pat = (const uint8_t*)p->word;
+    uint32_t* d = (uint32_t*)dst;
+    
+    // 4 точки - 3 слова
+    for (; count >= 4; count -= 4) {
+        d[0] = p->word[0];
+        d[1] = p->word[1];
+        d[2] = p->word[2];
+        d += 3;
+    }
+    dst = (uint8_t*)d;
+    for (uint32_t i = 0; i < count * 3; i++) dst[i] = pat[i];
+}
+
+static void copy_span24(uint8_t* dst, const color_t* src, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++, dst += 3) store24(dst, src[i]);
+}
+
+static void read_span24(color_t* dst, const uint8_t* src, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++, src += 3) dst[i] = load24(src);
+}
+
+static void blend_span24(uint8_t* dst, const color_t* src, uint32_t count, uint32_t a) {
+    for (uint32_t i = 0; i < count; i++, dst += 3) store24(dst, blend_px(load24(dst), src[i], a));
+}
+
+static void blend_color_span24(uint8_t* dst, color_t color, uint32_t count, uint32_t a) {
+    for (uint32_t i = 0; i < count; i++, dst += 3) store24(dst, blend_px(load24(dst), color, a));
+}
+
+static void put_glyph_row24(uint8_t* dst, uint8_t bits, uint32_t count, const span_pattern_t* p) {
+    const uint8_t* c = (const uint8_t*)p->word;
+    for (uint32_t i = 0; i < count; i++, bits <<= 1, dst += 3) {
+        if (bits & 0x80) {
+            dst[0] = c[0];
+            dst[1] = c[1];
+            dst[2] = c[2];
+        }
+    }
+}
+
+// 16 бит: RGB565
+static void fill_span16(uint8_t* dst, uint32_t count, const span_pattern_t* p) {
+    // Голова до выравнивания на слово, дальше по две точки
+    if (count && ((uint32_t)dst & 2)) {
+        *(uint16_t*)dst = (uint16_t)p->word[0];
+        dst += 2;
+        count--;
+    }
+    fill_dwords(dst, p->word[0], count / 2);
+    if (count & 1) *(uint16_t*)(dst + (count & ~1u) * 2) = (uint16_t)p->word[0];
+}
+
+static void copy_span16(uint8_t* dst, const color_t* src, uint32_t count) {
+    uint16_t* d = (uint16_t*)dst;
+    for (uint32_t i = 0; i < count; i++) d[i] = to_rgb565(src[i]);
+}
+
+static void read_span16(color_t* dst, const uint8_t* src, uint32_t count) {
+    const uint16_t* s = (const uint16_t*)src;
+    for (uint32_t i = 0; i < count; i++) dst[i] = from_rgb565(s[i]);
+}
+
+static void blend_span16(uint8_t* dst, const color_t* src, uint32_t count, uint32_t a) {
+    uint16_t* d = (uint16_t*)dst;
+    for (uint32_t i = 0; i < count; i++) d[i] = to_rgb565(blend_px(from_rgb565(d[i]), src[i], a));
+}
+
+static void blend_color_span16(uint8_t* dst, color_t color, uint32_t count, uint32_t a) {
+    uint16_t* d = (uint16_t*)dst;
+    for (uint32_t i = 0; i < count; i++) d[i] = to_rgb565(blend_px(from_rgb565(d[i]), color, a));
+}
+
+static void put_glyph_row16(uint8_t* dst, uint8_t bits, uint32_t count, const span_pattern_t* p) {
+    uint16_t* d = (uint16_t*)dst;
+    for (uint32_t i = 0; i < count; i++, bits <<= 1) {
+        if (bits & 0x80) d[i] = (uint16_t)p->word[0];
+    }
+}
+
+static const pixel_backend_t backend32 = {
+    4, fill_span32, copy_span32, read_span32, blend_span32, blend_color_span32, put_glyph_row32
+};
+
+static const pixel_backend_t backend32_sse2 = {
+    4, fill_span32, copy_span32, read_span32, blend_span32_sse2, blend_color_span32_sse2, put_glyph_row32
+};
+
+static const pixel_backend_t backend24 = {
+    3, fill_span24, copy_span24, read_span24, blend_span24, blend_color_span24, put_glyph_row24
+};
+
+static const pixel_backend_t backend16 = {
+    2, fill_span16, copy_span16, read_span16, blend_span16, blend_color_span16, put_glyph_row16
+};
+
+// Вызывается при инициализации и смене режима
+static void select_backend(void) {
+    if (fb.bpp == 32) {
+        backend = use_sse2 ? &backend32_sse2 : &backend32;
+    } else if (fb.bpp == 24) {
+        backend = &backend24;
+    } else {
+        backend = &backend16;
+    }
+}
+
+// Отсечение блита: источник по своим размерам, приёмник по экрану
+static int clip_blit(uint32_t* dst_x, uint32_t* dst_y, uint32_t src_width, uint32_t src_height,
+                     uint32_t* src_x, uint32_t* src_y, uint32_t* w, uint32_t* h) {
+    int32_t lx = (int32_t)*dst_x - target_x;
+    int32_t ly = (int32_t)*dst_y - target_y;
+    
+    if (*src_x >= src_width || *src_y >= src_height) return 0;
+    if (*w > src_width - *src_x) *w = src_width - *src_x;
+    if (*h > src_height - *src_y) *h = src_height - *src_y;
+    
+    // Срезанное слева и сверху сдвигает и источник
+    if (lx < 0 && (uint32_t)-lx < *w) *src_x += (uint32_t)-lx;
+    if (ly < 0 && (uint32_t)-ly < *h) *src_y += (uint32_t)-ly;
+    return clip_rect(dst_x, dst_y, w, h);
+}
+
+void vesa_blit(uint32_t dst_x, uint32_t dst_y,
+               uint32_t* src, uint32_t src_width, uint32_t src_height,
+               uint32_t src_x, uint32_t src_y, uint32_t blit_width, uint32_t blit_height) {
+    if (!fb.found || !src) return;
+    if (!clip_blit(&dst_x, &dst_y, src_width, src_height, &src_x, &src_y, &blit_width, &blit_height)) return;
+    
+    uint32_t bytes_pp = fb.bpp / 8;
+    uint32_t pitch = target_pitch();
+    uint8_t* row = draw_target() + dst_y * pitch + dst_x * bytes_pp;
+    const uint32_t* line = src + src_y * src_width + src_x;
+    
+    for (uint32_t y = 0; y < blit_height; y++) {
+        backend->copy_span(row, line, blit_width);
+        row += pitch;
+        line += src_width;
+    }
+}
+
+void vesa_blit_alpha(uint32_t dst_x, uint32_t dst_y,
+                    uint32_t* src, uint32_t src_width, uint32_t src_height,
+                    uint32_t src_x, uint32_t src_y, uint32_t blit_width, uint32_t blit_height,
+                    uint8_t alpha) {
+    if (alpha == 255) {
+        vesa_blit(dst_x, dst_y, src, src_width, src_height, src_x, src_y, blit_width, blit_height);
+        return;
+    }
+    if (!fb.found || !src || alpha == 0) return;
+    if (!clip_blit(&dst_x, &dst_y, src_width, src_height, &src_x, &src_y, &blit_width, &blit_height)) return;
+    
+    uint32_t a = alpha_weight(alpha);
+    uint32_t bytes_pp = fb.bpp / 8;
+    uint32_t pitch = target_pitch();
+    uint8_t* row = draw_target() + dst_y * pitch + dst_x * bytes_pp;
+    const uint32_t* line = src + src_y * src_width + src_x;
+    
+    for (uint32_t y = 0; y < blit_height; y++) {
+        backend->blend_span(row, line, blit_width, a);
+        row += pitch;
+        line += src_width;
+    }
+}
+
+void vesa_fill_alpha(uint32_t x, uint32_t y, uint32_t w, uint32_t h, color_t color, uint8_t alpha) {
+    if (alpha == 255) {
+        vesa_draw_rect(x, y, w, h, color);
+        return;
+    }
+    if (!fb.found || alpha == 0 || !clip_rect(&x, &y, &w, &h)) return;
+    
+    uint32_t a = alpha_weight(alpha);
+    uint32_t bytes_pp = fb.bpp / 8;
+    uint32_t pitch = target_pitch();
+    uint8_t* row = draw_target() + y * pitch + x * bytes_pp;
+    
+    for (uint32_t i = 0; i < h; i++) {
+        backend->blend_color_span(row, color, w, a);
+        row += pitch;
+    }
+}
+
+void vesa_draw_gradient(uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+                       color_t color1, color_t color2, uint8_t vertical) {
+    if (!fb.found) return;
+    
+    // Шаг градиента считается по полному размеру, до отсечения
+    uint32_t steps = vertical ? h : w;
+    int32_t start = vertical ? (int32_t)y - target_y : (int32_t)x - target_x;
+    if (!clip_rect(&x, &y, &w, &h)) return;
+    
+    uint32_t skip = (vertical ? (int32_t)y : (int32_t)x) - start;
+    uint32_t bytes_pp = fb.bpp / 8;
+    uint32_t pitch = target_pitch();
+    uint8_t* row = draw_target() + y * pitch + x * bytes_pp;
+    
+    if (vertical) {
+        // Строка одного цвета - обычная заливка
+        for (uint32_t i = 0; i < h; i++) {
+            span_pattern_t pat;
+            span_pattern(blend_px(color1, color2, steps > 1 ? (skip + i) * 256 / (steps - 1) : 0), &pat);
+            backend->fill_span(row, w, &pat);
+            row += pitch;
+        }
+        return;
+    }
+    
+    // Горизонтальный: первая строка кусками через буфер цветов, остальные - её копии
+    color_t colors[64];
+    for (uint32_t i = 0; i < w; i += 64) {
+        uint32_t n = w - i < 64 ? w - i : 64;
+        for (uint32_t j = 0; j < n; j++) {
+            colors[j] = blend_px(color1, color2, steps > 1 ? (skip + i + j) * 256 / (steps - 1) : 0);
         }
+        backend->copy_span(row + i * bytes_pp, colors, n);
+    }
+    for (uint32_t i = 1; i < h; i++) {
+        copy_row(row + i * pitch, row, w * bytes_pp);
+    }
+}
+
+// ===== ПОВЕРХНОСТИ =====
+
+vesa_surface_t* vesa_surface_create(uint32_t width, uint32_t height) {
+    if (!fb.found || width == 0 || height == 0) return NULL;
+    
+    vesa_surface_t* surface = kmalloc(sizeof(vesa_surface_t));
+    if (!surface) return NULL;
+    
+    // Строка выравнивается на 4 байта, чтобы копии шли dword'ами
+    surface->width = width;
+    surface->height = height;
+    surface->pitch = (width * (fb.bpp / 8) + 3) & ~3u;
+    surface->pixels = kmalloc(surface->pitch * height);
+    if (!surface->pixels) {
+        kfree(surface);
+        return NULL;
+    }
+    return surface;
+}
+
+void vesa_surface_destroy(vesa_surface_t* surface) {
+    if (!surface) return;
+    if (target == surface) vesa_set_target(NULL, 0, 0);
+    kfree(surface->pixels);
+    kfree(surface);
+}
+
+void vesa_set_target(vesa_surface_t* surface, int32_t x, int32_t y) {
+    target = surface;
+    target_x = surface ? x : 0;
+    target_y = surface ? y : 0;
+}
+
+void vesa_surface_present(const vesa_surface_t* surface, int32_t sx, int32_t sy,
+                          uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    if (!fb.found || !surface) return;
+    
+    // Пересечение прямоугольника, поверхности и экрана
+    int32_t x0 = (int32_t)x, y0 = (int32_t)y;
+    int32_t x1 = x0 + (int32_t)w, y1 = y0 + (int32_t)h;
+    if (x0 < sx) x0 = sx;
+    if (y0 < sy) y0 = sy;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > sx + (int32_t)surface->width) x1 = sx + surface->width;
+    if (y1 > sy + (int32_t)surface->height) y1 = sy + surface->height;
+    if (x1 > (int32_t)fb.width) x1 = fb.width;
+    if (y1 > (int32_t)fb.height) y1 = fb.height;
+    if (x0 >= x1 || y0 >= y1) return;
+    
+    uint32_t bytes_pp = fb.bpp / 8;
+    uint8_t* dst = screen_buffer() + y0 * fb.pitch + x0 * bytes_pp;
+    const uint8_t* src = surface->pixels + (y0 - sy) * surface->pitch + (x0 - sx) * bytes_pp;
+    
+    for (int32_t row = y0; row < y1; row++) {
+        copy_row(dst, src, (x1 - x0) * bytes_pp);
+        dst += fb.pitch;
+        src += surface->pitch;
+    }
+    frame_stats.pixels += (x1 - x0) * (y1 - y0);
+}
+
+// ===== РЕЖИМЫ =====
+
+// Мод-лист из VBE controller info, который загрузчик получил от BIOS
+struct vbe_controller_info {
+    char signature[4];
+    uint16_t version;
+    uint32_t oem_string;
+    uint32_t capabilities;
+    uint32_t video_modes;           // Сегмент:смещение списка, конец - 0xFFFF
+    uint16_t total_memory;          // В блоках по 64 КБ
+} __attribute__((packed));
+
+void vesa_list_modes(void) {
+    serial_puts("[VESA] Current mode: ");
+    serial_puts_num(fb.width);
+    serial_puts("x");
+    serial_puts_num(fb.height);
+    serial_puts("x");
+    serial_puts_num(fb.bpp);
+    serial_puts("\n");
+    
+    if (!boot_info || !(boot_info->flags & (1 << 11)) || !boot_info->vbe_control_info) {
+        serial_puts("[VESA] No VBE controller info from bootloader\n");
+        return;
     }
+    
+    struct vbe_controller_info* ctrl = (struct vbe_controller_info*)boot_info->vbe_control_info;
+    const uint16_t* modes = (const uint16_t*)(((ctrl->video_modes >> 16) << 4) + (ctrl->video_modes & 0xFFFF));
+    
+    serial_puts("[VESA] VBE modes (");
+    serial_puts_num(ctrl->total_memory * 64);
+    serial_puts(" KB video memory):");
+    for (uint32_t i = 0; i < 256 && modes[i] != 0xFFFF; i++) {
+        serial_puts(" 0x");
+        serial_puts_num_hex(modes[i]);
+    }
+    serial_puts("\n");
+}
+
+// Режим через регистры DISPI; две страницы, если на них хватает видеопамяти
+static int dispi_set_mode(uint32_t width, uint32_t height, uint32_t bpp) {
+    uint32_t pitch = width * (bpp / 8);
+    uint8_t had_back = double_buffer_enabled;
+    uint8_t flip;
+    
+    if (bpp != 16 && bpp != 24 && bpp != 32) return 0;
+    if (width == 0 || height == 0 || pitch * height > fb.vram_size) return 0;
+    
+    // Задний буфер и кэш фона старого размера больше не годятся
+    vesa_free_background_cache();
+    if (back_buffer) kfree(back_buffer);
+    back_buffer = NULL;
+    page_flip = 0;
+    front_page = 0;
+    
+    flip = pitch * height * 2 <= fb.vram_size;
+    if (!bga_set_mode(width, height, bpp, flip ? height * 2 : height)) {
+        bga_set_mode(fb.width, fb.height, fb.bpp, fb.height);
+        if (had_back) vesa_enable_double_buffer();
+        return 0;
+    }
+    if (bga_read(BGA_INDEX_VIRT_HEIGHT) < height * 2) flip = 0;
+    
+    fb.width = width;
+    fb.height = height;
+    fb.bpp = bpp;
+    fb.pitch = bga_read(BGA_INDEX_VIRT_WIDTH) * (bpp / 8);
+    page_flip = flip;
+    select_backend();
+    
+    serial_puts("[VESA] DISPI mode ");
+    serial_puts_num(width);
+    serial_puts("x");
+    serial_puts_num(height);
+    serial_puts("x");
+    serial_puts_num(bpp);
+    serial_puts(page_flip ? ", page flipping\n" : ", single page\n");
+    
+    if (had_back) vesa_enable_double_buffer();
+    vesa_mark_dirty_all();
+    return 1;
+}
+
+// Вызывается до включения страничной памяти: отображаемый объём видеопамяти
+// берётся с запасом, чтобы режимы, выставленные позже, в него уместились
+static void dispi_init(void) {
+    if (!bga_detect()) return;
+    
+    uint32_t vram = bga_vram_size();
+    if (vram > VESA_VRAM_MAP_MAX) vram = VESA_VRAM_MAP_MAX;
+    if (vram > fb.vram_size) fb.vram_size = vram;
+    dispi = 1;
+    
+    uint32_t width = VESA_DISPI_WIDTH ? VESA_DISPI_WIDTH : fb.width;
+    uint32_t height = VESA_DISPI_HEIGHT ? VESA_DISPI_HEIGHT : fb.height;
+    uint32_t bpp = VESA_DISPI_BPP ? VESA_DISPI_BPP : fb.bpp;
+    
+    if (!dispi_set_mode(width, height, bpp)) {
+        serial_puts("[VESA] DISPI mode set failed, keeping bootloader mode\n");
+    }
+}
+
+// Без DISPI в защищённом режиме сменить режим нечем: принимается только текущий
+int vesa_set_mode(uint32_t width, uint32_t height, uint32_t bpp) {
+    if (!fb.found) return 0;
+    
+    if (width == fb.width && height == fb.height && bpp == fb.bpp) return 1;
+    if (dispi) return dispi_set_mode(width, height, bpp);
+    
+    serial_puts("[VESA] Mode switch not supported: ");
+    serial_puts_num(width);
+    serial_puts("x");
+    serial_puts_num(height);
+    serial_puts("x");
+    serial_puts_num(bpp);
+    serial_puts("\n");
+    return 0;
 }
 
 void vesa_clear(void) {
@@ -1035,27 +1920,141 @@ void vesa_clear(void) {
 
 // ===== ТЕКСТ =====
 
-static uint16_t utf8_to_unicode(const char** str) {
-    uint8_t c = (uint8_t)*(*str)++;
+// Таблица строк глифа для пары цветов: байт строки глифа -> 8 готовых точек в формате кадра.
+// Непрозрачная строка глифа копируется из неё целиком, без разбора по битам
+typedef struct {
+    color_t fg, bg;
+    uint32_t bytes_pp;              // 0 - слот пуст
+    uint32_t stamp;                 // Для вытеснения давно не использованной пары
+    uint8_t rows[256][8 * 4];
+} glyph_lut_t;
+
+static glyph_lut_t glyph_luts[GLYPH_LUT_SLOTS];
+static uint32_t glyph_lut_stamp = 0;
+
+static const glyph_lut_t* glyph_lut(color_t fg, color_t bg) {
+    uint32_t bytes_pp = fb.bpp / 8;
+    glyph_lut_t* lut = &glyph_luts[0];
+    
+    glyph_lut_stamp++;
+    for (uint32_t i = 0; i < GLYPH_LUT_SLOTS; i++) {
+        glyph_lut_t* l = &glyph_luts[i];
+        if (l->bytes_pp == bytes_pp && l->fg == fg && l->bg == bg) {
+            l->stamp = glyph_lut_stamp;
+            return l;
+        }
+        if (l->stamp < lut->stamp) lut = l;
+    }
     
-    if (c < 0x80) return c;
-    if ((c & 0xE0) == 0xC0) {
-        uint8_t c2 = (uint8_t)*(*str)++;
-        if ((c2 & 0xC0) != 0x80) return '?';
-        return ((c & 0x1F) << 6) | (c2 & 0x3F);
+    // Первые bytes_pp байт шаблона - одна точка в любом формате
+    span_pattern_t fg_pat, bg_pat;
+    span_pattern(fg, &fg_pat);
+    span_pattern(bg, &bg_pat);
+    const uint8_t* fg_px = (const uint8_t*)fg_pat.word;
+    const uint8_t* bg_px = (const uint8_t*)bg_pat.word;
+    
+    for (uint32_t v = 0; v < 256; v++) {
+        uint8_t* dst = lut->rows[v];
+        for (uint32_t bit = 0; bit < 8; bit++) {
+            const uint8_t* px = (v & (0x80 >> bit)) ? fg_px : bg_px;
+            for (uint32_t b = 0; b < bytes_pp; b++) *dst++ = px[b];
+        }
     }
-    if ((c & 0xF0) == 0xE0) {
-        (*str) += 2;
-        return '?';
+    
+    lut->fg = fg;
+    lut->bg = bg;
+    lut->bytes_pp = bytes_pp;
+    lut->stamp = glyph_lut_stamp;
+    return lut;
+}
+
+// Строка глифов одной высоты: отсечение один раз на всю строку, вывод построчно слева
+// направо, чтобы запись в буфер шла подряд. NULL в glyphs - пустая клетка
+static void text_run(uint32_t x, uint32_t y, const uint8_t* const* glyphs, uint32_t count,
+                     color_t fg, color_t bg) {
+    int32_t lx = (int32_t)x - target_x;
+    int32_t ly = (int32_t)y - target_y;
+    uint32_t w = count * 8, h = 16;
+    
+    if (!count || !fb.found || !clip_rect(&x, &y, &w, &h)) return;
+    
+    // Срезанное слева начинается с середины первого видимого глифа
+    uint32_t skip = x - lx;
+    uint32_t row0 = y - ly;
+    uint32_t first = skip / 8;
+    uint32_t col0 = skip % 8;
+    uint32_t last = (skip + w + 7) / 8;
+    
+    uint8_t opaque = (bg != 0xFFFFFFFF);
+    const glyph_lut_t* lut = NULL;
+    span_pattern_t fg_pat;
+    uint32_t bytes_pp = fb.bpp / 8;
+    
+    if (opaque) lut = glyph_lut(fg, bg);
+    else span_pattern(fg, &fg_pat);
+    
+    uint32_t pitch = target_pitch();
+    uint8_t* row = draw_target() + y * pitch + x * bytes_pp;
+    
+    for (uint32_t cy = 0; cy < h; cy++, row += pitch) {
+        uint8_t* dst = row;
+        uint32_t left = w;
+        
+        for (uint32_t i = first; i < last; i++) {
+            uint32_t c0 = (i == first) ? col0 : 0;
+            uint32_t cols = 8 - c0;
+            if (cols > left) cols = left;
+            
+            const uint8_t* glyph = glyphs[i];
+            if (glyph) {
+                uint8_t byte = glyph[row0 + cy];
+                if (opaque) copy_row(dst, lut->rows[byte] + c0 * bytes_pp, cols * bytes_pp);
+                else backend->put_glyph_row(dst, byte << c0, cols, &fg_pat);
+            }
+            dst += cols * bytes_pp;
+            left -= cols;
+        }
+    }
+}
+
+// Полный UTF-8: до 4 байт. Битая последовательность даёт '?' и не съедает
+// следующий за ней байт (в том числе завершающий ноль)
+static uint32_t utf8_to_unicode(const char** str) {
+    const uint8_t* s = (const uint8_t*)*str;
+    uint32_t c = *s++;
+    uint32_t len, min;
+    
+    if (c < 0x80) {
+        *str = (const char*)s;
+        return c;
     }
-    if ((c & 0xF8) == 0xF0) {
-        (*str) += 3;
+    
+    if ((c & 0xE0) == 0xC0) {
+        len = 1; min = 0x80; c &= 0x1F;
+    } else if ((c & 0xF0) == 0xE0) {
+        len = 2; min = 0x800; c &= 0x0F;
+    } else if ((c & 0xF8) == 0xF0) {
+        len = 3; min = 0x10000; c &= 0x07;
+    } else {
+        *str = (const char*)s;
         return '?';
     }
-    return '?';
+    
+    for (uint32_t i = 0; i < len; i++, s++) {
+        if ((*s & 0xC0) != 0x80) {
+            *str = (const char*)s;
+            return '?';
+        }
+        c = (c << 6) | (*s & 0x3F);
+    }
+    *str = (const char*)s;
+    
+    // Избыточная запись, суррогаты и всё выше U+10FFFF
+    if (c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) return '?';
+    return c;
 }
 
-static const uint8_t* get_char_data(uint16_t unicode) {
+static const uint8_t* get_char_data(uint32_t unicode) {
     if (unicode >= 32 && unicode < 127) {
         return &font_8x16[(unicode - 32) * 16];
     }
@@ -1079,105 +2078,154 @@ static const uint8_t* get_char_data(uint16_t unicode) {
     return &font_8x16[('?' - 32) * 16];
 }
 
+static uint32_t cp866_to_unicode(uint8_t c) {
+    if (c >= 0x80 && c <= 0x9F) return 0x0410 + (c - 0x80);
+    if (c >= 0xA0 && c <= 0xBF) return 0x0430 + (c - 0xA0);
+    return c;
+}
+
 void vesa_draw_char(uint32_t x, uint32_t y, uint16_t unicode, color_t fg, color_t bg) {
-    const uint8_t* char_data = get_char_data(unicode);
-    if (!char_data) return;
-    
-    for (uint8_t cy = 0; cy < 16; cy++) {
-        uint8_t byte = char_data[cy];
-        for (uint8_t cx = 0; cx < 8; cx++) {
-            uint32_t px = x + cx;
-            uint32_t py = y + cy;
-            
-            if (px >= fb.width || py >= fb.height) continue;
-            
-            if (byte & (1 << (7 - cx))) {
-                vesa_put_pixel(px, py, fg);
-            }
-            else if (bg != 0xFFFFFFFF) {
-                vesa_put_pixel(px, py, bg);
-            }
-        }
-    }
+    const uint8_t* glyph = get_char_data(unicode);
+    if (glyph) text_run(x, y, &glyph, 1, fg, bg);
 }
 
-void vesa_draw_text(uint32_t x, uint32_t y, const char* text, color_t fg, color_t bg) {
+void vesa_draw_text_run(uint32_t x, uint32_t y, const char* text, uint32_t len,
+                        color_t fg, color_t bg) {
+    const uint8_t* glyphs[VESA_TEXT_RUN_MAX];
+    const char* end = text + len;
+    uint32_t count = 0;
+    
     if (!fb.found || !text) return;
     
+    while (text < end && *text && *text != '\n') {
+        glyphs[count++] = get_char_data(utf8_to_unicode(&text));
+        if (count == VESA_TEXT_RUN_MAX) {
+            text_run(x, y, glyphs, count, fg, bg);
+            x += count * 8;
+            count = 0;
+        }
+    }
+    text_run(x, y, glyphs, count, fg, bg);
+}
+
+// Общая раскладка текста: глифы копятся в строку и выводятся одним text_run
+// до перевода строки, табуляции или переноса по краю экрана
+static void draw_text(uint32_t x, uint32_t y, const char* text, uint8_t cp866,
+                      color_t fg, color_t bg) {
+    const uint8_t* glyphs[VESA_TEXT_RUN_MAX];
+    uint32_t count = 0;
+    uint32_t run_x = x;
     uint32_t cx = x;
     uint32_t cy = y;
-    const char* ptr = text;
     
-    while (*ptr) {
-        uint16_t unicode = utf8_to_unicode(&ptr);
+    if (!fb.found || !text) return;
+    
+    while (*text) {
+        uint32_t unicode = cp866 ? cp866_to_unicode((uint8_t)*text++) : utf8_to_unicode(&text);
         
-        if (unicode == '\n') {
-            cx = x;
-            cy += 16;
-        } else if (unicode == '\t') {
-            cx = (cx + 32) & ~31;
+        if (unicode == '\n' || unicode == '\t') {
+            text_run(run_x, cy, glyphs, count, fg, bg);
+            count = 0;
+            if (unicode == '\n') {
+                cx = x;
+                cy += 16;
+            } else {
+                cx = (cx + 32) & ~31;
+            }
+            run_x = cx;
         } else {
-            vesa_draw_char(cx, cy, unicode, fg, bg);
+            glyphs[count++] = get_char_data(unicode);
             cx += 8;
             
             if (cx + 8 > fb.width) {
-                cx = 0;
+                text_run(run_x, cy, glyphs, count, fg, bg);
+                count = 0;
+                cx = run_x = 0;
                 cy += 16;
+            } else if (count == VESA_TEXT_RUN_MAX) {
+                text_run(run_x, cy, glyphs, count, fg, bg);
+                count = 0;
+                run_x = cx;
             }
         }
         
         if (cy + 16 > fb.height) break;
     }
+    text_run(run_x, cy, glyphs, count, fg, bg);
+}
+
+void vesa_draw_text(uint32_t x, uint32_t y, const char* text, color_t fg, color_t bg) {
+    draw_text(x, y, text, 0, fg, bg);
 }
 
 void vesa_draw_text_cp866(uint32_t x, uint32_t y, const char* text, color_t fg, color_t bg) {
-    if (!fb.found || !text) return;
-    
-    uint32_t cx = x;
-    uint32_t cy = y;
-    const char* ptr = text;
-    
-    while (*ptr) {
-        uint8_t c = (uint8_t)*ptr++;
+    draw_text(x, y, text, 1, fg, bg);
+}
+
+void vesa_draw_text_rus(uint32_t x, uint32_t y, const char* text, color_t fg, color_t bg) {
+    vesa_draw_text(x, y, text, fg, bg);
+}
+
+// ===== ЗАМЕР ЗАЛИВКИ =====
+
+// Сколько полноэкранных заливок укладывается в VESA_BENCH_MS
+static uint32_t bench_fills(int per_pixel, uint32_t* ms) {
+    uint32_t count = 0;
+    uint32_t start = timer_get_ticks();
+    uint32_t end = timer_calc_ms(VESA_BENCH_MS);
+    
+    while (!timer_check_ms(end)) {
+        color_t color = (count & 1) ? 0x202020 : 0x404040;
         
-        if (c == '\n') {
-            cx = x;
-            cy += 16;
-        } else if (c == '\t') {
-            cx = (cx + 32) & ~31;
-        } else {
-            uint16_t unicode = c;
-            if (c >= 0x80 && c <= 0xBF) {
-                if (c <= 0x9F) {
-                    unicode = 0x0410 + (c - 0x80);
-                } else {
-                    unicode = 0x0430 + (c - 0xA0);
-                }
-            }
-            vesa_draw_char(cx, cy, unicode, fg, bg);
-            cx += 8;
-            
-            if (cx + 8 > fb.width) {
-                cx = 0;
-                cy += 16;
+        if (per_pixel) {
+            // Прежний путь: vesa_put_pixel на каждую точку
+            for (uint32_t y = 0; y < fb.height; y++) {
+                for (uint32_t x = 0; x < fb.width; x++) vesa_put_pixel(x, y, color);
             }
+        } else {
+            vesa_draw_rect(0, 0, fb.width, fb.height, color);
         }
-        
-        if (cy + 16 > fb.height) break;
+        count++;
     }
+    
+    *ms = TICKS_TO_MS(timer_get_ticks() - start);
+    return count;
 }
 
-void vesa_draw_text_rus(uint32_t x, uint32_t y, const char* text, color_t fg, color_t bg) {
-    vesa_draw_text(x, y, text, fg, bg);
+void vesa_fill_benchmark(void) {
+    uint32_t ms_pixel, ms_span;
+    
+    if (!fb.found) return;
+    
+    uint32_t pixel = bench_fills(1, &ms_pixel);
+    uint32_t span = bench_fills(0, &ms_span);
+    
+    serial_puts("[VESA] Fill benchmark ");
+    serial_puts_num(fb.width);
+    serial_puts("x");
+    serial_puts_num(fb.height);
+    serial_puts("x");
+    serial_puts_num(fb.bpp);
+    serial_puts(":\n  put_pixel: ");
+    serial_puts_num(ms_pixel ? pixel * 1000 / ms_pixel : 0);
+    serial_puts(" fills/s\n  span:      ");
+    serial_puts_num(ms_span ? span * 1000 / ms_span : 0);
+    serial_puts(" fills/s\n");
+    
+    vesa_clear_back_buffer(0x000000);
 }
 
 // ===== СЛУЖЕБНЫЕ ФУНКЦИИ =====
 
 uint32_t vesa_get_width(void) { return fb.width; }
 uint32_t vesa_get_height(void) { return fb.height; }
-uint32_t* vesa_get_framebuffer(void) { return fb.address; }
+uint32_t* vesa_get_framebuffer(void) { return (uint32_t*)front_buffer(); }
 struct fb_info* vesa_get_info(void) { return &fb; }
 
+uint8_t vesa_is_page_flipping(void) {
+    return page_flip && double_buffer_enabled && back_buffer;
+}
+
 uint8_t vesa_is_double_buffer_enabled(void) {
     return double_buffer_enabled && (back_buffer != NULL);
 }
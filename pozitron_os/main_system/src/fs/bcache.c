@@ -0,0 +1,520 @@
+#include "fs/bcache.h"
+#include "kernel/memory.h"
+#include "drivers/serial.h"
+#include "kernel/timer_utils.h"
+#include "lib/string.h"
+#include <stddef.h>
+
+static bcache_buf_t* hash_table[BCACHE_HASH_SIZE];
+
+// LRU: голова - самый свежий буфер, хвост - кандидат на вытеснение
+static bcache_buf_t* lru_head = NULL;
+static bcache_buf_t* lru_tail = NULL;
+
+static bcache_stats_t stats;
+static uint8_t bcache_initialized = 0;
+static uint8_t writeback_enabled = 0;
+static uint32_t next_flush_tick = 0;
+static uint8_t* readahead_buf = NULL;
+
+static uint32_t bcache_hash(disk_t* disk, uint64_t lba) {
+    uint32_t h = (uint32_t)lba ^ (uint32_t)(lba >> 32);
+    h ^= (uint32_t)disk >> 4;
+    h *= 0x9E3779B1;
+    return (h >> 16) & (BCACHE_HASH_SIZE - 1);
+}
+
+static void lru_unlink(bcache_buf_t* b) {
+    if (b->lru_prev) b->lru_prev->lru_next = b->lru_next;
+    else lru_head = b->lru_next;
+    if (b->lru_next) b->lru_next->lru_prev = b->lru_prev;
+    else lru_tail = b->lru_prev;
+    b->lru_prev = NULL;
+    b->lru_next = NULL;
+}
+
+static void lru_push_front(bcache_buf_t* b) {
+    b->lru_prev = NULL;
+    b->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = b;
+    lru_head = b;
+    if (!lru_tail) lru_tail = b;
+}
+
+static void hash_insert(bcache_buf_t* b) {
+    uint32_t h = bcache_hash(b->disk, b->lba);
+    b->hash_next = hash_table[h];
+    hash_table[h] = b;
+}
+
+static void hash_remove(bcache_buf_t* b) {
+    uint32_t h = bcache_hash(b->disk, b->lba);
+    bcache_buf_t** pp = &hash_table[h];
+    while (*pp) {
+        if (*pp == b) {
+            *pp = b->hash_next;
+            b->hash_next = NULL;
+            return;
+        }
+        pp = &(*pp)->hash_next;
+    }
+}
+
+static bcache_buf_t* hash_find(disk_t* disk, uint64_t lba) {
+    bcache_buf_t* b = hash_table[bcache_hash(disk, lba)];
+    while (b) {
+        if (b->disk == disk && b->lba == lba) return b;
+        b = b->hash_next;
+    }
+    return NULL;
+}
+
+static void bcache_set_dirty(bcache_buf_t* b) {
+    if (b->flags & BCACHE_DIRTY) return;
+    b->flags |= BCACHE_DIRTY;
+    stats.dirty++;
+    stats.dirty_bytes += b->size;
+}
+
+static void bcache_clear_dirty(bcache_buf_t* b) {
+    if (!(b->flags & BCACHE_DIRTY)) return;
+    b->flags &= ~BCACHE_DIRTY;
+    stats.dirty--;
+    stats.dirty_bytes -= b->size;
+}
+
+static int bcache_writeout(bcache_buf_t* b) {
+    int rc = disk_write(b->disk, b->lba, b->size / 512, b->data);
+    if (rc != 0) {
+        serial_puts("[BCACHE] Write failed at LBA ");
+        serial_puts_num((uint32_t)b->lba);
+        serial_puts("\n");
+        return rc;
+    }
+    bcache_clear_dirty(b);
+    stats.writes++;
+    return 0;
+}
+
+// Записывает подряд идущие по LBA буферы одной командой
+static int bcache_writeout_run(bcache_buf_t** run, uint32_t count, uint8_t* bounce) {
+    uint32_t offset = 0;
+    uint32_t i;
+    int rc;
+
+    if (count == 1 || !bounce) {
+        rc = 0;
+        for (i = 0; i < count; i++) {
+            if (bcache_writeout(run[i]) != 0) rc = -1;
+        }
+        return rc;
+    }
+
+    for (i = 0; i < count; i++) {
+        memcpy(bounce + offset, run[i]->data, run[i]->size);
+        offset += run[i]->size;
+    }
+
+    rc = disk_write(run[0]->disk, run[0]->lba, offset / 512, bounce);
+    if (rc != 0) {
+        serial_puts("[BCACHE] Write failed at LBA ");
+        serial_puts_num((uint32_t)run[0]->lba);
+        serial_puts("\n");
+        return rc;
+    }
+
+    for (i = 0; i < count; i++) {
+        bcache_clear_dirty(run[i]);
+    }
+    stats.writes++;
+    return 0;
+}
+
+static int bcache_before(bcache_buf_t* a, bcache_buf_t* b) {
+    if (a->disk != b->disk) return (uint32_t)a->disk < (uint32_t)b->disk;
+    return a->lba < b->lba;
+}
+
+static void bcache_sort(bcache_buf_t** list, uint32_t count) {
+    uint32_t gap, i, j;
+
+    for (gap = count / 2; gap > 0; gap /= 2) {
+        for (i = gap; i < count; i++) {
+            bcache_buf_t* tmp = list[i];
+            for (j = i; j >= gap && bcache_before(tmp, list[j - gap]); j -= gap) {
+                list[j] = list[j - gap];
+            }
+            list[j] = tmp;
+        }
+    }
+}
+
+// Сбрасывает все грязные буферы диска (или всех дисков) в порядке возрастания LBA
+static int bcache_flush_dirty(disk_t* disk) {
+    bcache_buf_t** list;
+    bcache_buf_t* b;
+    uint8_t* bounce;
+    uint32_t count = 0;
+    uint32_t start;
+    int ret = 0;
+
+    if (stats.dirty == 0) return 0;
+
+    list = kmalloc(stats.dirty * sizeof(bcache_buf_t*));
+    if (!list) {
+        // Без памяти под список пишем как есть, без сортировки
+        for (b = lru_head; b; b = b->lru_next) {
+            if ((!disk || b->disk == disk) && (b->flags & BCACHE_DIRTY) && !(b->flags & BCACHE_PINNED)) {
+                if (bcache_writeout(b) != 0) ret = -1;
+            }
+        }
+        return ret;
+    }
+
+    for (b = lru_head; b; b = b->lru_next) {
+        if ((!disk || b->disk == disk) && (b->flags & BCACHE_DIRTY) && !(b->flags & BCACHE_PINNED)) {
+            list[count++] = b;
+        }
+    }
+
+    bcache_sort(list, count);
+    bounce = kmalloc_aligned(BCACHE_MAX_IO_SECTORS * 512, 512);
+
+    start = 0;
+    while (start < count) {
+        uint32_t end = start + 1;
+        uint32_t sectors = list[start]->size / 512;
+
+        while (end < count &&
+               list[end]->disk == list[start]->disk &&
+               list[end]->lba == list[end - 1]->lba + list[end - 1]->size / 512 &&
+               sectors + list[end]->size / 512 <= BCACHE_MAX_IO_SECTORS) {
+            sectors += list[end]->size / 512;
+            end++;
+        }
+
+        if (bcache_writeout_run(&list[start], end - start, bounce) != 0) ret = -1;
+        start = end;
+    }
+
+    if (bounce) kfree_aligned(bounce);
+    kfree(list);
+    stats.flushes++;
+    return ret;
+}
+
+static void bcache_free_buf(bcache_buf_t* b) {
+    hash_remove(b);
+    lru_unlink(b);
+    stats.bytes -= b->size;
+    stats.buffers--;
+    kfree_aligned(b->data);
+    kfree(b);
+}
+
+// Вытесняет неиспользуемые чистые буферы с хвоста LRU, пока не освободится need байт
+static int bcache_evict_clean(uint32_t need) {
+    bcache_buf_t* b = lru_tail;
+
+    while (b && stats.bytes + need > stats.limit) {
+        bcache_buf_t* prev = b->lru_prev;
+
+        if (b->refcount == 0 && !(b->flags & BCACHE_DIRTY)) {
+            bcache_free_buf(b);
+            stats.evictions++;
+        }
+
+        b = prev;
+    }
+
+    return (stats.bytes + need <= stats.limit) ? 0 : -1;
+}
+
+static int bcache_evict(uint32_t need) {
+    if (bcache_evict_clean(need) == 0) return 0;
+
+    // Чистых буферов не хватило - сбрасываем грязные пачкой и пробуем снова
+    bcache_flush_dirty(NULL);
+    return bcache_evict_clean(need);
+}
+
+static bcache_buf_t* bcache_alloc(disk_t* disk, uint64_t lba, uint32_t size) {
+    bcache_buf_t* b;
+
+    if (stats.bytes + size > stats.limit && bcache_evict(size) != 0) {
+        serial_puts("[BCACHE] Cache full, all buffers in use\n");
+        return NULL;
+    }
+
+    b = kmalloc(sizeof(bcache_buf_t));
+    if (!b) return NULL;
+
+    memset(b, 0, sizeof(bcache_buf_t));
+    b->data = kmalloc_aligned(size, 512);
+    if (!b->data) {
+        kfree(b);
+        return NULL;
+    }
+
+    b->disk = disk;
+    b->lba = lba;
+    b->size = size;
+
+    hash_insert(b);
+    lru_push_front(b);
+    stats.bytes += size;
+    stats.buffers++;
+
+    return b;
+}
+
+void bcache_init(uint32_t limit) {
+    if (bcache_initialized) return;
+
+    memset(hash_table, 0, sizeof(hash_table));
+    memset(&stats, 0, sizeof(stats));
+    lru_head = NULL;
+    lru_tail = NULL;
+    stats.limit = limit ? limit : BCACHE_DEFAULT_LIMIT;
+    writeback_enabled = 0;
+    next_flush_tick = timer_calc_ms(BCACHE_FLUSH_INTERVAL_MS);
+    bcache_initialized = 1;
+
+    serial_puts("[BCACHE] Initialized, limit ");
+    serial_puts_num(stats.limit / 1024);
+    serial_puts(" KB\n");
+}
+
+void bcache_set_limit(uint32_t limit) {
+    if (limit == 0) return;
+    stats.limit = limit;
+    if (stats.bytes > stats.limit) {
+        bcache_evict(0);
+    }
+}
+
+void bcache_set_writeback(uint8_t enabled) {
+    if (writeback_enabled && !enabled) {
+        bcache_flush_dirty(NULL);
+    }
+    writeback_enabled = enabled ? 1 : 0;
+
+    serial_puts("[BCACHE] Mode: ");
+    serial_puts(writeback_enabled ? "write-back\n" : "write-through\n");
+}
+
+uint8_t bcache_is_writeback(void) {
+    return writeback_enabled;
+}
+
+bcache_buf_t* bcache_get(disk_t* disk, uint64_t lba, uint32_t size) {
+    bcache_buf_t* b;
+
+    if (!disk || size == 0 || (size % 512) != 0) return NULL;
+    if (!bcache_initialized) bcache_init(BCACHE_DEFAULT_LIMIT);
+
+    b = hash_find(disk, lba);
+    if (b) {
+        if (b->size != size) {
+            // Блок другого размера по тому же адресу - старая копия больше не нужна
+            if (b->refcount != 0) return NULL;
+            if ((b->flags & BCACHE_DIRTY) && bcache_writeout(b) != 0) return NULL;
+            bcache_free_buf(b);
+            b = NULL;
+        } else {
+            lru_unlink(b);
+            lru_push_front(b);
+        }
+    }
+
+    if (!b) {
+        b = bcache_alloc(disk, lba, size);
+        if (!b) return NULL;
+    }
+
+    b->refcount++;
+    return b;
+}
+
+bcache_buf_t* bcache_read(disk_t* disk, uint64_t lba, uint32_t size) {
+    bcache_buf_t* b = bcache_get(disk, lba, size);
+    if (!b) return NULL;
+
+    if (b->flags & BCACHE_VALID) {
+        stats.hits++;
+        return b;
+    }
+
+    stats.misses++;
+    if (disk_read(disk, lba, size / 512, b->data) != 0) {
+        bcache_release(b);
+        return NULL;
+    }
+
+    b->flags |= BCACHE_VALID;
+    return b;
+}
+
+int bcache_cached(disk_t* disk, uint64_t lba) {
+    bcache_buf_t* b;
+
+    if (!bcache_initialized) return 0;
+    b = hash_find(disk, lba);
+    return b && (b->flags & BCACHE_VALID);
+}
+
+// Упреждающее чтение: count блоков подряд одной многосекторной командой.
+// Уже закэшированные блоки (в том числе грязные) не перезаписываются.
+int bcache_readahead(disk_t* disk, uint64_t lba, uint32_t count, uint32_t size) {
+    uint32_t spb = size / 512;
+    uint32_t filled = 0;
+    uint32_t i;
+
+    if (!disk || count == 0 || size == 0 || (size % 512) != 0) return 0;
+    if (!bcache_initialized) bcache_init(BCACHE_DEFAULT_LIMIT);
+
+    if (count > BCACHE_MAX_IO_SECTORS / spb) count = BCACHE_MAX_IO_SECTORS / spb;
+    if (count == 0) return 0;
+
+    while (count > 0 && bcache_cached(disk, lba)) {
+        lba += spb;
+        count--;
+    }
+    while (count > 0 && bcache_cached(disk, lba + (uint64_t)(count - 1) * spb)) {
+        count--;
+    }
+    if (count == 0) return 0;
+
+    if (!readahead_buf) {
+        readahead_buf = kmalloc_aligned(BCACHE_MAX_IO_SECTORS * 512, 512);
+        if (!readahead_buf) return 0;
+    }
+
+    if (disk_read(disk, lba, count * spb, readahead_buf) != 0) {
+        return 0;
+    }
+
+    for (i = 0; i < count; i++) {
+        uint64_t blk_lba = lba + (uint64_t)i * spb;
+        bcache_buf_t* b;
+
+        if (bcache_cached(disk, blk_lba)) continue;
+
+        b = bcache_get(disk, blk_lba, size);
+        if (!b) break;
+
+        memcpy(b->data, readahead_buf + i * size, size);
+        b->flags |= BCACHE_VALID;
+        bcache_release(b);
+        filled++;
+    }
+
+    stats.readahead += filled;
+    return filled;
+}
+
+int bcache_write(bcache_buf_t* buf) {
+    if (!buf) return -1;
+
+    buf->flags |= BCACHE_VALID;
+    bcache_set_dirty(buf);
+
+    // Закреплённый буфер уйдёт на место после коммита журнала
+    if (buf->flags & BCACHE_PINNED) return 0;
+
+    if (!writeback_enabled) {
+        return bcache_writeout(buf);
+    }
+
+    if (stats.dirty_bytes > stats.limit / 100 * BCACHE_DIRTY_RATIO) {
+        return bcache_flush_dirty(NULL);
+    }
+
+    return 0;
+}
+
+void bcache_release(bcache_buf_t* buf) {
+    if (!buf || buf->refcount == 0) return;
+    buf->refcount--;
+
+    // Буфер с несчитанными данными держать незачем
+    if (buf->refcount == 0 && !(buf->flags & BCACHE_VALID)) {
+        bcache_free_buf(buf);
+    }
+}
+
+void bcache_pin(bcache_buf_t* buf) {
+    if (!buf || (buf->flags & BCACHE_PINNED)) return;
+    buf->refcount++;
+    buf->flags |= BCACHE_PINNED;
+}
+
+void bcache_unpin(bcache_buf_t* buf) {
+    if (!buf || !(buf->flags & BCACHE_PINNED)) return;
+    buf->flags &= ~BCACHE_PINNED;
+    bcache_release(buf);
+}
+
+int bcache_sync(disk_t* disk) {
+    return bcache_flush_dirty(disk);
+}
+
+// Периодический сброс грязных буферов, вызывается из главного цикла ядра
+void bcache_flusher_poll(void) {
+    if (!bcache_initialized || !writeback_enabled) return;
+    if (!timer_check_ms(next_flush_tick)) return;
+
+    next_flush_tick = timer_calc_ms(BCACHE_FLUSH_INTERVAL_MS);
+
+    if (stats.dirty > 0) {
+        bcache_flush_dirty(NULL);
+    }
+}
+
+void bcache_invalidate(disk_t* disk) {
+    bcache_buf_t* b = lru_head;
+
+    bcache_sync(disk);
+
+    while (b) {
+        bcache_buf_t* next = b->lru_next;
+        if ((!disk || b->disk == disk) && b->refcount == 0) {
+            bcache_free_buf(b);
+        }
+        b = next;
+    }
+}
+
+void bcache_get_stats(bcache_stats_t* out) {
+    if (!out) return;
+    memcpy(out, &stats, sizeof(bcache_stats_t));
+}
+
+void bcache_dump_stats(void) {
+    serial_puts("\n=== BUFFER CACHE ===\n");
+    serial_puts("  Buffers:   ");
+    serial_puts_num(stats.buffers);
+    serial_puts(" (");
+    serial_puts_num(stats.bytes / 1024);
+    serial_puts(" / ");
+    serial_puts_num(stats.limit / 1024);
+    serial_puts(" KB)\n");
+    serial_puts("  Hits:      ");
+    serial_puts_num(stats.hits);
+    serial_puts("\n  Misses:    ");
+    serial_puts_num(stats.misses);
+    serial_puts("\n  Readahead: ");
+    serial_puts_num(stats.readahead);
+    serial_puts("\n  Evictions: ");
+    serial_puts_num(stats.evictions);
+    serial_puts("\n  Writes:    ");
+    serial_puts_num(stats.writes);
+    serial_puts("\n  Flushes:   ");
+    serial_puts_num(stats.flushes);
+    serial_puts("\n  Dirty:     ");
+    serial_puts_num(stats.dirty);
+    serial_puts(" (");
+    serial_puts_num(stats.dirty_bytes / 1024);
+    serial_puts(" KB)");
+    serial_puts("\n====================\n");
+}
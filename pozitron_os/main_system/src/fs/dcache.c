@@ -0,0 +1,213 @@
+#include "fs/dcache.h"
+#include "fs/icache.h"
+#include "drivers/serial.h"
+#include "lib/string.h"
+#include <stddef.h>
+
+static dentry_t dentry_pool[DCACHE_SIZE];
+static dentry_t* hash_table[DCACHE_HASH_SIZE];
+static dentry_t* free_list = NULL;
+
+// LRU: голова - самая свежая запись, хвост - кандидат на вытеснение
+static dentry_t* lru_head = NULL;
+static dentry_t* lru_tail = NULL;
+
+static dcache_stats_t stats;
+
+// FNV-1a по имени, перемешанный с каталогом и ФС
+static uint32_t dcache_hash(struct vfs_superblock* sb, uint32_t parent, const char* name, uint32_t len) {
+    uint32_t h = 2166136261u;
+    for (uint32_t i = 0; i < len; i++) {
+        h ^= (uint8_t)name[i];
+        h *= 16777619u;
+    }
+    h ^= parent * 0x9E3779B1;
+    h ^= (uint32_t)sb >> 4;
+    return h;
+}
+
+static void lru_unlink(dentry_t* d) {
+    if (d->lru_prev) d->lru_prev->lru_next = d->lru_next;
+    else lru_head = d->lru_next;
+    if (d->lru_next) d->lru_next->lru_prev = d->lru_prev;
+    else lru_tail = d->lru_prev;
+    d->lru_prev = NULL;
+    d->lru_next = NULL;
+}
+
+static void lru_push_front(dentry_t* d) {
+    d->lru_prev = NULL;
+    d->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = d;
+    lru_head = d;
+    if (!lru_tail) lru_tail = d;
+}
+
+static void hash_remove(dentry_t* d) {
+    dentry_t** pp = &hash_table[d->hash & (DCACHE_HASH_SIZE - 1)];
+    while (*pp) {
+        if (*pp == d) {
+            *pp = d->hash_next;
+            d->hash_next = NULL;
+            return;
+        }
+        pp = &(*pp)->hash_next;
+    }
+}
+
+static void dentry_free(dentry_t* d) {
+    hash_remove(d);
+    lru_unlink(d);
+    if (d->inode) icache_put(d->inode);
+    d->sb = NULL;
+    d->inode = NULL;
+    d->hash_next = free_list;
+    free_list = d;
+    stats.entries--;
+}
+
+static dentry_t* dentry_find(struct vfs_superblock* sb, uint32_t parent, const char* name,
+                             uint32_t len, uint32_t hash) {
+    dentry_t* d = hash_table[hash & (DCACHE_HASH_SIZE - 1)];
+    while (d) {
+        if (d->hash == hash && d->sb == sb && d->parent == parent &&
+            d->name_len == len && memcmp(d->name, name, len) == 0) {
+            return d;
+        }
+        d = d->hash_next;
+    }
+    return NULL;
+}
+
+void dcache_init(void) {
+    memset(dentry_pool, 0, sizeof(dentry_pool));
+    memset(hash_table, 0, sizeof(hash_table));
+    memset(&stats, 0, sizeof(stats));
+    lru_head = NULL;
+    lru_tail = NULL;
+
+    free_list = NULL;
+    for (int i = DCACHE_SIZE - 1; i >= 0; i--) {
+        dentry_pool[i].hash_next = free_list;
+        free_list = &dentry_pool[i];
+    }
+}
+
+int dcache_lookup(struct vfs_inode* dir, const char* name, uint32_t len, struct vfs_inode** inode) {
+    if (!dir || len >= DCACHE_NAME_INLINE) return 0;
+
+    uint32_t hash = dcache_hash(dir->sb, dir->i_ino, name, len);
+    dentry_t* d = dentry_find(dir->sb, dir->i_ino, name, len, hash);
+    if (!d) {
+        stats.misses++;
+        return 0;
+    }
+
+    if (d != lru_head) {
+        lru_unlink(d);
+        lru_push_front(d);
+    }
+
+    if (d->inode) stats.hits++;
+    else stats.negative_hits++;
+
+    *inode = d->inode;
+    return 1;
+}
+
+void dcache_add(struct vfs_inode* dir, const char* name, uint32_t len, struct vfs_inode* inode) {
+    if (!dir || len == 0 || len >= DCACHE_NAME_INLINE) return;
+
+    uint32_t hash = dcache_hash(dir->sb, dir->i_ino, name, len);
+    dentry_t* d = dentry_find(dir->sb, dir->i_ino, name, len, hash);
+    if (d) {
+        if (inode) icache_hold(inode);
+        if (d->inode) icache_put(d->inode);
+        d->inode = inode;
+        if (d != lru_head) {
+            lru_unlink(d);
+            lru_push_front(d);
+        }
+        return;
+    }
+
+    if (!free_list) {
+        if (!lru_tail) return;
+        dentry_free(lru_tail);
+        stats.evictions++;
+    }
+
+    d = free_list;
+    free_list = d->hash_next;
+
+    d->sb = dir->sb;
+    d->parent = dir->i_ino;
+    d->hash = hash;
+    d->name_len = len;
+    memcpy(d->name, name, len);
+    d->name[len] = '\0';
+    d->inode = inode;
+    if (inode) icache_hold(inode);
+
+    uint32_t h = hash & (DCACHE_HASH_SIZE - 1);
+    d->hash_next = hash_table[h];
+    hash_table[h] = d;
+    lru_push_front(d);
+    stats.entries++;
+}
+
+void dcache_invalidate(struct vfs_inode* dir, const char* name, uint32_t len) {
+    if (!dir || len >= DCACHE_NAME_INLINE) return;
+
+    uint32_t hash = dcache_hash(dir->sb, dir->i_ino, name, len);
+    dentry_t* d = dentry_find(dir->sb, dir->i_ino, name, len, hash);
+    if (d) {
+        dentry_free(d);
+        stats.invalidations++;
+    }
+}
+
+// Удаляет все записи внутри каталога (при rmdir/rename самого каталога)
+void dcache_purge_dir(struct vfs_superblock* sb, uint32_t dir_ino) {
+    dentry_t* d = lru_head;
+    while (d) {
+        dentry_t* next = d->lru_next;
+        if (d->sb == sb && d->parent == dir_ino) {
+            dentry_free(d);
+            stats.invalidations++;
+        }
+        d = next;
+    }
+}
+
+void dcache_purge_sb(struct vfs_superblock* sb) {
+    dentry_t* d = lru_head;
+    while (d) {
+        dentry_t* next = d->lru_next;
+        if (d->sb == sb) dentry_free(d);
+        d = next;
+    }
+}
+
+void dcache_get_stats(dcache_stats_t* out) {
+    if (out) *out = stats;
+}
+
+void dcache_dump_stats(void) {
+    serial_puts("\n=== DENTRY CACHE ===\n");
+    serial_puts("  Entries:   ");
+    serial_puts_num(stats.entries);
+    serial_puts(" / ");
+    serial_puts_num(DCACHE_SIZE);
+    serial_puts("\n  Hits:      ");
+    serial_puts_num(stats.hits);
+    serial_puts("\n  Negative:  ");
+    serial_puts_num(stats.negative_hits);
+    serial_puts("\n  Misses:    ");
+    serial_puts_num(stats.misses);
+    serial_puts("\n  Evictions: ");
+    serial_puts_num(stats.evictions);
+    serial_puts("\n  Invalid:   ");
+    serial_puts_num(stats.invalidations);
+    serial_puts("\n====================\n");
+}
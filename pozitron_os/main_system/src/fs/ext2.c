@@ -2,11 +2,18 @@
 #include "kernel/memory.h"
 #include "drivers/serial.h"
 #include "drivers/disk.h"
+#include "drivers/cmos.h"
+#include "fs/bcache.h"
+#include "fs/icache.h"
+#include "fs/ext2_journal.h"
+#include "kernel/timer_utils.h"
 #include "lib/string.h"
 #include <stddef.h>
 
 #define EXT2_PARTITION_TYPE 0x83
 
+static uint32_t ext2_readahead_max = EXT2_READAHEAD_MAX;
+
 static int ext2_disk_read(disk_t* disk, uint64_t lba, uint32_t count, void* buf) {
     int rc = disk_read(disk, lba, count, buf);
     if (rc != 0) {
@@ -24,35 +31,45 @@ static int ext2_disk_write(disk_t* disk, uint64_t lba, uint32_t count, void* buf
 }
 
 static int ext2_read_block(struct ext2_private* priv, uint32_t block, void* buf) {
-    uint32_t sector = priv->disk->partition_offset + block * (priv->block_size / 512);
+    uint64_t sector = (uint64_t)block * (priv->block_size / 512);
     uint32_t sectors = priv->block_size / 512;
-    return ext2_disk_read(priv->disk, sector, sectors, buf);
+    bcache_buf_t* b = bcache_read(priv->disk, sector, priv->block_size);
+    
+    if (!b) {
+        return ext2_disk_read(priv->disk, sector, sectors, buf);
+    }
+    
+    memcpy(buf, b->data, priv->block_size);
+    bcache_release(b);
+    return 0;
 }
 
 static int ext2_write_block(struct ext2_private* priv, uint32_t block, void* buf) {
-    uint32_t sector = priv->disk->partition_offset + block * (priv->block_size / 512);
+    uint64_t sector = (uint64_t)block * (priv->block_size / 512);
     uint32_t sectors = priv->block_size / 512;
-    return ext2_disk_write(priv->disk, sector, sectors, buf);
-}
-
-static int ext2_read_bitmap(struct ext2_private* priv, uint32_t group, int inode_bitmap) {
-    uint32_t block;
-    if (inode_bitmap) {
-        block = priv->groups[group].bg_inode_bitmap;
-    } else {
-        block = priv->groups[group].bg_block_bitmap;
+    bcache_buf_t* b = bcache_get(priv->disk, sector, priv->block_size);
+    
+    if (!b) {
+        return ext2_disk_write(priv->disk, sector, sectors, buf);
     }
-    return ext2_read_block(priv, block, priv->bitmap_buf);
+    
+    memcpy(b->data, buf, priv->block_size);
+    if (bcache_write(b) != 0) {
+        serial_puts("[EXT2] Disk write warning, continuing...\n");
+    }
+    bcache_release(b);
+    return 0;
 }
 
-static int ext2_write_bitmap(struct ext2_private* priv, uint32_t group, int inode_bitmap) {
+// Битовые карты живут в буферном кэше и правятся на месте - без копий и перечитываний
+static bcache_buf_t* ext2_bitmap_get(struct ext2_private* priv, uint32_t group, int inode_bitmap) {
     uint32_t block;
     if (inode_bitmap) {
         block = priv->groups[group].bg_inode_bitmap;
     } else {
         block = priv->groups[group].bg_block_bitmap;
     }
-    return ext2_write_block(priv, block, priv->bitmap_buf);
+    return bcache_read(priv->disk, (uint64_t)block * (priv->block_size / 512), priv->block_size);
 }
 
 static int ext2_test_bit(uint8_t* bitmap, uint32_t bit) {
@@ -67,89 +84,349 @@ static void ext2_set_bit(uint8_t* bitmap, uint32_t bit, int value) {
     }
 }
 
-static uint32_t ext2_alloc_inode(struct ext2_private* priv, uint32_t group) {
-    uint32_t i;
-    uint32_t inode;
+// Первый нулевой бит в [start, size), по слову за шаг
+static uint32_t ext2_find_zero_bit(const uint8_t* bitmap, uint32_t size, uint32_t start) {
+    const uint32_t* words = (const uint32_t*)bitmap;
+    uint32_t nwords = (size + 31) / 32;
+    uint32_t i = start / 32;
+    uint32_t word;
+    
+    if (start >= size) return size;
+    
+    // Биты до start считаем занятыми
+    word = words[i] | ((1u << (start % 32)) - 1);
+    for (;;) {
+        if (word != 0xFFFFFFFF) {
+            uint32_t bit = i * 32 + __builtin_ctz(~word);
+            return bit < size ? bit : size;
+        }
+        if (++i >= nwords) return size;
+        word = words[i];
+    }
+}
+
+static uint32_t ext2_group_first_block(struct ext2_private* priv, uint32_t group) {
+    return group * priv->blocks_per_group + priv->sb.s_first_data_block;
+}
+
+// Последняя группа может быть короче остальных
+static uint32_t ext2_group_blocks(struct ext2_private* priv, uint32_t group) {
+    uint32_t first = ext2_group_first_block(priv, group);
+    uint32_t left = priv->sb.s_blocks_count - first;
+    return left < priv->blocks_per_group ? left : priv->blocks_per_group;
+}
+
+// Счётчики группы изменились: её блок таблицы и суперблок уйдут на диск при ближайшем сбросе
+static void ext2_group_dirty(struct ext2_private* priv, uint32_t group) {
+    uint32_t block = group / (priv->block_size / sizeof(struct ext2_group_desc));
+    
+    if (!priv->gdt_dirty) return;
     
-    if (group >= priv->groups_count) return 0;
+    if (!priv->sb_dirty) priv->meta_tick = timer_calc_ms(EXT2_META_SYNC_MS);
+    priv->gdt_dirty[block / 32] |= 1u << (block % 32);
+    priv->sb_dirty = 1;
+}
+
+// Группа для нового каталога (Orlov): каталоги верхнего уровня разносятся по
+// свободным группам, вложенные остаются рядом с родителем, пока там есть запас
+static uint32_t ext2_find_group_dir(struct ext2_private* priv, uint32_t parent_group, int top_level) {
+    uint32_t ngroups = priv->groups_count;
+    uint32_t avefreei = priv->sb.s_free_inodes_count / ngroups;
+    uint32_t avefreeb = priv->sb.s_free_blocks_count / ngroups;
+    uint32_t ndirs = 0;
+    uint32_t max_dirs;
+    uint32_t min_inodes;
+    uint32_t min_blocks;
+    uint32_t g;
+    
+    for (g = 0; g < ngroups; g++) ndirs += priv->groups[g].bg_used_dirs_count;
+    
+    if (top_level) {
+        uint32_t start = priv->orlov_rotor++ % ngroups;
+        int best = -1;
+        
+        for (uint32_t i = 0; i < ngroups; i++) {
+            struct ext2_group_desc* d;
+            g = (start + i) % ngroups;
+            d = &priv->groups[g];
+            if (d->bg_free_inodes_count == 0 || d->bg_free_inodes_count < avefreei) continue;
+            if (d->bg_free_blocks_count < avefreeb) continue;
+            if (best < 0 || d->bg_used_dirs_count < priv->groups[best].bg_used_dirs_count) best = g;
+        }
+        if (best >= 0) return best;
+    } else {
+        max_dirs = ndirs / ngroups + priv->inodes_per_group / 16;
+        min_inodes = avefreei > priv->inodes_per_group / 4 ? avefreei - priv->inodes_per_group / 4 : 1;
+        min_blocks = avefreeb > priv->blocks_per_group / 4 ? avefreeb - priv->blocks_per_group / 4 : 0;
+        
+        for (uint32_t i = 0; i < ngroups; i++) {
+            struct ext2_group_desc* d;
+            g = (parent_group + i) % ngroups;
+            d = &priv->groups[g];
+            if (d->bg_used_dirs_count >= max_dirs) continue;
+            if (d->bg_free_inodes_count < min_inodes) continue;
+            if (d->bg_free_blocks_count < min_blocks) continue;
+            return g;
+        }
+    }
     
-    if (ext2_read_bitmap(priv, group, 1) != 0) return 0;
+    for (uint32_t i = 0; i < ngroups; i++) {
+        g = (parent_group + i) % ngroups;
+        if (priv->groups[g].bg_free_inodes_count >= avefreei &&
+            priv->groups[g].bg_free_inodes_count > 0) return g;
+    }
+    for (uint32_t i = 0; i < ngroups; i++) {
+        g = (parent_group + i) % ngroups;
+        if (priv->groups[g].bg_free_inodes_count > 0) return g;
+    }
+    return parent_group;
+}
+
+// Группа для файла: группа каталога, иначе квадратичный, затем линейный поиск
+static uint32_t ext2_find_group_other(struct ext2_private* priv, uint32_t parent_group) {
+    uint32_t ngroups = priv->groups_count;
+    uint32_t g = parent_group;
     
-    for (i = 0; i < priv->inodes_per_group; i++) {
-        if (i + 1 < priv->sb.s_first_ino) continue;
-        if (!ext2_test_bit(priv->bitmap_buf, i)) {
-            ext2_set_bit(priv->bitmap_buf, i, 1);
-            ext2_write_bitmap(priv, group, 1);
-            
-            inode = group * priv->inodes_per_group + i + 1;
-            priv->groups[group].bg_free_inodes_count--;
-            priv->sb.s_free_inodes_count--;
-            
-            return inode;
+    if (priv->groups[g].bg_free_inodes_count && priv->groups[g].bg_free_blocks_count) return g;
+    
+    for (uint32_t j = 1; j < ngroups; j <<= 1) {
+        g = (g + j) % ngroups;
+        if (priv->groups[g].bg_free_inodes_count && priv->groups[g].bg_free_blocks_count) return g;
+    }
+    
+    for (uint32_t i = 0; i < ngroups; i++) {
+        g = (parent_group + i) % ngroups;
+        if (priv->groups[g].bg_free_inodes_count) return g;
+    }
+    return parent_group;
+}
+
+static uint32_t ext2_alloc_inode(struct ext2_private* priv, uint32_t parent_ino, int is_dir) {
+    uint32_t parent_group = (parent_ino - 1) / priv->inodes_per_group;
+    uint32_t group;
+    
+    if (parent_group >= priv->groups_count) parent_group = 0;
+    
+    if (is_dir) {
+        group = ext2_find_group_dir(priv, parent_group, parent_ino == EXT2_ROOT_INO);
+    } else {
+        group = ext2_find_group_other(priv, parent_group);
+    }
+    
+    for (uint32_t n = 0; n < priv->groups_count; n++) {
+        uint32_t g = (group + n) % priv->groups_count;
+        uint32_t start = 0;
+        uint32_t bit;
+        bcache_buf_t* b;
+        
+        if (priv->groups[g].bg_free_inodes_count == 0) continue;
+        
+        if (g == 0 && priv->sb.s_first_ino > 1) start = priv->sb.s_first_ino - 1;
+        
+        b = ext2_bitmap_get(priv, g, 1);
+        if (!b) continue;
+        
+        bit = ext2_find_zero_bit(b->data, priv->inodes_per_group, start);
+        if (bit >= priv->inodes_per_group) {
+            bcache_release(b);
+            continue;
         }
+        
+        ext2_set_bit(b->data, bit, 1);
+        ext2_journal_dirty(priv, b);
+        bcache_release(b);
+        
+        priv->groups[g].bg_free_inodes_count--;
+        priv->sb.s_free_inodes_count--;
+        if (is_dir) priv->groups[g].bg_used_dirs_count++;
+        ext2_group_dirty(priv, g);
+        
+        return g * priv->inodes_per_group + bit + 1;
     }
     
     return 0;
 }
 
-static void ext2_free_inode(struct ext2_private* priv, uint32_t inode) {
+static void ext2_free_inode(struct ext2_private* priv, uint32_t inode, int is_dir) {
     uint32_t group;
     uint32_t index;
+    bcache_buf_t* b;
     
     group = (inode - 1) / priv->inodes_per_group;
     index = (inode - 1) % priv->inodes_per_group;
     
     if (group >= priv->groups_count) return;
     
-    if (ext2_read_bitmap(priv, group, 1) != 0) return;
-    
-    ext2_set_bit(priv->bitmap_buf, index, 0);
-    ext2_write_bitmap(priv, group, 1);
+    b = ext2_bitmap_get(priv, group, 1);
+    if (!b) return;
     
-    priv->groups[group].bg_free_inodes_count++;
-    priv->sb.s_free_inodes_count++;
+    if (ext2_test_bit(b->data, index)) {
+        ext2_set_bit(b->data, index, 0);
+        ext2_journal_dirty(priv, b);
+        
+        priv->groups[group].bg_free_inodes_count++;
+        priv->sb.s_free_inodes_count++;
+        if (is_dir && priv->groups[group].bg_used_dirs_count) priv->groups[group].bg_used_dirs_count--;
+        ext2_group_dirty(priv, group);
+    }
+    bcache_release(b);
 }
 
-static uint32_t ext2_alloc_block(struct ext2_private* priv, uint32_t group) {
-    uint32_t i;
-    uint32_t block;
-    
-    if (group >= priv->groups_count) return 0;
-    
-    if (ext2_read_bitmap(priv, group, 0) != 0) return 0;
+// Выделяет до *count свободных блоков подряд в первом свободном месте от goal.
+// Возвращает первый блок, в *count - сколько реально занято
+static uint32_t ext2_alloc_blocks(struct ext2_private* priv, uint32_t goal, uint32_t* count) {
+    uint32_t first = priv->sb.s_first_data_block;
+    uint32_t group;
     
-    for (i = 0; i < priv->blocks_per_group; i++) {
-        if (!ext2_test_bit(priv->bitmap_buf, i)) {
-            ext2_set_bit(priv->bitmap_buf, i, 1);
-            ext2_write_bitmap(priv, group, 0);
-            
-            block = group * priv->blocks_per_group + i + priv->sb.s_first_data_block;
-            priv->groups[group].bg_free_blocks_count--;
-            priv->sb.s_free_blocks_count--;
-            
-            return block;
+    if (goal < first || goal >= priv->sb.s_blocks_count) goal = first;
+    group = (goal - first) / priv->blocks_per_group;
+    
+    // Группа цели просматривается дважды: от цели и затем с начала
+    for (uint32_t n = 0; n <= priv->groups_count; n++) {
+        uint32_t g = (group + n) % priv->groups_count;
+        uint32_t size = ext2_group_blocks(priv, g);
+        uint32_t start = n == 0 ? (goal - first) % priv->blocks_per_group : 0;
+        uint32_t bit;
+        uint32_t len = 0;
+        bcache_buf_t* b;
+        
+        if (priv->groups[g].bg_free_blocks_count == 0) continue;
+        
+        b = ext2_bitmap_get(priv, g, 0);
+        if (!b) continue;
+        
+        bit = ext2_find_zero_bit(b->data, size, start);
+        if (bit >= size) {
+            bcache_release(b);
+            continue;
+        }
+        
+        while (len < *count && bit + len < size && !ext2_test_bit(b->data, bit + len)) {
+            ext2_set_bit(b->data, bit + len, 1);
+            len++;
         }
+        ext2_journal_dirty(priv, b);
+        bcache_release(b);
+        
+        priv->groups[g].bg_free_blocks_count -= len;
+        priv->sb.s_free_blocks_count -= len;
+        ext2_group_dirty(priv, g);
+        
+        *count = len;
+        return ext2_group_first_block(priv, g) + bit;
     }
     
+    *count = 0;
     return 0;
 }
 
+static uint32_t ext2_alloc_block(struct ext2_private* priv, uint32_t goal) {
+    uint32_t count = 1;
+    return ext2_alloc_blocks(priv, goal, &count);
+}
+
+// Сразу возвращает серию блоков в битовые карты; серия может пересекать границы групп
+void ext2_release_blocks(struct ext2_private* priv, uint32_t block, uint32_t count) {
+    while (count) {
+        uint32_t group;
+        uint32_t index;
+        uint32_t run;
+        uint32_t freed = 0;
+        bcache_buf_t* b;
+        
+        if (block < priv->sb.s_first_data_block) return;
+        
+        group = (block - priv->sb.s_first_data_block) / priv->blocks_per_group;
+        index = (block - priv->sb.s_first_data_block) % priv->blocks_per_group;
+        
+        if (group >= priv->groups_count) return;
+        
+        run = priv->blocks_per_group - index;
+        if (run > count) run = count;
+        
+        b = ext2_bitmap_get(priv, group, 0);
+        if (!b) return;
+        
+        for (uint32_t i = 0; i < run; i++) {
+            if (ext2_test_bit(b->data, index + i)) {
+                ext2_set_bit(b->data, index + i, 0);
+                freed++;
+            }
+        }
+        if (freed) ext2_journal_dirty(priv, b);
+        bcache_release(b);
+        
+        if (freed) {
+            priv->groups[group].bg_free_blocks_count += freed;
+            priv->sb.s_free_blocks_count += freed;
+            ext2_group_dirty(priv, group);
+        }
+        
+        block += run;
+        count -= run;
+    }
+}
+
+// В журналируемой ФС блок остаётся занятым до коммита транзакции, которая его освободила
+static void ext2_free_blocks_run(struct ext2_private* priv, uint32_t block, uint32_t count) {
+    if (ext2_journal_free(priv, block, count) == 0) return;
+    ext2_release_blocks(priv, block, count);
+}
+
 static void ext2_free_block(struct ext2_private* priv, uint32_t block) {
-    uint32_t group;
-    uint32_t index;
+    ext2_free_blocks_run(priv, block, 1);
+}
+
+// Возвращает неиспользованный остаток окна предвыделения
+static void ext2_discard_prealloc(struct ext2_private* priv, struct ext2_inode_info* info) {
+    if (info->prealloc_count) {
+        ext2_free_blocks_run(priv, info->prealloc_block, info->prealloc_count);
+        info->prealloc_count = 0;
+    }
+}
+
+// Блок для inode. Цель - следующий за последним выделенным, так что
+// последовательная запись ложится на диск подряд. Промах по окну
+// предвыделения захватывает новое окно из s_prealloc_blocks блоков
+static uint32_t ext2_new_block(struct ext2_private* priv, struct ext2_inode_info* info) {
+    uint32_t goal;
+    uint32_t window;
+    uint32_t count;
+    uint32_t block;
     
-    group = (block - priv->sb.s_first_data_block) / priv->blocks_per_group;
-    index = (block - priv->sb.s_first_data_block) % priv->blocks_per_group;
+    if (info->last_block) {
+        goal = info->last_block + 1;
+    } else {
+        goal = ext2_group_first_block(priv, info->group);
+    }
     
-    if (group >= priv->groups_count) return;
+    if (info->prealloc_count) {
+        if (info->prealloc_block == goal) {
+            info->prealloc_block++;
+            info->prealloc_count--;
+            info->last_block = goal;
+            return goal;
+        }
+        ext2_discard_prealloc(priv, info);
+    }
     
-    if (ext2_read_bitmap(priv, group, 0) != 0) return;
+    if ((info->raw.i_mode & 0xF000) == EXT2_S_IFDIR) {
+        window = priv->sb.s_prealloc_dir_blocks;
+    } else {
+        window = priv->sb.s_prealloc_blocks ? priv->sb.s_prealloc_blocks : EXT2_PREALLOC_DEFAULT;
+    }
     
-    ext2_set_bit(priv->bitmap_buf, index, 0);
-    ext2_write_bitmap(priv, group, 0);
+    count = 1 + window;
+    block = ext2_alloc_blocks(priv, goal, &count);
+    if (block == 0) return 0;
+    
+    if (count > 1) {
+        info->prealloc_block = block + 1;
+        info->prealloc_count = count - 1;
+    }
     
-    priv->groups[group].bg_free_blocks_count++;
-    priv->sb.s_free_blocks_count++;
+    info->last_block = block;
+    return block;
 }
 
 static int ext2_read_inode(struct ext2_private* priv, uint32_t ino, struct ext2_inode* inode) {
@@ -173,330 +450,1368 @@ static int ext2_read_inode(struct ext2_private* priv, uint32_t ino, struct ext2_
     return 0;
 }
 
-static int ext2_write_inode(struct ext2_private* priv, uint32_t ino, struct ext2_inode* inode) {
-    uint32_t group;
-    uint32_t index;
-    uint32_t table_block;
-    uint32_t offset;
+static int ext2_write_inode(struct ext2_private* priv, uint32_t ino, struct ext2_inode* inode) {
+    uint32_t group;
+    uint32_t index;
+    uint32_t table_block;
+    uint32_t offset;
+    bcache_buf_t* b;
+    
+    if (ino == 0 || ino > priv->sb.s_inodes_count) return -1;
+    
+    group = (ino - 1) / priv->inodes_per_group;
+    index = (ino - 1) % priv->inodes_per_group;
+    table_block = priv->groups[group].bg_inode_table;
+    offset = index * priv->inode_size;
+    
+    // Блок таблицы правится на месте в кэше и уходит в журнал вместе с транзакцией
+    b = bcache_read(priv->disk, (uint64_t)(table_block + offset / priv->block_size) * (priv->block_size / 512),
+                    priv->block_size);
+    if (!b) return -1;
+    
+    memcpy(b->data + (offset % priv->block_size), inode, sizeof(struct ext2_inode));
+    ext2_journal_dirty(priv, b);
+    bcache_release(b);
+    return 0;
+}
+
+// Путь к логическому блоку по дереву i_block: глубина 1 (прямой) .. 4 (тройной косвенный)
+static int ext2_block_path(struct ext2_private* priv, uint32_t lblock, uint32_t offsets[4]) {
+    uint32_t per_block = priv->block_size / 4;
+    
+    if (lblock < 12) {
+        offsets[0] = lblock;
+        return 1;
+    }
+    lblock -= 12;
+    
+    if (lblock < per_block) {
+        offsets[0] = 12;
+        offsets[1] = lblock;
+        return 2;
+    }
+    lblock -= per_block;
+    
+    if (lblock / per_block < per_block) {
+        offsets[0] = 13;
+        offsets[1] = lblock / per_block;
+        offsets[2] = lblock % per_block;
+        return 3;
+    }
+    lblock -= per_block * per_block;
+    
+    if (lblock / per_block / per_block < per_block) {
+        offsets[0] = 14;
+        offsets[1] = lblock / per_block / per_block;
+        offsets[2] = (lblock / per_block) % per_block;
+        offsets[3] = lblock % per_block;
+        return 4;
+    }
+    
+    return -1;
+}
+
+// Проход по косвенным блокам через буферный кэш. *run - сколько следующих
+// указателей в той же таблице продолжают серию (смежные блоки или дыра)
+static int ext2_bmap(struct ext2_private* priv, struct ext2_inode* inode, uint32_t lblock,
+                     uint32_t* pblock, uint32_t* run) {
+    uint32_t offsets[4];
+    uint32_t spb = priv->block_size / 512;
+    uint32_t direct[12];
+    uint32_t* table = direct;
+    uint32_t limit = 12;
+    uint32_t idx;
+    uint32_t n = 1;
+    bcache_buf_t* b = NULL;
+    int depth;
+    
+    depth = ext2_block_path(priv, lblock, offsets);
+    if (depth < 0) return -1;
+    
+    // Указатель в packed-inode может быть невыровнен: прямые блоки читаются из копии
+    memcpy(direct, inode->i_block, sizeof(direct));
+    
+    if (depth > 1) {
+        uint32_t ptr = inode->i_block[offsets[0]];
+        
+        for (int level = 1; level < depth; level++) {
+            if (ptr == 0) {
+                if (b) bcache_release(b);
+                *pblock = 0;
+                *run = 1;
+                return 0;
+            }
+            if (b) bcache_release(b);
+            b = bcache_read(priv->disk, (uint64_t)ptr * spb, priv->block_size);
+            if (!b) return -1;
+            
+            table = (uint32_t*)b->data;
+            if (level < depth - 1) ptr = table[offsets[level]];
+        }
+        limit = priv->block_size / 4;
+    }
+    
+    idx = offsets[depth - 1];
+    *pblock = table[idx];
+    
+    if (*pblock) {
+        while (idx + n < limit && table[idx + n] == *pblock + n) n++;
+    } else {
+        while (idx + n < limit && table[idx + n] == 0) n++;
+    }
+    
+    if (b) bcache_release(b);
+    *run = n;
+    return 0;
+}
+
+static void ext2_map_invalidate(struct ext2_inode_info* info) {
+    memset(info->map, 0, sizeof(info->map));
+    info->map_next = 0;
+}
+
+static void ext2_map_insert(struct ext2_inode_info* info, uint32_t lblock, uint32_t pblock, uint32_t len) {
+    struct ext2_extent* e;
+    
+    // Продолжение уже известной серии (например, через границу косвенного блока)
+    for (int i = 0; i < EXT2_MAP_CACHE; i++) {
+        e = &info->map[i];
+        if (e->len && e->lblock + e->len == lblock && e->pblock + e->len == pblock) {
+            e->len += len;
+            return;
+        }
+    }
+    
+    e = &info->map[info->map_next];
+    info->map_next = (info->map_next + 1) % EXT2_MAP_CACHE;
+    e->lblock = lblock;
+    e->pblock = pblock;
+    e->len = len;
+}
+
+// Отображение логического блока с кэшем серий: дерево косвенных блоков
+// обходится один раз на серию, а не на каждый блок
+static int ext2_map_blocks(struct ext2_private* priv, struct ext2_inode_info* info, uint32_t lblock,
+                           uint32_t max, uint32_t* pblock, uint32_t* run) {
+    for (int i = 0; i < EXT2_MAP_CACHE; i++) {
+        struct ext2_extent* e = &info->map[i];
+        if (e->len && lblock >= e->lblock && lblock - e->lblock < e->len) {
+            *pblock = e->pblock + (lblock - e->lblock);
+            *run = e->len - (lblock - e->lblock);
+            if (*run > max) *run = max;
+            return 0;
+        }
+    }
+    
+    if (ext2_bmap(priv, &info->raw, lblock, pblock, run) != 0) return -1;
+    
+    if (*pblock) ext2_map_insert(info, lblock, *pblock, *run);
+    if (*run > max) *run = max;
+    return 0;
+}
+
+// Новый косвенный блок, обнулённый в кэше
+static uint32_t ext2_alloc_indirect(struct ext2_private* priv, struct ext2_inode_info* info) {
+    uint32_t block = ext2_new_block(priv, info);
+    bcache_buf_t* b;
+    
+    if (block == 0) return 0;
+    
+    b = bcache_get(priv->disk, (uint64_t)block * (priv->block_size / 512), priv->block_size);
+    if (!b) {
+        ext2_free_block(priv, block);
+        return 0;
+    }
+    memset(b->data, 0, priv->block_size);
+    ext2_journal_dirty(priv, b);
+    bcache_release(b);
+    
+    info->raw.i_blocks += priv->block_size / 512;
+    return block;
+}
+
+// Записывает указатель на блок данных, достраивая недостающие косвенные блоки
+static int ext2_set_block(struct ext2_private* priv, struct ext2_inode_info* info,
+                          uint32_t lblock, uint32_t pblock) {
+    struct ext2_inode* inode = &info->raw;
+    uint32_t offsets[4];
+    uint32_t spb = priv->block_size / 512;
+    uint32_t top;
+    uint32_t* slot;
+    bcache_buf_t* b = NULL;
+    int depth;
+    
+    depth = ext2_block_path(priv, lblock, offsets);
+    if (depth < 0) return -1;
+    
+    // Ссылка из inode правится в копии и записывается обратно, пока b == NULL:
+    // указатель в packed-структуру может быть невыровнен
+    top = inode->i_block[offsets[0]];
+    slot = &top;
+    
+    for (int level = 1; level < depth; level++) {
+        if (*slot == 0) {
+            if (pblock == 0) {
+                if (b) bcache_release(b);
+                return 0;
+            }
+            *slot = ext2_alloc_indirect(priv, info);
+            if (*slot == 0) {
+                if (b) bcache_release(b);
+                return -1;
+            }
+            if (b) ext2_journal_dirty(priv, b);
+            else inode->i_block[offsets[0]] = top;
+        }
+        
+        bcache_buf_t* next = bcache_read(priv->disk, (uint64_t)*slot * spb, priv->block_size);
+        if (b) bcache_release(b);
+        b = next;
+        if (!b) return -1;
+        
+        slot = &((uint32_t*)b->data)[offsets[level]];
+    }
+    
+    *slot = pblock;
+    if (b) {
+        ext2_journal_dirty(priv, b);
+        bcache_release(b);
+    } else {
+        inode->i_block[offsets[0]] = top;
+    }
+    
+    if (pblock) {
+        for (int i = 0; i < EXT2_MAP_CACHE; i++) {
+            struct ext2_extent* e = &info->map[i];
+            if (e->len && lblock >= e->lblock && lblock - e->lblock < e->len) e->len = 0;
+        }
+        ext2_map_insert(info, lblock, pblock, 1);
+    } else {
+        ext2_map_invalidate(info);
+    }
+    return 0;
+}
+
+// Освобождает косвенный блок вместе со всем, на что он ссылается.
+// Блоки метаданных отзываются в журнале, чтобы их старые копии не легли поверх новых данных
+static void ext2_free_branch(struct ext2_private* priv, uint32_t block, int depth, int meta) {
+    if (depth > 0) {
+        bcache_buf_t* b = bcache_read(priv->disk, (uint64_t)block * (priv->block_size / 512),
+                                      priv->block_size);
+        if (b) {
+            uint32_t* table = (uint32_t*)b->data;
+            for (uint32_t i = 0; i < priv->block_size / 4; i++) {
+                if (table[i]) ext2_free_branch(priv, table[i], depth - 1, meta);
+            }
+            bcache_release(b);
+        }
+    }
+    if (depth > 0 || meta) ext2_journal_revoke(priv, block);
+    ext2_free_block(priv, block);
+}
+
+// Удаление трогает битовую карту блоков каждой группы, где лежал файл
+static uint32_t ext2_delete_credits(struct ext2_private* priv) {
+    return priv->groups_count + EXT2_CREDITS_DIROP;
+}
+
+static void ext2_free_blocks(struct ext2_private* priv, struct ext2_inode_info* info) {
+    struct ext2_inode* inode = &info->raw;
+    // Блоки каталога журналируются, блоки файла - нет
+    int meta = (inode->i_mode & 0xF000) == EXT2_S_IFDIR;
+    
+    for (int i = 0; i < 12; i++) {
+        if (inode->i_block[i]) ext2_free_branch(priv, inode->i_block[i], 0, meta);
+    }
+    for (int depth = 1; depth <= 3; depth++) {
+        if (inode->i_block[11 + depth]) ext2_free_branch(priv, inode->i_block[11 + depth], depth, meta);
+    }
+    
+    ext2_discard_prealloc(priv, info);
+    
+    memset(inode->i_block, 0, sizeof(inode->i_block));
+    inode->i_blocks = 0;
+    info->last_block = 0;
+    ext2_map_invalidate(info);
+}
+
+// Полные блоки серии - прямо в буфер вызывающего. Блоки, уже лежащие в кэше
+// (возможно, грязные), копируются оттуда, остальные читаются одной командой на отрезок
+static int ext2_read_direct(struct ext2_private* priv, uint32_t block, uint32_t count, uint8_t* dst) {
+    uint32_t spb = priv->block_size / 512;
+    uint32_t max_run = BCACHE_MAX_IO_SECTORS / spb;
+    uint32_t i = 0;
+    
+    if (max_run == 0) max_run = 1;
+    
+    while (i < count) {
+        uint64_t lba = (uint64_t)(block + i) * spb;
+        uint32_t n;
+        
+        if (bcache_cached(priv->disk, lba)) {
+            bcache_buf_t* b = bcache_read(priv->disk, lba, priv->block_size);
+            if (!b) return -1;
+            memcpy(dst + i * priv->block_size, b->data, priv->block_size);
+            bcache_release(b);
+            i++;
+            continue;
+        }
+        
+        n = 1;
+        while (i + n < count && n < max_run &&
+               !bcache_cached(priv->disk, lba + (uint64_t)n * spb)) {
+            n++;
+        }
+        
+        if (disk_read(priv->disk, lba, n * spb, dst + i * priv->block_size) != 0) return -1;
+        i += n;
+    }
+    return 0;
+}
+
+// Часть одного блока через буферный кэш
+static int ext2_read_partial(struct ext2_private* priv, uint32_t block, uint32_t offset,
+                             uint8_t* dst, uint32_t len) {
+    bcache_buf_t* b = bcache_read(priv->disk, (uint64_t)block * (priv->block_size / 512),
+                                  priv->block_size);
+    if (!b) return -1;
+    memcpy(dst, b->data + offset, len);
+    bcache_release(b);
+    return 0;
+}
+
+static int ext2_read_data(struct ext2_private* priv, struct ext2_inode_info* info,
+                          uint32_t offset, void* buf, uint32_t size, uint32_t* bytes_read) {
+    struct ext2_inode* inode = &info->raw;
+    uint32_t spb = priv->block_size / 512;
+    uint8_t* dst = (uint8_t*)buf;
+    uint32_t read = 0;
+    
+    if (offset >= inode->i_size) {
+        *bytes_read = 0;
+        return 0;
+    }
+    if (offset + size > inode->i_size) size = inode->i_size - offset;
+    
+    while (read < size) {
+        uint32_t lblock = (offset + read) / priv->block_size;
+        uint32_t block_offset = (offset + read) % priv->block_size;
+        uint32_t want = (block_offset + (size - read) + priv->block_size - 1) / priv->block_size;
+        uint32_t block;
+        uint32_t run;
+        uint32_t full;
+        
+        if (ext2_map_blocks(priv, info, lblock, want, &block, &run) != 0) {
+            *bytes_read = read;
+            return -1;
+        }
+        
+        if (block == 0) {
+            uint32_t to_read = run * priv->block_size - block_offset;
+            if (to_read > size - read) to_read = size - read;
+            memset(dst + read, 0, to_read);
+            read += to_read;
+            continue;
+        }
+        
+        // Неполный первый блок - через кэш
+        if (block_offset != 0 || size - read < priv->block_size) {
+            uint32_t to_read = priv->block_size - block_offset;
+            if (to_read > size - read) to_read = size - read;
+            
+            if (ext2_read_partial(priv, block, block_offset, dst + read, to_read) != 0) {
+                *bytes_read = read;
+                return -1;
+            }
+            read += to_read;
+            continue;
+        }
+        
+        full = (size - read) / priv->block_size;
+        if (full > run) full = run;
+        
+        if (((uint32_t)(dst + read) & (EXT2_DIRECT_ALIGN - 1)) == 0) {
+            if (ext2_read_direct(priv, block, full, dst + read) != 0) {
+                *bytes_read = read;
+                return -1;
+            }
+        } else {
+            // Невыровненный буфер: серия одной командой в кэш, оттуда копии
+            if (full > 1) {
+                bcache_readahead(priv->disk, (uint64_t)block * spb, full, priv->block_size);
+            }
+            for (uint32_t i = 0; i < full; i++) {
+                if (ext2_read_partial(priv, block + i, 0, dst + read + i * priv->block_size,
+                                      priv->block_size) != 0) {
+                    *bytes_read = read + i * priv->block_size;
+                    return -1;
+                }
+            }
+        }
+        
+        read += full * priv->block_size;
+    }
+    
+    *bytes_read = read;
+    return 0;
+}
+
+static int ext2_write_data(struct ext2_private* priv, struct ext2_inode_info* info,
+                           uint32_t offset, const void* buf, uint32_t size, uint32_t* bytes_written) {
+    struct ext2_inode* inode = &info->raw;
+    uint32_t spb = priv->block_size / 512;
+    uint32_t written = 0;
+    
+    while (written < size) {
+        uint32_t lblock = (offset + written) / priv->block_size;
+        uint32_t block_offset = (offset + written) % priv->block_size;
+        uint32_t want = (block_offset + (size - written) + priv->block_size - 1) / priv->block_size;
+        uint32_t block;
+        uint32_t run;
+        int fresh = 0;
+        
+        if (ext2_map_blocks(priv, info, lblock, want, &block, &run) != 0) {
+            *bytes_written = written;
+            return -1;
+        }
+        
+        if (block == 0) {
+            block = ext2_new_block(priv, info);
+            if (block == 0) {
+                *bytes_written = written;
+                return -1;
+            }
+            if (ext2_set_block(priv, info, lblock, block) != 0) {
+                ext2_free_block(priv, block);
+                *bytes_written = written;
+                return -1;
+            }
+            inode->i_blocks += spb;
+            run = 1;
+            fresh = 1;
+        }
+        
+        for (uint32_t i = 0; i < run && written < size; i++) {
+            uint32_t to_write = priv->block_size - block_offset;
+            uint64_t sector = (uint64_t)(block + i) * spb;
+            bcache_buf_t* b;
+            
+            if (to_write > size - written) to_write = size - written;
+            
+            // Блок перезаписывается целиком или только что выделен - читать его незачем
+            if (to_write == priv->block_size || fresh) {
+                b = bcache_get(priv->disk, sector, priv->block_size);
+                if (b && to_write != priv->block_size) memset(b->data, 0, priv->block_size);
+            } else {
+                b = bcache_read(priv->disk, sector, priv->block_size);
+            }
+            
+            if (b) {
+                memcpy(b->data + block_offset, (const uint8_t*)buf + written, to_write);
+                bcache_write(b);
+                bcache_release(b);
+            } else {
+                if (fresh) memset(priv->block_buf, 0, priv->block_size);
+                else if (ext2_read_block(priv, block + i, priv->block_buf) != 0) {
+                    *bytes_written = written;
+                    return -1;
+                }
+                memcpy(priv->block_buf + block_offset, (const uint8_t*)buf + written, to_write);
+                if (ext2_write_block(priv, block + i, priv->block_buf) != 0) {
+                    *bytes_written = written;
+                    return -1;
+                }
+            }
+            
+            written += to_write;
+            block_offset = 0;
+            
+            if (offset + written > inode->i_size) {
+                inode->i_size = offset + written;
+            }
+        }
+    }
+    
+    *bytes_written = written;
+    return 0;
+}
+
+// Переносит поля из копии с диска в общую часть inode
+static void ext2_update_vfs_inode(vfs_inode_t* inode) {
+    struct ext2_inode* raw = &EXT2_I(inode)->raw;
+    
+    inode->i_mode = raw->i_mode;
+    inode->i_uid = raw->i_uid;
+    inode->i_gid = raw->i_gid;
+    inode->i_size = raw->i_size;
+    inode->i_atime = raw->i_atime;
+    inode->i_mtime = raw->i_mtime;
+    inode->i_ctime = raw->i_ctime;
+    inode->i_blocks = raw->i_blocks;
+    inode->i_nlink = raw->i_links_count;
+}
+
+static int ext2_sync(struct vfs_superblock* sb) {
+    struct ext2_private* priv = (struct ext2_private*)sb->private_data;
+    int ret = 0;
+    
+    if (!priv || !priv->disk) return 0;
+    
+    if (icache_sync(sb) != 0) ret = -1;
+    if (ext2_flush_meta(priv) != 0) ret = -1;
+    if (ext2_journal_commit(priv) != 0) ret = -1;
+    if (bcache_sync(priv->disk) != 0) ret = -1;
+    
+    if (priv->disk->flush && priv->disk->flush(priv->disk) != 0) ret = -1;
+    
+    return ret;
+}
+
+// ============ Каталоги ============
+
+// Положение записи каталога: буфер блока удерживается до bcache_release
+struct ext2_dir_slot {
+    bcache_buf_t* buf;
+    struct ext2_dir_entry* de;
+    struct ext2_dir_entry* prev;     // NULL - запись первая в блоке
+};
+
+// Блок каталога прямо из буферного кэша: правки делаются на месте и отдаются в журнал (ext2_journal_dirty)
+static bcache_buf_t* ext2_dir_bread(struct ext2_private* priv, struct ext2_inode* dir, uint32_t lblock) {
+    uint32_t block;
+    uint32_t run;
+    
+    if (ext2_bmap(priv, dir, lblock, &block, &run) != 0 || block == 0) return NULL;
+    return bcache_read(priv->disk, (uint64_t)block * (priv->block_size / 512), priv->block_size);
+}
+
+static int ext2_dirent_ok(struct ext2_private* priv, struct ext2_dir_entry* de, uint32_t offset) {
+    return de->rec_len >= 8 && (de->rec_len & 3) == 0 &&
+           offset + de->rec_len <= priv->block_size &&
+           (uint32_t)de->name_len + 8 <= de->rec_len;
+}
+
+static struct ext2_dir_entry* ext2_find_in_block(struct ext2_private* priv, uint8_t* data,
+                                                 const char* name, uint32_t len,
+                                                 struct ext2_dir_entry** prev_out) {
+    struct ext2_dir_entry* prev = NULL;
+    uint32_t offset = 0;
+    
+    while (offset < priv->block_size) {
+        struct ext2_dir_entry* de = (struct ext2_dir_entry*)(data + offset);
+        
+        if (!ext2_dirent_ok(priv, de, offset)) return NULL;
+        
+        if (de->inode != 0 && de->name_len == len && memcmp(de->name, name, len) == 0) {
+            if (prev_out) *prev_out = prev;
+            return de;
+        }
+        
+        prev = de;
+        offset += de->rec_len;
+    }
+    return NULL;
+}
+
+// Занимает пустую запись или хвост живой записи, если в блоке хватает места
+static int ext2_insert_in_block(struct ext2_private* priv, uint8_t* data, const char* name,
+                                uint32_t len, uint32_t ino, uint8_t type) {
+    uint32_t need = EXT2_DIR_REC_LEN(len);
+    uint32_t offset = 0;
+    
+    while (offset < priv->block_size) {
+        struct ext2_dir_entry* de = (struct ext2_dir_entry*)(data + offset);
+        uint32_t used;
+        
+        if (!ext2_dirent_ok(priv, de, offset)) return -1;
+        used = EXT2_DIR_REC_LEN(de->name_len);
+        
+        if (de->inode == 0 && de->rec_len >= need) {
+            break;
+        }
+        // Испорченная запись короче своего имени: хвоста у неё нет
+        if (de->inode != 0 && de->rec_len >= used && de->rec_len - used >= need) {
+            struct ext2_dir_entry* next = (struct ext2_dir_entry*)((uint8_t*)de + used);
+            next->rec_len = de->rec_len - used;
+            de->rec_len = used;
+            offset += used;
+            break;
+        }
+        offset += de->rec_len;
+    }
+    
+    if (offset >= priv->block_size) return -1;
+    
+    struct ext2_dir_entry* de = (struct ext2_dir_entry*)(data + offset);
+    de->inode = ino;
+    de->name_len = len;
+    de->file_type = type;
+    memcpy(de->name, name, len);
+    return 0;
+}
+
+// Добавляет каталогу пустой блок из одной свободной записи
+static bcache_buf_t* ext2_dir_append(struct ext2_private* priv, vfs_inode_t* dir, uint32_t* lblock_out) {
+    struct ext2_inode* raw = &EXT2_I(dir)->raw;
+    uint32_t lblock = raw->i_size / priv->block_size;
+    uint32_t block;
+    bcache_buf_t* b;
+    struct ext2_dir_entry* de;
+    
+    block = ext2_new_block(priv, EXT2_I(dir));
+    if (block == 0) return NULL;
+    
+    if (ext2_set_block(priv, EXT2_I(dir), lblock, block) != 0) {
+        ext2_free_block(priv, block);
+        return NULL;
+    }
+    
+    b = bcache_get(priv->disk, (uint64_t)block * (priv->block_size / 512), priv->block_size);
+    if (!b) {
+        ext2_set_block(priv, EXT2_I(dir), lblock, 0);
+        ext2_free_block(priv, block);
+        return NULL;
+    }
+    
+    memset(b->data, 0, priv->block_size);
+    de = (struct ext2_dir_entry*)b->data;
+    de->rec_len = priv->block_size;
+    
+    raw->i_size += priv->block_size;
+    raw->i_blocks += priv->block_size / 512;
+    ext2_update_vfs_inode(dir);
+    icache_mark_dirty(dir);
+    
+    *lblock_out = lblock;
+    return b;
+}
+
+// ============ HTree (dir_index) ============
+
+struct dx_frame {
+    bcache_buf_t* buf;
+    struct ext2_dx_entry* entries;
+    struct ext2_dx_entry* at;
+};
+
+struct dx_hash_info {
+    uint32_t hash;
+    uint32_t version;
+    uint32_t seed[4];
+};
+
+// Элемент карты листа при расщеплении
+struct dx_map_entry {
+    uint32_t hash;
+    uint16_t offs;
+};
+
+#define DX_BAD_INDEX (-2)
+
+static struct ext2_dx_countlimit* dx_cl(struct ext2_dx_entry* entries) {
+    return (struct ext2_dx_countlimit*)entries;
+}
+
+static uint32_t dx_root_limit(struct ext2_private* priv) {
+    return (priv->block_size - 32) / sizeof(struct ext2_dx_entry);
+}
+
+static uint32_t dx_node_limit(struct ext2_private* priv) {
+    return (priv->block_size - 8) / sizeof(struct ext2_dx_entry);
+}
+
+static void dx_release(struct dx_frame* frames, uint32_t levels) {
+    for (uint32_t i = 0; i <= levels; i++) {
+        if (frames[i].buf) bcache_release(frames[i].buf);
+        frames[i].buf = NULL;
+    }
+}
+
+static void dx_hash_setup(struct ext2_private* priv, struct ext2_dx_root_info* info,
+                          struct dx_hash_info* hinfo) {
+    hinfo->version = info->hash_version;
+    if (hinfo->version <= EXT2_DX_HASH_TEA && (priv->sb.s_flags & EXT2_FLAGS_UNSIGNED_HASH)) {
+        hinfo->version += 3;
+    }
+    // Копия: указатель в packed-суперблок может быть невыровнен
+    memcpy(hinfo->seed, priv->sb.s_hash_seed, sizeof(hinfo->seed));
+}
+
+// Спуск от корня к листу. DX_BAD_INDEX - индекс испорчен, каталог читается линейно
+static int dx_probe(struct ext2_private* priv, struct ext2_inode* dir, const char* name, uint32_t len,
+                    struct dx_hash_info* hinfo, struct dx_frame* frames, uint32_t* levels_out) {
+    struct ext2_dx_root_info* info;
+    struct ext2_dx_entry* entries;
+    uint32_t levels;
+    uint32_t limit;
+    bcache_buf_t* b;
+    
+    memset(frames, 0, sizeof(struct dx_frame) * EXT2_DX_MAX_LEVELS);
+    
+    b = ext2_dir_bread(priv, dir, 0);
+    if (!b) return -1;
+    
+    info = (struct ext2_dx_root_info*)(b->data + 24);
+    if (info->reserved_zero != 0 || info->info_length != 8 ||
+        info->indirect_levels >= EXT2_DX_MAX_LEVELS || info->hash_version > EXT2_DX_HASH_TEA) {
+        bcache_release(b);
+        return DX_BAD_INDEX;
+    }
+    
+    dx_hash_setup(priv, info, hinfo);
+    if (ext2_dirhash(name, len, hinfo->version, hinfo->seed, &hinfo->hash, NULL) != 0) {
+        bcache_release(b);
+        return DX_BAD_INDEX;
+    }
+    
+    levels = info->indirect_levels;
+    entries = (struct ext2_dx_entry*)(b->data + 24 + info->info_length);
+    limit = dx_root_limit(priv);
+    
+    for (uint32_t level = 0; ; level++) {
+        struct ext2_dx_countlimit* cl = dx_cl(entries);
+        struct ext2_dx_entry* p;
+        struct ext2_dx_entry* q;
+        
+        frames[level].buf = b;
+        
+        if (cl->limit != limit || cl->count == 0 || cl->count > cl->limit) {
+            dx_release(frames, level);
+            return DX_BAD_INDEX;
+        }
+        
+        // Последняя запись с hash <= искомого; нулевая покрывает всё ниже первой
+        p = entries + 1;
+        q = entries + cl->count - 1;
+        while (p <= q) {
+            struct ext2_dx_entry* m = p + (q - p) / 2;
+            if (m->hash > hinfo->hash) q = m - 1;
+            else p = m + 1;
+        }
+        
+        frames[level].entries = entries;
+        frames[level].at = p - 1;
+        
+        if (level == levels) break;
+        
+        b = ext2_dir_bread(priv, dir, frames[level].at->block & EXT2_DX_BLOCK_MASK);
+        if (!b) {
+            dx_release(frames, level);
+            return -1;
+        }
+        entries = (struct ext2_dx_entry*)(b->data + 8);
+        limit = dx_node_limit(priv);
+    }
+    
+    *levels_out = levels;
+    return 0;
+}
+
+// Переход к следующему листу, если серия одинаковых хэшей продолжается в нём
+static int dx_next_leaf(struct ext2_private* priv, struct ext2_inode* dir, struct dx_frame* frames,
+                        uint32_t levels, uint32_t hash) {
+    int i = levels;
+    
+    for (;;) {
+        struct dx_frame* f = &frames[i];
+        if (++f->at < f->entries + dx_cl(f->entries)->count) break;
+        if (i == 0) return 0;
+        i--;
+    }
+    
+    if ((frames[i].at->hash & ~1u) != hash) return 0;
+    
+    while (i < (int)levels) {
+        i++;
+        bcache_release(frames[i].buf);
+        frames[i].buf = ext2_dir_bread(priv, dir, frames[i - 1].at->block & EXT2_DX_BLOCK_MASK);
+        if (!frames[i].buf) return -1;
+        frames[i].entries = (struct ext2_dx_entry*)(frames[i].buf->data + 8);
+        frames[i].at = frames[i].entries;
+    }
+    return 1;
+}
+
+static int dx_find(struct ext2_private* priv, struct ext2_inode* dir, const char* name, uint32_t len,
+                   struct ext2_dir_slot* slot) {
+    struct dx_frame frames[EXT2_DX_MAX_LEVELS];
+    struct dx_hash_info hinfo;
+    uint32_t levels;
+    int ret;
+    
+    ret = dx_probe(priv, dir, name, len, &hinfo, frames, &levels);
+    if (ret != 0) return ret;
+    
+    for (;;) {
+        bcache_buf_t* b = ext2_dir_bread(priv, dir, frames[levels].at->block & EXT2_DX_BLOCK_MASK);
+        if (!b) {
+            ret = -1;
+            break;
+        }
+        
+        slot->de = ext2_find_in_block(priv, b->data, name, len, &slot->prev);
+        if (slot->de) {
+            slot->buf = b;
+            ret = 1;
+            break;
+        }
+        bcache_release(b);
+        
+        ret = dx_next_leaf(priv, dir, frames, levels, hinfo.hash);
+        if (ret <= 0) break;
+    }
+    
+    dx_release(frames, levels);
+    return ret;
+}
+
+// Вставка ссылки на блок сразу за frame->at
+static void dx_insert(struct ext2_private* priv, struct dx_frame* frame, uint32_t hash, uint32_t block) {
+    struct ext2_dx_countlimit* cl = dx_cl(frame->entries);
+    struct ext2_dx_entry* at = frame->at + 1;
+    
+    memmove(at + 1, at, (frame->entries + cl->count - at) * sizeof(struct ext2_dx_entry));
+    at->hash = hash;
+    at->block = block;
+    cl->count++;
+    ext2_journal_dirty(priv, frame->buf);
+}
+
+// Плотно укладывает выбранные записи src в блок dst, последняя забирает остаток
+static void dx_pack(struct ext2_private* priv, uint8_t* dst, uint8_t* src,
+                    struct dx_map_entry* map, uint32_t count) {
+    struct ext2_dir_entry* last = NULL;
+    uint32_t offset = 0;
+    
+    for (uint32_t i = 0; i < count; i++) {
+        struct ext2_dir_entry* de = (struct ext2_dir_entry*)(src + map[i].offs);
+        uint32_t rec_len = EXT2_DIR_REC_LEN(de->name_len);
+        
+        last = (struct ext2_dir_entry*)(dst + offset);
+        memcpy(last, de, rec_len);
+        last->rec_len = rec_len;
+        offset += rec_len;
+    }
+    
+    if (last) {
+        last->rec_len += priv->block_size - offset;
+    } else {
+        last = (struct ext2_dir_entry*)dst;
+        last->inode = 0;
+        last->name_len = 0;
+        last->rec_len = priv->block_size;
+    }
+}
+
+// Делит полный лист пополам по хэшам; верхняя половина уходит в новый блок
+static int dx_split_leaf(struct ext2_private* priv, vfs_inode_t* dir, struct dx_frame* parent,
+                         bcache_buf_t* leaf, struct dx_hash_info* hinfo) {
+    struct dx_map_entry* map;
+    uint8_t* copy;
+    bcache_buf_t* nb;
+    uint32_t count = 0;
+    uint32_t offset = 0;
+    uint32_t split;
+    uint32_t hash2;
+    uint32_t lblock;
+    
+    map = kmalloc((priv->block_size / 8) * sizeof(struct dx_map_entry));
+    copy = kmalloc(priv->block_size);
+    if (!map || !copy) {
+        if (map) kfree(map);
+        if (copy) kfree(copy);
+        return -1;
+    }
     
-    if (ino == 0 || ino > priv->sb.s_inodes_count) return -1;
+    memcpy(copy, leaf->data, priv->block_size);
     
-    group = (ino - 1) / priv->inodes_per_group;
-    index = (ino - 1) % priv->inodes_per_group;
-    table_block = priv->groups[group].bg_inode_table;
-    offset = index * priv->inode_size;
+    while (offset < priv->block_size) {
+        struct ext2_dir_entry* de = (struct ext2_dir_entry*)(copy + offset);
+        if (!ext2_dirent_ok(priv, de, offset)) break;
+        if (de->inode != 0) {
+            ext2_dirhash(de->name, de->name_len, hinfo->version, hinfo->seed, &map[count].hash, NULL);
+            map[count].offs = offset;
+            count++;
+        }
+        offset += de->rec_len;
+    }
     
-    if (ext2_read_block(priv, table_block + offset / priv->block_size, priv->inode_buf) != 0) {
+    if (count < 2) {
+        kfree(copy);
+        kfree(map);
         return -1;
     }
     
-    memcpy(priv->inode_buf + (offset % priv->block_size), inode, sizeof(struct ext2_inode));
+    // Вставками: записей в блоке немного, а порядок почти случайный
+    for (uint32_t i = 1; i < count; i++) {
+        struct dx_map_entry m = map[i];
+        uint32_t j = i;
+        while (j > 0 && map[j - 1].hash > m.hash) {
+            map[j] = map[j - 1];
+            j--;
+        }
+        map[j] = m;
+    }
     
-    return ext2_write_block(priv, table_block + offset / priv->block_size, priv->inode_buf);
-}
-
-static int ext2_read_block_from_inode(struct ext2_private* priv, struct ext2_inode* inode, 
-                                       uint32_t block_num, uint32_t* block) {
-    uint32_t indirect[512];
-    uint32_t double_indirect[512];
-    uint32_t i;
-    uint32_t per_block = priv->block_size / 4;
+    split = count / 2;
+    hash2 = map[split].hash;
+    // Одинаковые хэши по обе стороны границы - помечаем продолжение серии
+    if (map[split - 1].hash == hash2) hash2 |= 1;
     
-    if (block_num < 12) {
-        *block = inode->i_block[block_num];
-        return 0;
+    nb = ext2_dir_append(priv, dir, &lblock);
+    if (!nb) {
+        kfree(copy);
+        kfree(map);
+        return -1;
     }
     
-    block_num -= 12;
+    dx_pack(priv, leaf->data, copy, map, split);
+    dx_pack(priv, nb->data, copy, map + split, count - split);
+    ext2_journal_dirty(priv, leaf);
+    ext2_journal_dirty(priv, nb);
+    bcache_release(nb);
     
-    if (block_num < per_block) {
-        if (inode->i_block[12] == 0) return -1;
-        if (ext2_read_block(priv, inode->i_block[12], indirect) != 0) return -1;
-        *block = indirect[block_num];
-        return 0;
-    }
+    dx_insert(priv, parent, hash2, lblock);
     
-    block_num -= per_block;
+    kfree(copy);
+    kfree(map);
+    return 0;
+}
+
+// Корень полон: его записи переезжают в новый узел, дерево становится двухуровневым
+static int dx_grow_root(struct ext2_private* priv, vfs_inode_t* dir, struct dx_frame* root) {
+    struct ext2_dx_root_info* info = (struct ext2_dx_root_info*)(root->buf->data + 24);
+    struct ext2_dx_countlimit* cl = dx_cl(root->entries);
+    struct ext2_dx_entry* node;
+    bcache_buf_t* nb;
+    uint32_t lblock;
+    
+    nb = ext2_dir_append(priv, dir, &lblock);
+    if (!nb) return -1;
+    
+    node = (struct ext2_dx_entry*)(nb->data + 8);
+    memcpy(node, root->entries, cl->count * sizeof(struct ext2_dx_entry));
+    dx_cl(node)->limit = dx_node_limit(priv);
+    dx_cl(node)->count = cl->count;
+    ext2_journal_dirty(priv, nb);
+    bcache_release(nb);
+    
+    cl->count = 1;
+    root->entries[0].block = lblock;
+    info->indirect_levels = 1;
+    ext2_journal_dirty(priv, root->buf);
+    return 0;
+}
+
+// Промежуточный узел полон: вторая половина ссылок уходит в новый узел
+static int dx_split_node(struct ext2_private* priv, vfs_inode_t* dir, struct dx_frame* root,
+                         struct dx_frame* node) {
+    struct ext2_dx_countlimit* cl = dx_cl(node->entries);
+    struct ext2_dx_entry* dst;
+    bcache_buf_t* nb;
+    uint32_t count = cl->count;
+    uint32_t half = count / 2;
+    uint32_t hash2 = node->entries[half].hash;
+    uint32_t lblock;
+    
+    nb = ext2_dir_append(priv, dir, &lblock);
+    if (!nb) return -1;
+    
+    dst = (struct ext2_dx_entry*)(nb->data + 8);
+    memcpy(dst, node->entries + half, (count - half) * sizeof(struct ext2_dx_entry));
+    dx_cl(dst)->limit = dx_node_limit(priv);
+    dx_cl(dst)->count = count - half;
+    ext2_journal_dirty(priv, nb);
+    bcache_release(nb);
+    
+    cl->count = half;
+    ext2_journal_dirty(priv, node->buf);
+    
+    dx_insert(priv, root, hash2, lblock);
+    return 0;
+}
+
+// Каждый проход либо вставляет запись, либо делает одно расщепление и начинает спуск заново
+static int dx_add(struct ext2_private* priv, vfs_inode_t* dir, const char* name, uint32_t len,
+                  uint32_t ino, uint8_t type) {
+    struct ext2_inode* raw = &EXT2_I(dir)->raw;
+    struct dx_frame frames[EXT2_DX_MAX_LEVELS];
+    struct dx_hash_info hinfo;
+    uint32_t levels;
+    int ret;
     
-    if (block_num < per_block * per_block) {
-        if (inode->i_block[13] == 0) return -1;
-        if (ext2_read_block(priv, inode->i_block[13], double_indirect) != 0) return -1;
+    for (int pass = 0; pass < 4; pass++) {
+        struct dx_frame* parent;
+        bcache_buf_t* leaf;
         
-        i = block_num / per_block;
-        if (ext2_read_block(priv, double_indirect[i], indirect) != 0) return -1;
+        ret = dx_probe(priv, raw, name, len, &hinfo, frames, &levels);
+        if (ret != 0) return ret;
         
-        *block = indirect[block_num % per_block];
-        return 0;
+        parent = &frames[levels];
+        leaf = ext2_dir_bread(priv, raw, parent->at->block & EXT2_DX_BLOCK_MASK);
+        if (!leaf) {
+            dx_release(frames, levels);
+            return -1;
+        }
+        
+        if (ext2_insert_in_block(priv, leaf->data, name, len, ino, type) == 0) {
+            ext2_journal_dirty(priv, leaf);
+            bcache_release(leaf);
+            dx_release(frames, levels);
+            return 0;
+        }
+        
+        if (dx_cl(parent->entries)->count < dx_cl(parent->entries)->limit) {
+            ret = dx_split_leaf(priv, dir, parent, leaf, &hinfo);
+        } else if (levels == 0) {
+            ret = dx_grow_root(priv, dir, &frames[0]);
+        } else if (dx_cl(frames[0].entries)->count < dx_cl(frames[0].entries)->limit) {
+            ret = dx_split_node(priv, dir, &frames[0], &frames[1]);
+        } else {
+            serial_puts("[EXT2] Directory index is full\n");
+            ret = -1;
+        }
+        
+        bcache_release(leaf);
+        dx_release(frames, levels);
+        if (ret != 0) return ret;
     }
     
     return -1;
 }
 
-static int ext2_write_block_to_inode(struct ext2_private* priv, struct ext2_inode* inode,
-                                      uint32_t block_num, uint32_t block) {
-    uint32_t indirect[512];
-    uint32_t double_indirect[512];
-    uint32_t i;
-    uint32_t per_block = priv->block_size / 4;
+// Одноблочный каталог переполнен: записи переезжают в блок 1, блок 0 становится корнем
+static int dx_make_indexed(struct ext2_private* priv, vfs_inode_t* dir, const char* name,
+                           uint32_t len, uint32_t ino, uint8_t type) {
+    struct ext2_inode* raw = &EXT2_I(dir)->raw;
+    struct ext2_dir_entry* dot;
+    struct ext2_dir_entry* dotdot;
+    struct ext2_dx_root_info* info;
+    struct ext2_dx_entry* entries;
+    struct dx_map_entry* map;
+    bcache_buf_t* b0;
+    bcache_buf_t* b1;
+    uint32_t lblock;
+    uint32_t offset;
+    uint32_t count = 0;
     
-    if (block_num < 12) {
-        inode->i_block[block_num] = block;
-        return 0;
-    }
+    b0 = ext2_dir_bread(priv, raw, 0);
+    if (!b0) return -1;
     
-    block_num -= 12;
+    dot = (struct ext2_dir_entry*)b0->data;
+    dotdot = (struct ext2_dir_entry*)(b0->data + 12);
+    if (dot->rec_len != 12 || dot->name_len != 1 || dot->name[0] != '.' ||
+        dotdot->name_len != 2 || dotdot->name[0] != '.' || dotdot->name[1] != '.' ||
+        !ext2_dirent_ok(priv, dotdot, 12)) {
+        bcache_release(b0);
+        return DX_BAD_INDEX;
+    }
     
-    if (block_num < per_block) {
-        if (inode->i_block[12] == 0) {
-            inode->i_block[12] = ext2_alloc_block(priv, 0);
-            if (inode->i_block[12] == 0) return -1;
-            memset(indirect, 0, priv->block_size);
-            ext2_write_block(priv, inode->i_block[12], indirect);
-        }
-        if (ext2_read_block(priv, inode->i_block[12], indirect) != 0) return -1;
-        indirect[block_num] = block;
-        return ext2_write_block(priv, inode->i_block[12], indirect);
+    map = kmalloc((priv->block_size / 8) * sizeof(struct dx_map_entry));
+    if (!map) {
+        bcache_release(b0);
+        return -1;
     }
     
-    block_num -= per_block;
+    offset = 12 + dotdot->rec_len;
+    while (offset < priv->block_size) {
+        struct ext2_dir_entry* de = (struct ext2_dir_entry*)(b0->data + offset);
+        if (!ext2_dirent_ok(priv, de, offset)) break;
+        if (de->inode != 0) map[count++].offs = offset;
+        offset += de->rec_len;
+    }
     
-    if (block_num < per_block * per_block) {
-        if (inode->i_block[13] == 0) {
-            inode->i_block[13] = ext2_alloc_block(priv, 0);
-            if (inode->i_block[13] == 0) return -1;
-            memset(double_indirect, 0, priv->block_size);
-            ext2_write_block(priv, inode->i_block[13], double_indirect);
-        }
-        if (ext2_read_block(priv, inode->i_block[13], double_indirect) != 0) return -1;
-        
-        i = block_num / per_block;
-        if (double_indirect[i] == 0) {
-            double_indirect[i] = ext2_alloc_block(priv, 0);
-            if (double_indirect[i] == 0) return -1;
-            memset(indirect, 0, priv->block_size);
-            ext2_write_block(priv, double_indirect[i], indirect);
-            ext2_write_block(priv, inode->i_block[13], double_indirect);
-        }
-        
-        if (ext2_read_block(priv, double_indirect[i], indirect) != 0) return -1;
-        indirect[block_num % per_block] = block;
-        return ext2_write_block(priv, double_indirect[i], indirect);
+    b1 = ext2_dir_append(priv, dir, &lblock);
+    if (!b1) {
+        kfree(map);
+        bcache_release(b0);
+        return -1;
     }
     
-    return -1;
+    dx_pack(priv, b1->data, b0->data, map, count);
+    ext2_journal_dirty(priv, b1);
+    bcache_release(b1);
+    kfree(map);
+    
+    dotdot->rec_len = priv->block_size - 12;
+    memset(b0->data + 24, 0, priv->block_size - 24);
+    
+    info = (struct ext2_dx_root_info*)(b0->data + 24);
+    info->hash_version = priv->sb.s_def_hash_version;
+    if (info->hash_version > EXT2_DX_HASH_TEA) info->hash_version = EXT2_DX_HASH_HALF_MD4;
+    info->info_length = 8;
+    
+    entries = (struct ext2_dx_entry*)(b0->data + 32);
+    dx_cl(entries)->limit = dx_root_limit(priv);
+    dx_cl(entries)->count = 1;
+    entries[0].block = lblock;
+    ext2_journal_dirty(priv, b0);
+    bcache_release(b0);
+    
+    raw->i_flags |= EXT2_INDEX_FL;
+    icache_mark_dirty(dir);
+    
+    return dx_add(priv, dir, name, len, ino, type);
 }
 
-static int ext2_read_data(struct ext2_private* priv, struct ext2_inode* inode,
-                          uint32_t offset, void* buf, uint32_t size, uint32_t* bytes_read) {
-    uint32_t block_num;
-    uint32_t block_offset;
-    uint32_t block;
-    uint32_t read = 0;
-    uint32_t to_read;
+static int ext2_find_entry(vfs_inode_t* dir, const char* name, uint32_t len, struct ext2_dir_slot* slot) {
+    struct ext2_private* priv = EXT2_SB(dir->sb);
+    struct ext2_inode* raw = &EXT2_I(dir)->raw;
+    uint32_t nblocks;
     
-    if (offset >= inode->i_size) {
-        *bytes_read = 0;
-        return 0;
-    }
-    if (offset + size > inode->i_size) size = inode->i_size - offset;
+    nblocks = raw->i_size / priv->block_size;
     
-    block_num = offset / priv->block_size;
-    block_offset = offset % priv->block_size;
+    // "." и ".." лежат только в блоке 0, в листьях индекса их нет
+    if (len <= 2 && name[0] == '.' && (len == 1 || name[1] == '.')) {
+        if (nblocks > 1) nblocks = 1;
+    } else if (raw->i_flags & EXT2_INDEX_FL) {
+        int ret = dx_find(priv, raw, name, len, slot);
+        if (ret == 1) return 0;
+        if (ret != DX_BAD_INDEX) return -1;
+    }
     
-    while (read < size) {
-        if (ext2_read_block_from_inode(priv, inode, block_num, &block) != 0) {
-            *bytes_read = read;
-            return -1;
-        }
+    for (uint32_t lblock = 0; lblock < nblocks; lblock++) {
+        bcache_buf_t* b = ext2_dir_bread(priv, raw, lblock);
+        if (!b) continue;
         
-        if (block == 0) {
-            to_read = priv->block_size - block_offset;
-            if (to_read > size - read) to_read = size - read;
-            memset((uint8_t*)buf + read, 0, to_read);
-        } else {
-            if (ext2_read_block(priv, block, priv->block_buf) != 0) {
-                *bytes_read = read;
-                return -1;
-            }
-            
-            to_read = priv->block_size - block_offset;
-            if (to_read > size - read) to_read = size - read;
-            memcpy((uint8_t*)buf + read, priv->block_buf + block_offset, to_read);
+        slot->de = ext2_find_in_block(priv, b->data, name, len, &slot->prev);
+        if (slot->de) {
+            slot->buf = b;
+            return 0;
         }
-        
-        read += to_read;
-        block_num++;
-        block_offset = 0;
+        bcache_release(b);
     }
-    
-    *bytes_read = read;
-    return 0;
+    return -1;
 }
 
-static int ext2_write_data(struct ext2_private* priv, struct ext2_inode* inode,
-                           uint32_t offset, const void* buf, uint32_t size, uint32_t* bytes_written) {
-    uint32_t block_num;
-    uint32_t block_offset;
-    uint32_t block;
-    uint32_t written = 0;
-    uint32_t to_write;
-    int new_block;
-    
-    block_num = offset / priv->block_size;
-    block_offset = offset % priv->block_size;
+static int ext2_add_link(vfs_inode_t* dir, const char* name, uint32_t len, uint32_t ino, uint8_t type) {
+    struct ext2_private* priv = EXT2_SB(dir->sb);
+    struct ext2_inode* raw = &EXT2_I(dir)->raw;
+    uint32_t nblocks;
+    uint32_t lblock;
+    bcache_buf_t* b;
+    int ret;
     
-    while (written < size) {
-        if (ext2_read_block_from_inode(priv, inode, block_num, &block) != 0) {
-            block = 0;
-        }
-        
-        new_block = (block == 0);
+    if (raw->i_flags & EXT2_INDEX_FL) {
+        ret = dx_add(priv, dir, name, len, ino, type);
+        if (ret != DX_BAD_INDEX) return ret;
         
-        if (new_block) {
-            block = ext2_alloc_block(priv, 0);
-            if (block == 0) {
-                *bytes_written = written;
-                return -1;
-            }
-            if (ext2_write_block_to_inode(priv, inode, block_num, block) != 0) {
-                ext2_free_block(priv, block);
-                *bytes_written = written;
-                return -1;
-            }
-        }
+        // После линейной вставки индекс устареет - снимаем флаг, как это делает e2fsck
+        serial_puts("[EXT2] Bad directory index, switching to linear mode\n");
+        raw->i_flags &= ~EXT2_INDEX_FL;
+        EXT2_I(dir)->dir_hint = 0;
+        icache_mark_dirty(dir);
+    }
+    
+    // Серия вставок подряд (копирование дерева) дописывает в последний блок, не просматривая начало
+    nblocks = raw->i_size / priv->block_size;
+    for (lblock = EXT2_I(dir)->dir_hint; lblock < nblocks; lblock++) {
+        b = ext2_dir_bread(priv, raw, lblock);
+        if (!b) continue;
         
-        if (block_offset != 0 || (to_write = size - written) < priv->block_size) {
-            if (ext2_read_block(priv, block, priv->block_buf) != 0) {
-                *bytes_written = written;
-                return -1;
-            }
+        if (ext2_insert_in_block(priv, b->data, name, len, ino, type) == 0) {
+            ext2_journal_dirty(priv, b);
+            bcache_release(b);
+            EXT2_I(dir)->dir_hint = lblock;
+            return 0;
         }
+        bcache_release(b);
+    }
+    
+    if (nblocks == 1 && (priv->sb.s_feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX)) {
+        ret = dx_make_indexed(priv, dir, name, len, ino, type);
+        if (ret != DX_BAD_INDEX) return ret;
+    }
+    
+    b = ext2_dir_append(priv, dir, &lblock);
+    if (!b) return -1;
+    
+    EXT2_I(dir)->dir_hint = lblock;
+    ret = ext2_insert_in_block(priv, b->data, name, len, ino, type);
+    ext2_journal_dirty(priv, b);
+    bcache_release(b);
+    return ret;
+}
+
+// Пуст ли каталог (кроме "." и "..")
+static int ext2_dir_empty(struct ext2_private* priv, struct ext2_inode* dir) {
+    uint32_t nblocks = dir->i_size / priv->block_size;
+    
+    for (uint32_t lblock = 0; lblock < nblocks; lblock++) {
+        bcache_buf_t* b = ext2_dir_bread(priv, dir, lblock);
+        uint32_t offset = 0;
         
-        to_write = priv->block_size - block_offset;
-        if (to_write > size - written) to_write = size - written;
-        
-        memcpy(priv->block_buf + block_offset, (uint8_t*)buf + written, to_write);
+        if (!b) continue;
         
-        if (ext2_write_block(priv, block, priv->block_buf) != 0) {
-            *bytes_written = written;
-            return -1;
+        while (offset < priv->block_size) {
+            struct ext2_dir_entry* de = (struct ext2_dir_entry*)(b->data + offset);
+            if (!ext2_dirent_ok(priv, de, offset)) break;
+            
+            if (de->inode != 0 &&
+                !(de->name_len == 1 && de->name[0] == '.') &&
+                !(de->name_len == 2 && de->name[0] == '.' && de->name[1] == '.')) {
+                bcache_release(b);
+                return 0;
+            }
+            offset += de->rec_len;
         }
+        bcache_release(b);
+    }
+    return 1;
+}
+
+static int ext2_lookup(vfs_inode_t* dir, const char* name, vfs_inode_t** result) {
+    struct ext2_dir_slot slot;
+    uint32_t ino;
+    
+    if (!EXT2_SB(dir->sb)) return -1;
+    
+    if (ext2_find_entry(dir, name, strlen(name), &slot) != 0) return -1;
+    
+    ino = slot.de->inode;
+    bcache_release(slot.buf);
+    
+    *result = icache_get(dir->sb, ino);
+    return *result ? 0 : -1;
+}
+
+// Подгружает в кэш блоки файла [start, start + count), объединяя
+// физически смежные блоки в одну многосекторную команду
+static void ext2_readahead(struct ext2_private* priv, struct ext2_inode_info* info,
+                           uint32_t start, uint32_t count) {
+    uint32_t spb = priv->block_size / 512;
+    uint32_t max_run = BCACHE_MAX_IO_SECTORS / spb;
+    uint32_t file_blocks = (info->raw.i_size + priv->block_size - 1) / priv->block_size;
+    uint32_t i = 0;
+    
+    if (max_run == 0 || start >= file_blocks) return;
+    if (count > file_blocks - start) count = file_blocks - start;
+    
+    while (i < count) {
+        uint32_t block;
+        uint32_t run;
         
-        written += to_write;
-        block_num++;
-        block_offset = 0;
+        if (ext2_map_blocks(priv, info, start + i, count - i, &block, &run) != 0) return;
         
-        if (offset + written > inode->i_size) {
-            inode->i_size = offset + written;
+        for (uint32_t done = 0; block != 0 && done < run; done += max_run) {
+            uint32_t len = run - done < max_run ? run - done : max_run;
+            bcache_readahead(priv->disk, (uint64_t)(block + done) * spb, len, priv->block_size);
         }
         
-        inode->i_blocks = (inode->i_size + priv->block_size - 1) / priv->block_size;
+        i += run;
     }
-    
-    *bytes_written = written;
-    return 0;
 }
 
-static int ext2_sync(struct vfs_superblock* sb) {
-    struct ext2_private* priv = (struct ext2_private*)sb->private_data;
-    if (priv && priv->disk && priv->disk->flush) {
-        return priv->disk->flush(priv->disk);
+static void ext2_file_readahead(struct ext2_private* priv, vfs_file_t* file,
+                                struct ext2_inode_info* info, uint32_t size) {
+    struct ext2_inode* inode = &info->raw;
+    struct vfs_readahead* ra = &file->f_ra;
+    uint32_t end_pos;
+    uint32_t first;
+    uint32_t last;
+    uint32_t start;
+    uint32_t end;
+    
+    if (size == 0 || file->f_pos >= inode->i_size) return;
+    
+    end_pos = file->f_pos + size;
+    if (end_pos > inode->i_size || end_pos < file->f_pos) end_pos = inode->i_size;
+    
+    first = file->f_pos / priv->block_size;
+    last = (end_pos - 1) / priv->block_size;
+    
+    if (first == ra->next_block || first + 1 == ra->next_block) {
+        // Последовательный доступ - окно растёт вдвое до максимума
+        ra->window = ra->window ? ra->window * 2 : EXT2_READAHEAD_MIN;
+        if (ra->window > ext2_readahead_max) ra->window = ext2_readahead_max;
+    } else {
+        ra->window = 0;
+        ra->ra_end = 0;
     }
-    return 0;
-}
-
-static int ext2_lookup(vfs_inode_t* dir, const char* name, vfs_inode_t** result) {
-    struct ext2_private* priv = (struct ext2_private*)dir->private_data;
-    if (!priv) return -1;
     
-    struct ext2_inode dir_inode;
-    if (ext2_read_inode(priv, dir->i_ino, &dir_inode) != 0) return -1;
+    ra->next_block = last + 1;
     
-    uint32_t offset = 0;
-    while (offset < dir_inode.i_size) {
-        uint32_t bytes_read;
-        if (ext2_read_data(priv, &dir_inode, offset, priv->block_buf, priv->block_size, &bytes_read) != 0) return -1;
-        if (bytes_read == 0) break;
-        
-        uint32_t entry_offset = 0;
-        while (entry_offset < bytes_read) {
-            struct ext2_dir_entry* entry = (struct ext2_dir_entry*)(priv->block_buf + entry_offset);
-            
-            if (entry->inode != 0 && entry->name_len == strlen(name) &&
-                strncmp(entry->name, name, entry->name_len) == 0) {
-                
-                struct ext2_inode file_inode;
-                if (ext2_read_inode(priv, entry->inode, &file_inode) != 0) return -1;
-                
-                *result = kmalloc(sizeof(vfs_inode_t));
-                if (!*result) return -1;
-                
-                memset(*result, 0, sizeof(vfs_inode_t));
-                (*result)->i_ino = entry->inode;
-                (*result)->i_mode = file_inode.i_mode;
-                (*result)->i_size = file_inode.i_size;
-                (*result)->i_blocks = file_inode.i_blocks;
-                (*result)->private_data = priv;
-                (*result)->sb = dir->sb;
-                (*result)->fops = dir->fops;
-                (*result)->iops = dir->iops;
-                
-                return 0;
-            }
-            entry_offset += entry->rec_len;
-        }
-        offset += bytes_read;
+    if (ra->window == 0) return;
+    
+    // Блоки самого запроса читает ext2_read_data (полные - мимо кэша),
+    // упреждение начинается за ними
+    start = last + 1 > ra->ra_end ? last + 1 : ra->ra_end;
+    end = last + 1 + ra->window;
+    
+    if (start < end) {
+        ext2_readahead(priv, info, start, end - start);
+        ra->ra_end = end;
     }
-    return -1;
+}
+
+void ext2_set_readahead_max(uint32_t blocks) {
+    ext2_readahead_max = blocks;
 }
 
 static int ext2_read(vfs_file_t* file, void* buf, uint32_t size, uint32_t* bytes_read) {
     struct ext2_private* priv;
-    struct ext2_inode inode;
+    struct ext2_inode_info* info;
+    int ret;
     
     if (!file || !buf || !bytes_read) return -1;
     
-    priv = (struct ext2_private*)file->f_inode->private_data;
+    priv = EXT2_SB(file->f_inode->sb);
     if (!priv) return -1;
     
-    if (ext2_read_inode(priv, file->f_inode->i_ino, &inode) != 0) return -1;
+    info = EXT2_I(file->f_inode);
+    
+    ext2_file_readahead(priv, file, info, size);
+    
+    ret = ext2_read_data(priv, info, file->f_pos, buf, size, bytes_read);
+    file->f_pos += *bytes_read;
     
-    return ext2_read_data(priv, &inode, file->f_pos, buf, size, bytes_read);
+    return ret;
 }
 
+// Большая запись режется на куски со своим резервом: коммит возможен между кусками
 static int ext2_write(vfs_file_t* file, const void* buf, uint32_t size, uint32_t* bytes_written) {
     struct ext2_private* priv;
-    struct ext2_inode inode;
-    int ret;
+    uint32_t done = 0;
+    int ret = 0;
     
     if (!file || !buf || !bytes_written) return -1;
     
-    priv = (struct ext2_private*)file->f_inode->private_data;
+    priv = EXT2_SB(file->f_inode->sb);
     if (!priv) return -1;
     
-    if (ext2_read_inode(priv, file->f_inode->i_ino, &inode) != 0) return -1;
+    while (done < size) {
+        uint32_t pos = file->f_pos + done;
+        uint32_t chunk = EXT2_WRITE_CHUNK_BLOCKS * priv->block_size - pos % priv->block_size;
+        uint32_t n = 0;
+        
+        if (chunk > size - done) chunk = size - done;
+        
+        ext2_journal_start(priv, EXT2_CREDITS_WRITE);
+        ret = ext2_write_data(priv, EXT2_I(file->f_inode), pos, (const uint8_t*)buf + done, chunk, &n);
+        
+        // Блоки могли быть выделены даже при ошибке - inode войдёт в транзакцию при коммите
+        ext2_update_vfs_inode(file->f_inode);
+        icache_mark_dirty(file->f_inode);
+        ext2_journal_stop(priv);
+        
+        done += n;
+        if (ret != 0) break;
+    }
     
-    ret = ext2_write_data(priv, &inode, file->f_pos, buf, size, bytes_written);
+    *bytes_written = done;
     if (ret != 0) return ret;
     
-    file->f_pos += *bytes_written;
-    file->f_inode->i_size = inode.i_size;
-    file->f_inode->i_blocks = inode.i_blocks;
-    
-    return ext2_write_inode(priv, file->f_inode->i_ino, &inode);
+    file->f_pos += done;
+    return 0;
 }
 
 static int ext2_lseek(vfs_file_t* file, uint32_t offset, int whence) {
-    struct ext2_private* priv;
-    struct ext2_inode inode;
+    struct ext2_inode* inode;
     uint32_t new_pos;
     
-    if (!file) return -1;
-    
-    priv = (struct ext2_private*)file->f_inode->private_data;
-    if (!priv) return -1;
+    if (!file || !file->f_inode) return -1;
     
-    if (ext2_read_inode(priv, file->f_inode->i_ino, &inode) != 0) return -1;
+    inode = &EXT2_I(file->f_inode)->raw;
     
     switch (whence) {
         case 0:
@@ -506,14 +1821,14 @@ static int ext2_lseek(vfs_file_t* file, uint32_t offset, int whence) {
             new_pos = file->f_pos + offset;
             break;
         case 2:
-            new_pos = inode.i_size + offset;
+            new_pos = inode->i_size + offset;
             break;
         default:
             return -1;
     }
     
-    if (new_pos > inode.i_size) {
-        new_pos = inode.i_size;
+    if (new_pos > inode->i_size) {
+        new_pos = inode->i_size;
     }
     
     file->f_pos = new_pos;
@@ -522,7 +1837,7 @@ static int ext2_lseek(vfs_file_t* file, uint32_t offset, int whence) {
 
 static int ext2_readdir(vfs_file_t* file, void* dirent, uint32_t* bytes_read) {
     struct ext2_private* priv;
-    struct ext2_inode inode;
+    struct ext2_inode* inode;
     struct ext2_dir_entry* entry;
     struct vfs_dirent* dent = (struct vfs_dirent*)dirent;
     uint32_t offset = file->f_pos;
@@ -531,17 +1846,17 @@ static int ext2_readdir(vfs_file_t* file, void* dirent, uint32_t* bytes_read) {
     
     if (!file || !dirent || !bytes_read) return -1;
     
-    priv = (struct ext2_private*)file->f_inode->private_data;
+    priv = EXT2_SB(file->f_inode->sb);
     if (!priv) return -1;
     
-    if (ext2_read_inode(priv, file->f_inode->i_ino, &inode) != 0) return -1;
+    inode = &EXT2_I(file->f_inode)->raw;
     
-    if (offset >= inode.i_size) {
+    if (offset >= inode->i_size) {
         *bytes_read = 0;
         return 0;
     }
     
-    if (ext2_read_data(priv, &inode, offset, priv->block_buf, priv->block_size, &bytes) != 0) {
+    if (ext2_read_data(priv, EXT2_I(file->f_inode), offset, priv->block_buf, priv->block_size, &bytes) != 0) {
         return -1;
     }
     if (bytes == 0) return -1;
@@ -570,228 +1885,111 @@ static int ext2_readdir(vfs_file_t* file, void* dirent, uint32_t* bytes_read) {
     return 0;
 }
 
+// inode пишется на диск лениво (sync или вытеснение из icache), закрытие ничего не делает
 static int ext2_close(vfs_file_t* file) {
-    struct ext2_private* priv = (struct ext2_private*)file->f_inode->private_data;
-    if (!priv) return -1;
+    struct ext2_private* priv;
     
-    struct ext2_inode inode;
-    if (ext2_read_inode(priv, file->f_inode->i_ino, &inode) == 0) {
-        inode.i_size = file->f_inode->i_size;
-        inode.i_blocks = file->f_inode->i_blocks;
-        ext2_write_inode(priv, file->f_inode->i_ino, &inode);
-    }
+    if (!file || !file->f_inode) return -1;
+    priv = EXT2_SB(file->f_inode->sb);
     
+    // Неиспользованные блоки окна возвращаются в группу сразу после записи
+    ext2_journal_start(priv, EXT2_CREDITS_WRITE);
+    ext2_discard_prealloc(priv, EXT2_I(file->f_inode));
+    ext2_journal_stop(priv);
     return 0;
 }
 
-static int ext2_create(vfs_inode_t* dir, const char* name, uint32_t mode, vfs_inode_t** result) {
+static int ext2_do_create(vfs_inode_t* dir, const char* name, uint32_t mode, vfs_inode_t** result) {
     struct ext2_private* priv;
-    struct ext2_inode parent_inode;
     struct ext2_inode new_inode;
-    struct ext2_dir_entry* entry;
+    struct ext2_dir_slot slot;
+    uint32_t len;
     uint32_t ino;
-    uint32_t offset = 0;
-    uint32_t bytes;
-    uint32_t entry_offset;
-    uint32_t rec_len;
-    int found_space = 0;
     
     if (!dir || !name || !result) return -1;
     
-    priv = (struct ext2_private*)dir->private_data;
+    priv = EXT2_SB(dir->sb);
     if (!priv) return -1;
     
-    if (ext2_read_inode(priv, dir->i_ino, &parent_inode) != 0) return -1;
+    len = strlen(name);
+    if (len == 0 || len > 255) return -1;
     
-    ino = ext2_alloc_inode(priv, 0);
+    if (ext2_find_entry(dir, name, len, &slot) == 0) {
+        bcache_release(slot.buf);
+        return -1;
+    }
+    
+    ino = ext2_alloc_inode(priv, dir->i_ino, 0);
     if (ino == 0) return -1;
     
     memset(&new_inode, 0, sizeof(struct ext2_inode));
     new_inode.i_mode = mode | EXT2_S_IFREG;
-    new_inode.i_uid = 0;
-    new_inode.i_gid = 0;
     new_inode.i_links_count = 1;
-    new_inode.i_blocks = 0;
-    new_inode.i_size = 0;
-    new_inode.i_atime = 0;
-    new_inode.i_ctime = 0;
-    new_inode.i_mtime = 0;
     
     if (ext2_write_inode(priv, ino, &new_inode) != 0) {
-        ext2_free_inode(priv, ino);
+        ext2_free_inode(priv, ino, 0);
         return -1;
     }
     
-    rec_len = sizeof(struct ext2_dir_entry) + strlen(name);
-    if (rec_len % 4) rec_len += 4 - (rec_len % 4);
-    if (rec_len < 8) rec_len = 8;
-    
-    while (offset < parent_inode.i_size) {
-        if (ext2_read_data(priv, &parent_inode, offset, priv->block_buf, priv->block_size, &bytes) != 0) {
-            ext2_free_inode(priv, ino);
-            return -1;
-        }
-        if (bytes == 0) break;
-        
-        entry_offset = 0;
-        while (entry_offset < bytes) {
-            entry = (struct ext2_dir_entry*)(priv->block_buf + entry_offset);
-            
-            if (entry->inode == 0) {
-                if (entry->rec_len >= rec_len) {
-                    found_space = 1;
-                    break;
-                }
-            } else if (entry->name_len == strlen(name) &&
-                       strncmp(entry->name, name, entry->name_len) == 0) {
-                ext2_free_inode(priv, ino);
-                return -1;
-            }
-            
-            entry_offset += entry->rec_len;
-        }
-        
-        if (found_space) break;
-        offset += bytes;
-    }
-    
-    if (!found_space) {
-        offset = parent_inode.i_size;
-        if (offset % priv->block_size == 0) {
-            uint32_t new_block = ext2_alloc_block(priv, 0);
-            if (new_block == 0) {
-                ext2_free_inode(priv, ino);
-                return -1;
-            }
-            if (ext2_write_block_to_inode(priv, &parent_inode, offset / priv->block_size, new_block) != 0) {
-                ext2_free_block(priv, new_block);
-                ext2_free_inode(priv, ino);
-                return -1;
-            }
-            memset(priv->block_buf, 0, priv->block_size);
-            ext2_write_block(priv, new_block, priv->block_buf);
-        }
-        
-        if (ext2_read_data(priv, &parent_inode, offset, priv->block_buf, priv->block_size, &bytes) != 0) {
-            ext2_free_inode(priv, ino);
-            return -1;
-        }
-        
-        entry = (struct ext2_dir_entry*)priv->block_buf;
-        entry->inode = 0;
-        entry->rec_len = priv->block_size - (offset % priv->block_size);
-        
-        entry_offset = 0;
-        found_space = 1;
-    }
-    
-    entry = (struct ext2_dir_entry*)(priv->block_buf + entry_offset);
-    if (entry->rec_len >= rec_len) {
-        uint32_t new_rec_len = entry->rec_len - rec_len;
-        
-        entry->inode = ino;
-        entry->name_len = strlen(name);
-        entry->file_type = EXT2_FT_REG_FILE;
-        memcpy(entry->name, name, entry->name_len);
-        entry->rec_len = rec_len;
-        
-        if (new_rec_len >= 8) {
-            struct ext2_dir_entry* next = (struct ext2_dir_entry*)((uint8_t*)entry + rec_len);
-            next->inode = 0;
-            next->rec_len = new_rec_len;
-        }
-        
-        if (ext2_write_data(priv, &parent_inode, offset + entry_offset,
-                           priv->block_buf + entry_offset, rec_len, &bytes) != 0) {
-            ext2_free_inode(priv, ino);
-            return -1;
-        }
-        
-        parent_inode.i_links_count++;
-        ext2_write_inode(priv, dir->i_ino, &parent_inode);
-        
-        *result = kmalloc(sizeof(vfs_inode_t));
-        if (!*result) {
-            ext2_free_inode(priv, ino);
-            return -1;
-        }
-        
-        memset(*result, 0, sizeof(vfs_inode_t));
-        (*result)->i_ino = ino;
-        (*result)->i_mode = new_inode.i_mode;
-        (*result)->i_size = 0;
-        (*result)->i_blocks = 0;
-        (*result)->private_data = priv;
-        (*result)->sb = dir->sb;
-        (*result)->fops = dir->fops;
-        (*result)->iops = dir->iops;
-
-        ext2_sync(dir->sb);
-        
-        return 0;
+    if (ext2_add_link(dir, name, len, ino, EXT2_FT_REG_FILE) != 0) {
+        ext2_free_inode(priv, ino, 0);
+        return -1;
     }
     
-    ext2_free_inode(priv, ino);
-    return -1;
+    *result = icache_get(dir->sb, ino);
+    return *result ? 0 : -1;
 }
 
-static int ext2_mkdir(vfs_inode_t* dir, const char* name, uint32_t mode) {
+static int ext2_do_mkdir(vfs_inode_t* dir, const char* name, uint32_t mode) {
     struct ext2_private* priv;
-    struct ext2_inode parent_inode;
     struct ext2_inode new_inode;
     struct ext2_dir_entry* entry;
+    struct ext2_dir_slot slot;
+    bcache_buf_t* b;
+    uint32_t len;
     uint32_t ino;
     uint32_t block;
-    uint32_t offset = 0;
-    uint32_t bytes;
-    uint32_t entry_offset;
-    uint32_t rec_len;
-    int found_space = 0;
     
     if (!dir || !name) return -1;
     
-    priv = (struct ext2_private*)dir->private_data;
+    priv = EXT2_SB(dir->sb);
     if (!priv) return -1;
     
-    if (ext2_read_inode(priv, dir->i_ino, &parent_inode) != 0) return -1;
+    len = strlen(name);
+    if (len == 0 || len > 255) return -1;
     
-    ino = ext2_alloc_inode(priv, 0);
+    if (ext2_find_entry(dir, name, len, &slot) == 0) {
+        bcache_release(slot.buf);
+        return -1;
+    }
+    
+    ino = ext2_alloc_inode(priv, dir->i_ino, 1);
     if (ino == 0) return -1;
     
-    block = ext2_alloc_block(priv, 0);
+    // Первый блок каталога - в начале группы его inode
+    block = ext2_alloc_block(priv, ext2_group_first_block(priv, (ino - 1) / priv->inodes_per_group));
     if (block == 0) {
-        ext2_free_inode(priv, ino);
+        ext2_free_inode(priv, ino, 1);
         return -1;
     }
     
-    memset(&new_inode, 0, sizeof(struct ext2_inode));
-    new_inode.i_mode = mode | EXT2_S_IFDIR;
-    new_inode.i_uid = 0;
-    new_inode.i_gid = 0;
-    new_inode.i_links_count = 2;
-    new_inode.i_blocks = 1;
-    new_inode.i_size = priv->block_size;
-    new_inode.i_block[0] = block;
-    new_inode.i_atime = 0;
-    new_inode.i_ctime = 0;
-    new_inode.i_mtime = 0;
-    
-    if (ext2_write_inode(priv, ino, &new_inode) != 0) {
+    b = bcache_get(priv->disk, (uint64_t)block * (priv->block_size / 512), priv->block_size);
+    if (!b) {
         ext2_free_block(priv, block);
-        ext2_free_inode(priv, ino);
+        ext2_free_inode(priv, ino, 1);
         return -1;
     }
     
-    memset(priv->block_buf, 0, priv->block_size);
+    memset(b->data, 0, priv->block_size);
     
-    entry = (struct ext2_dir_entry*)priv->block_buf;
+    entry = (struct ext2_dir_entry*)b->data;
     entry->inode = ino;
     entry->name_len = 1;
     entry->file_type = EXT2_FT_DIR;
     entry->name[0] = '.';
     entry->rec_len = 12;
     
-    entry = (struct ext2_dir_entry*)(priv->block_buf + 12);
+    entry = (struct ext2_dir_entry*)(b->data + 12);
     entry->inode = dir->i_ino;
     entry->name_len = 2;
     entry->file_type = EXT2_FT_DIR;
@@ -799,187 +1997,127 @@ static int ext2_mkdir(vfs_inode_t* dir, const char* name, uint32_t mode) {
     entry->name[1] = '.';
     entry->rec_len = priv->block_size - 12;
     
-    ext2_write_block(priv, block, priv->block_buf);
-    
-    rec_len = sizeof(struct ext2_dir_entry) + strlen(name);
-    if (rec_len % 4) rec_len += 4 - (rec_len % 4);
-    if (rec_len < 8) rec_len = 8;
-    
-    while (offset < parent_inode.i_size) {
-        if (ext2_read_data(priv, &parent_inode, offset, priv->block_buf, priv->block_size, &bytes) != 0) {
-            return -1;
-        }
-        if (bytes == 0) break;
-        
-        entry_offset = 0;
-        while (entry_offset < bytes) {
-            entry = (struct ext2_dir_entry*)(priv->block_buf + entry_offset);
-            
-            if (entry->inode == 0) {
-                if (entry->rec_len >= rec_len) {
-                    found_space = 1;
-                    break;
-                }
-            } else if (entry->name_len == strlen(name) &&
-                       strncmp(entry->name, name, entry->name_len) == 0) {
-                return -1;
-            }
-            
-            entry_offset += entry->rec_len;
-        }
-        
-        if (found_space) break;
-        offset += bytes;
-    }
-    
-    if (!found_space) {
-        offset = parent_inode.i_size;
-        if (offset % priv->block_size == 0) {
-            uint32_t new_block = ext2_alloc_block(priv, 0);
-            if (new_block == 0) return -1;
-            if (ext2_write_block_to_inode(priv, &parent_inode, offset / priv->block_size, new_block) != 0) {
-                ext2_free_block(priv, new_block);
-                return -1;
-            }
-            memset(priv->block_buf, 0, priv->block_size);
-            ext2_write_block(priv, new_block, priv->block_buf);
-        }
-        
-        if (ext2_read_data(priv, &parent_inode, offset, priv->block_buf, priv->block_size, &bytes) != 0) {
-            return -1;
-        }
-        
-        entry = (struct ext2_dir_entry*)priv->block_buf;
-        entry->inode = 0;
-        entry->rec_len = priv->block_size - (offset % priv->block_size);
-        
-        entry_offset = 0;
-        found_space = 1;
+    ext2_journal_dirty(priv, b);
+    bcache_release(b);
+    
+    memset(&new_inode, 0, sizeof(struct ext2_inode));
+    new_inode.i_mode = mode | EXT2_S_IFDIR;
+    new_inode.i_links_count = 2;
+    new_inode.i_blocks = priv->block_size / 512;
+    new_inode.i_size = priv->block_size;
+    new_inode.i_block[0] = block;
+    
+    if (ext2_write_inode(priv, ino, &new_inode) != 0) {
+        ext2_free_block(priv, block);
+        ext2_free_inode(priv, ino, 1);
+        return -1;
     }
     
-    entry = (struct ext2_dir_entry*)(priv->block_buf + entry_offset);
-    if (entry->rec_len >= rec_len) {
-        uint32_t new_rec_len = entry->rec_len - rec_len;
-        
-        entry->inode = ino;
-        entry->name_len = strlen(name);
-        entry->file_type = EXT2_FT_DIR;
-        memcpy(entry->name, name, entry->name_len);
-        entry->rec_len = rec_len;
-        
-        if (new_rec_len >= 8) {
-            struct ext2_dir_entry* next = (struct ext2_dir_entry*)((uint8_t*)entry + rec_len);
-            next->inode = 0;
-            next->rec_len = new_rec_len;
-        }
-        
-        if (ext2_write_data(priv, &parent_inode, offset + entry_offset,
-                           priv->block_buf + entry_offset, rec_len, &bytes) != 0) {
-            return -1;
-        }
-        
-        parent_inode.i_links_count++;
-        ext2_write_inode(priv, dir->i_ino, &parent_inode);
-
-        ext2_sync(dir->sb);
-        
-        return 0;
+    if (ext2_add_link(dir, name, len, ino, EXT2_FT_DIR) != 0) {
+        ext2_free_block(priv, block);
+        ext2_free_inode(priv, ino, 1);
+        return -1;
     }
     
-    return -1;
+    // ".." нового каталога ссылается на родителя
+    EXT2_I(dir)->raw.i_links_count++;
+    ext2_update_vfs_inode(dir);
+    icache_mark_dirty(dir);
+    
+    return 0;
 }
 
-static int ext2_unlink(vfs_inode_t* dir, const char* name) {
+static int ext2_do_unlink(vfs_inode_t* dir, const char* name) {
     struct ext2_private* priv;
-    struct ext2_inode parent_inode;
-    struct ext2_inode file_inode;
-    struct ext2_dir_entry* entry;
-    uint32_t offset = 0;
-    uint32_t bytes;
-    uint32_t entry_offset;
-    uint32_t found_offset = 0;
-    uint32_t found_entry_offset = 0;
-    uint32_t found_rec_len = 0;
+    struct ext2_inode* file_inode;
+    struct ext2_dir_slot slot;
+    vfs_inode_t* victim;
+    int is_dir;
     
     if (!dir || !name) return -1;
     
-    priv = (struct ext2_private*)dir->private_data;
+    priv = EXT2_SB(dir->sb);
     if (!priv) return -1;
     
-    if (ext2_read_inode(priv, dir->i_ino, &parent_inode) != 0) return -1;
+    if (ext2_find_entry(dir, name, strlen(name), &slot) != 0) return -1;
     
-    while (offset < parent_inode.i_size) {
-        if (ext2_read_data(priv, &parent_inode, offset, priv->block_buf, priv->block_size, &bytes) != 0) {
-            return -1;
-        }
-        if (bytes == 0) break;
-        
-        entry_offset = 0;
-        while (entry_offset < bytes) {
-            entry = (struct ext2_dir_entry*)(priv->block_buf + entry_offset);
-            
-            if (entry->inode != 0 && entry->name_len == strlen(name) &&
-                strncmp(entry->name, name, entry->name_len) == 0) {
-                
-                found_offset = offset;
-                found_entry_offset = entry_offset;
-                found_rec_len = entry->rec_len;
-                break;
-            }
-            
-            entry_offset += entry->rec_len;
-        }
-        
-        if (found_rec_len) break;
-        offset += bytes;
+    victim = icache_get(dir->sb, slot.de->inode);
+    if (!victim) {
+        bcache_release(slot.buf);
+        return -1;
     }
+    file_inode = &EXT2_I(victim)->raw;
+    is_dir = (file_inode->i_mode & 0xF000) == EXT2_S_IFDIR;
     
-    if (!found_rec_len) return -1;
-    
-    if (ext2_read_inode(priv, ((struct ext2_dir_entry*)(priv->block_buf + found_entry_offset))->inode, &file_inode) != 0) {
+    if (is_dir && !ext2_dir_empty(priv, file_inode)) {
+        icache_put(victim);
+        bcache_release(slot.buf);
         return -1;
     }
     
-    if (file_inode.i_mode & EXT2_S_IFDIR) {
-        if (file_inode.i_links_count > 2) return -1;
+    // Запись поглощается предыдущей; первая в блоке просто помечается пустой.
+    // Освободилось место - поиск места под вставку снова начинается с начала
+    EXT2_I(dir)->dir_hint = 0;
+    if (slot.prev) {
+        slot.prev->rec_len += slot.de->rec_len;
+    } else {
+        slot.de->inode = 0;
     }
+    ext2_journal_dirty(priv, slot.buf);
+    bcache_release(slot.buf);
     
-    entry = (struct ext2_dir_entry*)(priv->block_buf + found_entry_offset);
-    entry->inode = 0;
-    
-    if (found_entry_offset + found_rec_len < bytes) {
-        struct ext2_dir_entry* next = (struct ext2_dir_entry*)((uint8_t*)entry + found_rec_len);
-        if (next->inode == 0) {
-            entry->rec_len += next->rec_len;
-        }
+    if (is_dir) {
+        // Пустой каталог держат только запись в родителе и собственная "."
+        file_inode->i_links_count = 0;
+        EXT2_I(dir)->raw.i_links_count--;
+        ext2_update_vfs_inode(dir);
+        icache_mark_dirty(dir);
+    } else {
+        file_inode->i_links_count--;
     }
     
-    if (ext2_write_data(priv, &parent_inode, found_offset + found_entry_offset,
-                       priv->block_buf + found_entry_offset, found_rec_len, &bytes) != 0) {
-        return -1;
+    // Файл может быть ещё открыт: блоки и номер освобождает последний icache_put (ext2_ifree)
+    if (file_inode->i_links_count == 0) {
+        file_inode->i_dtime = cmos_get_timestamp();
+        EXT2_I(victim)->unlinked = 1;
     }
+    ext2_update_vfs_inode(victim);
+    icache_mark_dirty(victim);
+    icache_put(victim);
     
-    file_inode.i_links_count--;
+    return 0;
+}
+
+// Операции над каталогами целиком входят в одну транзакцию журнала
+static int ext2_create(vfs_inode_t* dir, const char* name, uint32_t mode, vfs_inode_t** result) {
+    struct ext2_private* priv = dir ? EXT2_SB(dir->sb) : NULL;
+    int ret;
     
-    if (file_inode.i_links_count == 0) {
-        uint32_t i;
-        for (i = 0; i < file_inode.i_blocks; i++) {
-            uint32_t block;
-            if (ext2_read_block_from_inode(priv, &file_inode, i, &block) == 0 && block != 0) {
-                ext2_free_block(priv, block);
-            }
-        }
-        ext2_free_inode(priv, ((struct ext2_dir_entry*)(priv->block_buf + found_entry_offset))->inode);
-    } else {
-        ext2_write_inode(priv, ((struct ext2_dir_entry*)(priv->block_buf + found_entry_offset))->inode, &file_inode);
-    }
+    ext2_journal_start(priv, EXT2_CREDITS_DIROP);
+    ret = ext2_do_create(dir, name, mode, result);
+    ext2_journal_stop(priv);
+    return ret;
+}
+
+static int ext2_mkdir(vfs_inode_t* dir, const char* name, uint32_t mode) {
+    struct ext2_private* priv = dir ? EXT2_SB(dir->sb) : NULL;
+    int ret;
     
-    parent_inode.i_links_count--;
-    ext2_write_inode(priv, dir->i_ino, &parent_inode);
+    ext2_journal_start(priv, EXT2_CREDITS_DIROP);
+    ret = ext2_do_mkdir(dir, name, mode);
+    ext2_journal_stop(priv);
+    return ret;
+}
 
-    ext2_sync(dir->sb);
+static int ext2_unlink(vfs_inode_t* dir, const char* name) {
+    struct ext2_private* priv = dir ? EXT2_SB(dir->sb) : NULL;
+    int ret;
     
-    return 0;
+    // Последняя ссылка может уйти здесь же: резерв и на освобождение блоков
+    ext2_journal_start(priv, ext2_delete_credits(priv));
+    ret = ext2_do_unlink(dir, name);
+    ext2_journal_stop(priv);
+    return ret;
 }
 
 static vfs_file_operations_t ext2_fops = {
@@ -1001,11 +2139,84 @@ static vfs_inode_operations_t ext2_iops = {
     .rename = NULL,
 };
 
-static vfs_superblock_operations_t ext2_sops = {
-    .read_inode = NULL,
-    .write_inode = NULL,
-    .sync = ext2_sync,
-};
+// Создание inode для icache: читается с диска один раз, дальше живёт в кэше
+static int ext2_iget(vfs_superblock_t* sb, uint32_t ino, vfs_inode_t** result) {
+    struct ext2_private* priv = EXT2_SB(sb);
+    vfs_inode_t* inode;
+    struct ext2_inode_info* info;
+    
+    inode = kmalloc(sizeof(vfs_inode_t));
+    if (!inode) return -1;
+    info = kmalloc(sizeof(struct ext2_inode_info));
+    if (!info) {
+        kfree(inode);
+        return -1;
+    }
+    memset(info, 0, sizeof(struct ext2_inode_info));
+    info->group = (ino - 1) / priv->inodes_per_group;
+    
+    if (ext2_read_inode(priv, ino, &info->raw) != 0) {
+        kfree(info);
+        kfree(inode);
+        return -1;
+    }
+    
+    // Свободный inode по устаревшей или битой записи каталога. Списка сирот (s_last_orphan)
+    // ядро не ведёт, так что живых inode без ссылок на диске не бывает
+    if (info->raw.i_mode == 0 || info->raw.i_links_count == 0) {
+        serial_puts("[EXT2] Reference to free inode ");
+        serial_puts_num(ino);
+        serial_puts("\n");
+        kfree(info);
+        kfree(inode);
+        return -1;
+    }
+    
+    memset(inode, 0, sizeof(vfs_inode_t));
+    inode->i_ino = ino;
+    inode->sb = sb;
+    inode->private_data = info;
+    inode->fops = &ext2_fops;
+    inode->iops = &ext2_iops;
+    ext2_update_vfs_inode(inode);
+    
+    *result = inode;
+    return 0;
+}
+
+static int ext2_iwrite(vfs_superblock_t* sb, vfs_inode_t* inode) {
+    struct ext2_private* priv = EXT2_SB(sb);
+    int ret;
+    
+    ext2_journal_start(priv, EXT2_CREDITS_INODE);
+    ret = ext2_write_inode(priv, inode->i_ino, &EXT2_I(inode)->raw);
+    ext2_journal_stop(priv);
+    return ret;
+}
+
+// Удалённый inode: на диске остаётся пустым, а не ссылается на освобождённые блоки
+static void ext2_delete_inode(struct ext2_private* priv, vfs_inode_t* inode) {
+    struct ext2_inode_info* info = EXT2_I(inode);
+    int is_dir = (info->raw.i_mode & 0xF000) == EXT2_S_IFDIR;
+    
+    ext2_journal_start(priv, ext2_delete_credits(priv));
+    ext2_free_blocks(priv, info);
+    ext2_write_inode(priv, inode->i_ino, &info->raw);
+    ext2_free_inode(priv, inode->i_ino, is_dir);
+    ext2_journal_stop(priv);
+}
+
+static void ext2_ifree(vfs_inode_t* inode) {
+    if (inode->private_data) {
+        if (EXT2_I(inode)->unlinked) {
+            ext2_delete_inode(EXT2_SB(inode->sb), inode);
+        } else {
+            ext2_discard_prealloc(EXT2_SB(inode->sb), EXT2_I(inode));
+        }
+        kfree(inode->private_data);
+    }
+    kfree(inode);
+}
 
 static void ext2_cleanup_private(struct ext2_private* priv) {
     if (!priv) return;
@@ -1023,36 +2234,295 @@ static void ext2_cleanup_private(struct ext2_private* priv) {
         kfree_aligned(priv->inode_buf);
         priv->inode_buf = NULL;
     }
-    if (priv->bitmap_buf) {
-        kfree_aligned(priv->bitmap_buf);
-        priv->bitmap_buf = NULL;
+    if (priv->gdt_dirty) {
+        kfree(priv->gdt_dirty);
+        priv->gdt_dirty = NULL;
+    }
+}
+
+static struct ext2_private* mounted = NULL;
+
+// Первичный суперблок лежит по смещению 1024 при любом размере блока.
+// journaled - правка идёт в транзакцию; иначе прямо в bcache (монтирование и размонтирование)
+static int ext2_write_super(struct ext2_private* priv, int journaled) {
+    uint32_t block = 1024 / priv->block_size;
+    uint32_t offset = 1024 % priv->block_size;
+    bcache_buf_t* b;
+    
+    b = bcache_read(priv->disk, (uint64_t)block * (priv->block_size / 512), priv->block_size);
+    if (!b) return -1;
+    
+    priv->sb.s_wtime = cmos_get_timestamp();
+    memcpy(b->data + offset, &priv->sb, sizeof(struct ext2_superblock));
+    if (journaled) ext2_journal_dirty(priv, b);
+    else bcache_write(b);
+    bcache_release(b);
+    return 0;
+}
+
+int ext2_flush_meta(struct ext2_private* priv) {
+    uint32_t per_block = priv->block_size / sizeof(struct ext2_group_desc);
+    uint32_t gdt_blocks = (priv->groups_count + per_block - 1) / per_block;
+    uint32_t spb = priv->block_size / 512;
+    int ret = 0;
+    
+    if (!priv->sb_dirty) return 0;
+    
+    for (uint32_t i = 0; i < gdt_blocks; i++) {
+        uint32_t first = i * per_block;
+        uint32_t count = priv->groups_count - first;
+        bcache_buf_t* b;
+        
+        if (!(priv->gdt_dirty[i / 32] & (1u << (i % 32)))) continue;
+        if (count > per_block) count = per_block;
+        
+        b = bcache_read(priv->disk, (uint64_t)(priv->sb.s_first_data_block + 1 + i) * spb, priv->block_size);
+        if (!b) {
+            ret = -1;
+            continue;
+        }
+        memcpy(b->data, &priv->groups[first], count * sizeof(struct ext2_group_desc));
+        ext2_journal_dirty(priv, b);
+        bcache_release(b);
+        
+        priv->gdt_dirty[i / 32] &= ~(1u << (i % 32));
+    }
+    
+    if (ext2_write_super(priv, 1) != 0) ret = -1;
+    if (ret == 0) priv->sb_dirty = 0;
+    return ret;
+}
+
+void ext2_poll(void) {
+    for (struct ext2_private* priv = mounted; priv; priv = priv->next) {
+        if (priv->sb_dirty && timer_check_ms(priv->meta_tick)) ext2_flush_meta(priv);
+    }
+    ext2_journal_poll();
+}
+
+static int ext2_group_has_super(struct ext2_private* priv, uint32_t group) {
+    static const uint32_t bases[] = { 3, 5, 7 };
+    
+    if (group <= 1) return 1;
+    if (!(priv->sb.s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER)) return 1;
+    
+    for (int i = 0; i < 3; i++) {
+        uint32_t p = bases[i];
+        while (p < group) p *= bases[i];
+        if (p == group) return 1;
+    }
+    return 0;
+}
+
+// Резервные копии суперблока в начале групп; обновляются только при размонтировании.
+// Пишем лишь туда, где копия уже есть: ext2_format места под них не оставляет
+static void ext2_write_backups(struct ext2_private* priv) {
+    uint32_t spb = priv->block_size / 512;
+    uint32_t updated = 0;
+    
+    for (uint32_t g = 1; g < priv->groups_count; g++) {
+        struct ext2_superblock* copy;
+        bcache_buf_t* b;
+        
+        if (!ext2_group_has_super(priv, g)) continue;
+        
+        b = bcache_read(priv->disk, (uint64_t)ext2_group_first_block(priv, g) * spb, priv->block_size);
+        if (!b) continue;
+        
+        copy = (struct ext2_superblock*)b->data;
+        if (copy->s_magic == EXT2_SUPER_MAGIC && copy->s_block_group_nr == g) {
+            memcpy(copy, &priv->sb, sizeof(struct ext2_superblock));
+            copy->s_block_group_nr = g;
+            bcache_write(b);
+            updated++;
+        }
+        bcache_release(b);
+    }
+    
+    if (updated) {
+        serial_puts("[EXT2] Backup superblocks updated: ");
+        serial_puts_num(updated);
+        serial_puts("\n");
+    }
+}
+
+// После нечистого размонтирования без журнала счётчики свободного места пересчитываются по битовым картам
+static void ext2_recount(struct ext2_private* priv) {
+    uint32_t free_blocks = 0;
+    uint32_t free_inodes = 0;
+    
+    for (uint32_t g = 0; g < priv->groups_count; g++) {
+        struct ext2_group_desc* d = &priv->groups[g];
+        uint32_t size = ext2_group_blocks(priv, g);
+        uint32_t fb = 0;
+        uint32_t fi = 0;
+        bcache_buf_t* b;
+        
+        b = ext2_bitmap_get(priv, g, 0);
+        if (!b) return;
+        for (uint32_t i = 0; i < size; i++) {
+            if (!ext2_test_bit(b->data, i)) fb++;
+        }
+        bcache_release(b);
+        
+        b = ext2_bitmap_get(priv, g, 1);
+        if (!b) return;
+        for (uint32_t i = 0; i < priv->inodes_per_group; i++) {
+            if (!ext2_test_bit(b->data, i)) fi++;
+        }
+        bcache_release(b);
+        
+        if (d->bg_free_blocks_count != fb || d->bg_free_inodes_count != fi) {
+            d->bg_free_blocks_count = fb;
+            d->bg_free_inodes_count = fi;
+            ext2_group_dirty(priv, g);
+        }
+        free_blocks += fb;
+        free_inodes += fi;
+    }
+    
+    if (priv->sb.s_free_blocks_count != free_blocks || priv->sb.s_free_inodes_count != free_inodes) {
+        serial_puts("[EXT2] Free counts fixed from bitmaps\n");
+        priv->sb.s_free_blocks_count = free_blocks;
+        priv->sb.s_free_inodes_count = free_inodes;
+        priv->sb_dirty = 1;
+    }
+}
+
+static int ext2_read_groups(struct ext2_private* priv) {
+    uint32_t groups_size = priv->groups_count * sizeof(struct ext2_group_desc);
+    uint32_t group_desc_blocks = (groups_size + priv->block_size - 1) / priv->block_size;
+    uint32_t spb = priv->block_size / 512;
+    uint8_t* buf = kmalloc_aligned(priv->block_size, 512);
+    int ret = 0;
+    
+    if (!buf) return -1;
+    
+    for (uint32_t i = 0; i < group_desc_blocks; i++) {
+        uint32_t block = priv->sb.s_first_data_block + 1 + i;
+        uint32_t offset = i * priv->block_size;
+        uint32_t len = groups_size - offset;
+        
+        if (len > priv->block_size) len = priv->block_size;
+        if (disk_read(priv->disk, (uint64_t)block * spb, spb, buf) != 0) {
+            ret = -1;
+            break;
+        }
+        memcpy((uint8_t*)priv->groups + offset, buf, len);
+    }
+    
+    kfree_aligned(buf);
+    return ret;
+}
+
+// ext3: журнал - обычный inode, карта его блоков строится один раз при монтировании
+static int ext2_open_journal(struct ext2_private* priv, int* replayed) {
+    struct ext2_inode raw;
+    uint32_t* map;
+    uint32_t blocks;
+    uint32_t lblock = 0;
+    int needs_recovery = (priv->sb.s_feature_incompat & EXT2_FEATURE_INCOMPAT_RECOVER) != 0;
+    
+    *replayed = 0;
+    
+    if (!(priv->sb.s_feature_compat & EXT2_FEATURE_COMPAT_HAS_JOURNAL) || priv->sb.s_journal_inum == 0) {
+        if (needs_recovery) {
+            serial_puts("[EXT2] ERROR: Needs recovery, but the journal is missing or external\n");
+            return -1;
+        }
+        return 0;
+    }
+    
+    if (ext2_read_inode(priv, priv->sb.s_journal_inum, &raw) != 0) return -1;
+    
+    blocks = raw.i_size / priv->block_size;
+    if (blocks < 2) return needs_recovery ? -1 : 0;
+    
+    map = kmalloc(blocks * sizeof(uint32_t));
+    if (!map) return -1;
+    
+    while (lblock < blocks) {
+        uint32_t pblock;
+        uint32_t run;
+        
+        if (ext2_bmap(priv, &raw, lblock, &pblock, &run) != 0 || pblock == 0) {
+            serial_puts("[EXT2] ERROR: Journal inode has holes\n");
+            kfree(map);
+            return -1;
+        }
+        for (uint32_t i = 0; i < run && lblock < blocks; i++) {
+            map[lblock++] = pblock + i;
+        }
     }
+    
+    return ext2_journal_load(priv, map, blocks, replayed);
+}
+
+// Размонтирование: журнал пуст, ФС помечена чистой, копии суперблока совпадают с основным
+static void ext2_put_super(struct vfs_superblock* sb) {
+    struct ext2_private* priv = EXT2_SB(sb);
+    struct ext2_private** pp = &mounted;
+    
+    if (!priv) return;
+    
+    while (*pp && *pp != priv) pp = &(*pp)->next;
+    if (*pp) *pp = priv->next;
+    
+    ext2_flush_meta(priv);
+    ext2_journal_release(priv);
+    
+    priv->sb.s_feature_incompat &= ~EXT2_FEATURE_INCOMPAT_RECOVER;
+    if (!(priv->sb.s_state & EXT2_ERROR_FS)) priv->sb.s_state |= EXT2_VALID_FS;
+    ext2_write_super(priv, 0);
+    ext2_write_backups(priv);
+    bcache_sync(priv->disk);
+    disk_flush(priv->disk);
+    
+    ext2_cleanup_private(priv);
+}
+
+// Пакет VFS не коммитит после каждого файла; транзакция закрывается по заполнению
+// между операциями и в конце пакета, так что в журнал попадают только целые операции
+static void ext2_batch(struct vfs_superblock* sb, int begin) {
+    ext2_journal_batch(EXT2_SB(sb), begin);
 }
 
+static vfs_superblock_operations_t ext2_sops = {
+    .read_inode = ext2_iget,
+    .write_inode = ext2_iwrite,
+    .free_inode = ext2_ifree,
+    .sync = ext2_sync,
+    .put_super = ext2_put_super,
+    .batch = ext2_batch,
+};
+
+
 static int ext2_mount(disk_t* disk, vfs_superblock_t** sb) {
     struct ext2_private* priv;
     vfs_superblock_t* super;
-    uint32_t group_desc_blocks;
-    uint32_t i;
     uint8_t* sb_buf;
     uint32_t groups_size;
     uint32_t groups_phys;
     int part_index;
-    uint32_t partition_offset;
+    int replayed = 0;
     
     serial_puts("[EXT2] Mounting on disk: ");
     serial_puts(disk->model);
     serial_puts("\n");
     
-    part_index = disk_find_partition_by_type(disk, EXT2_PARTITION_TYPE);
-    
-    if (part_index < 0) {
-        serial_puts("[EXT2] ERROR: No ext2 partition (type 0x83) found on disk\n");
-        return -1;
+    // Монтируем блочное устройство раздела, смещение транслирует драйвер диска
+    if (disk->type != DISK_TYPE_PARTITION) {
+        part_index = disk_find_partition_by_type(disk, EXT2_PARTITION_TYPE);
+        
+        if (part_index < 0) {
+            serial_puts("[EXT2] ERROR: No ext2 partition (type 0x83) found on disk\n");
+            return -1;
+        }
+        
+        disk = disk_get_partition(disk, part_index);
+        if (!disk) return -1;
     }
     
-    partition_offset = disk_get_partition_offset(disk, part_index);
-    
     priv = kmalloc_aligned(sizeof(struct ext2_private), 1024);
     if (!priv) return -1;
     
@@ -1065,7 +2535,7 @@ static int ext2_mount(disk_t* disk, vfs_superblock_t** sb) {
         return -1;
     }
     
-    if (disk_read_partition(disk, part_index, 2, 2, sb_buf) != 0) {
+    if (disk_read(disk, 2, 2, sb_buf) != 0) {
         kfree_aligned(sb_buf);
         kfree_aligned(priv);
         return -1;
@@ -1079,7 +2549,6 @@ static int ext2_mount(disk_t* disk, vfs_superblock_t** sb) {
         return -1;
     }
     
-    disk->partition_offset = partition_offset;
     priv->disk = disk;
     
     priv->block_size = 1024 << priv->sb.s_log_block_size;
@@ -1088,7 +2557,6 @@ static int ext2_mount(disk_t* disk, vfs_superblock_t** sb) {
     priv->inodes_per_group = priv->sb.s_inodes_per_group;
     priv->groups_count = (priv->sb.s_blocks_count + priv->blocks_per_group - 1) / priv->blocks_per_group;
     
-    group_desc_blocks = (priv->groups_count * sizeof(struct ext2_group_desc) + priv->block_size - 1) / priv->block_size;
     groups_size = priv->groups_count * sizeof(struct ext2_group_desc);
     
     priv->groups = (struct ext2_group_desc*)kmalloc_dma_region(groups_size, &groups_phys);
@@ -1098,37 +2566,65 @@ static int ext2_mount(disk_t* disk, vfs_superblock_t** sb) {
         return -1;
     }
     
-    memset(priv->groups, 0, groups_size);
-    
-    for (i = 0; i < group_desc_blocks; i++) {
-        uint32_t block = priv->sb.s_first_data_block + 1 + i;
-        uint32_t offset = i * priv->block_size;
-        uint32_t sector = block * (priv->block_size / 512);
-        
-        if (disk_read_partition(disk, part_index, sector, priv->block_size / 512, (uint8_t*)priv->groups + offset) != 0) {
-            kfree_dma_region(priv->groups, groups_size);
-            kfree_aligned(sb_buf);
-            kfree_aligned(priv);
-            return -1;
-        }
+    if (ext2_read_groups(priv) != 0) {
+        kfree_dma_region(priv->groups, groups_size);
+        kfree_aligned(sb_buf);
+        kfree_aligned(priv);
+        return -1;
     }
     
     priv->block_buf = kmalloc_aligned(priv->block_size, priv->block_size);
     priv->inode_buf = kmalloc_aligned(priv->block_size, priv->block_size);
-    priv->bitmap_buf = kmalloc_aligned(priv->block_size, priv->block_size);
+    priv->gdt_dirty = kcalloc((priv->groups_count + 31) / 32, sizeof(uint32_t));
     
-    if (!priv->block_buf || !priv->inode_buf || !priv->bitmap_buf) {
-        kfree_dma_region(priv->groups, groups_size);
-        if (priv->block_buf) kfree_aligned(priv->block_buf);
-        if (priv->inode_buf) kfree_aligned(priv->inode_buf);
-        if (priv->bitmap_buf) kfree_aligned(priv->bitmap_buf);
+    if (!priv->block_buf || !priv->inode_buf || !priv->gdt_dirty) {
+        ext2_cleanup_private(priv);
+        kfree_aligned(sb_buf);
+        kfree_aligned(priv);
+        return -1;
+    }
+    
+    // Проигрывание журнала может переписать и суперблок, и таблицу групп
+    if (ext2_open_journal(priv, &replayed) != 0) {
+        ext2_cleanup_private(priv);
         kfree_aligned(sb_buf);
         kfree_aligned(priv);
         return -1;
     }
+    if (replayed) {
+        bcache_invalidate(disk);
+        if (disk_read(disk, 2, 2, sb_buf) != 0 || ext2_read_groups(priv) != 0) {
+            ext2_journal_release(priv);
+            ext2_cleanup_private(priv);
+            kfree_aligned(sb_buf);
+            kfree_aligned(priv);
+            return -1;
+        }
+        memcpy(&priv->sb, sb_buf, sizeof(struct ext2_superblock));
+    }
+    
+    // С журналом нечистое размонтирование видно по RECOVER, без него - по сброшенному VALID
+    if (!priv->journal && !(priv->sb.s_state & EXT2_VALID_FS)) {
+        serial_puts("[EXT2] Filesystem was not cleanly unmounted\n");
+        ext2_recount(priv);
+    }
+    if (priv->journal) priv->sb.s_feature_incompat |= EXT2_FEATURE_INCOMPAT_RECOVER;
+    else priv->sb.s_state &= ~EXT2_VALID_FS;
+    priv->sb.s_mnt_count++;
+    priv->sb.s_mtime = cmos_get_timestamp();
+    ext2_write_super(priv, 0);
+    bcache_sync(disk);
+    
+    // Пересчитанное уже в суперблоке, а таблица групп уйдёт обычным сбросом
+    priv->sb_dirty = 0;
+    for (uint32_t i = 0; i < (priv->groups_count + 31) / 32; i++) {
+        if (priv->gdt_dirty[i]) priv->sb_dirty = 1;
+    }
+    if (priv->sb_dirty) priv->meta_tick = timer_calc_ms(0);
     
     super = kmalloc(sizeof(vfs_superblock_t));
     if (!super) {
+        ext2_journal_release(priv);
         ext2_cleanup_private(priv);
         kfree_aligned(sb_buf);
         kfree_aligned(priv);
@@ -1145,9 +2641,11 @@ static int ext2_mount(disk_t* disk, vfs_superblock_t** sb) {
     super->s_disk = disk;
     super->private_data = priv;
     super->sops = &ext2_sops;
-    super->s_root = kmalloc(sizeof(vfs_inode_t));
+    priv->vsb = super;
+    super->s_root = icache_get(super, EXT2_ROOT_INO);
     
     if (!super->s_root) {
+        ext2_journal_release(priv);
         ext2_cleanup_private(priv);
         kfree(super);
         kfree_aligned(sb_buf);
@@ -1155,14 +2653,9 @@ static int ext2_mount(disk_t* disk, vfs_superblock_t** sb) {
         return -1;
     }
     
-    memset(super->s_root, 0, sizeof(vfs_inode_t));
-    super->s_root->i_ino = EXT2_ROOT_INO;
-    super->s_root->private_data = priv;
-    super->s_root->sb = super;
-    super->s_root->fops = &ext2_fops;
-    super->s_root->iops = &ext2_iops;
-    
     *sb = super;
+    priv->next = mounted;
+    mounted = priv;
     
     kfree_aligned(sb_buf);
     return 0;
@@ -1287,6 +2780,7 @@ int ext2_format(disk_t* disk) {
     sb.s_feature_ro_compat = 0;
     memcpy(sb.s_volume_name, "PozitronOS", 10);
     
+    memset(&priv, 0, sizeof(priv));
     priv.disk = disk;
     priv.block_size = block_size;
     priv.sb = sb;
@@ -1337,8 +2831,6 @@ int ext2_format(disk_t* disk) {
         }
     }
     
-    kfree(priv.groups);
-    
     struct ext2_inode root_inode;
     memset(&root_inode, 0, sizeof(root_inode));
     root_inode.i_mode = EXT2_S_IFDIR | 0755;
@@ -1351,13 +2843,9 @@ int ext2_format(disk_t* disk) {
     root_inode.i_ctime = 0;
     root_inode.i_mtime = 0;
     
-    uint32_t root_inode_num = ext2_alloc_inode(&priv, 0);
-    if (root_inode_num != EXT2_ROOT_INO) {
-        kfree(buf);
-        return -1;
-    }
-    
+    // Корневой inode входит в зарезервированные и уже отмечен в карте группы 0
     ext2_write_inode(&priv, EXT2_ROOT_INO, &root_inode);
+    kfree(priv.groups);
     
     serial_puts("[EXT2] Format complete\n");
     kfree_aligned(buf);
@@ -1372,6 +2860,150 @@ int ext2_check(disk_t* disk) {
     return (sb.s_magic == EXT2_SUPER_MAGIC);
 }
 
+// Замер каталога: count файлов через VFS, затем поиск каждого напрямую в ext2 (минуя dcache)
+void ext2_dir_benchmark(const char* path, uint32_t count) {
+    vfs_inode_t* dir;
+    char full[256];
+    char name[16];
+    uint32_t path_len = strlen(path);
+    uint32_t created = 0;
+    uint32_t found = 0;
+    uint32_t start;
+    uint32_t create_ticks;
+    uint32_t lookup_ticks;
+    
+    if (path_len + sizeof(name) + 1 > sizeof(full)) return;
+    
+    vfs_mkdir(path, 0755);
+    if (vfs_stat(path, &dir) != 0 || !dir->iops || !dir->iops->lookup) {
+        serial_puts("[EXT2] Benchmark: no directory\n");
+        return;
+    }
+    icache_hold(dir);
+    
+    memcpy(full, path, path_len);
+    full[path_len] = '/';
+    
+    start = timer_get_ticks();
+    for (uint32_t i = 0; i < count; i++) {
+        struct vfs_file* f;
+        
+        memcpy(name, "f", 2);
+        itoa(i, name + 1, 10);
+        strcpy(full + path_len + 1, name);
+        
+        if (vfs_open(full, FS_O_WRONLY | FS_O_CREAT, &f) != 0) break;
+        vfs_close(f);
+        created++;
+    }
+    create_ticks = timer_get_ticks() - start;
+    
+    start = timer_get_ticks();
+    for (uint32_t i = 0; i < created; i++) {
+        vfs_inode_t* inode;
+        
+        memcpy(name, "f", 2);
+        itoa(i, name + 1, 10);
+        
+        if (dir->iops->lookup(dir, name, &inode) == 0) {
+            icache_put(inode);
+            found++;
+        }
+    }
+    lookup_ticks = timer_get_ticks() - start;
+    
+    serial_puts("[EXT2] Directory benchmark: ");
+    serial_puts(path);
+    serial_puts(EXT2_I(dir)->raw.i_flags & EXT2_INDEX_FL ? " (htree)\n" : " (linear)\n");
+    serial_puts("  Created: ");
+    serial_puts_num(created);
+    serial_puts(" in ");
+    serial_puts_num(TICKS_TO_MS(create_ticks));
+    serial_puts(" ms\n  Found:   ");
+    serial_puts_num(found);
+    serial_puts(" in ");
+    serial_puts_num(TICKS_TO_MS(lookup_ticks));
+    serial_puts(" ms\n  Blocks:  ");
+    serial_puts_num(EXT2_I(dir)->raw.i_size / EXT2_SB(dir->sb)->block_size);
+    serial_puts("\n");
+    
+    icache_put(dir);
+}
+
+// Файл из blocks блоков, заполненных байтом fill, и коммит
+static int ext2_stress_file(const char* path, uint8_t* buf, uint32_t block_size, uint32_t blocks) {
+    struct vfs_file* f;
+    uint32_t written;
+    int ret = 0;
+    
+    if (vfs_open(path, FS_O_WRONLY | FS_O_CREAT | FS_O_TRUNC, &f) != 0) return -1;
+    for (uint32_t i = 0; i < blocks && ret == 0; i++) {
+        if (vfs_write(f, buf, block_size, &written) != 0 || written != block_size) ret = -1;
+    }
+    if (vfs_fsync(f) != 0) ret = -1;
+    vfs_close(f);
+    return ret;
+}
+
+// Для crash_test.sh: закоммиченный файл с косвенным блоком удаляется, и тут же пишется
+// файл данных, который получает его блоки. Если освобождённый косвенный блок отдан под
+// данные до коммита отзыва, сбой в этом окне проигрывает старую копию поверх данных.
+// Файлы данных d0..d15 целиком из EXT2_STRESS_FILL - хост проверяет их после восстановления
+void ext2_reuse_stress(const char* path, uint32_t rounds) {
+    vfs_inode_t* dir;
+    char meta[256];
+    char data[256];
+    char name[16];
+    uint32_t path_len = strlen(path);
+    uint32_t block_size;
+    uint32_t blocks;
+    uint32_t done = 0;
+    uint8_t* buf;
+    
+    if (path_len + sizeof(name) + 1 > sizeof(meta)) return;
+    
+    vfs_mkdir(path, 0755);
+    if (vfs_stat(path, &dir) != 0) {
+        serial_puts("[EXT2] Reuse stress: no directory\n");
+        return;
+    }
+    block_size = EXT2_SB(dir->sb)->block_size;
+    
+    // Прямые блоки и ещё половина косвенного
+    blocks = 12 + block_size / 8;
+    buf = kmalloc(block_size);
+    if (!buf) return;
+    
+    memcpy(meta, path, path_len);
+    strcpy(meta + path_len, "/meta");
+    memcpy(data, path, path_len);
+    data[path_len] = '/';
+    
+    for (uint32_t i = 0; i < rounds; i++) {
+        memcpy(name, "d", 2);
+        itoa(i % 16, name + 1, 10);
+        strcpy(data + path_len + 1, name);
+        
+        // Косвенный блок этого файла - метаданные, его копия в логе
+        memset(buf, (int)i, block_size);
+        if (ext2_stress_file(meta, buf, block_size, blocks) != 0) break;
+        if (vfs_unlink(meta) != 0) break;
+        
+        vfs_unlink(data);
+        memset(buf, EXT2_STRESS_FILL, block_size);
+        if (ext2_stress_file(data, buf, block_size, blocks) != 0) break;
+        done++;
+    }
+    
+    kfree(buf);
+    
+    serial_puts("[EXT2] Reuse stress: ");
+    serial_puts_num(done);
+    serial_puts(" of ");
+    serial_puts_num(rounds);
+    serial_puts(" rounds\n");
+}
+
 static vfs_filesystem_t ext2_fs = {
     .name = "ext2",
     .magic = EXT2_SUPER_MAGIC,
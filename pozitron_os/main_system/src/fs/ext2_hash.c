@@ -0,0 +1,175 @@
+#include "fs/ext2.h"
+#include "lib/string.h"
+#include <stddef.h>
+
+// Хэши имён для HTree, побитно совместимые с ext3/e2fsprogs
+
+#define ROL32(x, s) (((x) << (s)) | ((x) >> (32 - (s))))
+
+#define MD4_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD4_G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define MD4_H(x, y, z) ((x) ^ (y) ^ (z))
+
+#define MD4_ROUND(f, a, b, c, d, x, s) \
+    (a += f(b, c, d) + (x), a = ROL32(a, s))
+
+#define MD4_K1 0
+#define MD4_K2 013240474631UL
+#define MD4_K3 015666365641UL
+
+#define TEA_DELTA 0x9E3779B9
+
+static void half_md4_transform(uint32_t buf[4], const uint32_t in[8]) {
+    uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+    MD4_ROUND(MD4_F, a, b, c, d, in[0] + MD4_K1,  3);
+    MD4_ROUND(MD4_F, d, a, b, c, in[1] + MD4_K1,  7);
+    MD4_ROUND(MD4_F, c, d, a, b, in[2] + MD4_K1, 11);
+    MD4_ROUND(MD4_F, b, c, d, a, in[3] + MD4_K1, 19);
+    MD4_ROUND(MD4_F, a, b, c, d, in[4] + MD4_K1,  3);
+    MD4_ROUND(MD4_F, d, a, b, c, in[5] + MD4_K1,  7);
+    MD4_ROUND(MD4_F, c, d, a, b, in[6] + MD4_K1, 11);
+    MD4_ROUND(MD4_F, b, c, d, a, in[7] + MD4_K1, 19);
+
+    MD4_ROUND(MD4_G, a, b, c, d, in[1] + MD4_K2,  3);
+    MD4_ROUND(MD4_G, d, a, b, c, in[3] + MD4_K2,  5);
+    MD4_ROUND(MD4_G, c, d, a, b, in[5] + MD4_K2,  9);
+    MD4_ROUND(MD4_G, b, c, d, a, in[7] + MD4_K2, 13);
+    MD4_ROUND(MD4_G, a, b, c, d, in[0] + MD4_K2,  3);
+    MD4_ROUND(MD4_G, d, a, b, c, in[2] + MD4_K2,  5);
+    MD4_ROUND(MD4_G, c, d, a, b, in[4] + MD4_K2,  9);
+    MD4_ROUND(MD4_G, b, c, d, a, in[6] + MD4_K2, 13);
+
+    MD4_ROUND(MD4_H, a, b, c, d, in[3] + MD4_K3,  3);
+    MD4_ROUND(MD4_H, d, a, b, c, in[7] + MD4_K3,  9);
+    MD4_ROUND(MD4_H, c, d, a, b, in[2] + MD4_K3, 11);
+    MD4_ROUND(MD4_H, b, c, d, a, in[6] + MD4_K3, 15);
+    MD4_ROUND(MD4_H, a, b, c, d, in[1] + MD4_K3,  3);
+    MD4_ROUND(MD4_H, d, a, b, c, in[5] + MD4_K3,  9);
+    MD4_ROUND(MD4_H, c, d, a, b, in[0] + MD4_K3, 11);
+    MD4_ROUND(MD4_H, b, c, d, a, in[4] + MD4_K3, 15);
+
+    buf[0] += a;
+    buf[1] += b;
+    buf[2] += c;
+    buf[3] += d;
+}
+
+static void tea_transform(uint32_t buf[4], const uint32_t in[4]) {
+    uint32_t sum = 0;
+    uint32_t b0 = buf[0], b1 = buf[1];
+    uint32_t a = in[0], b = in[1], c = in[2], d = in[3];
+    int n = 16;
+
+    do {
+        sum += TEA_DELTA;
+        b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+        b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+    } while (--n);
+
+    buf[0] += b0;
+    buf[1] += b1;
+}
+
+static uint32_t dx_hack_hash(const char* name, uint32_t len, int is_unsigned) {
+    uint32_t hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+
+    while (len--) {
+        int c = is_unsigned ? (int)(uint8_t)*name : (int)(int8_t)*name;
+        name++;
+        hash = hash1 + (hash0 ^ (uint32_t)(c * 7152373));
+        if (hash & 0x80000000) hash -= 0x7fffffff;
+        hash1 = hash0;
+        hash0 = hash;
+    }
+    return hash0 << 1;
+}
+
+// Упаковка имени в слова; знаковость char влияет на результат, поэтому оба варианта
+static void str2hashbuf(const char* msg, uint32_t len, uint32_t* buf, int num, int is_unsigned) {
+    uint32_t pad, val;
+    uint32_t i;
+
+    pad = len | (len << 8);
+    pad |= pad << 16;
+
+    val = pad;
+    if (len > (uint32_t)num * 4) len = num * 4;
+    for (i = 0; i < len; i++) {
+        int c = is_unsigned ? (int)(uint8_t)msg[i] : (int)(int8_t)msg[i];
+        val = (uint32_t)c + (val << 8);
+        if ((i % 4) == 3) {
+            *buf++ = val;
+            val = pad;
+            num--;
+        }
+    }
+    if (--num >= 0) *buf++ = val;
+    while (--num >= 0) *buf++ = pad;
+}
+
+int ext2_dirhash(const char* name, uint32_t len, uint32_t version,
+                 const uint32_t* seed, uint32_t* hash, uint32_t* minor_hash) {
+    uint32_t h;
+    uint32_t minor = 0;
+    uint32_t buf[4];
+    uint32_t in[8];
+    int is_unsigned = 0;
+    int remaining = (int)len;
+    const char* p = name;
+
+    buf[0] = 0x67452301;
+    buf[1] = 0xefcdab89;
+    buf[2] = 0x98badcfe;
+    buf[3] = 0x10325476;
+
+    if (seed && (seed[0] | seed[1] | seed[2] | seed[3])) {
+        memcpy(buf, seed, sizeof(buf));
+    }
+
+    switch (version) {
+    case EXT2_DX_HASH_LEGACY_UNSIGNED:
+        h = dx_hack_hash(name, len, 1);
+        break;
+    case EXT2_DX_HASH_LEGACY:
+        h = dx_hack_hash(name, len, 0);
+        break;
+    case EXT2_DX_HASH_HALF_MD4_UNSIGNED:
+        is_unsigned = 1;
+        // fallthrough
+    case EXT2_DX_HASH_HALF_MD4:
+        while (remaining > 0) {
+            str2hashbuf(p, remaining, in, 8, is_unsigned);
+            half_md4_transform(buf, in);
+            remaining -= 32;
+            p += 32;
+        }
+        minor = buf[2];
+        h = buf[1];
+        break;
+    case EXT2_DX_HASH_TEA_UNSIGNED:
+        is_unsigned = 1;
+        // fallthrough
+    case EXT2_DX_HASH_TEA:
+        while (remaining > 0) {
+            str2hashbuf(p, remaining, in, 4, is_unsigned);
+            tea_transform(buf, in);
+            remaining -= 16;
+            p += 16;
+        }
+        h = buf[0];
+        minor = buf[1];
+        break;
+    default:
+        *hash = 0;
+        return -1;
+    }
+
+    // Младший бит занят под признак продолжения коллизии, 0xFFFFFFFE - маркер конца
+    h &= ~1u;
+    if (h == (0x7fffffffu << 1)) h = (0x7fffffffu - 1) << 1;
+
+    *hash = h;
+    if (minor_hash) *minor_hash = minor;
+    return 0;
+}
@@ -0,0 +1,730 @@
+#include "fs/ext2_journal.h"
+#include "fs/ext2.h"
+#include "fs/icache.h"
+#include "kernel/memory.h"
+#include "kernel/timer_utils.h"
+#include "drivers/serial.h"
+#include "lib/string.h"
+#include <stddef.h>
+
+// Упорядоченный режим ext3, только метаданные. Перед коммитом на место уходят данные
+// и все прошлые транзакции, поэтому в логе живёт лишь хвост, который ещё может
+// понадобиться; при нехватке места лог просто начинается заново с s_first.
+
+#define JBD_IO_SIZE        (BCACHE_MAX_IO_SECTORS * 512)
+#define JBD_REVOKE_HASH    256
+
+struct ext2_journal {
+    struct ext2_private* priv;
+    uint32_t* map;              // Логический блок журнала -> блок ФС
+    uint32_t blocks;            // s_maxlen
+    uint32_t first;             // s_first
+    uint32_t head;              // Следующий свободный блок лога
+    uint32_t sequence;          // Номер открытой транзакции
+    uint8_t  empty;             // На диске s_start == 0
+    uint8_t  committing;
+    uint8_t* sb_buf;            // Блок суперблока журнала
+    uint8_t* io_buf;            // Набор подряд идущих блоков лога для одной записи
+    uint32_t io_first;
+    uint32_t io_count;
+
+    // Открытая транзакция
+    bcache_buf_t** bufs;
+    uint32_t count;
+    uint32_t cap;
+    uint32_t* revoked;
+    uint32_t revoke_count;
+    uint32_t revoke_cap;
+    struct jbd_free_run* frees; // Освобождены транзакцией, в карте блоков до её коммита
+    uint32_t free_count;
+    uint32_t free_cap;
+    uint32_t soft_limit;        // Коммит по окончании операции
+    uint32_t hard_limit;        // Коммит перед операцией, чей резерв сюда не влезет
+    uint32_t handles;
+    uint32_t batch;             // Пакет VFS: коммиты только по hard_limit
+    uint32_t commit_tick;
+
+    uint32_t commits;
+    struct ext2_journal* next;
+};
+
+struct jbd_free_run {
+    uint32_t block;
+    uint32_t count;
+};
+
+struct jbd_revoke_entry {
+    uint32_t block;
+    uint32_t sequence;          // Последняя транзакция, отозвавшая блок
+    struct jbd_revoke_entry* next;
+};
+
+static struct ext2_journal* journals = NULL;
+
+static inline uint32_t be32(uint32_t v) {
+    return __builtin_bswap32(v);
+}
+
+static struct jbd_superblock* jsb(struct ext2_journal* j) {
+    return (struct jbd_superblock*)j->sb_buf;
+}
+
+static uint32_t jbd_spb(struct ext2_journal* j) {
+    return j->priv->block_size / 512;
+}
+
+static uint32_t jbd_next(struct ext2_journal* j, uint32_t lblock) {
+    return (lblock + 1 >= j->blocks) ? j->first : lblock + 1;
+}
+
+static int jbd_read(struct ext2_journal* j, uint32_t lblock, void* buf) {
+    return disk_read(j->priv->disk, (uint64_t)j->map[lblock] * jbd_spb(j), jbd_spb(j), buf);
+}
+
+static int jbd_write_super(struct ext2_journal* j) {
+    return disk_write(j->priv->disk, (uint64_t)j->map[0] * jbd_spb(j), jbd_spb(j), j->sb_buf);
+}
+
+static void jbd_header(void* block, uint32_t type, uint32_t sequence) {
+    struct jbd_header* h = (struct jbd_header*)block;
+    h->h_magic = be32(JBD_MAGIC);
+    h->h_blocktype = be32(type);
+    h->h_sequence = be32(sequence);
+}
+
+// ============ Запись лога ============
+
+static int jbd_io_flush(struct ext2_journal* j) {
+    int rc;
+
+    if (j->io_count == 0) return 0;
+    rc = disk_write(j->priv->disk, (uint64_t)j->map[j->io_first] * jbd_spb(j),
+                    j->io_count * jbd_spb(j), j->io_buf);
+    j->io_count = 0;
+    return rc;
+}
+
+// Место под очередной блок лога; смежные на диске блоки уходят одной командой
+static uint8_t* jbd_io_slot(struct ext2_journal* j, uint32_t lblock, int* rc) {
+    uint32_t bs = j->priv->block_size;
+
+    if (j->io_count &&
+        (lblock != j->io_first + j->io_count ||
+         j->map[lblock] != j->map[j->io_first] + j->io_count ||
+         (j->io_count + 1) * bs > JBD_IO_SIZE)) {
+        if (jbd_io_flush(j) != 0) *rc = -1;
+    }
+
+    if (j->io_count == 0) j->io_first = lblock;
+    return j->io_buf + (j->io_count++) * bs;
+}
+
+static uint32_t jbd_tags_per_desc(struct ext2_journal* j) {
+    // UUID пишется только после первого тега
+    return (j->priv->block_size - sizeof(struct jbd_header) - 16) / sizeof(struct jbd_block_tag);
+}
+
+static uint32_t jbd_revokes_per_block(struct ext2_journal* j) {
+    return (j->priv->block_size - sizeof(struct jbd_revoke_header)) / sizeof(uint32_t);
+}
+
+static uint32_t jbd_tx_blocks(struct ext2_journal* j, uint32_t count, uint32_t revokes) {
+    uint32_t tags = jbd_tags_per_desc(j);
+    uint32_t per_revoke = jbd_revokes_per_block(j);
+    return count + (count + tags - 1) / tags + (revokes + per_revoke - 1) / per_revoke + 1;
+}
+
+static void jbd_write_revokes(struct ext2_journal* j, int* rc) {
+    uint32_t per_block = jbd_revokes_per_block(j);
+    uint32_t done = 0;
+
+    while (done < j->revoke_count) {
+        uint32_t n = j->revoke_count - done;
+        uint8_t* blk = jbd_io_slot(j, j->head, rc);
+        struct jbd_revoke_header* rh = (struct jbd_revoke_header*)blk;
+        uint32_t* records = (uint32_t*)(blk + sizeof(struct jbd_revoke_header));
+
+        if (n > per_block) n = per_block;
+
+        memset(blk, 0, j->priv->block_size);
+        jbd_header(blk, JBD_REVOKE_BLOCK, j->sequence);
+        rh->r_count = be32(sizeof(struct jbd_revoke_header) + n * sizeof(uint32_t));
+        for (uint32_t i = 0; i < n; i++) {
+            records[i] = be32(j->revoked[done + i]);
+        }
+
+        done += n;
+        j->head = jbd_next(j, j->head);
+    }
+}
+
+// Дескриптор и копии блоков за ним
+static void jbd_write_blocks(struct ext2_journal* j, int* rc) {
+    uint32_t bs = j->priv->block_size;
+    uint32_t spb = jbd_spb(j);
+    uint32_t per_desc = jbd_tags_per_desc(j);
+    uint32_t done = 0;
+
+    while (done < j->count) {
+        uint32_t n = j->count - done;
+        uint8_t* desc;
+        uint32_t offset = sizeof(struct jbd_header);
+
+        if (n > per_desc) n = per_desc;
+
+        desc = jbd_io_slot(j, j->head, rc);
+        memset(desc, 0, bs);
+        jbd_header(desc, JBD_DESCRIPTOR_BLOCK, j->sequence);
+        j->head = jbd_next(j, j->head);
+
+        // Теги заполняются целиком до копий: слот под копию может вытолкнуть дескриптор на диск
+        for (uint32_t i = 0; i < n; i++) {
+            bcache_buf_t* b = j->bufs[done + i];
+            struct jbd_block_tag* tag = (struct jbd_block_tag*)(desc + offset);
+            uint32_t flags = 0;
+
+            if (*(uint32_t*)b->data == be32(JBD_MAGIC)) flags |= JBD_FLAG_ESCAPE;
+            if (i > 0) flags |= JBD_FLAG_SAME_UUID;
+            if (i == n - 1) flags |= JBD_FLAG_LAST_TAG;
+
+            tag->t_blocknr = be32((uint32_t)b->lba / spb);
+            tag->t_flags = be32(flags);
+            offset += sizeof(struct jbd_block_tag);
+            if (i == 0) {
+                memcpy(desc + offset, jsb(j)->s_uuid, 16);
+                offset += 16;
+            }
+        }
+
+        for (uint32_t i = 0; i < n; i++) {
+            uint8_t* copy = jbd_io_slot(j, j->head, rc);
+            memcpy(copy, j->bufs[done + i]->data, bs);
+            if (*(uint32_t*)copy == be32(JBD_MAGIC)) *(uint32_t*)copy = 0;
+            j->head = jbd_next(j, j->head);
+        }
+
+        done += n;
+    }
+}
+
+// Коммит на диске: отзывы больше не дадут логу лечь поверх новых данных, блоки можно
+// отдавать. Правка карт уходит уже в следующую транзакцию
+static void jbd_release_frees(struct ext2_journal* j) {
+    uint32_t n = j->free_count;
+
+    j->free_count = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        ext2_release_blocks(j->priv, j->frees[i].block, j->frees[i].count);
+    }
+}
+
+int ext2_journal_commit(struct ext2_private* priv) {
+    struct ext2_journal* j = priv ? priv->journal : NULL;
+    disk_t* disk;
+    uint32_t need;
+    uint8_t* blk;
+    int rc = 0;
+
+    if (!j || j->committing) return 0;
+
+    j->committing = 1;
+
+    // inode, суперблок и таблица групп живут в памяти и попадают в буферы только при сбросе - забираем их в транзакцию
+    if (priv->vsb) icache_sync(priv->vsb);
+    ext2_flush_meta(priv);
+
+    if (j->count == 0 && j->revoke_count == 0) {
+        // Всё, что освобождение могло задеть, уже закоммичено раньше
+        jbd_release_frees(j);
+        j->committing = 0;
+        return 0;
+    }
+
+    disk = priv->disk;
+    need = jbd_tx_blocks(j, j->count, j->revoke_count);
+
+    // Упорядоченный режим: данные и прошлые транзакции на месте раньше, чем коммит этой
+    if (bcache_sync(disk) != 0) rc = -1;
+    disk_flush(disk);
+
+    // Всё до этой транзакции уже на месте - при нехватке места лог начинается заново
+    if (j->empty || need > j->blocks - j->head) {
+        j->head = j->first;
+        jsb(j)->s_start = be32(j->first);
+        jsb(j)->s_sequence = be32(j->sequence);
+        if (j->revoke_count) jsb(j)->s_feature_incompat |= be32(JBD_FEATURE_INCOMPAT_REVOKE);
+        if (jbd_write_super(j) != 0) rc = -1;
+        j->empty = 0;
+    }
+
+    jbd_write_revokes(j, &rc);
+    jbd_write_blocks(j, &rc);
+    if (jbd_io_flush(j) != 0) rc = -1;
+    disk_flush(disk);
+
+    // Коммит-блок пишется только после того, как всё остальное на диске
+    blk = jbd_io_slot(j, j->head, &rc);
+    memset(blk, 0, priv->block_size);
+    jbd_header(blk, JBD_COMMIT_BLOCK, j->sequence);
+    j->head = jbd_next(j, j->head);
+    if (jbd_io_flush(j) != 0) rc = -1;
+    disk_flush(disk);
+
+    if (rc != 0) serial_puts("[JBD] Commit write failed\n");
+
+    // Теперь блоки могут идти на место обычным сбросом bcache
+    for (uint32_t i = 0; i < j->count; i++) {
+        bcache_unpin(j->bufs[i]);
+    }
+
+    j->count = 0;
+    j->revoke_count = 0;
+    j->sequence++;
+    j->commits++;
+
+    jbd_release_frees(j);
+    j->committing = 0;
+    return rc;
+}
+
+// ============ Транзакции ============
+
+static int jbd_grow(void** array, uint32_t* cap, uint32_t elem) {
+    uint32_t new_cap = *cap ? *cap * 2 : 64;
+    void* p = krealloc(*array, new_cap * elem);
+    if (!p) return -1;
+    *array = p;
+    *cap = new_cap;
+    return 0;
+}
+
+// Коммит возможен только между операциями, поэтому место под резерв внешней
+// операции освобождается до её начала: и в логе, и в списке транзакции
+void ext2_journal_start(struct ext2_private* priv, uint32_t credits) {
+    struct ext2_journal* j = priv ? priv->journal : NULL;
+
+    if (!j) return;
+
+    if (j->handles == 0 && !j->committing) {
+        if (j->count && j->count + credits > j->hard_limit) ext2_journal_commit(priv);
+
+        while (j->cap < j->count + credits) {
+            if (jbd_grow((void**)&j->bufs, &j->cap, sizeof(bcache_buf_t*)) != 0) {
+                if (j->count) ext2_journal_commit(priv);
+                break;
+            }
+        }
+    }
+    j->handles++;
+}
+
+void ext2_journal_stop(struct ext2_private* priv) {
+    struct ext2_journal* j = priv ? priv->journal : NULL;
+
+    if (!j || j->handles == 0) return;
+    if (--j->handles == 0 && j->batch == 0 && j->count >= j->soft_limit) {
+        ext2_journal_commit(priv);
+    }
+}
+
+void ext2_journal_batch(struct ext2_private* priv, int begin) {
+    struct ext2_journal* j = priv ? priv->journal : NULL;
+
+    if (!j) return;
+    if (begin) {
+        j->batch++;
+        return;
+    }
+    if (j->batch == 0) return;
+    if (--j->batch == 0 && j->handles == 0 && j->count >= j->soft_limit) {
+        ext2_journal_commit(priv);
+    }
+}
+
+static void jbd_arm_timer(struct ext2_journal* j) {
+    if (j->count + j->revoke_count + j->free_count == 1) j->commit_tick = timer_calc_ms(EXT2_JOURNAL_COMMIT_MS);
+}
+
+int ext2_journal_dirty(struct ext2_private* priv, bcache_buf_t* b) {
+    struct ext2_journal* j = priv ? priv->journal : NULL;
+    uint32_t block;
+
+    if (!b) return -1;
+    if (!j) return bcache_write(b);
+
+    if (!(b->flags & BCACHE_PINNED)) {
+        if (j->count == j->cap && jbd_grow((void**)&j->bufs, &j->cap, sizeof(bcache_buf_t*)) != 0) {
+            // Между операциями транзакцию можно закрыть; внутри операции, вышедшей
+            // за резерв, блок без памяти под список уходит мимо журнала
+            if (j->handles == 0) ext2_journal_commit(priv);
+            if (j->count == j->cap) {
+                serial_puts("[JBD] Transaction list full, block written unjournaled\n");
+                return bcache_write(b);
+            }
+        }
+
+        bcache_pin(b);
+        j->bufs[j->count++] = b;
+        jbd_arm_timer(j);
+
+        // Блок снова стал метаданными - отзыв в этой же транзакции убил бы новую копию
+        block = (uint32_t)b->lba / jbd_spb(j);
+        for (uint32_t i = 0; i < j->revoke_count; i++) {
+            if (j->revoked[i] == block) {
+                j->revoked[i] = j->revoked[--j->revoke_count];
+                break;
+            }
+        }
+    }
+
+    bcache_write(b);
+
+    // Запись вне операций (inode при закрытии файла) - сама себе граница
+    if (j->handles == 0 && j->count >= j->hard_limit && !j->committing) {
+        ext2_journal_commit(priv);
+    }
+    return 0;
+}
+
+void ext2_journal_revoke(struct ext2_private* priv, uint32_t block) {
+    struct ext2_journal* j = priv ? priv->journal : NULL;
+
+    if (!j) return;
+
+    for (uint32_t i = 0; i < j->revoke_count; i++) {
+        if (j->revoked[i] == block) return;
+    }
+    if (j->revoke_count == j->revoke_cap &&
+        jbd_grow((void**)&j->revoked, &j->revoke_cap, sizeof(uint32_t)) != 0) {
+        return;
+    }
+
+    j->revoked[j->revoke_count++] = block;
+    jbd_arm_timer(j);
+}
+
+int ext2_journal_free(struct ext2_private* priv, uint32_t block, uint32_t count) {
+    struct ext2_journal* j = priv ? priv->journal : NULL;
+    struct jbd_free_run* last;
+
+    if (!j || count == 0) return -1;
+
+    // Освобождение подряд (файл, окно предвыделения) - одна серия
+    last = j->free_count ? &j->frees[j->free_count - 1] : NULL;
+    if (last && last->block + last->count == block) {
+        last->count += count;
+        return 0;
+    }
+
+    if (j->free_count == j->free_cap &&
+        jbd_grow((void**)&j->frees, &j->free_cap, sizeof(struct jbd_free_run)) != 0) {
+        return -1;
+    }
+
+    j->frees[j->free_count].block = block;
+    j->frees[j->free_count].count = count;
+    j->free_count++;
+    jbd_arm_timer(j);
+    return 0;
+}
+
+void ext2_journal_poll(void) {
+    for (struct ext2_journal* j = journals; j; j = j->next) {
+        if (j->handles || j->batch || j->committing) continue;
+        if (j->count == 0 && j->revoke_count == 0 && j->free_count == 0) continue;
+        if (!timer_check_ms(j->commit_tick)) continue;
+        ext2_journal_commit(j->priv);
+    }
+}
+
+// ============ Восстановление ============
+
+enum jbd_pass { JBD_PASS_SCAN, JBD_PASS_REVOKE, JBD_PASS_REPLAY };
+
+static uint32_t jbd_revoke_hash(uint32_t block) {
+    return (block * 0x9E3779B1) >> 24;
+}
+
+static int jbd_revoke_add(struct jbd_revoke_entry** table, uint32_t block, uint32_t sequence) {
+    struct jbd_revoke_entry* e;
+
+    for (e = table[jbd_revoke_hash(block)]; e; e = e->next) {
+        if (e->block == block) {
+            if ((int32_t)(sequence - e->sequence) > 0) e->sequence = sequence;
+            return 0;
+        }
+    }
+
+    e = kmalloc(sizeof(struct jbd_revoke_entry));
+    if (!e) return -1;
+    e->block = block;
+    e->sequence = sequence;
+    e->next = table[jbd_revoke_hash(block)];
+    table[jbd_revoke_hash(block)] = e;
+    return 0;
+}
+
+// Копия из транзакции sequence не проигрывается, если блок отозван ею же или позже
+static int jbd_revoked(struct jbd_revoke_entry** table, uint32_t block, uint32_t sequence) {
+    for (struct jbd_revoke_entry* e = table[jbd_revoke_hash(block)]; e; e = e->next) {
+        if (e->block == block) return (int32_t)(e->sequence - sequence) >= 0;
+    }
+    return 0;
+}
+
+static void jbd_revoke_free(struct jbd_revoke_entry** table) {
+    for (int i = 0; i < JBD_REVOKE_HASH; i++) {
+        struct jbd_revoke_entry* e = table[i];
+        while (e) {
+            struct jbd_revoke_entry* next = e->next;
+            kfree(e);
+            e = next;
+        }
+        table[i] = NULL;
+    }
+}
+
+// Один проход по логу от s_start. SCAN находит первую незакоммиченную транзакцию (*end),
+// остальные проходы доходят до неё
+static int jbd_walk(struct ext2_journal* j, enum jbd_pass pass, uint32_t* end,
+                    struct jbd_revoke_entry** revokes, uint8_t* buf, uint8_t* data, uint32_t* replayed) {
+    uint32_t bs = j->priv->block_size;
+    uint32_t spb = jbd_spb(j);
+    uint32_t sequence = be32(jsb(j)->s_sequence);
+    uint32_t lblock = be32(jsb(j)->s_start);
+    uint32_t seen = 0;
+
+    while (pass == JBD_PASS_SCAN || sequence != *end) {
+        struct jbd_header* h = (struct jbd_header*)buf;
+        uint32_t type;
+
+        // Лог не может быть длиннее самого журнала - защита от зацикливания
+        if (++seen > j->blocks) break;
+        if (jbd_read(j, lblock, buf) != 0) return -1;
+        if (be32(h->h_magic) != JBD_MAGIC || be32(h->h_sequence) != sequence) break;
+
+        type = be32(h->h_blocktype);
+        lblock = jbd_next(j, lblock);
+
+        if (type == JBD_DESCRIPTOR_BLOCK) {
+            uint32_t offset = sizeof(struct jbd_header);
+
+            while (offset + sizeof(struct jbd_block_tag) <= bs) {
+                struct jbd_block_tag* tag = (struct jbd_block_tag*)(buf + offset);
+                uint32_t flags = be32(tag->t_flags) & 0xFFFF;
+                uint32_t target = be32(tag->t_blocknr);
+
+                if (pass == JBD_PASS_REPLAY && !jbd_revoked(revokes, target, sequence) &&
+                    target < j->priv->sb.s_blocks_count) {
+                    if (jbd_read(j, lblock, data) != 0) return -1;
+                    if (flags & JBD_FLAG_ESCAPE) *(uint32_t*)data = be32(JBD_MAGIC);
+                    if (disk_write(j->priv->disk, (uint64_t)target * spb, spb, data) != 0) return -1;
+                    (*replayed)++;
+                }
+
+                lblock = jbd_next(j, lblock);
+                offset += sizeof(struct jbd_block_tag);
+                if (!(flags & JBD_FLAG_SAME_UUID)) offset += 16;
+                if (flags & JBD_FLAG_LAST_TAG) break;
+            }
+        } else if (type == JBD_COMMIT_BLOCK) {
+            sequence++;
+        } else if (type == JBD_REVOKE_BLOCK) {
+            if (pass == JBD_PASS_REVOKE) {
+                struct jbd_revoke_header* rh = (struct jbd_revoke_header*)buf;
+                uint32_t used = be32(rh->r_count);
+                uint32_t* records = (uint32_t*)(buf + sizeof(struct jbd_revoke_header));
+
+                if (used > bs) used = bs;
+                for (uint32_t off = sizeof(struct jbd_revoke_header); off + 4 <= used; off += 4) {
+                    if (jbd_revoke_add(revokes, be32(*records++), sequence) != 0) return -1;
+                }
+            }
+        } else {
+            break;
+        }
+    }
+
+    if (pass == JBD_PASS_SCAN) *end = sequence;
+    return 0;
+}
+
+static int jbd_recover(struct ext2_journal* j, int* replayed) {
+    struct jbd_revoke_entry* revokes[JBD_REVOKE_HASH];
+    uint32_t bs = j->priv->block_size;
+    uint32_t end = 0;
+    uint32_t blocks = 0;
+    uint8_t* buf;
+    uint8_t* data;
+    int rc = -1;
+
+    if (jsb(j)->s_start == 0) return 0;
+
+    buf = kmalloc_aligned(bs, 512);
+    data = kmalloc_aligned(bs, 512);
+    memset(revokes, 0, sizeof(revokes));
+
+    if (buf && data &&
+        jbd_walk(j, JBD_PASS_SCAN, &end, revokes, buf, data, &blocks) == 0 &&
+        jbd_walk(j, JBD_PASS_REVOKE, &end, revokes, buf, data, &blocks) == 0 &&
+        jbd_walk(j, JBD_PASS_REPLAY, &end, revokes, buf, data, &blocks) == 0) {
+        rc = 0;
+    }
+
+    jbd_revoke_free(revokes);
+    if (buf) kfree_aligned(buf);
+    if (data) kfree_aligned(data);
+
+    if (rc != 0) {
+        serial_puts("[JBD] Recovery failed\n");
+        return -1;
+    }
+
+    serial_puts("[JBD] Recovered transactions ");
+    serial_puts_num(be32(jsb(j)->s_sequence));
+    serial_puts("..");
+    serial_puts_num(end);
+    serial_puts(", blocks replayed: ");
+    serial_puts_num(blocks);
+    serial_puts("\n");
+
+    disk_flush(j->priv->disk);
+
+    jsb(j)->s_start = 0;
+    jsb(j)->s_sequence = be32(end);
+    if (jbd_write_super(j) != 0) return -1;
+    disk_flush(j->priv->disk);
+
+    *replayed = 1;
+    return 0;
+}
+
+// ============ Открытие и закрытие ============
+
+static void jbd_free(struct ext2_journal* j) {
+    if (j->sb_buf) kfree_aligned(j->sb_buf);
+    if (j->io_buf) kfree_aligned(j->io_buf);
+    if (j->bufs) kfree(j->bufs);
+    if (j->revoked) kfree(j->revoked);
+    if (j->frees) kfree(j->frees);
+    kfree(j->map);
+    kfree(j);
+}
+
+int ext2_journal_load(struct ext2_private* priv, uint32_t* map, uint32_t blocks, int* replayed) {
+    struct ext2_journal* j;
+    struct jbd_superblock* sb;
+    bcache_stats_t bstats;
+    uint32_t type;
+    uint32_t avail;
+
+    *replayed = 0;
+
+    j = kmalloc(sizeof(struct ext2_journal));
+    if (!j) {
+        kfree(map);
+        return -1;
+    }
+    memset(j, 0, sizeof(struct ext2_journal));
+    j->priv = priv;
+    j->map = map;
+    j->blocks = blocks;
+
+    j->sb_buf = kmalloc_aligned(priv->block_size, 512);
+    j->io_buf = kmalloc_aligned(JBD_IO_SIZE, 512);
+    if (!j->sb_buf || !j->io_buf || jbd_read(j, 0, j->sb_buf) != 0) {
+        jbd_free(j);
+        return -1;
+    }
+
+    sb = jsb(j);
+    type = be32(sb->s_header.h_blocktype);
+    if (be32(sb->s_header.h_magic) != JBD_MAGIC ||
+        (type != JBD_SUPERBLOCK_V1 && type != JBD_SUPERBLOCK_V2) ||
+        be32(sb->s_blocksize) != priv->block_size ||
+        be32(sb->s_first) == 0 || be32(sb->s_first) >= blocks) {
+        serial_puts("[JBD] Bad journal superblock\n");
+        jbd_free(j);
+        return -1;
+    }
+
+    if (be32(sb->s_maxlen) < blocks) j->blocks = be32(sb->s_maxlen);
+    j->first = be32(sb->s_first);
+
+    // JBD2 с 64-битными номерами или контрольными суммами пишет теги другого размера
+    if (type == JBD_SUPERBLOCK_V2 && (be32(sb->s_feature_incompat) & ~JBD_FEATURE_INCOMPAT_REVOKE)) {
+        int needs_recovery = sb->s_start != 0;
+        serial_puts("[JBD] Unsupported journal features");
+        jbd_free(j);
+        if (needs_recovery) {
+            serial_puts(", cannot recover\n");
+            return -1;
+        }
+        serial_puts(", mounting without journal\n");
+        return 0;
+    }
+
+    if (jbd_recover(j, replayed) != 0) {
+        jbd_free(j);
+        return -1;
+    }
+
+    j->sequence = be32(sb->s_sequence);
+    j->head = j->first;
+    j->empty = 1;
+
+    // Транзакция ограничена и логом, и тем, сколько закреплённых буферов вынесет bcache
+    avail = j->blocks - j->first;
+    bcache_get_stats(&bstats);
+    j->hard_limit = avail / 2;
+    j->soft_limit = avail / 4;
+    if (j->hard_limit > bstats.limit / 2 / priv->block_size) {
+        j->hard_limit = bstats.limit / 2 / priv->block_size;
+    }
+    if (j->soft_limit > bstats.limit / 4 / priv->block_size) {
+        j->soft_limit = bstats.limit / 4 / priv->block_size;
+    }
+    if (j->soft_limit == 0) j->soft_limit = 1;
+    if (j->hard_limit < j->soft_limit) j->hard_limit = j->soft_limit;
+
+    priv->journal = j;
+    j->next = journals;
+    journals = j;
+
+    serial_puts("[JBD] Journal: ");
+    serial_puts_num(j->blocks);
+    serial_puts(" blocks, transaction ");
+    serial_puts_num(j->sequence);
+    serial_puts("\n");
+    return 0;
+}
+
+void ext2_journal_release(struct ext2_private* priv) {
+    struct ext2_journal* j = priv ? priv->journal : NULL;
+    struct ext2_journal** pp = &journals;
+
+    if (!j) return;
+
+    // Блоки, возвращённые коммитом в карты, закрываются ещё одной транзакцией
+    ext2_journal_commit(priv);
+    ext2_journal_commit(priv);
+
+    // Всё на месте - лог больше не нужен
+    bcache_sync(priv->disk);
+    disk_flush(priv->disk);
+
+    jsb(j)->s_start = 0;
+    jsb(j)->s_sequence = be32(j->sequence);
+    jbd_write_super(j);
+    disk_flush(priv->disk);
+
+    while (*pp && *pp != j) pp = &(*pp)->next;
+    if (*pp) *pp = j->next;
+
+    serial_puts("[JBD] Journal closed after ");
+    serial_puts_num(j->commits);
+    serial_puts(" commits\n");
+
+    priv->journal = NULL;
+    jbd_free(j);
+}
@@ -0,0 +1,231 @@
+#include "fs/icache.h"
+#include "fs/pcache.h"
+#include "drivers/serial.h"
+#include "lib/string.h"
+#include <stddef.h>
+
+static struct vfs_inode* hash_table[ICACHE_HASH_SIZE];
+
+// Неиспользуемые inode: голова - самый свежий, хвост - кандидат на вытеснение
+static struct vfs_inode* lru_head = NULL;
+static struct vfs_inode* lru_tail = NULL;
+
+static icache_stats_t stats;
+
+static uint32_t icache_hash(struct vfs_superblock* sb, uint32_t ino) {
+    uint32_t h = ino ^ ((uint32_t)sb >> 4);
+    h *= 0x9E3779B1;
+    return (h >> 16) & (ICACHE_HASH_SIZE - 1);
+}
+
+static void lru_unlink(struct vfs_inode* inode) {
+    if (inode->i_lru_prev) inode->i_lru_prev->i_lru_next = inode->i_lru_next;
+    else lru_head = inode->i_lru_next;
+    if (inode->i_lru_next) inode->i_lru_next->i_lru_prev = inode->i_lru_prev;
+    else lru_tail = inode->i_lru_prev;
+    inode->i_lru_prev = NULL;
+    inode->i_lru_next = NULL;
+    stats.unused--;
+}
+
+static void lru_push_front(struct vfs_inode* inode) {
+    inode->i_lru_prev = NULL;
+    inode->i_lru_next = lru_head;
+    if (lru_head) lru_head->i_lru_prev = inode;
+    lru_head = inode;
+    if (!lru_tail) lru_tail = inode;
+    stats.unused++;
+}
+
+static void hash_remove(struct vfs_inode* inode) {
+    struct vfs_inode** pp = &hash_table[icache_hash(inode->sb, inode->i_ino)];
+    while (*pp) {
+        if (*pp == inode) {
+            *pp = inode->i_hash_next;
+            inode->i_hash_next = NULL;
+            inode->i_state &= ~FS_I_HASHED;
+            stats.cached--;
+            return;
+        }
+        pp = &(*pp)->i_hash_next;
+    }
+}
+
+static void clear_dirty(struct vfs_inode* inode) {
+    if (inode->i_state & FS_I_DIRTY) {
+        inode->i_state &= ~FS_I_DIRTY;
+        stats.dirty--;
+    }
+}
+
+int icache_write(struct vfs_inode* inode) {
+    struct vfs_superblock* sb = inode->sb;
+
+    if (!(inode->i_state & FS_I_DIRTY)) return 0;
+    // Вне хэша номер inode уже не наш: запись затёрла бы чужой inode
+    if (!(inode->i_state & FS_I_HASHED)) return 0;
+
+    if (!sb || !sb->sops || !sb->sops->write_inode) {
+        clear_dirty(inode);
+        return 0;
+    }
+
+    // При ошибке inode остаётся грязным: запишется при следующем сбросе
+    stats.writebacks++;
+    if (sb->sops->write_inode(sb, inode) != 0) return -1;
+
+    clear_dirty(inode);
+    return 0;
+}
+
+static void icache_free(struct vfs_inode* inode) {
+    struct vfs_superblock* sb = inode->sb;
+
+    // Страницы знают inode только по адресу - до kfree они уходят из хэша
+    pcache_invalidate(inode);
+    clear_dirty(inode);
+
+    if (sb && sb->sops && sb->sops->free_inode) {
+        sb->sops->free_inode(inode);
+    }
+}
+
+// Вытесняет самый старый неиспользуемый inode, предварительно записав его;
+// не записался - остаётся в кэше
+static int icache_evict_one(void) {
+    struct vfs_inode* victim = lru_tail;
+    if (!victim) return -1;
+
+    if (icache_write(victim) != 0) return -1;
+
+    lru_unlink(victim);
+    hash_remove(victim);
+    icache_free(victim);
+    stats.evictions++;
+    return 0;
+}
+
+void icache_init(void) {
+    memset(hash_table, 0, sizeof(hash_table));
+    memset(&stats, 0, sizeof(stats));
+    lru_head = NULL;
+    lru_tail = NULL;
+}
+
+struct vfs_inode* icache_get(struct vfs_superblock* sb, uint32_t ino) {
+    struct vfs_inode* inode;
+    uint32_t h;
+
+    if (!sb) return NULL;
+
+    h = icache_hash(sb, ino);
+    for (inode = hash_table[h]; inode; inode = inode->i_hash_next) {
+        if (inode->sb == sb && inode->i_ino == ino) {
+            if (inode->i_count++ == 0) lru_unlink(inode);
+            stats.hits++;
+            return inode;
+        }
+    }
+
+    stats.misses++;
+
+    if (!sb->sops || !sb->sops->read_inode) return NULL;
+    if (sb->sops->read_inode(sb, ino, &inode) != 0 || !inode) return NULL;
+
+    inode->sb = sb;
+    inode->i_ino = ino;
+    inode->i_count = 1;
+    inode->i_state = FS_I_HASHED;
+    inode->i_lru_prev = NULL;
+    inode->i_lru_next = NULL;
+    inode->i_hash_next = hash_table[h];
+    hash_table[h] = inode;
+    stats.cached++;
+
+    return inode;
+}
+
+void icache_hold(struct vfs_inode* inode) {
+    if (!inode) return;
+    if (inode->i_count++ == 0 && (inode->i_state & FS_I_HASHED)) lru_unlink(inode);
+}
+
+void icache_put(struct vfs_inode* inode) {
+    if (!inode || inode->i_count == 0) return;
+    if (--inode->i_count > 0) return;
+
+    // Последняя ссылка на удалённый inode: ФС освобождает его блоки и номер в free_inode
+    if (inode->i_nlink == 0 && (inode->i_state & FS_I_HASHED)) hash_remove(inode);
+
+    if (!(inode->i_state & FS_I_HASHED)) {
+        icache_free(inode);
+        return;
+    }
+
+    lru_push_front(inode);
+
+    while (stats.unused > ICACHE_MAX_UNUSED) {
+        if (icache_evict_one() != 0) break;
+    }
+}
+
+void icache_mark_dirty(struct vfs_inode* inode) {
+    if (!inode || (inode->i_state & FS_I_DIRTY)) return;
+    inode->i_state |= FS_I_DIRTY;
+    stats.dirty++;
+}
+
+int icache_sync(struct vfs_superblock* sb) {
+    int ret = 0;
+
+    if (stats.dirty == 0) return 0;
+
+    for (int h = 0; h < ICACHE_HASH_SIZE; h++) {
+        for (struct vfs_inode* inode = hash_table[h]; inode; inode = inode->i_hash_next) {
+            if (sb && inode->sb != sb) continue;
+            if (icache_write(inode) != 0) ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+// Размонтирование: пишем и освобождаем все inode ФС, включая удерживаемые
+void icache_purge_sb(struct vfs_superblock* sb) {
+    for (int h = 0; h < ICACHE_HASH_SIZE; h++) {
+        struct vfs_inode* inode = hash_table[h];
+        while (inode) {
+            struct vfs_inode* next = inode->i_hash_next;
+            if (inode->sb == sb) {
+                if (inode->i_count == 0) lru_unlink(inode);
+                icache_write(inode);
+                hash_remove(inode);
+                icache_free(inode);
+            }
+            inode = next;
+        }
+    }
+}
+
+void icache_get_stats(icache_stats_t* out) {
+    if (out) *out = stats;
+}
+
+void icache_dump_stats(void) {
+    serial_puts("\n=== INODE CACHE ===\n");
+    serial_puts("  Cached:     ");
+    serial_puts_num(stats.cached);
+    serial_puts(" (unused ");
+    serial_puts_num(stats.unused);
+    serial_puts(", dirty ");
+    serial_puts_num(stats.dirty);
+    serial_puts(")\n  Hits:       ");
+    serial_puts_num(stats.hits);
+    serial_puts("\n  Misses:     ");
+    serial_puts_num(stats.misses);
+    serial_puts("\n  Evictions:  ");
+    serial_puts_num(stats.evictions);
+    serial_puts("\n  Writebacks: ");
+    serial_puts_num(stats.writebacks);
+    serial_puts("\n===================\n");
+}
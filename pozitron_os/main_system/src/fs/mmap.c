@@ -0,0 +1,166 @@
+#include "fs/mmap.h"
+#include "fs/icache.h"
+#include "kernel/memory.h"
+#include "kernel/paging.h"
+#include "drivers/serial.h"
+#include "lib/string.h"
+#include <stddef.h>
+
+static vfs_vma_t* vmas = NULL;
+static mmap_stats_t stats;
+
+static vfs_vma_t* find_vma(uint32_t addr) {
+    for (vfs_vma_t* vma = vmas; vma; vma = vma->next) {
+        if (addr < vma->start) return NULL;
+        if (addr - vma->start < vma->pages * PAGE_SIZE) return vma;
+    }
+    return NULL;
+}
+
+// Первая подходящая дыра в окне; prev получает соседа слева для вставки
+static uint32_t find_hole(uint32_t pages, vfs_vma_t** prev) {
+    uint32_t window = paging_mmap_window();
+    uint32_t size = pages * PAGE_SIZE;
+    uint32_t addr = PAGING_MMAP_BASE;
+
+    *prev = NULL;
+    for (vfs_vma_t* vma = vmas; vma; vma = vma->next) {
+        if (vma->start - addr >= size) break;
+        addr = vma->start + vma->pages * PAGE_SIZE;
+        *prev = vma;
+    }
+
+    if (addr - PAGING_MMAP_BASE + size > window) return 0;
+    return addr;
+}
+
+// Запись в частное отображение: своя копия страницы вместо общей из кэша
+static int vma_cow(vfs_vma_t* vma, uint32_t va, uint32_t i) {
+    uint8_t* copy = kmalloc_aligned(PAGE_SIZE, PAGE_SIZE);
+    if (!copy) return -1;
+
+    memcpy(copy, vma->cache[i]->data, PAGE_SIZE);
+    paging_map_page(current_directory, va, (uint32_t)copy, PAGE_PRESENT | PAGE_WRITABLE | PAGE_PRIVATE);
+
+    pcache_put(vma->cache[i]);
+    vma->cache[i] = NULL;
+    stats.cow_copies++;
+    return 0;
+}
+
+void* vfs_mmap(struct vfs_file* file, uint32_t offset, uint32_t length, int flags) {
+    vfs_vma_t* vma;
+    vfs_vma_t* prev;
+    uint32_t pages;
+    uint32_t start;
+
+    if (!file || !file->f_inode || length == 0) return NULL;
+    if (offset % PAGE_SIZE) return NULL;
+    if (flags != VFS_MAP_SHARED && flags != VFS_MAP_PRIVATE) return NULL;
+    if (!file->f_inode->fops || !file->f_inode->fops->read) return NULL;
+
+    pages = (length + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (pages > paging_mmap_window() / PAGE_SIZE) return NULL;
+
+    start = find_hole(pages, &prev);
+    if (!start) {
+        serial_puts("[MMAP] No room in mapping window\n");
+        return NULL;
+    }
+
+    vma = kmalloc(sizeof(vfs_vma_t));
+    if (!vma) return NULL;
+    memset(vma, 0, sizeof(vfs_vma_t));
+
+    vma->cache = kcalloc(pages, sizeof(pcache_page_t*));
+    if (!vma->cache) {
+        kfree(vma);
+        return NULL;
+    }
+
+    icache_hold(file->f_inode);
+    vma->start = start;
+    vma->pages = pages;
+    vma->pgoff = offset / PAGE_SIZE;
+    vma->flags = flags;
+    vma->inode = file->f_inode;
+
+    if (prev) {
+        vma->next = prev->next;
+        prev->next = vma;
+    } else {
+        vma->next = vmas;
+        vmas = vma;
+    }
+
+    stats.mappings++;
+    return (void*)start;
+}
+
+int vfs_munmap(void* addr, uint32_t length) {
+    vfs_vma_t** pp = &vmas;
+    vfs_vma_t* vma;
+
+    while (*pp && (*pp)->start != (uint32_t)addr) pp = &(*pp)->next;
+    vma = *pp;
+    if (!vma) return -1;
+
+    // Снимается только отображение целиком
+    if ((length + PAGE_SIZE - 1) / PAGE_SIZE != vma->pages) return -1;
+
+    for (uint32_t i = 0; i < vma->pages; i++) {
+        uint32_t va = vma->start + i * PAGE_SIZE;
+        uint32_t entry = paging_get_entry(current_directory, va);
+
+        if (entry & PAGE_PRESENT) {
+            paging_unmap_page(current_directory, va);
+            if (entry & PAGE_PRIVATE) kfree_aligned((void*)(entry & 0xFFFFF000));
+        }
+        if (vma->cache[i]) pcache_put(vma->cache[i]);
+    }
+
+    *pp = vma->next;
+    stats.mappings--;
+
+    icache_put(vma->inode);
+    kfree(vma->cache);
+    kfree(vma);
+    return 0;
+}
+
+int vfs_mmap_fault(uint32_t addr, int write) {
+    vfs_vma_t* vma = find_vma(addr);
+    uint32_t va = addr & 0xFFFFF000;
+    uint32_t entry;
+    uint32_t i;
+
+    if (!vma) return -1;
+
+    i = (va - vma->start) / PAGE_SIZE;
+    entry = paging_get_entry(current_directory, va);
+    stats.faults++;
+
+    // Страница есть - значит запись в защищённую: копируем только для частных
+    if (entry & PAGE_PRESENT) {
+        if (!write || !(vma->flags & VFS_MAP_PRIVATE) || (entry & PAGE_PRIVATE) || !vma->cache[i]) {
+            serial_puts("[MMAP] Write to read-only mapping\n");
+            return -1;
+        }
+        return vma_cow(vma, va, i);
+    }
+
+    if (!vma->cache[i]) vma->cache[i] = pcache_get(vma->inode, vma->pgoff + i);
+    if (!vma->cache[i]) {
+        serial_puts("[MMAP] Failed to read file page\n");
+        return -1;
+    }
+
+    if (write && (vma->flags & VFS_MAP_PRIVATE)) return vma_cow(vma, va, i);
+
+    paging_map_page(current_directory, va, (uint32_t)vma->cache[i]->data, PAGE_PRESENT);
+    return 0;
+}
+
+void mmap_get_stats(mmap_stats_t* out) {
+    if (out) *out = stats;
+}
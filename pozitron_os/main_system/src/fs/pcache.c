@@ -0,0 +1,243 @@
+#include "fs/pcache.h"
+#include "kernel/memory.h"
+#include "kernel/paging.h"
+#include "drivers/serial.h"
+#include "lib/string.h"
+#include <stddef.h>
+
+static pcache_page_t* hash_table[PCACHE_HASH_SIZE];
+
+// Неиспользуемые страницы: голова - самая свежая, хвост - кандидат на вытеснение
+static pcache_page_t* lru_head = NULL;
+static pcache_page_t* lru_tail = NULL;
+
+static pcache_stats_t stats;
+
+static uint32_t pcache_hash(struct vfs_inode* inode, uint32_t index) {
+    uint32_t h = index ^ ((uint32_t)inode >> 4);
+    h *= 0x9E3779B1;
+    return (h >> 16) & (PCACHE_HASH_SIZE - 1);
+}
+
+static void lru_unlink(pcache_page_t* page) {
+    if (page->lru_prev) page->lru_prev->lru_next = page->lru_next;
+    else lru_head = page->lru_next;
+    if (page->lru_next) page->lru_next->lru_prev = page->lru_prev;
+    else lru_tail = page->lru_prev;
+    page->lru_prev = NULL;
+    page->lru_next = NULL;
+    stats.unused--;
+}
+
+static void lru_push_front(pcache_page_t* page) {
+    page->lru_prev = NULL;
+    page->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = page;
+    lru_head = page;
+    if (!lru_tail) lru_tail = page;
+    stats.unused++;
+}
+
+static void hash_remove(pcache_page_t* page) {
+    pcache_page_t** pp = &hash_table[pcache_hash(page->inode, page->index)];
+    while (*pp) {
+        if (*pp == page) {
+            *pp = page->hash_next;
+            page->hash_next = NULL;
+            stats.cached--;
+            return;
+        }
+        pp = &(*pp)->hash_next;
+    }
+}
+
+static void page_free(pcache_page_t* page) {
+    kfree_aligned(page->data);
+    kfree(page);
+}
+
+// Убирает страницу из хэша; отображённая страница доживает до pcache_put
+static void page_detach(pcache_page_t* page) {
+    struct vfs_inode* inode = page->inode;
+
+    if (!inode) return;
+
+    hash_remove(page);
+    page->inode = NULL;
+    inode->i_pages--;
+
+    if (page->refcount == 0) {
+        lru_unlink(page);
+        page_free(page);
+    }
+}
+
+static void pcache_evict_one(void) {
+    pcache_page_t* victim = lru_tail;
+    if (!victim) return;
+
+    page_detach(victim);
+    stats.evictions++;
+}
+
+// Читает страницу через fops->read временным файлом, чтобы не трогать позицию открытых
+static int page_fill(struct vfs_inode* inode, uint32_t index, uint8_t* data) {
+    vfs_file_t file;
+    uint32_t done = 0;
+
+    memset(data, 0, PAGE_SIZE);
+
+    if (!inode->fops || !inode->fops->read) return -1;
+    if (index * PAGE_SIZE >= inode->i_size) return 0;
+
+    memset(&file, 0, sizeof(file));
+    file.f_flags = FS_O_RDONLY;
+    file.f_inode = inode;
+    file.fops = inode->fops;
+    file.f_pos = index * PAGE_SIZE;
+
+    while (done < PAGE_SIZE) {
+        uint32_t n = 0;
+        if (file.fops->read(&file, data + done, PAGE_SIZE - done, &n) != 0) return -1;
+        if (n == 0) break;
+        done += n;
+    }
+
+    return 0;
+}
+
+void pcache_init(void) {
+    memset(hash_table, 0, sizeof(hash_table));
+    memset(&stats, 0, sizeof(stats));
+    lru_head = NULL;
+    lru_tail = NULL;
+}
+
+pcache_page_t* pcache_get(struct vfs_inode* inode, uint32_t index) {
+    pcache_page_t* page;
+    uint32_t h;
+
+    if (!inode) return NULL;
+
+    h = pcache_hash(inode, index);
+    for (page = hash_table[h]; page; page = page->hash_next) {
+        if (page->inode == inode && page->index == index) {
+            if (page->refcount++ == 0) lru_unlink(page);
+            stats.hits++;
+            return page;
+        }
+    }
+
+    stats.misses++;
+
+    page = kmalloc(sizeof(pcache_page_t));
+    if (!page) return NULL;
+    memset(page, 0, sizeof(pcache_page_t));
+
+    page->data = kmalloc_aligned(PAGE_SIZE, PAGE_SIZE);
+    if (!page->data) {
+        kfree(page);
+        return NULL;
+    }
+
+    if (page_fill(inode, index, page->data) != 0) {
+        page_free(page);
+        return NULL;
+    }
+
+    // Кэш inode не держит: иначе удалённый файл жил бы, пока страницы не вытеснены
+    inode->i_pages++;
+    page->inode = inode;
+    page->index = index;
+    page->refcount = 1;
+    page->hash_next = hash_table[h];
+    hash_table[h] = page;
+    stats.cached++;
+
+    return page;
+}
+
+void pcache_put(pcache_page_t* page) {
+    if (!page || page->refcount == 0) return;
+    if (--page->refcount > 0) return;
+
+    if (!page->inode) {
+        page_free(page);
+        return;
+    }
+
+    lru_push_front(page);
+
+    while (stats.unused > PCACHE_MAX_UNUSED) {
+        pcache_evict_one();
+    }
+}
+
+void pcache_update(struct vfs_inode* inode, uint32_t offset, const void* buf, uint32_t len) {
+    const uint8_t* src = (const uint8_t*)buf;
+
+    if (!inode || !buf || stats.cached == 0) return;
+
+    while (len > 0) {
+        uint32_t index = offset / PAGE_SIZE;
+        uint32_t in_page = offset % PAGE_SIZE;
+        uint32_t chunk = PAGE_SIZE - in_page;
+        if (chunk > len) chunk = len;
+
+        for (pcache_page_t* page = hash_table[pcache_hash(inode, index)]; page; page = page->hash_next) {
+            if (page->inode == inode && page->index == index) {
+                memcpy(page->data + in_page, src, chunk);
+                break;
+            }
+        }
+
+        offset += chunk;
+        src += chunk;
+        len -= chunk;
+    }
+}
+
+void pcache_invalidate(struct vfs_inode* inode) {
+    if (!inode || inode->i_pages == 0) return;
+
+    for (int h = 0; h < PCACHE_HASH_SIZE; h++) {
+        pcache_page_t* page = hash_table[h];
+        while (page) {
+            pcache_page_t* next = page->hash_next;
+            if (page->inode == inode) page_detach(page);
+            page = next;
+        }
+    }
+}
+
+void pcache_purge_sb(struct vfs_superblock* sb) {
+    if (stats.cached == 0) return;
+
+    for (int h = 0; h < PCACHE_HASH_SIZE; h++) {
+        pcache_page_t* page = hash_table[h];
+        while (page) {
+            pcache_page_t* next = page->hash_next;
+            if (page->inode && page->inode->sb == sb) page_detach(page);
+            page = next;
+        }
+    }
+}
+
+void pcache_get_stats(pcache_stats_t* out) {
+    if (out) *out = stats;
+}
+
+void pcache_dump_stats(void) {
+    serial_puts("\n=== PAGE CACHE ===\n");
+    serial_puts("  Cached:    ");
+    serial_puts_num(stats.cached);
+    serial_puts(" (unused ");
+    serial_puts_num(stats.unused);
+    serial_puts(")\n  Hits:      ");
+    serial_puts_num(stats.hits);
+    serial_puts("\n  Misses:    ");
+    serial_puts_num(stats.misses);
+    serial_puts("\n  Evictions: ");
+    serial_puts_num(stats.evictions);
+    serial_puts("\n==================\n");
+}
@@ -1,5 +1,9 @@
 #include "fs/vfs.h"
 #include "fs/ext2.h"
+#include "fs/bcache.h"
+#include "fs/dcache.h"
+#include "fs/icache.h"
+#include "fs/pcache.h"
 #include "kernel/memory.h"
 #include "drivers/serial.h"
 #include "lib/string.h"
@@ -24,6 +28,7 @@ static struct vfs_file* open_files[MAX_OPEN_FILES];
 static int open_file_count = 0;
 
 static struct vfs_inode* root_inode = NULL;
+static uint32_t batch_depth = 0;
 
 static vfs_mount_t* find_mount(const char* path) {
     vfs_mount_t* m = mounts;
@@ -45,41 +50,65 @@ static vfs_mount_t* find_mount(const char* path) {
     return best;
 }
 
-static int path_walk(const char* path, struct vfs_inode** result) {
-    struct vfs_inode* current = root_inode;
-    char buffer[256];
-    char* token;
-    char* saveptr = NULL;
-    
-    if (!path || !result) return -1;
-    if (!current) return -1;
+// Поиск одного компонента пути: сначала кэш имён, затем драйвер ФС
+static int vfs_lookup(struct vfs_inode* dir, const char* name, uint32_t len, struct vfs_inode** result) {
+    char buf[256];
+    struct vfs_inode* inode;
     
-    if (*path == '\0') {
-        *result = current;
+    if (len == 1 && name[0] == '.') {
+        *result = dir;
         return 0;
     }
     
-    if (*path == '/') path++;
-    if (*path == '\0') {
-        *result = current;
+    if (dcache_lookup(dir, name, len, &inode)) {
+        if (!inode) return -1;
+        *result = inode;
         return 0;
     }
     
-    strcpy(buffer, path);
+    if (!dir->iops || !dir->iops->lookup) return -1;
+    if (len >= sizeof(buf)) return -1;
+    
+    memcpy(buf, name, len);
+    buf[len] = '\0';
+    
+    if (dir->iops->lookup(dir, buf, &inode) != 0) {
+        dcache_add(dir, name, len, NULL);
+        return -1;
+    }
+    
+    // Ссылку держит dentry; вызывающему inode выдаётся взаймы
+    dcache_add(dir, name, len, inode);
+    icache_put(inode);
+    *result = inode;
+    return 0;
+}
+
+// Разбор пути на месте, без копирования и strtok
+static int walk_from(struct vfs_inode* current, const char* path, struct vfs_inode** result) {
+    const char* p = path;
     
-    token = strtok(buffer, "/");
-    while (token) {
-        if (!current->iops || !current->iops->lookup) return -1;
+    while (*p) {
+        while (*p == '/') p++;
+        if (*p == '\0') break;
         
-        if (current->iops->lookup(current, token, &current) != 0) return -1;
+        const char* name = p;
+        while (*p && *p != '/') p++;
         
-        token = strtok(NULL, "/");
+        if (vfs_lookup(current, name, p - name, &current) != 0) return -1;
     }
     
     *result = current;
     return 0;
 }
 
+static int path_walk(const char* path, struct vfs_inode** result) {
+    if (!path || !result) return -1;
+    if (!root_inode) return -1;
+    
+    return walk_from(root_inode, path, result);
+}
+
 int vfs_init(void) {
     serial_puts("[VFS] Initializing...\n");
     
@@ -91,6 +120,11 @@ int vfs_init(void) {
     memset(open_files, 0, sizeof(open_files));
     fs_count = 0;
     
+    bcache_init(BCACHE_DEFAULT_LIMIT);
+    bcache_set_writeback(1);
+    icache_init();
+    dcache_init();
+    pcache_init();
     ext2_init();
     
     serial_puts("[VFS] Initialized\n");
@@ -178,13 +212,22 @@ int vfs_umount(const char* mountpoint) {
             if (m->sb && m->sb->sops && m->sb->sops->sync) {
                 m->sb->sops->sync(m->sb);
             }
+            if (m->sb) {
+                dcache_purge_sb(m->sb);
+                pcache_purge_sb(m->sb);
+                icache_purge_sb(m->sb);
+                m->sb->s_root = NULL;
+                if (m->sb->sops && m->sb->sops->put_super) {
+                    m->sb->sops->put_super(m->sb);
+                }
+            }
+            if (m->sb && m->sb->s_disk) {
+                bcache_invalidate(m->sb->s_disk);
+            }
             
             if (m->sb && m->sb->private_data) {
                 kfree_aligned(m->sb->private_data);
             }
-            if (m->sb && m->sb->s_root) {
-                kfree_aligned(m->sb->s_root);
-            }
             if (m->sb) {
                 kfree_aligned(m->sb);
             }
@@ -220,11 +263,16 @@ int vfs_open(const char* path, int flags, struct vfs_file** file) {
         if (!parent->iops || !parent->iops->create) return -1;
         
         if (parent->iops->create(parent, name, FS_IRUSR | FS_IWUSR, &inode) != 0) return -1;
+        dcache_add(parent, name, strlen(name), inode);
+        icache_put(inode);
     }
     
     f = kmalloc(sizeof(struct vfs_file));
     if (!f) return -1;
     
+    // Все открытия одного файла разделяют один inode из icache
+    icache_hold(inode);
+    
     memset(f, 0, sizeof(struct vfs_file));
     f->f_flags = flags;
     f->f_inode = inode;
@@ -233,11 +281,13 @@ int vfs_open(const char* path, int flags, struct vfs_file** file) {
     
     if (flags & FS_O_TRUNC && inode->iops && inode->iops->truncate) {
         inode->iops->truncate(inode, 0);
+        pcache_invalidate(inode);
     }
     
     if (f->fops && f->fops->open) {
         ret = f->fops->open(inode, f);
         if (ret != 0) {
+            icache_put(inode);
             kfree(f);
             return ret;
         }
@@ -259,10 +309,13 @@ int vfs_close(struct vfs_file* file) {
         ret = file->fops->close(file);
     }
 
-    if (file->f_flags & (FS_O_WRONLY | FS_O_RDWR | FS_O_CREAT | FS_O_TRUNC)) {
-        if (file->f_inode && file->f_inode->sb && file->f_inode->sb->sops && file->f_inode->sb->sops->sync) {
-            file->f_inode->sb->sops->sync(file->f_inode->sb);
-        }
+    // inode меняется в памяти на каждом write и попадает в буферный кэш только здесь
+    icache_write(file->f_inode);
+
+    // В режиме write-back данные уходят на диск фоновым сбросом или через vfs_fsync
+    if (!bcache_is_writeback() && batch_depth == 0 &&
+        (file->f_flags & (FS_O_WRONLY | FS_O_RDWR | FS_O_CREAT | FS_O_TRUNC))) {
+        vfs_fsync(file);
     }
     
     for (i = 0; i < open_file_count; i++) {
@@ -272,10 +325,36 @@ int vfs_close(struct vfs_file* file) {
         }
     }
     
+    icache_put(file->f_inode);
     kfree(file);
     return ret;
 }
 
+int vfs_fsync(struct vfs_file* file) {
+    struct vfs_superblock* sb;
+    
+    if (!file || !file->f_inode) return -1;
+    
+    sb = file->f_inode->sb;
+    if (!sb || !sb->sops || !sb->sops->sync) return 0;
+    
+    return sb->sops->sync(sb);
+}
+
+int vfs_sync(void) {
+    vfs_mount_t* m = mounts;
+    int ret = 0;
+    
+    while (m) {
+        if (m->sb && m->sb->sops && m->sb->sops->sync) {
+            if (m->sb->sops->sync(m->sb) != 0) ret = -1;
+        }
+        m = m->next;
+    }
+    
+    return ret;
+}
+
 int vfs_read(struct vfs_file* file, void* buf, uint32_t size, uint32_t* bytes_read) {
     if (!file || !buf || !bytes_read) return -1;
     if (!file->fops || !file->fops->read) return -1;
@@ -287,7 +366,12 @@ int vfs_write(struct vfs_file* file, const void* buf, uint32_t size, uint32_t* b
     if (!file || !buf || !bytes_written) return -1;
     if (!file->fops || !file->fops->write) return -1;
     
-    return file->fops->write(file, buf, size, bytes_written);
+    uint32_t pos = file->f_pos;
+    int ret = file->fops->write(file, buf, size, bytes_written);
+    
+    // Отображения файла должны видеть записанное
+    if (ret == 0 && *bytes_written) pcache_update(file->f_inode, pos, buf, *bytes_written);
+    return ret;
 }
 
 int vfs_lseek(struct vfs_file* file, uint32_t offset, int whence) {
@@ -323,9 +407,11 @@ int vfs_mkdir(const char* path, uint32_t mode) {
     if (!parent->iops || !parent->iops->mkdir) return -1;
     
     ret = parent->iops->mkdir(parent, name, mode | FS_DIRECTORY);
+    dcache_invalidate(parent, name, strlen(name));
     
-    // Синхронизируем после создания директории
-    if (ret == 0 && parent->sb && parent->sb->sops && parent->sb->sops->sync) {
+    // Синхронизируем после создания директории (в write-back это делает фоновый сброс)
+    if (ret == 0 && !bcache_is_writeback() && batch_depth == 0 &&
+        parent->sb && parent->sb->sops && parent->sb->sops->sync) {
         parent->sb->sops->sync(parent->sb);
     }
     
@@ -369,8 +455,10 @@ int vfs_mkdir_p(const char* path, uint32_t mode) {
 
 int vfs_rmdir(const char* path) {
     struct vfs_inode* parent;
+    struct vfs_inode* victim;
     char dir[256];
     char name[256];
+    int ret;
     
     if (!path) return -1;
     
@@ -379,13 +467,21 @@ int vfs_rmdir(const char* path) {
     if (path_walk(dir, &parent) != 0) return -1;
     if (!parent->iops || !parent->iops->rmdir) return -1;
     
-    return parent->iops->rmdir(parent, name);
+    if (vfs_lookup(parent, name, strlen(name), &victim) == 0) {
+        dcache_purge_dir(parent->sb, victim->i_ino);
+    }
+    
+    ret = parent->iops->rmdir(parent, name);
+    dcache_invalidate(parent, name, strlen(name));
+    
+    return ret;
 }
 
 int vfs_unlink(const char* path) {
     struct vfs_inode* parent;
     char dir[256];
     char name[256];
+    int ret;
     
     if (!path) return -1;
     
@@ -394,7 +490,40 @@ int vfs_unlink(const char* path) {
     if (path_walk(dir, &parent) != 0) return -1;
     if (!parent->iops || !parent->iops->unlink) return -1;
     
-    return parent->iops->unlink(parent, name);
+    ret = parent->iops->unlink(parent, name);
+    dcache_invalidate(parent, name, strlen(name));
+    
+    return ret;
+}
+
+int vfs_rename(const char* old_path, const char* new_path) {
+    struct vfs_inode* old_parent;
+    struct vfs_inode* new_parent;
+    struct vfs_inode* moved;
+    char old_dir[256], old_name[256];
+    char new_dir[256], new_name[256];
+    int ret;
+    
+    if (!old_path || !new_path) return -1;
+    
+    vfs_path_split(old_path, old_dir, old_name);
+    vfs_path_split(new_path, new_dir, new_name);
+    
+    if (path_walk(old_dir, &old_parent) != 0) return -1;
+    if (path_walk(new_dir, &new_parent) != 0) return -1;
+    if (!old_parent->iops || !old_parent->iops->rename) return -1;
+    
+    // У перенесённого каталога меняется "..", поэтому сбрасываем и его содержимое
+    if (vfs_lookup(old_parent, old_name, strlen(old_name), &moved) == 0) {
+        dcache_purge_dir(old_parent->sb, moved->i_ino);
+    }
+    
+    ret = old_parent->iops->rename(old_parent, old_name, new_parent, new_name);
+    
+    dcache_invalidate(old_parent, old_name, strlen(old_name));
+    dcache_invalidate(new_parent, new_name, strlen(new_name));
+    
+    return ret;
 }
 
 int vfs_exists(const char* path) {
@@ -432,46 +561,159 @@ cleanup:
     return ret;
 }
 
-int vfs_copy_dir(const char* src, const char* dst) {
-    struct vfs_file* dir = NULL;
+void vfs_batch_begin(void) {
+    if (batch_depth++ > 0) return;
+    
+    for (vfs_mount_t* m = mounts; m; m = m->next) {
+        if (m->sb && m->sb->sops && m->sb->sops->batch) m->sb->sops->batch(m->sb, 1);
+    }
+}
+
+int vfs_batch_commit(void) {
+    if (batch_depth == 0) return -1;
+    if (--batch_depth > 0) return 0;
+    
+    for (vfs_mount_t* m = mounts; m; m = m->next) {
+        if (m->sb && m->sb->sops && m->sb->sops->batch) m->sb->sops->batch(m->sb, 0);
+    }
+    return vfs_sync();
+}
+
+// Файл без записи в open_files - для копирования внутри VFS, как в pcache
+static void tree_file(struct vfs_file* f, struct vfs_inode* inode, uint32_t flags) {
+    memset(f, 0, sizeof(struct vfs_file));
+    f->f_flags = flags;
+    f->f_inode = inode;
+    f->fops = inode->fops;
+}
+
+static int tree_copy_data(struct vfs_inode* src, struct vfs_inode* dst, uint8_t* buf, uint32_t size) {
+    struct vfs_file in;
+    struct vfs_file out;
+    uint32_t bytes_read, bytes_written;
+    int ret = 0;
+    
+    if (!src->fops || !src->fops->read || !dst->fops || !dst->fops->write) return -1;
+    
+    tree_file(&in, src, FS_O_RDONLY);
+    tree_file(&out, dst, FS_O_WRONLY);
+    
+    while (1) {
+        if (src->fops->read(&in, buf, size, &bytes_read) != 0) {
+            ret = -1;
+            break;
+        }
+        if (bytes_read == 0) break;
+        if (dst->fops->write(&out, buf, bytes_read, &bytes_written) != 0 || bytes_written != bytes_read) {
+            ret = -1;
+            break;
+        }
+    }
+    
+    if (dst->fops->close) dst->fops->close(&out);
+    icache_write(dst);
+    return ret;
+}
+
+// Обход по inode: родитель уже разрешён, пути не собираются. fresh - dst создан этим же копированием
+static int tree_copy_dir(struct vfs_inode* src, struct vfs_inode* dst, uint8_t* buf, uint32_t size, int fresh) {
+    struct vfs_file dir;
     struct vfs_dirent dirent;
     uint32_t bytes_read;
-    char src_path[512];
-    char dst_path[512];
-    int ret = -1;
+    int ret = 0;
     
-    if (!src || !dst) return -1;
+    if (!src->fops || !src->fops->readdir || !dst->iops) return -1;
     
-    if (vfs_open(src, FS_O_RDONLY | FS_O_DIRECTORY, &dir) != 0) return -1;
-    if (vfs_mkdir(dst, 0755) != 0 && !vfs_exists(dst)) {
-        vfs_close(dir);
-        return -1;
-    }
+    tree_file(&dir, src, FS_O_RDONLY | FS_O_DIRECTORY);
     
-    while (vfs_readdir(dir, &dirent, &bytes_read) == 0 && bytes_read > 0) {
-        if (strcmp(dirent.d_name, ".") == 0 || strcmp(dirent.d_name, "..") == 0) {
-            continue;
+    while (ret == 0 && src->fops->readdir(&dir, &dirent, &bytes_read) == 0 && bytes_read > 0) {
+        uint32_t len = strlen(dirent.d_name);
+        struct vfs_inode* child;
+        struct vfs_inode* copy;
+        
+        if (strcmp(dirent.d_name, ".") == 0 || strcmp(dirent.d_name, "..") == 0) continue;
+        if (vfs_lookup(src, dirent.d_name, len, &child) != 0) {
+            ret = -1;
+            break;
         }
         
-        sprintf(src_path, "%s/%s", src, dirent.d_name);
-        sprintf(dst_path, "%s/%s", dst, dirent.d_name);
+        // Поддерево может вытеснить dentry, поэтому на время копирования держим ссылку сами
+        icache_hold(child);
         
         if (dirent.d_type == EXT2_FT_DIR) {
-            if (vfs_copy_dir(src_path, dst_path) != 0) goto cleanup;
+            int made = dst->iops->mkdir && dst->iops->mkdir(dst, dirent.d_name, child->i_mode & 0x0FFF) == 0;
+            
+            if (made) dcache_invalidate(dst, dirent.d_name, len);
+            if (vfs_lookup(dst, dirent.d_name, len, &copy) != 0) {
+                ret = -1;
+            } else {
+                icache_hold(copy);
+                ret = tree_copy_dir(child, copy, buf, size, made);
+                icache_put(copy);
+            }
         } else {
-            if (vfs_copy_file(src_path, dst_path) != 0) goto cleanup;
+            // В только что созданном каталоге искать нечего; существующий файл перезаписывается
+            if (!fresh && vfs_lookup(dst, dirent.d_name, len, &copy) == 0) {
+                icache_hold(copy);
+                if (copy->iops && copy->iops->truncate) {
+                    copy->iops->truncate(copy, 0);
+                    pcache_invalidate(copy);
+                }
+            } else if (!dst->iops->create ||
+                       dst->iops->create(dst, dirent.d_name, child->i_mode & 0x0FFF, &copy) != 0) {
+                ret = -1;
+            } else {
+                dcache_invalidate(dst, dirent.d_name, len);
+                dcache_add(dst, dirent.d_name, len, copy);
+            }
+            
+            if (ret == 0) {
+                ret = tree_copy_data(child, copy, buf, size);
+                icache_put(copy);
+            }
         }
+        
+        icache_put(child);
     }
     
-    ret = 0;
+    return ret;
+}
+
+int vfs_copy_tree(const char* src, const char* dst) {
+    struct vfs_inode* from;
+    struct vfs_inode* to;
+    uint8_t* buf;
+    int fresh;
+    int ret;
     
-cleanup:
-    vfs_close(dir);
+    if (!src || !dst) return -1;
+    if (path_walk(src, &from) != 0) return -1;
+    
+    fresh = vfs_mkdir(dst, 0755) == 0;
+    if (path_walk(dst, &to) != 0) return -1;
+    
+    buf = kmalloc(4096);
+    if (!buf) return -1;
+    
+    icache_hold(from);
+    icache_hold(to);
+    
+    vfs_batch_begin();
+    ret = tree_copy_dir(from, to, buf, 4096, fresh);
+    if (vfs_batch_commit() != 0) ret = -1;
+    
+    icache_put(to);
+    icache_put(from);
+    kfree(buf);
     return ret;
 }
 
+int vfs_copy_dir(const char* src, const char* dst) {
+    return vfs_copy_tree(src, dst);
+}
+
 int vfs_copy_template(const char* src, const char* dst) {
-    return vfs_copy_dir(src, dst);
+    return vfs_copy_tree(src, dst);
 }
 
 int vfs_write_config(const char* path, const char* key, const char* value) {
@@ -568,35 +810,8 @@ void vfs_path_split(const char* path, char* dir, char* name) {
 }
 
 int vfs_path_walk(const char* path, struct vfs_inode* start, struct vfs_inode** result) {
-    struct vfs_inode* current = start;
-    char buffer[256];
-    char* token;
-    
     if (!path || !result) return -1;
     if (!start) return -1;
     
-    if (*path == '\0') {
-        *result = current;
-        return 0;
-    }
-    
-    if (*path == '/') path++;
-    if (*path == '\0') {
-        *result = current;
-        return 0;
-    }
-    
-    strcpy(buffer, path);
-    
-    token = strtok(buffer, "/");
-    while (token) {
-        if (!current->iops || !current->iops->lookup) return -1;
-        
-        if (current->iops->lookup(current, token, &current) != 0) return -1;
-        
-        token = strtok(NULL, "/");
-    }
-    
-    *result = current;
-    return 0;
-}
\ No newline at end of file
+    return walk_from(start, path, result);
+}
@@ -0,0 +1,299 @@
+#include "gui/compositor.h"
+#include "drivers/vesa.h"
+#include "drivers/serial.h"
+#include "drivers/timer.h"
+#include "gui/frame.h"
+#include <stddef.h>
+
+// Повреждение копится в dirty-прямоугольниках VESA; окно вместе с тенью
+static void damage_rect(int32_t x, int32_t y, uint32_t w, uint32_t h) {
+    w += COMPOSITOR_SHADOW_OFFSET;
+    h += COMPOSITOR_SHADOW_OFFSET;
+    
+    if (x < 0) {
+        if ((uint32_t)-x >= w) return;
+        w -= (uint32_t)-x;
+        x = 0;
+    }
+    if (y < 0) {
+        if ((uint32_t)-y >= h) return;
+        h -= (uint32_t)-y;
+        y = 0;
+    }
+    vesa_mark_dirty(x, y, w, h);
+}
+
+static void damage_shown(Window* window) {
+    if (window->shown) {
+        damage_rect(window->shown_x, window->shown_y, window->shown_width, window->shown_height);
+    }
+}
+
+// Содержимое окна устарело: окно или любой виджет просит перерисовки
+static uint8_t window_content_dirty(Window* window) {
+    uint8_t dirty = window->needs_redraw;
+    
+    for (Widget* widget = window->first_widget; widget; widget = widget->next) {
+        // Курсор ввода мигает сам по себе: следующий кадр - на смене фазы
+        if (widget->type == WIDGET_INPUT && widget->focused && widget->data) {
+            InputData* input = (InputData*)widget->data;
+            uint32_t phase = timer_get_ticks() / INPUT_BLINK_TICKS;
+            if (input->cursor_visible != (phase & 1)) {
+                widget->needs_redraw = 1;
+            }
+            frame_request_at((phase + 1) * INPUT_BLINK_TICKS);
+        }
+        if (widget->needs_redraw) dirty = 1;
+    }
+    return dirty;
+}
+
+static void window_clear_dirty(Window* window) {
+    window->needs_redraw = 0;
+    for (Widget* widget = window->first_widget; widget; widget = widget->next) {
+        widget->needs_redraw = 0;
+    }
+}
+
+// Перерисовка окна в его поверхность; -1 - не хватило памяти
+static int window_render(Window* window) {
+    if (!window->surface || window->surface->width != window->width ||
+        window->surface->height != window->height) {
+        vesa_surface_destroy(window->surface);
+        window->surface = vesa_surface_create(window->width, window->height);
+        if (!window->surface) {
+            serial_puts("[COMPOSITOR] No memory for window surface\n");
+            return -1;
+        }
+    }
+    
+    vesa_set_target(window->surface, window->x, window->y);
+    gui_draw_window(window);
+    vesa_set_target(NULL, 0, 0);
+    
+    window_clear_dirty(window);
+    return 0;
+}
+
+// Видимые окна снизу вверх: список окон и так упорядочен по z
+static uint32_t collect_windows(Window** windows, uint32_t max) {
+    uint32_t count = 0;
+    
+    for (Window* window = gui_state.first_window; window && count < max; window = window->next) {
+        if (IS_VALID_WINDOW_PTR(window) && window->visible && !window->minimized) {
+            windows[count++] = window;
+        }
+    }
+    return count;
+}
+
+// Нужна ли перерисовка в поверхность: содержимое устарело или окно сменило размер
+static uint8_t surface_stale(Window* window) {
+    return window_content_dirty(window) || !window->surface ||
+           window->surface->width != window->width || window->surface->height != window->height;
+}
+
+static region_t covered;            // Прямоугольники окон выше текущего
+static region_t desktop;            // Часть экрана, не закрытая ни одним окном
+static uint8_t regions_valid = 0;   // Видимые области посчитаны для текущей раскладки
+
+// Сверху вниз: видимая часть окна - его прямоугольник минус всё, что выше.
+// Тени не закрывают нижние окна: их рисует само окно после нижних
+static void compute_visibility(Window** windows, uint32_t count) {
+    regions_valid = 0;
+    region_clear(&covered);
+    
+    for (uint32_t i = count; i-- > 0;) {
+        Window* window = windows[i];
+        
+        if (region_set_rect(&window->visible_region, window->x, window->y, window->width, window->height) != 0 ||
+            region_subtract(&window->visible_region, &window->visible_region, &covered) != 0 ||
+            region_union_rect(&covered, window->x, window->y, window->width, window->height) != 0) {
+            serial_puts("[COMPOSITOR] No memory for visible regions, culling disabled\n");
+            return;
+        }
+    }
+    
+    if (region_set_rect(&desktop, 0, 0, vesa_get_width(), vesa_get_height()) != 0 ||
+        region_subtract(&desktop, &desktop, &covered) != 0) {
+        return;
+    }
+    regions_valid = 1;
+}
+
+static void damage_region(const region_t* region) {
+    for (uint32_t i = 0; i < region->count; i++) {
+        const region_rect_t* r = &region->rects[i];
+        vesa_mark_dirty(r->x1, r->y1, r->x2 - r->x1, r->y2 - r->y1);
+    }
+}
+
+// Пересечение прямоугольника области с (x, y, w, h); 0 - пусто
+static uint8_t clip_to(const region_rect_t* r, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+                       region_rect_t* out) {
+    out->x1 = r->x1 > (int32_t)x ? r->x1 : (int32_t)x;
+    out->y1 = r->y1 > (int32_t)y ? r->y1 : (int32_t)y;
+    out->x2 = r->x2 < (int32_t)(x + w) ? r->x2 : (int32_t)(x + w);
+    out->y2 = r->y2 < (int32_t)(y + h) ? r->y2 : (int32_t)(y + h);
+    return out->x1 < out->x2 && out->y1 < out->y2;
+}
+
+static void restore_desktop(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    if (vesa_is_background_cached()) {
+        vesa_restore_background_rect(x, y, w, h);
+    } else {
+        vesa_draw_rect(x, y, w, h, COMPOSITOR_DESKTOP_COLOR);
+    }
+}
+
+// Заливка пересечения прямоугольника с областью (cx, cy, cw, ch)
+static void fill_clipped(int32_t x, int32_t y, uint32_t w, uint32_t h,
+                         uint32_t cx, uint32_t cy, uint32_t cw, uint32_t ch, color_t color) {
+    int32_t x0 = x > (int32_t)cx ? x : (int32_t)cx;
+    int32_t y0 = y > (int32_t)cy ? y : (int32_t)cy;
+    int32_t x1 = x + (int32_t)w < (int32_t)(cx + cw) ? x + (int32_t)w : (int32_t)(cx + cw);
+    int32_t y1 = y + (int32_t)h < (int32_t)(cy + ch) ? y + (int32_t)h : (int32_t)(cy + ch);
+    
+    if (x0 < x1 && y0 < y1) vesa_draw_rect(x0, y0, x1 - x0, y1 - y0, color);
+}
+
+// Сборка экрана в повреждённых прямоугольниках: фон там, где нет окон, затем окна
+// снизу вверх, каждое только в своей видимой части
+static void compose(Window** windows, uint32_t count) {
+    uint32_t rects = vesa_get_dirty_count();
+    region_rect_t part;
+    
+    for (uint32_t r = 0; r < rects; r++) {
+        uint32_t x, y, w, h;
+        if (!vesa_get_dirty_rect(r, &x, &y, &w, &h)) continue;
+        
+        if (regions_valid) {
+            for (uint32_t d = 0; d < desktop.count; d++) {
+                if (clip_to(&desktop.rects[d], x, y, w, h, &part)) {
+                    restore_desktop(part.x1, part.y1, part.x2 - part.x1, part.y2 - part.y1);
+                }
+            }
+        } else {
+            restore_desktop(x, y, w, h);
+        }
+        
+        for (uint32_t i = 0; i < count; i++) {
+            Window* window = windows[i];
+            if (!window->surface) continue;
+            
+            if (window->has_titlebar && !window->maximized) {
+                fill_clipped(window->x + window->width, window->y + COMPOSITOR_SHADOW_OFFSET,
+                             COMPOSITOR_SHADOW_OFFSET, window->height, x, y, w, h, COMPOSITOR_SHADOW_COLOR);
+                fill_clipped(window->x + COMPOSITOR_SHADOW_OFFSET, window->y + window->height,
+                             window->width, COMPOSITOR_SHADOW_OFFSET, x, y, w, h, COMPOSITOR_SHADOW_COLOR);
+            }
+            
+            if (!regions_valid) {
+                vesa_surface_present(window->surface, window->x, window->y, x, y, w, h);
+                continue;
+            }
+            
+            for (uint32_t v = 0; v < window->visible_region.count; v++) {
+                if (clip_to(&window->visible_region.rects[v], x, y, w, h, &part)) {
+                    vesa_surface_present(window->surface, window->x, window->y,
+                                         part.x1, part.y1, part.x2 - part.x1, part.y2 - part.y1);
+                }
+            }
+        }
+    }
+    
+    vesa_clear_dirty();
+}
+
+void compositor_render(void) {
+    Window* windows[COMPOSITOR_MAX_WINDOWS];
+    uint32_t count = collect_windows(windows, COMPOSITOR_MAX_WINDOWS);
+    
+    // Скрытые и свёрнутые окна освобождают своё место
+    for (Window* window = gui_state.first_window; window; window = window->next) {
+        if (IS_VALID_WINDOW_PTR(window) && window->shown && (!window->visible || window->minimized)) {
+            damage_shown(window);
+            region_clear(&window->visible_region);
+            window->shown = 0;
+        }
+    }
+    
+    // Перемещение и смена z - только повреждение старого и нового места, без перерисовки виджетов
+    for (uint32_t i = 0; i < count; i++) {
+        Window* window = windows[i];
+        
+        if (!window->shown ||
+            window->shown_x != window->x || window->shown_y != window->y ||
+            window->shown_width != window->width || window->shown_height != window->height ||
+            window->shown_z != window->z_index) {
+            damage_shown(window);
+            damage_rect(window->x, window->y, window->width, window->height);
+        }
+        
+        window->shown = 1;
+        window->shown_x = window->x;
+        window->shown_y = window->y;
+        window->shown_width = window->width;
+        window->shown_height = window->height;
+        window->shown_z = window->z_index;
+    }
+    
+    compute_visibility(windows, count);
+    
+    // Полностью закрытое окно не перерисовывается: флаги остаются до того, как его откроют
+    for (uint32_t i = 0; i < count; i++) {
+        Window* window = windows[i];
+        
+        if (regions_valid && region_is_empty(&window->visible_region)) continue;
+        if (!surface_stale(window)) continue;
+        if (window_render(window) != 0) continue;
+        
+        if (regions_valid) {
+            damage_region(&window->visible_region);
+        } else {
+            vesa_mark_dirty(window->x, window->y, window->width, window->height);
+        }
+    }
+    
+    compose(windows, count);
+}
+
+void compositor_forget(Window* window) {
+    if (!window) return;
+    
+    damage_shown(window);
+    window->shown = 0;
+    regions_valid = 0;
+    
+    region_free(&window->visible_region);
+    vesa_surface_destroy(window->surface);
+    window->surface = NULL;
+}
+
+uint8_t compositor_window_at(uint32_t x, uint32_t y, Window** hit) {
+    if (!regions_valid) return 0;
+    
+    // Области верны, пока ни одно окно не сдвинулось, не сменило z и не пропало с экрана
+    for (Window* window = gui_state.first_window; window; window = window->next) {
+        if (!IS_VALID_WINDOW_PTR(window)) continue;
+        
+        uint8_t on_screen = window->visible && !window->minimized;
+        if (on_screen != window->shown) return 0;
+        if (on_screen && (window->shown_x != window->x || window->shown_y != window->y ||
+                          window->shown_width != window->width || window->shown_height != window->height ||
+                          window->shown_z != window->z_index)) {
+            return 0;
+        }
+    }
+    
+    // Видимые области не пересекаются: подходит первое же совпадение
+    *hit = NULL;
+    for (Window* window = gui_state.last_window; window; window = window->prev) {
+        if (IS_VALID_WINDOW_PTR(window) && window->shown &&
+            region_contains_point(&window->visible_region, (int32_t)x, (int32_t)y)) {
+            *hit = window;
+            break;
+        }
+    }
+    return 1;
+}
@@ -5,6 +5,7 @@
 #include "gui/shutdown.h"
 #include "drivers/timer.h"
 #include "lib/string.h"
+#include "gui/compositor.h"
 
 struct GUI_State gui_state;
 
@@ -529,7 +530,6 @@ void gui_handle_event(event_t* event) {
             int32_t new_y = my - window->drag_offset_y;
             
             wm_move_window(window, new_x, new_y);
-            window->needs_redraw = 1;
         }
         else if (event->type == EVENT_MOUSE_RELEASE && button == 0) {
             gui_state.dragging_window = NULL;
@@ -806,48 +806,14 @@ void gui_handle_event(event_t* event) {
                         window->drag_offset_x = mx - window->x;
                         window->drag_offset_y = my - window->y;
                         gui_state.dragging_window = window;
-                        window->needs_redraw = 1;
                         return;
                     }
                 }
                 
-                if (window->resizable && !window->maximized && !window->minimized) {
-                    uint32_t edge_size = 8;
-                    uint32_t corner_size = 12;
-                    
-                    if (mx <= window->x + (int32_t)corner_size && my <= window->y + (int32_t)corner_size) {
-                        wm_start_resize(window, 1, mx, my);
-                        return;
-                    }
-                    if (mx >= window->x + (int32_t)window->width - (int32_t)corner_size && 
-                        my <= window->y + (int32_t)corner_size) {
-                        wm_start_resize(window, 2, mx, my);
-                        return;
-                    }
-                    if (mx <= window->x + (int32_t)corner_size && 
-                        my >= window->y + (int32_t)window->height - (int32_t)corner_size) {
-                        wm_start_resize(window, 3, mx, my);
-                        return;
-                    }
-                    if (mx >= window->x + (int32_t)window->width - (int32_t)corner_size && 
-                        my >= window->y + (int32_t)window->height - (int32_t)corner_size) {
-                        wm_start_resize(window, 4, mx, my);
-                        return;
-                    }
-                    
-                    if (mx <= window->x + (int32_t)edge_size && my > window->y + (int32_t)title_h) {
-                        wm_start_resize(window, 5, mx, my);
-                        return;
-                    }
-                    if (mx >= window->x + (int32_t)window->width - (int32_t)edge_size && 
-                        my > window->y + (int32_t)title_h) {
-                        wm_start_resize(window, 6, mx, my);
-                        return;
-                    }
-                    if (my >= window->y + (int32_t)window->height - (int32_t)edge_size) {
-                        wm_start_resize(window, 8, mx, my);
-                        return;
-                    }
+                uint32_t edge = wm_resize_edge_at(window, mx, my);
+                if (edge) {
+                    wm_start_resize(window, edge, mx, my);
+                    return;
                 }
             }
         } else {
@@ -917,39 +883,32 @@ void gui_handle_event(event_t* event) {
             window = window->next;
         }
         
-        window = gui_state.first_window;
-        while (window) {
-            if (IS_VALID_WINDOW_PTR(window) && 
-                window->visible && !window->minimized && 
-                point_in_rect_static(mx, my, window->x, window->y, 
-                                   window->width, window->height)) {
-                
-                Widget* widget = window->first_widget;
-                while (widget) {
-                    if (widget->visible && widget->enabled) {
-                        uint8_t is_hovering = point_in_rect_static(mx, my, 
-                                                                  widget->x, widget->y,
-                                                                  widget->width, widget->height);
-                        
-                        if (is_hovering) {
-                            if (widget->state != STATE_HOVER && widget->state != STATE_PRESSED) {
-                                widget->state = STATE_HOVER;
-                                widget->needs_redraw = 1;
-                                window->needs_redraw = 1;
-                            }
-                        } else {
-                            if (widget->state == STATE_HOVER) {
-                                widget->state = STATE_NORMAL;
-                                widget->needs_redraw = 1;
-                                window->needs_redraw = 1;
-                            }
+        // Подсветка - только в окне, которое видно под курсором
+        window = wm_find_window_at(mx, my);
+        if (window) {
+            Widget* widget = window->first_widget;
+            while (widget) {
+                if (widget->visible && widget->enabled) {
+                    uint8_t is_hovering = point_in_rect_static(mx, my, 
+                                                              widget->x, widget->y,
+                                                              widget->width, widget->height);
+                    
+                    if (is_hovering) {
+                        if (widget->state != STATE_HOVER && widget->state != STATE_PRESSED) {
+                            widget->state = STATE_HOVER;
+                            widget->needs_redraw = 1;
+                            window->needs_redraw = 1;
+                        }
+                    } else {
+                        if (widget->state == STATE_HOVER) {
+                            widget->state = STATE_NORMAL;
+                            widget->needs_redraw = 1;
+                            window->needs_redraw = 1;
                         }
                     }
-                    widget = widget->next;
                 }
-                break;
+                widget = widget->next;
             }
-            window = window->next;
         }
     }
     else if (event->type == EVENT_MOUSE_RELEASE && button == 0) {
@@ -1008,6 +967,345 @@ void gui_handle_event(event_t* event) {
 }
 
 // ============ РЕНДЕРИНГ ============
+// Хром и виджеты окна; вызывается компоновщиком с целью рисования на поверхности окна
+void gui_draw_window(Window* window) {
+    vesa_draw_rect(window->x, window->y, window->width, window->height, WINDOW_BG_COLOR);
+    
+    if (window->has_titlebar) {
+        uint32_t title_color = window->focused ? WINDOW_TITLE_ACTIVE : WINDOW_TITLE_COLOR;
+        vesa_draw_rect(window->x, window->y, window->width, 
+                     window->title_height, title_color);
+        
+        if (window->title) {
+            uint32_t text_x = window->x + 8;
+            uint32_t text_y = window->y + (window->title_height - 16) / 2;
+            vesa_draw_text(text_x, text_y, window->title, 
+                         0xFFFFFF, title_color);
+        }
+        
+        uint32_t button_y = window->y + 5;
+        
+        if (window->maximizable) {
+            int32_t max_x;
+            if (window->maximized) {
+                max_x = gui_state.screen_width - (window->closable ? 65 : 45);
+            } else {
+                max_x = window->x + window->width - (window->closable ? 65 : 45);
+            }
+            
+            vesa_draw_rect(max_x, button_y, 15, 15, WINDOW_BUTTON_COLOR);
+            
+            vesa_draw_rect(max_x + 3, button_y + 3, 9, 1, 0x000000);
+            vesa_draw_rect(max_x + 3, button_y + 11, 9, 1, 0x000000);
+            vesa_draw_rect(max_x + 3, button_y + 3, 1, 9, 0x000000);
+            vesa_draw_rect(max_x + 11, button_y + 3, 1, 9, 0x000000);
+            
+            vesa_draw_rect(max_x, button_y, 15, 1, WINDOW_BORDER_COLOR);
+            vesa_draw_rect(max_x, button_y + 14, 15, 1, WINDOW_BORDER_COLOR);
+            vesa_draw_rect(max_x, button_y, 1, 15, WINDOW_BORDER_COLOR);
+            vesa_draw_rect(max_x + 14, button_y, 1, 15, WINDOW_BORDER_COLOR);
+        }
+        
+        if (window->minimizable) {
+            int32_t min_x;
+            if (window->maximized) {
+                min_x = gui_state.screen_width - (window->closable ? 45 : 25);
+            } else {
+                min_x = window->x + window->width - (window->closable ? 45 : 25);
+            }
+            vesa_draw_rect(min_x, button_y, 15, 15, WINDOW_BUTTON_COLOR);
+            vesa_draw_rect(min_x + 4, button_y + 7, 7, 1, 0x000000);
+            vesa_draw_rect(min_x, button_y, 15, 1, WINDOW_BORDER_COLOR);
+            vesa_draw_rect(min_x, button_y + 14, 15, 1, WINDOW_BORDER_COLOR);
+            vesa_draw_rect(min_x, button_y, 1, 15, WINDOW_BORDER_COLOR);
+            vesa_draw_rect(min_x + 14, button_y, 1, 15, WINDOW_BORDER_COLOR);
+        }
+        
+        if (window->closable) {
+            int32_t close_x;
+            if (window->maximized) {
+                close_x = gui_state.screen_width - 25;
+            } else {
+                close_x = window->x + window->width - 25;
+            }
+            vesa_draw_rect(close_x, button_y, 15, 15, WINDOW_BUTTON_COLOR);
+            vesa_draw_line(close_x + 4, button_y + 4, close_x + 10, button_y + 10, 0x000000);
+            vesa_draw_line(close_x + 10, button_y + 4, close_x + 4, button_y + 10, 0x000000);
+            vesa_draw_rect(close_x, button_y, 15, 1, WINDOW_BORDER_COLOR);
+            vesa_draw_rect(close_x, button_y + 14, 15, 1, WINDOW_BORDER_COLOR);
+            vesa_draw_rect(close_x, button_y, 1, 15, WINDOW_BORDER_COLOR);
+            vesa_draw_rect(close_x + 14, button_y, 1, 15, WINDOW_BORDER_COLOR);
+        }
+    }
+    
+    uint32_t border_color = WINDOW_BORDER_COLOR;
+    if (!window->maximized) {
+        vesa_draw_rect(window->x, window->y, window->width, 1, border_color);
+        vesa_draw_rect(window->x, window->y + window->height - 1, 
+                     window->width, 1, border_color);
+        vesa_draw_rect(window->x, window->y, 1, window->height, border_color);
+        vesa_draw_rect(window->x + window->width - 1, window->y, 
+                     1, window->height, border_color);
+        
+        if (window->resizable && !window->maximized) {
+            uint32_t corner_size = 8;
+            vesa_draw_line(window->x + window->width - corner_size, 
+                         window->y + window->height - 1,
+                         window->x + window->width - 1,
+                         window->y + window->height - corner_size,
+                         0x808080);
+            vesa_draw_line(window->x, window->y + window->height - corner_size,
+                         window->x + corner_size, window->y + window->height - 1,
+                         0x808080);
+        }
+    } else {
+        vesa_draw_rect(window->x, window->y + window->height - 1, 
+                     window->width, 1, border_color);
+    }
+    
+    Widget* widget = window->first_widget;
+    while (widget) {
+        if (!widget->visible) {
+            widget = widget->next;
+            continue;
+        }
+        
+        if (widget->draw) {
+            widget->draw(widget);
+        } else {
+            switch (widget->type) {
+                case WIDGET_BUTTON: {
+                    uint32_t btn_color;
+                    switch (widget->state) {
+                        case STATE_HOVER: btn_color = WINDOW_BUTTON_HOVER; break;
+                        case STATE_PRESSED: btn_color = WINDOW_BUTTON_PRESSED; break;
+                        case STATE_DISABLED: btn_color = 0xCCCCCC; break;
+                        default: btn_color = WINDOW_BUTTON_COLOR; break;
+                    }
+                    
+                    vesa_draw_rect(widget->x, widget->y, widget->width, widget->height, btn_color);
+                    vesa_draw_rect(widget->x, widget->y, widget->width, 1, border_color);
+                    vesa_draw_rect(widget->x, widget->y + widget->height - 1, 
+                                 widget->width, 1, border_color);
+                    vesa_draw_rect(widget->x, widget->y, 1, widget->height, border_color);
+                    vesa_draw_rect(widget->x + widget->width - 1, widget->y, 
+                                 1, widget->height, border_color);
+                    
+                    if (widget->text) {
+                        uint32_t text_len = gui_strlen(widget->text);
+                        uint32_t text_x = widget->x + (widget->width - text_len * 8) / 2;
+                        uint32_t text_y = widget->y + (widget->height - 16) / 2;
+                        
+                        if (text_x < widget->x + 4) text_x = widget->x + 4;
+                        if (text_y < widget->y + 2) text_y = widget->y + 2;
+                        
+                        uint32_t text_color = (widget->state == STATE_DISABLED) ? 0x888888 : 0x000000;
+                        vesa_draw_text(text_x, text_y, widget->text, text_color, btn_color);
+                    }
+                    break;
+                }
+                case WIDGET_LABEL:
+                    if (widget->text) {
+                        vesa_draw_text(widget->x, widget->y, widget->text, 0x000000, WINDOW_BG_COLOR);
+                    }
+                    break;
+                case WIDGET_CHECKBOX: {
+                    uint32_t box_x = widget->x;
+                    uint32_t box_y = widget->y + 2;
+                    uint32_t box_size = 14;
+                    
+                    vesa_draw_rect(box_x, box_y, box_size, box_size, CHECKBOX_COLOR);
+                    vesa_draw_rect(box_x, box_y, box_size, 1, WINDOW_BORDER_COLOR);
+                    vesa_draw_rect(box_x, box_y + box_size - 1, box_size, 1, WINDOW_BORDER_COLOR);
+                    vesa_draw_rect(box_x, box_y, 1, box_size, WINDOW_BORDER_COLOR);
+                    vesa_draw_rect(box_x + box_size - 1, box_y, 1, box_size, WINDOW_BORDER_COLOR);
+                    
+                    if (widget->data && *((uint8_t*)widget->data)) {
+                        vesa_draw_rect(box_x + 3, box_y + 3, 8, 8, CHECKBOX_CHECKED_COLOR);
+                    }
+                    
+                    if (widget->text) {
+                        vesa_draw_text(widget->x + 20, widget->y, widget->text, 0x000000, WINDOW_BG_COLOR);
+                    }
+                    break;
+                }
+                case WIDGET_SLIDER: {
+                    uint32_t* data = (uint32_t*)widget->data;
+                    if (!data) break;
+                    
+                    uint32_t min = data[0];
+                    uint32_t max = data[1];
+                    uint32_t value = data[2];
+                    
+                    uint32_t track_height = 6;
+                    uint32_t track_y = widget->y + (widget->height - track_height) / 2;
+                    
+                    vesa_draw_rect(widget->x, track_y, widget->width, track_height, SLIDER_TRACK_COLOR);
+                    vesa_draw_rect(widget->x, track_y, widget->width, 1, 0x606060);
+                    vesa_draw_rect(widget->x, track_y + track_height - 1, widget->width, 1, 0xA0A0A0);
+                    
+                    if (max > min) {
+                        uint32_t fill_width = (value - min) * widget->width / (max - min);
+                        if (fill_width > 0) {
+                            vesa_draw_rect(widget->x, track_y, fill_width, track_height, SLIDER_FILL_COLOR);
+                        }
+                    }
+                    
+                    uint32_t handle_size = 16;
+                    uint32_t handle_x = widget->x;
+                    if (max > min) {
+                        handle_x = widget->x + (value - min) * (widget->width - handle_size) / (max - min);
+                    }
+                    uint32_t handle_y = widget->y + (widget->height - handle_size) / 2;
+                    
+                    vesa_draw_rect(handle_x, handle_y, handle_size, handle_size, SLIDER_HANDLE_COLOR);
+                    vesa_draw_rect(handle_x, handle_y, handle_size, 1, 0x808080);
+                    vesa_draw_rect(handle_x, handle_y + handle_size - 1, handle_size, 1, 0x404040);
+                    vesa_draw_rect(handle_x, handle_y, 1, handle_size, 0x808080);
+                    vesa_draw_rect(handle_x + handle_size - 1, handle_y, 1, handle_size, 0x404040);
+                    break;
+                }
+                case WIDGET_PROGRESSBAR: {
+                    uint32_t value = 0;
+                    if (widget->data) {
+                        value = *((uint32_t*)widget->data);
+                    }
+                    
+                    vesa_draw_rect(widget->x, widget->y, widget->width, widget->height, PROGRESSBAR_BG_COLOR);
+                    
+                    vesa_draw_rect(widget->x, widget->y, widget->width, 1, 0x808080);
+                    vesa_draw_rect(widget->x, widget->y + widget->height - 1, widget->width, 1, 0x808080);
+                    vesa_draw_rect(widget->x, widget->y, 1, widget->height, 0x808080);
+                    vesa_draw_rect(widget->x + widget->width - 1, widget->y, 1, widget->height, 0x808080);
+                    
+                    if (value > 0 && widget->width > 2) {
+                        uint32_t fill_width = (value * (widget->width - 2)) / 100;
+                        if (fill_width > 0) {
+                            vesa_draw_rect(widget->x + 1, widget->y + 1, fill_width, widget->height - 2, PROGRESSBAR_FILL_COLOR);
+                            
+                            if (fill_width > 4) {
+                                vesa_draw_rect(widget->x + 1, widget->y + 1, fill_width, 1, 0xA0D0FF);
+                                vesa_draw_rect(widget->x + 1, widget->y + widget->height - 2, fill_width, 1, 0x2050A0);
+                            }
+                        }
+                    }
+                    break;
+                }
+                case WIDGET_INPUT: {
+                    uint32_t bg_color = INPUT_BG_COLOR;
+                    vesa_draw_rect(widget->x, widget->y, widget->width, widget->height, bg_color);
+                    
+                    uint32_t border = (widget->focused) ? 0x007ACC : 0x808080;
+                    vesa_draw_rect(widget->x, widget->y, widget->width, 1, border);
+                    vesa_draw_rect(widget->x, widget->y + widget->height - 1, widget->width, 1, border);
+                    vesa_draw_rect(widget->x, widget->y, 1, widget->height, border);
+                    vesa_draw_rect(widget->x + widget->width - 1, widget->y, 1, widget->height, border);
+                    
+                    InputData* input = (InputData*)widget->data;
+                    if (input && input->buffer) {
+                        uint32_t text_x = widget->x + 4;
+                        uint32_t text_y = widget->y + (widget->height - 16) / 2;
+                        
+                        char* display_text = input->buffer;
+                        
+                        uint32_t max_chars = (widget->width - 8) / 8;
+                        if (max_chars < 1) max_chars = 1;
+                        
+                        uint32_t len = gui_strlen(display_text);
+                        if (input->cursor_pos > input->scroll_offset + max_chars - 1) {
+                            input->scroll_offset = input->cursor_pos - max_chars + 1;
+                        }
+                        if (input->cursor_pos < input->scroll_offset) {
+                            input->scroll_offset = input->cursor_pos;
+                        }
+                        
+                        char visible_text[256];
+                        uint32_t visible_len = 0;
+                        for (uint32_t i = input->scroll_offset; 
+                             i < len && visible_len < max_chars; i++, visible_len++) {
+                            visible_text[visible_len] = display_text[i];
+                        }
+                        visible_text[visible_len] = '\0';
+                        
+                        // Рисуем выделение (СИНИМ!) — сначала фон
+                        if (input->selection_start != input->selection_end && widget->focused) {
+                            uint32_t sel_start = input->selection_start;
+                            uint32_t sel_end = input->selection_end;
+                            if (sel_start > sel_end) {
+                                uint32_t temp = sel_start;
+                                sel_start = sel_end;
+                                sel_end = temp;
+                            }
+                            
+                            uint32_t vis_start = sel_start > input->scroll_offset ? 
+                                                 sel_start - input->scroll_offset : 0;
+                            uint32_t vis_end = sel_end - input->scroll_offset;
+                            if (vis_end > max_chars) vis_end = max_chars;
+                            
+                            // Рисуем синий фон ДО текста
+                            for (uint32_t pos = vis_start; pos < vis_end && pos < max_chars; pos++) {
+                                if (pos < visible_len) { // Только если символ существует
+                                    vesa_draw_rect(text_x + pos * 8, text_y, 8, 16, INPUT_SELECTION_COLOR);
+                                }
+                            }
+                        }
+                        
+                        // Рисуем текст поверх (белым если в выделении)
+                        for (uint32_t i = 0; i < visible_len; i++) {
+                            uint32_t global_pos = input->scroll_offset + i;
+                            uint32_t char_x = text_x + i * 8;
+                            uint32_t char_y = text_y;
+                            
+                            // Проверяем, попадает ли символ в выделение
+                            uint8_t is_selected = 0;
+                            if (widget->focused && input->selection_start != input->selection_end) {
+                                uint32_t sel_start = input->selection_start;
+                                uint32_t sel_end = input->selection_end;
+                                if (sel_start > sel_end) {
+                                    uint32_t temp = sel_start;
+                                    sel_start = sel_end;
+                                    sel_end = temp;
+                                }
+                                is_selected = (global_pos >= sel_start && global_pos < sel_end);
+                            }
+                            
+                            if (input->password_mode) {
+                                char c = '*';
+                                uint32_t color = is_selected ? 0xFFFFFF : INPUT_TEXT_COLOR;
+                                vesa_draw_char(char_x, char_y, c, color, 
+                                              is_selected ? INPUT_SELECTION_COLOR : bg_color);
+                            } else {
+                                char c = visible_text[i];
+                                uint32_t color = is_selected ? 0xFFFFFF : INPUT_TEXT_COLOR;
+                                vesa_draw_char(char_x, char_y, c, color,
+                                              is_selected ? INPUT_SELECTION_COLOR : bg_color);
+                            }
+                        }
+                        
+                        // Рисуем курсор
+                        if (widget->focused) {
+                            // Фаза мигания от таймера: по ней компоновщик видит, что пора перерисовать
+                            input->cursor_visible = (timer_get_ticks() / INPUT_BLINK_TICKS) & 1;
+                            
+                            if (input->cursor_visible) {
+                                uint32_t cursor_x = text_x + (input->cursor_pos - input->scroll_offset) * 8;
+                                if (cursor_x >= widget->x && cursor_x < widget->x + widget->width - 4) {
+                                    vesa_draw_line(cursor_x, text_y, cursor_x, text_y + 16, INPUT_TEXT_COLOR);
+                                }
+                            }
+                        }
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+        
+        widget = widget->next;
+    }
+}
+
 void gui_render(void) {
     if (!gui_state.initialized) return;
 
@@ -1077,415 +1375,18 @@ void gui_render(void) {
                 widget = widget->next;
             }
             
-            vesa_mark_dirty(dialog->x - 5, dialog->y - 5,
-                           dialog->width + 10, dialog->height + 10);
+            vesa_mark_present(dialog->x - 5, dialog->y - 5,
+                              dialog->width + 10, dialog->height + 10);
         }
         
+        // Затемнение перекрыло весь экран: накопленный урон закрыт, кадры не нужны без повода
+        vesa_clear_dirty();
         return;
     }
     
-    uint8_t has_visible_windows = 0;
-    Window* window = gui_state.first_window;
-    while (window) {
-        if (IS_VALID_WINDOW_PTR(window) && window->visible && !window->minimized) {
-            has_visible_windows = 1;
-            break;
-        }
-        window = window->next;
-    }
-    
-    if (has_visible_windows) {
-        Window* windows[64];
-        uint32_t count = 0;
-        
-        window = gui_state.first_window;
-        while (window && count < 64) {
-            if (IS_VALID_WINDOW_PTR(window) && window->visible && !window->minimized) {
-                windows[count++] = window;
-            }
-            window = window->next;
-        }
-        
-        for (uint32_t i = 0; i < count - 1; i++) {
-            for (uint32_t j = 0; j < count - i - 1; j++) {
-                if (windows[j]->z_index > windows[j + 1]->z_index) {
-                    Window* temp = windows[j];
-                    windows[j] = windows[j + 1];
-                    windows[j + 1] = temp;
-                }
-            }
-        }
-        
-        for (uint32_t i = 0; i < count; i++) {
-            window = windows[i];
-            
-            if (!IS_VALID_WINDOW_PTR(window) || !window->visible || window->minimized) 
-                continue;
-
-            if (!window->needs_redraw && !window->dragging && !window->resizing) {
-                continue;
-            }
-            
-            if (window->has_titlebar && !window->maximized) {
-                vesa_draw_rect(window->x + 2, window->y + 2, 
-                             window->width, window->height, 0x888888);
-            }
-            
-            vesa_draw_rect(window->x, window->y, window->width, window->height, WINDOW_BG_COLOR);
-            
-            if (window->has_titlebar) {
-                uint32_t title_color = window->focused ? WINDOW_TITLE_ACTIVE : WINDOW_TITLE_COLOR;
-                vesa_draw_rect(window->x, window->y, window->width, 
-                             window->title_height, title_color);
-                
-                if (window->title) {
-                    uint32_t text_x = window->x + 8;
-                    uint32_t text_y = window->y + (window->title_height - 16) / 2;
-                    vesa_draw_text(text_x, text_y, window->title, 
-                                 0xFFFFFF, title_color);
-                }
-                
-                uint32_t button_y = window->y + 5;
-                
-                if (window->maximizable) {
-                    int32_t max_x;
-                    if (window->maximized) {
-                        max_x = gui_state.screen_width - (window->closable ? 65 : 45);
-                    } else {
-                        max_x = window->x + window->width - (window->closable ? 65 : 45);
-                    }
-                    
-                    vesa_draw_rect(max_x, button_y, 15, 15, WINDOW_BUTTON_COLOR);
-                    
-                    vesa_draw_rect(max_x + 3, button_y + 3, 9, 1, 0x000000);
-                    vesa_draw_rect(max_x + 3, button_y + 11, 9, 1, 0x000000);
-                    vesa_draw_rect(max_x + 3, button_y + 3, 1, 9, 0x000000);
-                    vesa_draw_rect(max_x + 11, button_y + 3, 1, 9, 0x000000);
-                    
-                    vesa_draw_rect(max_x, button_y, 15, 1, WINDOW_BORDER_COLOR);
-                    vesa_draw_rect(max_x, button_y + 14, 15, 1, WINDOW_BORDER_COLOR);
-                    vesa_draw_rect(max_x, button_y, 1, 15, WINDOW_BORDER_COLOR);
-                    vesa_draw_rect(max_x + 14, button_y, 1, 15, WINDOW_BORDER_COLOR);
-                }
-                
-                if (window->minimizable) {
-                    int32_t min_x;
-                    if (window->maximized) {
-                        min_x = gui_state.screen_width - (window->closable ? 45 : 25);
-                    } else {
-                        min_x = window->x + window->width - (window->closable ? 45 : 25);
-                    }
-                    vesa_draw_rect(min_x, button_y, 15, 15, WINDOW_BUTTON_COLOR);
-                    vesa_draw_rect(min_x + 4, button_y + 7, 7, 1, 0x000000);
-                    vesa_draw_rect(min_x, button_y, 15, 1, WINDOW_BORDER_COLOR);
-                    vesa_draw_rect(min_x, button_y + 14, 15, 1, WINDOW_BORDER_COLOR);
-                    vesa_draw_rect(min_x, button_y, 1, 15, WINDOW_BORDER_COLOR);
-                    vesa_draw_rect(min_x + 14, button_y, 1, 15, WINDOW_BORDER_COLOR);
-                }
-                
-                if (window->closable) {
-                    int32_t close_x;
-                    if (window->maximized) {
-                        close_x = gui_state.screen_width - 25;
-                    } else {
-                        close_x = window->x + window->width - 25;
-                    }
-                    vesa_draw_rect(close_x, button_y, 15, 15, WINDOW_BUTTON_COLOR);
-                    vesa_draw_line(close_x + 4, button_y + 4, close_x + 10, button_y + 10, 0x000000);
-                    vesa_draw_line(close_x + 10, button_y + 4, close_x + 4, button_y + 10, 0x000000);
-                    vesa_draw_rect(close_x, button_y, 15, 1, WINDOW_BORDER_COLOR);
-                    vesa_draw_rect(close_x, button_y + 14, 15, 1, WINDOW_BORDER_COLOR);
-                    vesa_draw_rect(close_x, button_y, 1, 15, WINDOW_BORDER_COLOR);
-                    vesa_draw_rect(close_x + 14, button_y, 1, 15, WINDOW_BORDER_COLOR);
-                }
-            }
-            
-            uint32_t border_color = WINDOW_BORDER_COLOR;
-            if (!window->maximized) {
-                vesa_draw_rect(window->x, window->y, window->width, 1, border_color);
-                vesa_draw_rect(window->x, window->y + window->height - 1, 
-                             window->width, 1, border_color);
-                vesa_draw_rect(window->x, window->y, 1, window->height, border_color);
-                vesa_draw_rect(window->x + window->width - 1, window->y, 
-                             1, window->height, border_color);
-                
-                if (window->resizable && !window->maximized) {
-                    uint32_t corner_size = 8;
-                    vesa_draw_line(window->x + window->width - corner_size, 
-                                 window->y + window->height - 1,
-                                 window->x + window->width - 1,
-                                 window->y + window->height - corner_size,
-                                 0x808080);
-                    vesa_draw_line(window->x, window->y + window->height - corner_size,
-                                 window->x + corner_size, window->y + window->height - 1,
-                                 0x808080);
-                }
-            } else {
-                vesa_draw_rect(window->x, window->y + window->height - 1, 
-                             window->width, 1, border_color);
-            }
-            
-            Widget* widget = window->first_widget;
-            while (widget) {
-                if (!widget->visible) {
-                    widget = widget->next;
-                    continue;
-                }
-                
-                if (widget->draw) {
-                    widget->draw(widget);
-                } else {
-                    switch (widget->type) {
-                        case WIDGET_BUTTON: {
-                            uint32_t btn_color;
-                            switch (widget->state) {
-                                case STATE_HOVER: btn_color = WINDOW_BUTTON_HOVER; break;
-                                case STATE_PRESSED: btn_color = WINDOW_BUTTON_PRESSED; break;
-                                case STATE_DISABLED: btn_color = 0xCCCCCC; break;
-                                default: btn_color = WINDOW_BUTTON_COLOR; break;
-                            }
-                            
-                            vesa_draw_rect(widget->x, widget->y, widget->width, widget->height, btn_color);
-                            vesa_draw_rect(widget->x, widget->y, widget->width, 1, border_color);
-                            vesa_draw_rect(widget->x, widget->y + widget->height - 1, 
-                                         widget->width, 1, border_color);
-                            vesa_draw_rect(widget->x, widget->y, 1, widget->height, border_color);
-                            vesa_draw_rect(widget->x + widget->width - 1, widget->y, 
-                                         1, widget->height, border_color);
-                            
-                            if (widget->text) {
-                                uint32_t text_len = gui_strlen(widget->text);
-                                uint32_t text_x = widget->x + (widget->width - text_len * 8) / 2;
-                                uint32_t text_y = widget->y + (widget->height - 16) / 2;
-                                
-                                if (text_x < widget->x + 4) text_x = widget->x + 4;
-                                if (text_y < widget->y + 2) text_y = widget->y + 2;
-                                
-                                uint32_t text_color = (widget->state == STATE_DISABLED) ? 0x888888 : 0x000000;
-                                vesa_draw_text(text_x, text_y, widget->text, text_color, btn_color);
-                            }
-                            break;
-                        }
-                        case WIDGET_LABEL:
-                            if (widget->text) {
-                                vesa_draw_text(widget->x, widget->y, widget->text, 0x000000, WINDOW_BG_COLOR);
-                            }
-                            break;
-                        case WIDGET_CHECKBOX: {
-                            uint32_t box_x = widget->x;
-                            uint32_t box_y = widget->y + 2;
-                            uint32_t box_size = 14;
-                            
-                            vesa_draw_rect(box_x, box_y, box_size, box_size, CHECKBOX_COLOR);
-                            vesa_draw_rect(box_x, box_y, box_size, 1, WINDOW_BORDER_COLOR);
-                            vesa_draw_rect(box_x, box_y + box_size - 1, box_size, 1, WINDOW_BORDER_COLOR);
-                            vesa_draw_rect(box_x, box_y, 1, box_size, WINDOW_BORDER_COLOR);
-                            vesa_draw_rect(box_x + box_size - 1, box_y, 1, box_size, WINDOW_BORDER_COLOR);
-                            
-                            if (widget->data && *((uint8_t*)widget->data)) {
-                                vesa_draw_rect(box_x + 3, box_y + 3, 8, 8, CHECKBOX_CHECKED_COLOR);
-                            }
-                            
-                            if (widget->text) {
-                                vesa_draw_text(widget->x + 20, widget->y, widget->text, 0x000000, WINDOW_BG_COLOR);
-                            }
-                            break;
-                        }
-                        case WIDGET_SLIDER: {
-                            uint32_t* data = (uint32_t*)widget->data;
-                            if (!data) break;
-                            
-                            uint32_t min = data[0];
-                            uint32_t max = data[1];
-                            uint32_t value = data[2];
-                            
-                            uint32_t track_height = 6;
-                            uint32_t track_y = widget->y + (widget->height - track_height) / 2;
-                            
-                            vesa_draw_rect(widget->x, track_y, widget->width, track_height, SLIDER_TRACK_COLOR);
-                            vesa_draw_rect(widget->x, track_y, widget->width, 1, 0x606060);
-                            vesa_draw_rect(widget->x, track_y + track_height - 1, widget->width, 1, 0xA0A0A0);
-                            
-                            if (max > min) {
-                                uint32_t fill_width = (value - min) * widget->width / (max - min);
-                                if (fill_width > 0) {
-                                    vesa_draw_rect(widget->x, track_y, fill_width, track_height, SLIDER_FILL_COLOR);
-                                }
-                            }
-                            
-                            uint32_t handle_size = 16;
-                            uint32_t handle_x = widget->x;
-                            if (max > min) {
-                                handle_x = widget->x + (value - min) * (widget->width - handle_size) / (max - min);
-                            }
-                            uint32_t handle_y = widget->y + (widget->height - handle_size) / 2;
-                            
-                            vesa_draw_rect(handle_x, handle_y, handle_size, handle_size, SLIDER_HANDLE_COLOR);
-                            vesa_draw_rect(handle_x, handle_y, handle_size, 1, 0x808080);
-                            vesa_draw_rect(handle_x, handle_y + handle_size - 1, handle_size, 1, 0x404040);
-                            vesa_draw_rect(handle_x, handle_y, 1, handle_size, 0x808080);
-                            vesa_draw_rect(handle_x + handle_size - 1, handle_y, 1, handle_size, 0x404040);
-                            break;
-                        }
-                        case WIDGET_PROGRESSBAR: {
-                            uint32_t value = 0;
-                            if (widget->data) {
-                                value = *((uint32_t*)widget->data);
-                            }
-                            
-                            vesa_draw_rect(widget->x, widget->y, widget->width, widget->height, PROGRESSBAR_BG_COLOR);
-                            
-                            vesa_draw_rect(widget->x, widget->y, widget->width, 1, 0x808080);
-                            vesa_draw_rect(widget->x, widget->y + widget->height - 1, widget->width, 1, 0x808080);
-                            vesa_draw_rect(widget->x, widget->y, 1, widget->height, 0x808080);
-                            vesa_draw_rect(widget->x + widget->width - 1, widget->y, 1, widget->height, 0x808080);
-                            
-                            if (value > 0 && widget->width > 2) {
-                                uint32_t fill_width = (value * (widget->width - 2)) / 100;
-                                if (fill_width > 0) {
-                                    vesa_draw_rect(widget->x + 1, widget->y + 1, fill_width, widget->height - 2, PROGRESSBAR_FILL_COLOR);
-                                    
-                                    if (fill_width > 4) {
-                                        vesa_draw_rect(widget->x + 1, widget->y + 1, fill_width, 1, 0xA0D0FF);
-                                        vesa_draw_rect(widget->x + 1, widget->y + widget->height - 2, fill_width, 1, 0x2050A0);
-                                    }
-                                }
-                            }
-                            break;
-                        }
-                        case WIDGET_INPUT: {
-                            uint32_t bg_color = INPUT_BG_COLOR;
-                            vesa_draw_rect(widget->x, widget->y, widget->width, widget->height, bg_color);
-                            
-                            uint32_t border = (widget->focused) ? 0x007ACC : 0x808080;
-                            vesa_draw_rect(widget->x, widget->y, widget->width, 1, border);
-                            vesa_draw_rect(widget->x, widget->y + widget->height - 1, widget->width, 1, border);
-                            vesa_draw_rect(widget->x, widget->y, 1, widget->height, border);
-                            vesa_draw_rect(widget->x + widget->width - 1, widget->y, 1, widget->height, border);
-                            
-                            InputData* input = (InputData*)widget->data;
-                            if (input && input->buffer) {
-                                uint32_t text_x = widget->x + 4;
-                                uint32_t text_y = widget->y + (widget->height - 16) / 2;
-                                
-                                char* display_text = input->buffer;
-                                
-                                uint32_t max_chars = (widget->width - 8) / 8;
-                                if (max_chars < 1) max_chars = 1;
-                                
-                                uint32_t len = gui_strlen(display_text);
-                                if (input->cursor_pos > input->scroll_offset + max_chars - 1) {
-                                    input->scroll_offset = input->cursor_pos - max_chars + 1;
-                                }
-                                if (input->cursor_pos < input->scroll_offset) {
-                                    input->scroll_offset = input->cursor_pos;
-                                }
-                                
-                                char visible_text[256];
-                                uint32_t visible_len = 0;
-                                for (uint32_t i = input->scroll_offset; 
-                                     i < len && visible_len < max_chars; i++, visible_len++) {
-                                    visible_text[visible_len] = display_text[i];
-                                }
-                                visible_text[visible_len] = '\0';
-                                
-                                // Рисуем выделение (СИНИМ!) — сначала фон
-                                if (input->selection_start != input->selection_end && widget->focused) {
-                                    uint32_t sel_start = input->selection_start;
-                                    uint32_t sel_end = input->selection_end;
-                                    if (sel_start > sel_end) {
-                                        uint32_t temp = sel_start;
-                                        sel_start = sel_end;
-                                        sel_end = temp;
-                                    }
-                                    
-                                    uint32_t vis_start = sel_start > input->scroll_offset ? 
-                                                         sel_start - input->scroll_offset : 0;
-                                    uint32_t vis_end = sel_end - input->scroll_offset;
-                                    if (vis_end > max_chars) vis_end = max_chars;
-                                    
-                                    // Рисуем синий фон ДО текста
-                                    for (uint32_t pos = vis_start; pos < vis_end && pos < max_chars; pos++) {
-                                        if (pos < visible_len) { // Только если символ существует
-                                            vesa_draw_rect(text_x + pos * 8, text_y, 8, 16, INPUT_SELECTION_COLOR);
-                                        }
-                                    }
-                                }
-                                
-                                // Рисуем текст поверх (белым если в выделении)
-                                for (uint32_t i = 0; i < visible_len; i++) {
-                                    uint32_t global_pos = input->scroll_offset + i;
-                                    uint32_t char_x = text_x + i * 8;
-                                    uint32_t char_y = text_y;
-                                    
-                                    // Проверяем, попадает ли символ в выделение
-                                    uint8_t is_selected = 0;
-                                    if (widget->focused && input->selection_start != input->selection_end) {
-                                        uint32_t sel_start = input->selection_start;
-                                        uint32_t sel_end = input->selection_end;
-                                        if (sel_start > sel_end) {
-                                            uint32_t temp = sel_start;
-                                            sel_start = sel_end;
-                                            sel_end = temp;
-                                        }
-                                        is_selected = (global_pos >= sel_start && global_pos < sel_end);
-                                    }
-                                    
-                                    if (input->password_mode) {
-                                        char c = '*';
-                                        uint32_t color = is_selected ? 0xFFFFFF : INPUT_TEXT_COLOR;
-                                        vesa_draw_char(char_x, char_y, c, color, 
-                                                      is_selected ? INPUT_SELECTION_COLOR : bg_color);
-                                    } else {
-                                        char c = visible_text[i];
-                                        uint32_t color = is_selected ? 0xFFFFFF : INPUT_TEXT_COLOR;
-                                        vesa_draw_char(char_x, char_y, c, color,
-                                                      is_selected ? INPUT_SELECTION_COLOR : bg_color);
-                                    }
-                                }
-                                
-                                // Рисуем курсор
-                                if (widget->focused) {
-                                    static uint32_t last_blink = 0;
-                                    uint32_t now = timer_get_ticks();
-                                    if (now - last_blink > 50) {
-                                        input->cursor_visible = !input->cursor_visible;
-                                        last_blink = now;
-                                    }
-                                    
-                                    if (input->cursor_visible) {
-                                        uint32_t cursor_x = text_x + (input->cursor_pos - input->scroll_offset) * 8;
-                                        if (cursor_x >= widget->x && cursor_x < widget->x + widget->width - 4) {
-                                            vesa_draw_line(cursor_x, text_y, cursor_x, text_y + 16, INPUT_TEXT_COLOR);
-                                        }
-                                    }
-                                }
-                            }
-                            break;
-                        }
-                        default:
-                            break;
-                    }
-                }
-                
-                widget = widget->next;
-            }
-            
-            vesa_mark_dirty(window->x - 5, window->y - 5,
-                           window->width + 10, window->height + 10);
-            
-            // window->needs_redraw = 0;
-        }
-    }
-    
+    // Окна собирает компоновщик из своих поверхностей, панель задач рисуется поверх
+    compositor_render();
     taskbar_render();
-    
-    if (start_menu_is_visible()) {
-        Window* start_win = start_menu_get_window();
-        if (start_win && IS_VALID_WINDOW_PTR(start_win)) {
-            start_win->needs_redraw = 1;
-        }
-    }
 }
 
 void gui_force_redraw(void) {
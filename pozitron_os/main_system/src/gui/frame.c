@@ -0,0 +1,251 @@
+#include "gui/frame.h"
+#include "drivers/vesa.h"
+#include "drivers/serial.h"
+#include "drivers/timer.h"
+#include "kernel/timer_utils.h"
+#include <stddef.h>
+
+#define CPUID_EDX_TSC       (1 << 4)
+
+// Кредит кадров: за тик копится FRAME_RATE, кадр стоит TIMER_FREQUENCY.
+// Потолок не даёт после простоя выпустить пачку кадров подряд
+#define FRAME_COST          TIMER_FREQUENCY
+#define FRAME_CREDIT_MAX    (2 * FRAME_COST - 1)
+
+static frame_stats_t stats;
+static frame_timer_t* timers = NULL;
+
+static uint32_t credit = FRAME_CREDIT_MAX;
+static uint32_t credit_tick = 0;
+static uint32_t last_frame_tick = 0;
+
+static uint8_t requested = 0;
+static uint8_t deadline_set = 0;
+static uint32_t deadline = 0;
+
+static uint8_t input_pending = 0;
+static uint32_t input_tick = 0;
+
+static uint32_t cycles_per_us = 0;
+static uint32_t frame_start = 0;
+
+static uint32_t read_tsc(void) {
+    uint32_t lo;
+    asm volatile("rdtsc" : "=a"(lo) : : "edx");
+    return lo;
+}
+
+static uint8_t tick_passed(uint32_t now, uint32_t tick) {
+    return (int32_t)(now - tick) >= 0;
+}
+
+static void wait_tick_edge(void) {
+    uint32_t start = timer_get_ticks();
+    while (timer_get_ticks() == start) asm volatile("hlt");
+}
+
+// Частота TSC по одному тику таймера: младших 32 бит хватает на кадр до секунды
+static void calibrate_tsc(void) {
+    uint32_t eax, ebx, ecx, edx;
+    uint32_t start;
+
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    if (!(edx & CPUID_EDX_TSC)) {
+        serial_puts("[FRAME] No TSC, frame time is not measured\n");
+        return;
+    }
+
+    wait_tick_edge();
+    start = read_tsc();
+    wait_tick_edge();
+    cycles_per_us = (read_tsc() - start) / (1000000 / TIMER_FREQUENCY);
+}
+
+void frame_init(void) {
+    stats = (frame_stats_t){0};
+    calibrate_tsc();
+
+    credit = FRAME_CREDIT_MAX;
+    credit_tick = last_frame_tick = timer_get_ticks();
+
+    serial_puts("[FRAME] Pacing at ");
+    serial_puts_num(FRAME_RATE);
+    serial_puts(" fps max, TSC ");
+    serial_puts_num(cycles_per_us);
+    serial_puts(" MHz\n");
+}
+
+static void input_seen(const event_t* event) {
+    stats.input_events++;
+    if (!input_pending) {
+        input_pending = 1;
+        input_tick = event->timestamp;
+    }
+}
+
+uint8_t frame_coalesce(const event_t* event) {
+    event_t next;
+
+    // Координаты в событии абсолютные: промежуточное положение никому не нужно
+    if (event->type != EVENT_MOUSE_MOVE) return 0;
+    if (!event_peek(&next) || next.type != EVENT_MOUSE_MOVE) return 0;
+
+    input_seen(event);
+    stats.coalesced++;
+    return 1;
+}
+
+void frame_input(const event_t* event) {
+    if (event->type == EVENT_TIMER_TICK) return;
+    input_seen(event);
+}
+
+void frame_request(void) {
+    requested = 1;
+}
+
+void frame_request_at(uint32_t tick) {
+    if (!deadline_set || (int32_t)(tick - deadline) < 0) {
+        deadline = tick;
+        deadline_set = 1;
+    }
+}
+
+static uint8_t timers_due(uint32_t now) {
+    for (frame_timer_t* timer = timers; timer; timer = timer->next) {
+        if (tick_passed(now, timer->next_tick)) return 1;
+    }
+    return 0;
+}
+
+static uint8_t frame_wanted(uint32_t now) {
+    if (requested || input_pending) return 1;
+    if (deadline_set && tick_passed(now, deadline)) return 1;
+    if (timers_due(now)) return 1;
+    if (vesa_get_dirty_count() > 0) return 1;
+    return now - last_frame_tick >= FRAME_IDLE_TICKS;
+}
+
+uint8_t frame_begin(void) {
+    uint32_t now = timer_get_ticks();
+
+    stats.wakeups++;
+
+    if (now != credit_tick) {
+        uint32_t elapsed = now - credit_tick;
+        if (elapsed > TIMER_FREQUENCY) elapsed = TIMER_FREQUENCY;
+
+        credit += elapsed * FRAME_RATE;
+        if (credit > FRAME_CREDIT_MAX) credit = FRAME_CREDIT_MAX;
+        credit_tick = now;
+    }
+
+    if (!frame_wanted(now)) {
+        stats.skipped++;
+        return 0;
+    }
+
+    // Повод остаётся, кадр выйдет на одном из следующих тиков
+    if (credit < FRAME_COST) {
+        stats.deferred++;
+        return 0;
+    }
+
+    credit -= FRAME_COST;
+    requested = 0;
+    if (deadline_set && tick_passed(now, deadline)) deadline_set = 0;
+
+    frame_start = read_tsc();
+    return 1;
+}
+
+void frame_end(void) {
+    uint32_t now = timer_get_ticks();
+
+    stats.frames++;
+    last_frame_tick = now;
+
+    if (cycles_per_us) {
+        stats.last_us = (read_tsc() - frame_start) / cycles_per_us;
+        if (stats.last_us > stats.max_us) stats.max_us = stats.last_us;
+        stats.avg_us += (int32_t)(stats.last_us - stats.avg_us) / 8;
+    }
+
+    if (input_pending) {
+        stats.last_latency_ms = TICKS_TO_MS(now - input_tick);
+        if (stats.last_latency_ms > stats.max_latency_ms) stats.max_latency_ms = stats.last_latency_ms;
+        stats.avg_latency_ms += (int32_t)(stats.last_latency_ms - stats.avg_latency_ms) / 8;
+        input_pending = 0;
+    }
+}
+
+void frame_timer_start(frame_timer_t* timer, uint32_t period) {
+    if (!timer->active) {
+        timer->next = timers;
+        timers = timer;
+        timer->active = 1;
+    }
+
+    timer->period = period ? period : 1;
+    timer->next_tick = timer_get_ticks() + timer->period;
+}
+
+void frame_timer_stop(frame_timer_t* timer) {
+    frame_timer_t** pp = &timers;
+
+    if (!timer->active) return;
+
+    while (*pp && *pp != timer) pp = &(*pp)->next;
+    if (*pp) *pp = timer->next;
+
+    timer->next = NULL;
+    timer->active = 0;
+}
+
+uint8_t frame_timer_active(const frame_timer_t* timer) {
+    return timer->active;
+}
+
+uint32_t frame_timer_steps(frame_timer_t* timer) {
+    uint32_t now = timer_get_ticks();
+    uint32_t steps;
+
+    if (!timer->active || !tick_passed(now, timer->next_tick)) return 0;
+
+    steps = (now - timer->next_tick) / timer->period + 1;
+    timer->next_tick += steps * timer->period;
+    return steps;
+}
+
+void frame_get_stats(frame_stats_t* out) {
+    if (out) *out = stats;
+}
+
+void frame_dump_stats(void) {
+    serial_puts("\n=== FRAME PACING ===\n");
+    serial_puts("  Frames:      ");
+    serial_puts_num(stats.frames);
+    serial_puts(" of ");
+    serial_puts_num(stats.wakeups);
+    serial_puts(" wakeups\n  Skipped:     ");
+    serial_puts_num(stats.skipped);
+    serial_puts(" idle, ");
+    serial_puts_num(stats.deferred);
+    serial_puts(" deferred by rate cap\n  Input:       ");
+    serial_puts_num(stats.input_events);
+    serial_puts(" events, ");
+    serial_puts_num(stats.coalesced);
+    serial_puts(" moves coalesced\n  Frame time:  ");
+    serial_puts_num(stats.last_us);
+    serial_puts(" us last, ");
+    serial_puts_num(stats.avg_us);
+    serial_puts(" avg, ");
+    serial_puts_num(stats.max_us);
+    serial_puts(" max\n  Latency:     ");
+    serial_puts_num(stats.last_latency_ms);
+    serial_puts(" ms last, ");
+    serial_puts_num(stats.avg_latency_ms);
+    serial_puts(" avg, ");
+    serial_puts_num(stats.max_latency_ms);
+    serial_puts(" max\n====================\n");
+}
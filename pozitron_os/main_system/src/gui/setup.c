@@ -58,7 +58,11 @@ static void setup_finish_callback(Widget* button, void* userdata) {
     sprintf(user_path, "/users/%s", username);
     sprintf(template_path, "/users/Default");
     
+    // Вся настройка учётной записи - один пакет ФС со сбросом на диск в конце
+    vfs_batch_begin();
+    
     if (vfs_mkdir_p(user_path, 0755) != 0) {
+        vfs_batch_commit();
         serial_puts("[SETUP] Failed to create user directory\n");
         if (status_label) wg_set_text(status_label, "  ERROR: Failed to create user directory!");
         return;
@@ -71,6 +75,7 @@ static void setup_finish_callback(Widget* button, void* userdata) {
     if (vesa_is_double_buffer_enabled()) vesa_swap_buffers();
     
     if (vfs_copy_template(template_path, user_path) != 0) {
+        vfs_batch_commit();
         serial_puts("[SETUP] Failed to copy template\n");
         if (status_label) wg_set_text(status_label, "  ERROR: Failed to copy user template!");
         return;
@@ -131,6 +136,7 @@ static void setup_finish_callback(Widget* button, void* userdata) {
         serial_puts("[SETUP] System configuration saved\n");
     }
     
+    vfs_batch_commit();
     setup_complete = 1;
     
     if (status_label) {
@@ -4,6 +4,7 @@
 #include "drivers/power.h"
 #include "kernel/memory.h"
 #include "drivers/timer.h"
+#include "gui/frame.h"
 #include <stddef.h>
 
 // Объявляем функции из taskbar.c
@@ -17,12 +18,15 @@ extern void taskbar_remove_window(Window* window);
 #define SHUTDOWN_STATE_CANCELING     2
 #define SHUTDOWN_STATE_CONFIRMING    3
 
+#define SHUTDOWN_STEP_TICKS          5
+
 // Глобальные переменные
 static Window* original_windows[64];
 static uint32_t original_window_count = 0;
 static uint8_t shutdown_state = SHUTDOWN_STATE_IDLE;
 static Window* shutdown_dialog = NULL;
 static uint8_t darken_level = 0;
+static frame_timer_t darken_timer;
 static uint8_t shutdown_immediate = 0;
 
 // ============ БЛОКИРОВКА УПРАВЛЕНИЯ ============
@@ -60,62 +64,41 @@ static void restore_all_windows(void) {
 // ============ ЭФФЕКТ ЗАТЕМНЕНИЯ ============
 
 void render_darken_effect(void) {
-    if (shutdown_state == SHUTDOWN_STATE_IDLE || darken_level == 0) return;
+    // Затемнение заливает весь экран; выводить его заново нужно только при смене цвета
+    static uint32_t shown_color = 0xFFFFFFFF;
+    
+    if (shutdown_state == SHUTDOWN_STATE_IDLE || darken_level == 0) {
+        shown_color = 0xFFFFFFFF;
+        return;
+    }
     
     uint32_t screen_width = vesa_get_width();
     uint32_t screen_height = vesa_get_height();
-    uint32_t* back_buffer = vesa_get_back_buffer();
     
-    if (!back_buffer) return;
+    if (!vesa_get_back_buffer()) return;
     
     if (shutdown_state == SHUTDOWN_STATE_CONFIRMING && darken_level > 100) {
         uint8_t brightness = 64 - ((darken_level - 100) * 64 / 100);
         if (brightness > 64) brightness = 64;
         
         uint32_t black_color = (brightness << 16) | (brightness << 8) | brightness;
-        
-        for (uint32_t i = 0; i < screen_width * screen_height; i++) {
-            back_buffer[i] = black_color;
-        }
+        vesa_draw_rect(0, 0, screen_width, screen_height, black_color);
+        if (black_color != shown_color) vesa_mark_present(0, 0, screen_width, screen_height);
+        shown_color = black_color;
     } else {
-        uint32_t light_gray = 0xC0C0C0;
-        uint32_t dark_gray = 0x404040;
-        
-        uint8_t light_r = (light_gray >> 16) & 0xFF;
-        uint8_t light_g = (light_gray >> 8) & 0xFF;
-        uint8_t light_b = light_gray & 0xFF;
-        
-        uint8_t dark_r = (dark_gray >> 16) & 0xFF;
-        uint8_t dark_g = (dark_gray >> 8) & 0xFF;
-        uint8_t dark_b = dark_gray & 0xFF;
-        
         uint8_t effective_level = darken_level;
         if (effective_level > 100) effective_level = 100;
         
-        uint8_t final_r = light_r + ((dark_r - light_r) * effective_level) / 100;
-        uint8_t final_g = light_g + ((dark_g - light_g) * effective_level) / 100;
-        uint8_t final_b = light_b + ((dark_b - light_b) * effective_level) / 100;
-        
-        uint32_t darken_color = (final_r << 16) | (final_g << 8) | final_b;
-        
-        for (uint32_t i = 0; i < screen_width * screen_height; i++) {
-            back_buffer[i] = darken_color;
-        }
+        // От светло-серого к тёмно-серому по уровню затемнения
+        uint32_t darken_color = vesa_blend_color(0xC0C0C0, 0x404040, effective_level * 255 / 100);
+        vesa_draw_rect(0, 0, screen_width, screen_height, darken_color);
+        if (darken_color != shown_color) vesa_mark_present(0, 0, screen_width, screen_height);
+        shown_color = darken_color;
     }
 }
 
-void update_shutdown_animation(void) {
-    if (shutdown_state == SHUTDOWN_STATE_IDLE) return;
-    
-    static uint32_t last_update = 0;
-    uint32_t current_time = timer_get_ticks();
-    
-    if (current_time - last_update < 5) {
-        return;
-    }
-    
-    last_update = current_time;
-    
+// Шаг затемнения раз в SHUTDOWN_STEP_TICKS; таймер держит кадры, пока идёт анимация
+static void shutdown_step(void) {
     switch (shutdown_state) {
         case SHUTDOWN_STATE_DIALOG:
             if (darken_level < 100) {
@@ -167,6 +150,29 @@ void update_shutdown_animation(void) {
     }
 }
 
+void update_shutdown_animation(void) {
+    if (shutdown_state == SHUTDOWN_STATE_IDLE) return;
+    
+    // Диалог затемнён до конца: кадры больше не нужны до выбора пользователя
+    if (shutdown_state == SHUTDOWN_STATE_DIALOG && darken_level >= 100) {
+        frame_timer_stop(&darken_timer);
+        return;
+    }
+    
+    if (!frame_timer_active(&darken_timer)) {
+        frame_timer_start(&darken_timer, SHUTDOWN_STEP_TICKS);
+    }
+    
+    // Пропущенные кадры догоняются шагами, скорость затемнения не зависит от частоты кадров
+    for (uint32_t steps = frame_timer_steps(&darken_timer); steps; steps--) {
+        shutdown_step();
+        if (shutdown_state == SHUTDOWN_STATE_IDLE) {
+            frame_timer_stop(&darken_timer);
+            break;
+        }
+    }
+}
+
 // ============ CALLBACK-ФУНКЦИИ ============
 
 static void shutdown_cancel_callback(Widget* button, void* userdata) {
@@ -326,6 +332,7 @@ void force_reset_shutdown_state(void) {
         shutdown_dialog = NULL;
         darken_level = 0;
         shutdown_immediate = 0;
+        frame_timer_stop(&darken_timer);
         
         gui_force_redraw();
         vesa_mark_dirty_all();
@@ -6,6 +6,7 @@
 #include "drivers/cmos.h"
 #include "drivers/timer.h"
 #include "lib/string.h"
+#include "lib/crc32.h"
 #include <stddef.h>
 #include <stdio.h>
 
@@ -54,6 +55,9 @@ static char date_text[16] = "01.01.2000";
 static Window* date_menu_window = NULL;
 static uint8_t date_menu_visible = 0;
 
+// Панель рисуется каждый кадр, а на экран выводится только при изменении вида
+static uint32_t taskbar_shown_crc = 0;
+
 // ============ ВСПОМОГАТЕЛЬНЫЕ ФУНКЦИИ ============
 static inline uint8_t is_valid_button_index(uint32_t index) {
     return (index < MAX_TASKBAR_BUTTONS && 
@@ -846,6 +850,50 @@ void taskbar_handle_event(event_t* event) {
 }
 
 // ============ РЕНДЕРИНГ ============
+// Всё, от чего зависит вид панели: совпала сумма - пиксели те же, что уже на экране
+static uint32_t taskbar_state_crc(uint32_t screen_width, uint32_t screen_height) {
+    struct {
+        uint32_t screen_width, screen_height;
+        uint32_t scroll_offset, button_count;
+        uint32_t clock_x, clock_width;
+        uint8_t start_pressed, start_hover, start_menu;
+        uint8_t clock_pressed, clock_hover, date_menu;
+        uint8_t scroll_visible, left_pressed, right_pressed, left_hover, right_hover;
+    } state;
+    
+    memset(&state, 0, sizeof(state));
+    state.screen_width = screen_width;
+    state.screen_height = screen_height;
+    state.scroll_offset = taskbar_scroll_offset;
+    state.button_count = taskbar_button_count;
+    state.clock_x = clock_button_x;
+    state.clock_width = clock_button_width;
+    state.start_pressed = start_button_pressed;
+    state.start_hover = start_button_hover;
+    state.start_menu = start_menu_is_visible();
+    state.clock_pressed = clock_button_pressed;
+    state.clock_hover = clock_button_hover;
+    state.date_menu = date_menu_is_visible();
+    state.scroll_visible = scroll_buttons_visible;
+    state.left_pressed = scroll_left_pressed;
+    state.right_pressed = scroll_right_pressed;
+    state.left_hover = scroll_left_hover;
+    state.right_hover = scroll_right_hover;
+    
+    uint32_t crc = crc32(&state, sizeof(state));
+    crc = crc32_update(crc, clock_text, sizeof(clock_text));
+    
+    for (uint32_t i = 0; i < MAX_TASKBAR_BUTTONS; i++) {
+        if (!is_valid_button_index(i) || !IS_VALID_WINDOW_PTR(taskbar_buttons[i].window)) continue;
+        
+        Window* win = taskbar_buttons[i].window;
+        uint8_t win_state[2] = { win->focused, win->minimized };
+        crc = crc32_update(crc, &taskbar_buttons[i], sizeof(taskbar_button_t));
+        crc = crc32_update(crc, win_state, sizeof(win_state));
+    }
+    return crc;
+}
+
 void taskbar_render(void) {
     if (!taskbar_initialized || taskbar_disabled) return;
     if (!taskbar_initialized) return;
@@ -862,6 +910,12 @@ void taskbar_render(void) {
         update_date_menu_time();
     }
     
+    uint32_t crc = taskbar_state_crc(screen_width, screen_height);
+    if (crc != taskbar_shown_crc) {
+        vesa_mark_present(0, taskbar_top, screen_width, TASKBAR_HEIGHT);
+        taskbar_shown_crc = crc;
+    }
+    
     vesa_draw_rect(0, taskbar_top, screen_width, TASKBAR_HEIGHT, TASKBAR_COLOR);
     vesa_draw_rect(0, taskbar_top, screen_width, 1, TASKBAR_SHADOW);
     vesa_draw_rect(0, taskbar_top + 1, screen_width, 1, TASKBAR_HIGHLIGHT);
@@ -1,6 +1,7 @@
 #include "gui/gui.h"
 #include "drivers/serial.h"
 #include "kernel/memory.h"
+#include "gui/compositor.h"
 
 // ============ ВСПОМОГАТЕЛЬНЫЕ ФУНКЦИИ ============
 static inline void safe_remove_window_from_list(Window* window) {
@@ -22,9 +23,11 @@ static inline void safe_remove_window_from_list(Window* window) {
     window->next = NULL;
 }
 
+// Список всегда упорядочен по z: в конец попадает окно выше всех остальных
 static inline void safe_add_window_to_list(Window* window) {
     if (!window) return;
     
+    window->z_index = gui_state.last_window ? gui_state.last_window->z_index + 1 : 0;
     window->prev = gui_state.last_window;
     window->next = NULL;
     
@@ -269,7 +272,6 @@ Window* wm_create_window(const char* title, uint32_t x, uint32_t y,
     window->title_height = 25;
     window->visible = 1;
     window->has_titlebar = (flags & WINDOW_HAS_TITLE) ? 1 : 0;
-    window->z_index = gui_state.window_count;
     window->focused = 0;
     window->dragging = 0;
     window->resizing = 0;
@@ -301,6 +303,9 @@ Window* wm_create_window(const char* title, uint32_t x, uint32_t y,
     window->in_taskbar = 1;
     window->is_resizing = 0;
     window->focused_widget = NULL;
+    window->surface = NULL;
+    window->shown = 0;
+    region_init(&window->visible_region);
     
     window->orig_x = new_x;
     window->orig_y = new_y;
@@ -381,6 +386,7 @@ void wm_destroy_window(Window* window) {
         window->title = NULL;
     }
     
+    compositor_forget(window);
     safe_remove_window_from_list(window);
     gui_unregister_window(window_id);
     
@@ -390,35 +396,16 @@ void wm_destroy_window(Window* window) {
     
     window->id = 0;
     kfree(window);
-    
-    int32_t z = 0;
-    Window* w = gui_state.first_window;
-    while (w) {
-        if (IS_VALID_WINDOW_PTR(w)) {
-            w->z_index = z++;
-        }
-        w = w->next;
-    }
 }
 
 void wm_bring_to_front(Window* window) {
     if (!IS_VALID_WINDOW_PTR(window) || !gui_state.first_window) return;
     if (window == gui_state.last_window) return;
     
+    // Перестановка в конец списка: порядок остальных окон не меняется
     safe_remove_window_from_list(window);
     safe_add_window_to_list(window);
     
-    int32_t z = 0;
-    Window* w = gui_state.first_window;
-    while (w) {
-        if (IS_VALID_WINDOW_PTR(w)) {
-            w->z_index = z++;
-            w = w->next;
-        } else {
-            w = w->next;
-        }
-    }
-    
     wm_focus_window(window);
 }
 
@@ -459,6 +446,11 @@ Window* wm_get_focused_window(void) {
 }
 
 Window* wm_find_window_at(uint32_t x, uint32_t y) {
+    Window* hit;
+    
+    // Видимые области с последнего кадра; если окна с тех пор сдвинулись - обход сверху вниз
+    if (compositor_window_at(x, y, &hit)) return hit;
+    
     Window* window = gui_state.last_window;
     while (window) {
         if (IS_VALID_WINDOW_PTR(window) && 
@@ -472,6 +464,28 @@ Window* wm_find_window_at(uint32_t x, uint32_t y) {
     return NULL;
 }
 
+// Край под точкой для ресайза: 1-4 углы, 5/6 левый/правый, 8 нижний; 0 - не край
+uint32_t wm_resize_edge_at(Window* window, int32_t mx, int32_t my) {
+    if (!IS_VALID_WINDOW_PTR(window) || !window->has_titlebar) return 0;
+    if (!window->resizable || window->maximized || window->minimized) return 0;
+    
+    int32_t edge_size = 8;
+    int32_t corner_size = 12;
+    int32_t right = window->x + (int32_t)window->width;
+    int32_t bottom = window->y + (int32_t)window->height;
+    int32_t title_bottom = window->y + (int32_t)window->title_height;
+    
+    if (mx <= window->x + corner_size && my <= window->y + corner_size) return 1;
+    if (mx >= right - corner_size && my <= window->y + corner_size) return 2;
+    if (mx <= window->x + corner_size && my >= bottom - corner_size) return 3;
+    if (mx >= right - corner_size && my >= bottom - corner_size) return 4;
+    
+    if (mx <= window->x + edge_size && my > title_bottom) return 5;
+    if (mx >= right - edge_size && my > title_bottom) return 6;
+    if (my >= bottom - edge_size) return 8;
+    return 0;
+}
+
 void wm_move_window(Window* window, int32_t x, int32_t y) {
     if (!IS_VALID_WINDOW_PTR(window) || !window->movable || window->minimized || window->maximized) return;
     
@@ -493,15 +507,12 @@ void wm_move_window(Window* window, int32_t x, int32_t y) {
     int32_t delta_x = x - window->x;
     int32_t delta_y = y - window->y;
     
+    // Относительные виджеты при сдвиге окна смещаются так же, как абсолютные. Содержимое
+    // не меняется - компоновщик просто переложит поверхность окна на новое место
     Widget* widget = window->first_widget;
     while (widget) {
-        if (!widget->use_relative) {
-            widget->x += delta_x;
-            widget->y += delta_y;
-        } else {
-            wg_update_position(widget);
-        }
-        widget->needs_redraw = 1;
+        widget->x += delta_x;
+        widget->y += delta_y;
         widget = widget->next;
     }
     
@@ -514,8 +525,6 @@ void wm_move_window(Window* window, int32_t x, int32_t y) {
         window->orig_x = x;
         window->orig_y = y;
     }
-    
-    window->needs_redraw = 1;
 }
 
 void wm_close_window(Window* window) {
@@ -538,24 +538,17 @@ static void microdelay(uint32_t microseconds) {
     for (volatile uint32_t i = 0; i < microseconds * 20; i++);
 }
 
-// Простое смешивание (альфа 0-255)
-static uint32_t blend_with_bg(uint32_t bg, uint32_t fg, uint8_t alpha) {
-    if (alpha == 0) return bg;
-    if (alpha == 255) return fg;
+// Следующий отрезок закрашенных (нулевых) битов строки логотипа: [*px, *end)
+static int logo_next_run(const uint8_t* row, uint32_t* px, uint32_t* end) {
+    uint32_t i = *px;
     
-    uint8_t bg_r = (bg >> 16) & 0xFF;
-    uint8_t bg_g = (bg >> 8) & 0xFF;
-    uint8_t bg_b = bg & 0xFF;
+    while (i < LOGO_WIDTH && (row[i / 8] & (0x80 >> (i % 8)))) i++;
+    if (i >= LOGO_WIDTH) return 0;
     
-    uint8_t fg_r = (fg >> 16) & 0xFF;
-    uint8_t fg_g = (fg >> 8) & 0xFF;
-    uint8_t fg_b = fg & 0xFF;
-    
-    uint8_t r = (bg_r * (255 - alpha) + fg_r * alpha) / 255;
-    uint8_t g = (bg_g * (255 - alpha) + fg_g * alpha) / 255;
-    uint8_t b = (bg_b * (255 - alpha) + fg_b * alpha) / 255;
-    
-    return (r << 16) | (g << 8) | b;
+    *px = i;
+    while (i < LOGO_WIDTH && !(row[i / 8] & (0x80 >> (i % 8)))) i++;
+    *end = i;
+    return 1;
 }
 
 // ============ ПРОГРЕСС-БАР ============
@@ -563,89 +556,28 @@ void draw_boot_progress_bar(uint32_t x, uint32_t y, uint8_t percent) {
     struct fb_info* fb = vesa_get_info();
     if (!fb || !fb->found) return;
 
-    uint32_t bytes_per_pixel = fb->bpp / 8;
-    uint8_t* buffer;
-    if (vesa_is_double_buffer_enabled()) {
-        buffer = (uint8_t*)vesa_get_back_buffer();
-    } else {
-        buffer = (uint8_t*)fb->address;
-    }
-    if (!buffer) return;
-
     // Позиция и размеры
     uint32_t bar_x = x - 17;
     uint32_t bar_y = y + LOGO_HEIGHT + 15;
     uint32_t bar_width = 350;  //stretched_width;
     uint32_t bar_height = 16;
 
-    uint32_t black = 0x000000;
     uint32_t logo_color = LOGO_COLOR;  // И рамка, и заполнение - цветом логотипа
 
     // 1. ЧЁРНЫЙ фон
-    for (uint32_t py = bar_y; py < bar_y + bar_height && py < fb->height; py++) {
-        for (uint32_t px = bar_x; px < bar_x + bar_width && px < fb->width; px++) {
-            uint32_t offset = py * fb->pitch + px * bytes_per_pixel;
-            if (bytes_per_pixel == 4) {
-                *(uint32_t*)(buffer + offset) = black;
-            } else if (bytes_per_pixel == 3) {
-                buffer[offset] = 0;
-                buffer[offset + 1] = 0;
-                buffer[offset + 2] = 0;
-            }
-        }
-    }
+    vesa_draw_rect(bar_x, bar_y, bar_width, bar_height, 0x000000);
 
     // 2. Заполнение цветом логотипа
     if (percent > 0) {
         uint32_t fill_width = (bar_width * percent) / 100;
-        for (uint32_t py = bar_y; py < bar_y + bar_height && py < fb->height; py++) {
-            for (uint32_t px = bar_x; px < bar_x + fill_width && px < fb->width; px++) {
-                uint32_t offset = py * fb->pitch + px * bytes_per_pixel;
-                if (bytes_per_pixel == 4) {
-                    *(uint32_t*)(buffer + offset) = logo_color;
-                } else if (bytes_per_pixel == 3) {
-                    buffer[offset] = logo_color & 0xFF;
-                    buffer[offset + 1] = (logo_color >> 8) & 0xFF;
-                    buffer[offset + 2] = (logo_color >> 16) & 0xFF;
-                }
-            }
-        }
+        vesa_draw_rect(bar_x, bar_y, fill_width, bar_height, logo_color);
     }
 
     // 3. Рамка ТОЖЕ ЦВЕТОМ ЛОГОТИПА
-    for (uint32_t px = bar_x; px < bar_x + bar_width && px < fb->width; px++) {
-        uint32_t offset_top = bar_y * fb->pitch + px * bytes_per_pixel;
-        uint32_t offset_bottom = (bar_y + bar_height - 1) * fb->pitch + px * bytes_per_pixel;
-        
-        if (bytes_per_pixel == 4) {
-            *(uint32_t*)(buffer + offset_top) = logo_color;
-            *(uint32_t*)(buffer + offset_bottom) = logo_color;
-        } else if (bytes_per_pixel == 3) {
-            buffer[offset_top] = logo_color & 0xFF;
-            buffer[offset_top + 1] = (logo_color >> 8) & 0xFF;
-            buffer[offset_top + 2] = (logo_color >> 16) & 0xFF;
-            buffer[offset_bottom] = logo_color & 0xFF;
-            buffer[offset_bottom + 1] = (logo_color >> 8) & 0xFF;
-            buffer[offset_bottom + 2] = (logo_color >> 16) & 0xFF;
-        }
-    }
-
-    for (uint32_t py = bar_y; py < bar_y + bar_height && py < fb->height; py++) {
-        uint32_t offset_left = py * fb->pitch + bar_x * bytes_per_pixel;
-        uint32_t offset_right = py * fb->pitch + (bar_x + bar_width - 1) * bytes_per_pixel;
-        
-        if (bytes_per_pixel == 4) {
-            *(uint32_t*)(buffer + offset_left) = logo_color;
-            *(uint32_t*)(buffer + offset_right) = logo_color;
-        } else if (bytes_per_pixel == 3) {
-            buffer[offset_left] = logo_color & 0xFF;
-            buffer[offset_left + 1] = (logo_color >> 8) & 0xFF;
-            buffer[offset_left + 2] = (logo_color >> 16) & 0xFF;
-            buffer[offset_right] = logo_color & 0xFF;
-            buffer[offset_right + 1] = (logo_color >> 8) & 0xFF;
-            buffer[offset_right + 2] = (logo_color >> 16) & 0xFF;
-        }
-    }
+    vesa_draw_rect(bar_x, bar_y, bar_width, 1, logo_color);
+    vesa_draw_rect(bar_x, bar_y + bar_height - 1, bar_width, 1, logo_color);
+    vesa_draw_rect(bar_x, bar_y, 1, bar_height, logo_color);
+    vesa_draw_rect(bar_x + bar_width - 1, bar_y, 1, bar_height, logo_color);
 }
 
 // ============ ЛОГОТИП НА ЧЁРНОМ ============
@@ -653,39 +585,19 @@ static void draw_logo_black_bg(uint32_t x, uint32_t y, uint8_t alpha) {
     struct fb_info* fb = vesa_get_info();
     if (!fb || !fb->found) return;
 
-    uint32_t bytes_per_pixel = fb->bpp / 8;
-    uint8_t* buffer;
-    if (vesa_is_double_buffer_enabled()) {
-        buffer = (uint8_t*)vesa_get_back_buffer();
-    } else {
-        buffer = (uint8_t*)fb->address;
-    }
-    if (!buffer) return;
-
-    uint32_t logo_color = blend_with_bg(0x000000, LOGO_COLOR, alpha);
+    uint32_t logo_color = vesa_blend_color(0x000000, LOGO_COLOR, alpha);
 
+    // Каждый отрезок закрашенных битов - одна заливка
     for (uint32_t py = 0; py < LOGO_HEIGHT && y + py < fb->height; py++) {
-        for (uint32_t px = 0; px < LOGO_WIDTH; px++) {
-            uint32_t byte_index = py * (LOGO_WIDTH / 8) + (px / 8);
-            if (byte_index >= 8192) continue;
-
-            uint8_t bit = 7 - (px % 8);
-            if (!(logo_bitmap[byte_index] & (1 << bit))) {
-                uint32_t start_x = x + (uint32_t)(px * STRETCH_X);
-                uint32_t end_x = x + (uint32_t)((px + 1) * STRETCH_X);
-                
-                for (uint32_t sx = start_x; sx < end_x && sx < fb->width; sx++) {
-                    uint32_t offset = (y + py) * fb->pitch + sx * bytes_per_pixel;
-                    
-                    if (bytes_per_pixel == 4) {
-                        *(uint32_t*)(buffer + offset) = logo_color;
-                    } else if (bytes_per_pixel == 3) {
-                        buffer[offset] = logo_color & 0xFF;
-                        buffer[offset + 1] = (logo_color >> 8) & 0xFF;
-                        buffer[offset + 2] = (logo_color >> 16) & 0xFF;
-                    }
-                }
-            }
+        const uint8_t* row = &logo_bitmap[py * (LOGO_WIDTH / 8)];
+        uint32_t px = 0, end;
+
+        while (logo_next_run(row, &px, &end)) {
+            uint32_t start_x = x + (uint32_t)(px * STRETCH_X);
+            uint32_t end_x = x + (uint32_t)(end * STRETCH_X);
+
+            vesa_fill_span(start_x, y + py, end_x - start_x, logo_color);
+            px = end;
         }
     }
 }
@@ -695,50 +607,17 @@ static void draw_logo_over_gui(uint32_t x, uint32_t y, uint8_t alpha) {
     struct fb_info* fb = vesa_get_info();
     if (!fb || !fb->found) return;
 
-    uint32_t bytes_per_pixel = fb->bpp / 8;
-    uint8_t* buffer;
-    if (vesa_is_double_buffer_enabled()) {
-        buffer = (uint8_t*)vesa_get_back_buffer();
-    } else {
-        buffer = (uint8_t*)fb->address;
-    }
-    if (!buffer) return;
-
+    // Отрезок за раз смешивается с тем, что уже нарисовано под логотипом
     for (uint32_t py = 0; py < LOGO_HEIGHT && y + py < fb->height; py++) {
-        for (uint32_t px = 0; px < LOGO_WIDTH; px++) {
-            uint32_t byte_index = py * (LOGO_WIDTH / 8) + (px / 8);
-            if (byte_index >= 8192) continue;
-
-            uint8_t bit = 7 - (px % 8);
-            if (!(logo_bitmap[byte_index] & (1 << bit))) {
-                uint32_t start_x = x + (uint32_t)(px * STRETCH_X);
-                uint32_t end_x = x + (uint32_t)((px + 1) * STRETCH_X);
-                
-                for (uint32_t sx = start_x; sx < end_x && sx < fb->width; sx++) {
-                    uint32_t offset = (y + py) * fb->pitch + sx * bytes_per_pixel;
-                    
-                    // Читаем фон
-                    uint32_t bg;
-                    if (bytes_per_pixel == 4) {
-                        bg = *(uint32_t*)(buffer + offset);
-                    } else if (bytes_per_pixel == 3) {
-                        bg = buffer[offset] | (buffer[offset + 1] << 8) | (buffer[offset + 2] << 16);
-                    } else {
-                        bg = 0;
-                    }
-                    
-                    // Смешиваем
-                    uint32_t color = blend_with_bg(bg, LOGO_COLOR, alpha);
-                    
-                    if (bytes_per_pixel == 4) {
-                        *(uint32_t*)(buffer + offset) = color;
-                    } else if (bytes_per_pixel == 3) {
-                        buffer[offset] = color & 0xFF;
-                        buffer[offset + 1] = (color >> 8) & 0xFF;
-                        buffer[offset + 2] = (color >> 16) & 0xFF;
-                    }
-                }
-            }
+        const uint8_t* row = &logo_bitmap[py * (LOGO_WIDTH / 8)];
+        uint32_t px = 0, end;
+
+        while (logo_next_run(row, &px, &end)) {
+            uint32_t start_x = x + (uint32_t)(px * STRETCH_X);
+            uint32_t end_x = x + (uint32_t)(end * STRETCH_X);
+
+            vesa_fill_alpha(start_x, y + py, end_x - start_x, 1, LOGO_COLOR, alpha);
+            px = end;
         }
     }
 }
@@ -16,6 +16,7 @@
 #include "hw/scanner.h"
 #include "drivers/power.h"
 #include "gui/shutdown.h"
+#include "gui/frame.h"
 #include "kernel/multiboot_util.h"
 #include "kernel/logo.h"
 #include "stddef.h"
@@ -29,6 +30,11 @@
 #include "drivers/ata.h"
 #include "drivers/disk.h"
 #include "fs/vfs.h"
+#include "fs/ext2.h"
+#include "fs/bcache.h"
+#include "fs/dcache.h"
+#include "fs/icache.h"
+#include "fs/mmap.h"
 
 static uint8_t system_running = 1;
 uint8_t taskbar_disabled = 1;
@@ -114,6 +120,9 @@ void kernel_main(uint32_t magic, multiboot_info_t* mb_info) {
         vga_puts("[ OK ] VBE/VESA OK\n");
     }
     vesa_enable_double_buffer();
+#if VESA_FILL_BENCHMARK
+    vesa_fill_benchmark();
+#endif
 
     show_boot_logo();
     boot_progress = 15;
@@ -214,7 +223,64 @@ void kernel_main(uint32_t magic, multiboot_info_t* mb_info) {
         serial_puts("[TEST 3] Failed to create directory\n");
     }
 
+    // Тест 4: отображение файла. Общее совпадает с файлом, запись в частное
+    // получает свою копию страницы, а файл и общее отображение не меняются
+    serial_puts("[TEST 4] Mapping /test.txt...\n");
+    struct vfs_file* map_file;
+    if (vfs_open("/test.txt", FS_O_RDONLY, &map_file) == 0) {
+        char original[128];
+        char after[128];
+        uint32_t got = 0;
+        uint32_t again = 0;
+        mmap_stats_t mstats;
+        vfs_read(map_file, original, sizeof(original), &got);
+
+        char* shared = vfs_mmap(map_file, 0, got, VFS_MAP_SHARED);
+        char* private = vfs_mmap(map_file, 0, got, VFS_MAP_PRIVATE);
+        if (got == 0 || !shared || !private) {
+            serial_puts("[TEST 4] mmap FAILED\n");
+        } else {
+            int ok = memcmp(shared, original, got) == 0 && memcmp(private, original, got) == 0;
+
+            mmap_get_stats(&mstats);
+            uint32_t copies = mstats.cow_copies;
+            private[0] = '#';
+            mmap_get_stats(&mstats);
+            ok = ok && private[0] == '#' && shared[0] == original[0] && mstats.cow_copies == copies + 1;
+
+            vfs_munmap(private, got);
+            vfs_munmap(shared, got);
+            private = NULL;
+            shared = NULL;
+
+            struct vfs_file* check_file;
+            if (vfs_open("/test.txt", FS_O_RDONLY, &check_file) == 0) {
+                vfs_read(check_file, after, sizeof(after), &again);
+                vfs_close(check_file);
+            }
+            ok = ok && again == got && memcmp(after, original, got) == 0;
+
+            serial_puts(ok ? "[TEST 4] mmap OK, private copy-on-write left file intact\n"
+                           : "[TEST 4] mmap FAILED\n");
+        }
+        if (private) vfs_munmap(private, got);
+        if (shared) vfs_munmap(shared, got);
+        vfs_close(map_file);
+    } else {
+        serial_puts("[TEST 4] Failed to open file\n");
+    }
+
+#if EXT2_DIR_BENCHMARK
+    ext2_dir_benchmark("/benchdir", 10000);
+#endif
+#if EXT2_REUSE_STRESS
+    ext2_reuse_stress("/reuse", 2000);
+#endif
+
     serial_puts("=== END OF EXT2 TEST ===\n\n");
+    bcache_dump_stats();
+    dcache_dump_stats();
+    icache_dump_stats();
 
 
 
@@ -283,16 +349,27 @@ void kernel_main(uint32_t magic, multiboot_info_t* mb_info) {
         vesa_swap_buffers();
     }
 
+    frame_init();
+
     while(system_running) {
         check_stack_overflow();
         asm volatile("hlt");
 
         event_t event;
         while (event_poll(&event)) {
+            if (frame_coalesce(&event)) continue;
+            frame_input(&event);
             gui_handle_event(&event);
             handle_keyboard_events(&event);
         }
 
+        ext2_poll();
+        bcache_flusher_poll();
+        disk_poll();
+
+        // Кадр только по вводу, урону, анимации или сроку и не чаще FRAME_RATE
+        if (!frame_begin()) continue;
+
         vesa_hide_cursor();
 
         mouse_update();
@@ -301,10 +378,6 @@ void kernel_main(uint32_t magic, multiboot_info_t* mb_info) {
             update_shutdown_animation();
         }
 
-        if (vesa_is_background_cached()) {
-            vesa_restore_background_dirty();
-        }
-
         gui_render();
 
         notif_update();
@@ -313,8 +386,11 @@ void kernel_main(uint32_t magic, multiboot_info_t* mb_info) {
         vesa_show_cursor();
         vesa_cursor_update();
 
+        // На экран - только изменившиеся строки; кадр без урона пропускается
         if (vesa_is_double_buffer_enabled()) {
-            vesa_swap_buffers();
+            vesa_update_dirty();
         }
+
+        frame_end();
     }
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <drivers/mouse.h>
 #include <gui/gui.h>
 #include <gui/shutdown.h>
+#include <gui/frame.h>
 #include <lib/string.h>
 #include <stdarg.h>
 #include <lib/mini_printf.h>
@@ -17,6 +18,7 @@
 #define NOTIF_MAX_COUNT 16
 #define NOTIF_LIFETIME  1800
 #define NOTIF_MOVE_STEPS 10
+#define NOTIF_MOVE_TICKS 1         // Шаг перемещения раз в тик
 
 #define COLOR_INFO      0x808080
 #define COLOR_WARNING   0xFF8000
@@ -37,9 +39,12 @@ typedef struct {
     
     uint8_t mouse_down;
     int clicked_index;
+    
+    uint8_t redraw;                 // Что-то появилось или сдвинулось: место уведомлений повреждено
 } notif_sys_t;
 
 static notif_sys_t notif = {0};
+static frame_timer_t move_timer;
 
 static uint32_t notif_get_color(notif_type_t type) {
     switch (type) {
@@ -73,6 +78,10 @@ static void notif_recalc_targets(void) {
             notif.notifs[i].move_start_y = notif.notifs[i].current_y;
             notif.notifs[i].target_y = target_y;
             notif.notifs[i].move_step = 0;
+            
+            if (!frame_timer_active(&move_timer)) {
+                frame_timer_start(&move_timer, NOTIF_MOVE_TICKS);
+            }
         }
         
         visible_count++;
@@ -142,7 +151,11 @@ static void notif_draw_one(notif_t* n) {
     vesa_draw_line(close_x, close_y, close_x + 10, close_y + 10, COLOR_CLOSE);
     vesa_draw_line(close_x + 10, close_y, close_x, close_y + 10, COLOR_CLOSE);
     
-    vesa_mark_dirty(x, n->current_y, NOTIF_WIDTH, NOTIF_HEIGHT);
+    // Неподвижное уведомление рисуется поверх каждого кадра, но экран не повреждает:
+    // под ним перерисовывается только то, что повредили окна
+    if (notif.redraw) {
+        vesa_mark_dirty(x, n->current_y, NOTIF_WIDTH, NOTIF_HEIGHT);
+    }
 }
 
 static void notif_draw_all(void) {
@@ -286,9 +299,12 @@ void notif_printf(notif_type_t type, const char* title, const char* format, ...)
     n->message[NOTIF_MAX_MSG - 1] = '\0';
     
     notif.count++;
+    notif.redraw = 1;
     
     asm volatile("sti");
     
+    frame_request();
+    
     serial_puts("[NOTIF] ");
     serial_puts(title);
     serial_puts(": ");
@@ -313,28 +329,41 @@ void notif_update(void) {
     notif_handle_clicks();
     
     uint32_t current_tick = timer_get_ticks();
+    uint32_t steps = frame_timer_steps(&move_timer);
+    uint8_t moving = 0;
     
     for (int i = 0; i < NOTIF_MAX_COUNT; i++) {
         if (notif.notifs[i].id == 0) continue;
         
         notif_t* n = &notif.notifs[i];
         
-        if (n->moving) {
-            n->move_step++;
+        // Шаги по таймеру, а не по проходам цикла: скорость не зависит от частоты кадров
+        if (n->moving && steps) {
+            n->move_step += steps;
+            notif.redraw = 1;
             if (n->move_step >= NOTIF_MOVE_STEPS) {
                 n->moving = 0;
                 n->current_y = n->target_y;
             } else {
-                float t = (float)n->move_step / NOTIF_MOVE_STEPS;
-                n->current_y = n->move_start_y + (int32_t)((n->target_y - n->move_start_y) * t);
+                n->current_y = n->move_start_y +
+                               (n->target_y - n->move_start_y) * (int32_t)n->move_step / NOTIF_MOVE_STEPS;
             }
         }
         
         if (!n->moving && current_tick - n->created_tick >= NOTIF_LIFETIME) {
             notif_remove(i);
             i--;
+            continue;
+        }
+        
+        if (n->moving) {
+            moving = 1;
+        } else {
+            frame_request_at(n->created_tick + NOTIF_LIFETIME);
         }
     }
+    
+    if (!moving) frame_timer_stop(&move_timer);
 }
 
 void notif_render(void) {
@@ -343,4 +372,5 @@ void notif_render(void) {
     if (notif.count > 0) {
         notif_draw_all();
     }
+    notif.redraw = 0;
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "core/isr.h"
 #include "hw/scanner.h"
 #include "drivers/pci.h"
+#include "fs/mmap.h"
 
 extern mem_region_t* memory_regions;
 extern uint32_t heap_start;
@@ -13,6 +14,7 @@ page_directory_t* current_directory = NULL;
 static page_directory_t* kernel_directory = NULL;
 static uint32_t* page_frames = NULL;
 static uint32_t total_frames = 0;
+static uint32_t mmap_window_size = 0;
 
 #define ADDR_TO_FRAME(addr) ((uint32_t)(addr) / PAGE_SIZE)
 #define FRAME_TO_ADDR(frame) ((uint32_t)(frame) * PAGE_SIZE)
@@ -115,6 +117,52 @@ uint32_t paging_get_physical(page_directory_t* dir, uint32_t virt) {
     return (table->entries[table_idx] & 0xFFFFF000) | (virt & 0xFFF);
 }
 
+uint32_t paging_get_entry(page_directory_t* dir, uint32_t virt) {
+    uint32_t dir_idx = (virt >> 22) & 0x3FF;
+    uint32_t table_idx = (virt >> 12) & 0x3FF;
+    
+    if (!dir || !(dir->entries[dir_idx] & PAGE_PRESENT)) return 0;
+    
+    page_table_t* table = (page_table_t*)(dir->entries[dir_idx] & 0xFFFFF000);
+    return table->entries[table_idx];
+}
+
+uint32_t paging_mmap_window(void) {
+    return mmap_window_size;
+}
+
+// Пустые таблицы окна отображений: каталоги процессов копируют PDE и видят те же страницы
+static void reserve_mmap_window(void) {
+    for (uint32_t addr = PAGING_MMAP_BASE; addr < PAGING_MMAP_BASE + PAGING_MMAP_SIZE; addr += 0x400000) {
+        uint32_t dir_idx = (addr >> 22) & 0x3FF;
+        
+        if (kernel_directory->entries[dir_idx] & PAGE_PRESENT) {
+            serial_puts("[PAGING] mmap window overlaps existing mapping at 0x");
+            serial_puts_num_hex(addr);
+            serial_puts(", file mappings disabled\n");
+            return;
+        }
+    }
+    
+    for (uint32_t addr = PAGING_MMAP_BASE; addr < PAGING_MMAP_BASE + PAGING_MMAP_SIZE; addr += 0x400000) {
+        uint32_t dir_idx = (addr >> 22) & 0x3FF;
+        page_table_t* table = (page_table_t*)kmalloc_aligned(sizeof(page_table_t), PAGE_SIZE);
+        if (!table) {
+            serial_puts("[PAGING] Failed to allocate page table for mmap window\n");
+            return;
+        }
+        memset(table->entries, 0, sizeof(table->entries));
+        kernel_directory->entries[dir_idx] = (uint32_t)table | PAGE_PRESENT | PAGE_WRITABLE;
+        mmap_window_size = addr + 0x400000 - PAGING_MMAP_BASE;
+    }
+    
+    serial_puts("[PAGING] mmap window: 0x");
+    serial_puts_num_hex(PAGING_MMAP_BASE);
+    serial_puts(" - 0x");
+    serial_puts_num_hex(PAGING_MMAP_BASE + mmap_window_size);
+    serial_puts("\n");
+}
+
 void paging_init(void) {
     memory_info_t mem_info = get_memory_info();
     total_frames = mem_info.total_memory / PAGE_SIZE;
@@ -172,7 +220,7 @@ void paging_init(void) {
         }
         
         page_table_t* table = (page_table_t*)(kernel_directory->entries[dir_idx] & 0xFFFFF000);
-        table->entries[table_idx] = addr | PAGE_PRESENT;
+        table->entries[table_idx] = addr | PAGE_PRESENT | PAGE_WRITABLE;
     }
     
     serial_puts("[PAGING] Mapping video memory (0xA0000-0xC0000)...\n");
@@ -210,7 +258,7 @@ void paging_init(void) {
         }
         
         page_table_t* table = (page_table_t*)(kernel_directory->entries[dir_idx] & 0xFFFFF000);
-        table->entries[table_idx] = addr | PAGE_PRESENT;
+        table->entries[table_idx] = addr | PAGE_PRESENT | PAGE_WRITABLE;
     }
     
     serial_puts("[PAGING] Mapping BIOS area (0xE0000-0x100000)...\n");
@@ -229,13 +277,14 @@ void paging_init(void) {
         }
         
         page_table_t* table = (page_table_t*)(kernel_directory->entries[dir_idx] & 0xFFFFF000);
-        table->entries[table_idx] = addr | PAGE_PRESENT;
+        table->entries[table_idx] = addr | PAGE_PRESENT | PAGE_WRITABLE;
     }
     
     struct fb_info* fb = vesa_get_info();
     if (fb && fb->found && fb->address) {
         uint32_t fb_start = (uint32_t)fb->address;
-        uint32_t fb_size = fb->height * fb->pitch;
+        // С DISPI отображается вся видеопамять: вторая страница и режимы, выставленные позже
+        uint32_t fb_size = fb->vram_size ? fb->vram_size : fb->height * fb->pitch;
         uint32_t fb_end = fb_start + fb_size;
         
         serial_puts("[PAGING] Mapping framebuffer: 0x");
@@ -416,17 +465,23 @@ void paging_init(void) {
     serial_puts_num(total_mapped);
     serial_puts(" pages)\n");
     
+    reserve_mmap_window();
+    
     current_directory = kernel_directory;
     asm volatile("mov %0, %%cr3" : : "r"(current_directory));
     
+    // WP: ядро тоже получает #PF при записи в страницу только для чтения - нужно для copy-on-write.
+    // Поэтому области BIOS выше отображены с записью: при WP=0 их флаги ядро не ограничивали
     uint32_t cr0;
     asm volatile("mov %%cr0, %0" : "=r"(cr0));
-    cr0 |= 0x80000000;
+    cr0 |= 0x80000000 | 0x00010000;
     asm volatile("mov %0, %%cr0" : : "r"(cr0));
     
     extern void memory_paging_activated(void);
     memory_paging_activated();
     
+    isr_install_handler(14, page_fault_handler);
+    
     serial_puts("[PAGING] Initialized and enabled\n");
 }
 
@@ -447,6 +502,12 @@ void page_fault_handler(registers_t* r) {
     uint32_t fault_addr;
     asm volatile("mov %%cr2, %0" : "=r"(fault_addr));
     
+    // Отображения файлов подгружаются по требованию; чтение с диска требует прерываний
+    if (fault_addr - PAGING_MMAP_BASE < mmap_window_size) {
+        if (r->eflags & 0x200) asm volatile("sti");
+        if (vfs_mmap_fault(fault_addr, (r->err_code & 0x2) ? 1 : 0) == 0) return;
+    }
+    
     serial_puts("\n*** PAGE FAULT ***\n");
     serial_puts("Address: 0x"); serial_puts_num_hex(fault_addr); serial_puts("\n");
     serial_puts("Error:   0x"); serial_puts_num_hex(r->err_code); serial_puts("\n");
@@ -0,0 +1,31 @@
+#include "lib/crc32.h"
+
+static uint32_t crc32_table[256];
+static uint8_t crc32_table_ready = 0;
+
+static void crc32_init_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+        }
+        crc32_table[i] = c;
+    }
+    crc32_table_ready = 1;
+}
+
+uint32_t crc32_update(uint32_t crc, const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    
+    if (!crc32_table_ready) crc32_init_table();
+    
+    crc = ~crc;
+    while (len--) {
+        crc = crc32_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+uint32_t crc32(const void* data, size_t len) {
+    return crc32_update(0, data, len);
+}
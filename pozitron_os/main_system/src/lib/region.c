@@ -0,0 +1,285 @@
+#include "lib/region.h"
+#include "kernel/memory.h"
+#include <stddef.h>
+
+#define REGION_INITIAL_RECTS 8
+
+#define REGION_OP_UNION      0
+#define REGION_OP_INTERSECT  1
+#define REGION_OP_SUBTRACT   2
+
+static int32_t imin(int32_t a, int32_t b) { return a < b ? a : b; }
+static int32_t imax(int32_t a, int32_t b) { return a > b ? a : b; }
+
+void region_init(region_t* region) {
+    region->rects = NULL;
+    region->count = 0;
+    region->capacity = 0;
+    region->extents.x1 = region->extents.y1 = 0;
+    region->extents.x2 = region->extents.y2 = 0;
+}
+
+void region_free(region_t* region) {
+    if (region->rects) kfree(region->rects);
+    region_init(region);
+}
+
+// Память не отдаётся: область урона очищается каждый кадр
+void region_clear(region_t* region) {
+    region->count = 0;
+    region->extents.x1 = region->extents.y1 = 0;
+    region->extents.x2 = region->extents.y2 = 0;
+}
+
+static int push_rect(region_t* region, int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+    if (region->count == region->capacity) {
+        uint32_t capacity = region->capacity ? region->capacity * 2 : REGION_INITIAL_RECTS;
+        region_rect_t* rects = krealloc(region->rects, capacity * sizeof(region_rect_t));
+        if (!rects) return -1;
+        region->rects = rects;
+        region->capacity = capacity;
+    }
+
+    region_rect_t* r = &region->rects[region->count++];
+    r->x1 = x1;
+    r->y1 = y1;
+    r->x2 = x2;
+    r->y2 = y2;
+    return 0;
+}
+
+static void update_extents(region_t* region) {
+    if (region->count == 0) {
+        region_clear(region);
+        return;
+    }
+
+    // По y границы дают первая и последняя полосы, по x нужен проход
+    region->extents.y1 = region->rects[0].y1;
+    region->extents.y2 = region->rects[region->count - 1].y2;
+    region->extents.x1 = region->rects[0].x1;
+    region->extents.x2 = region->rects[0].x2;
+
+    for (uint32_t i = 1; i < region->count; i++) {
+        region->extents.x1 = imin(region->extents.x1, region->rects[i].x1);
+        region->extents.x2 = imax(region->extents.x2, region->rects[i].x2);
+    }
+}
+
+// Конец полосы, начинающейся с прямоугольника i
+static uint32_t band_end(const region_t* region, uint32_t i) {
+    int32_t y1 = region->rects[i].y1;
+    while (i < region->count && region->rects[i].y1 == y1) i++;
+    return i;
+}
+
+static uint8_t op_inside(int op, uint8_t in_a, uint8_t in_b) {
+    switch (op) {
+        case REGION_OP_UNION:     return in_a || in_b;
+        case REGION_OP_INTERSECT: return in_a && in_b;
+        default:                  return in_a && !in_b;
+    }
+}
+
+// Слияние отрезков двух полос одним проходом по границам; соприкасающиеся отрезки склеиваются
+static int band_combine(region_t* out, const region_rect_t* a, uint32_t na,
+                        const region_rect_t* b, uint32_t nb, int32_t y1, int32_t y2, int op) {
+    uint32_t i = 0, j = 0;
+    int32_t x = INT32_MIN;
+    int32_t start = 0;
+    uint8_t open = 0;
+
+    while (i < na || j < nb) {
+        int32_t next_a = i < na ? (x < a[i].x1 ? a[i].x1 : a[i].x2) : INT32_MAX;
+        int32_t next_b = j < nb ? (x < b[j].x1 ? b[j].x1 : b[j].x2) : INT32_MAX;
+
+        x = imin(next_a, next_b);
+        if (i < na && a[i].x2 <= x) i++;
+        if (j < nb && b[j].x2 <= x) j++;
+
+        uint8_t inside = op_inside(op, i < na && a[i].x1 <= x, j < nb && b[j].x1 <= x);
+        if (inside && !open) {
+            start = x;
+            open = 1;
+        } else if (!inside && open) {
+            if (push_rect(out, start, y1, x, y2) != 0) return -1;
+            open = 0;
+        }
+    }
+    return 0;
+}
+
+// Новая полоса [start, count) продолжает предыдущую с теми же x - растягиваем предыдущую
+static uint32_t coalesce(region_t* out, uint32_t prev, uint32_t start) {
+    uint32_t prev_count = start - prev;
+
+    if (prev_count == 0 || out->count - start != prev_count) return start;
+    if (out->rects[prev].y2 != out->rects[start].y1) return start;
+
+    for (uint32_t i = 0; i < prev_count; i++) {
+        if (out->rects[prev + i].x1 != out->rects[start + i].x1 ||
+            out->rects[prev + i].x2 != out->rects[start + i].x2) {
+            return start;
+        }
+    }
+
+    for (uint32_t i = 0; i < prev_count; i++) {
+        out->rects[prev + i].y2 = out->rects[start].y2;
+    }
+    out->count = start;
+    return prev;
+}
+
+// Проход сверху вниз по слоям, где набор полос a и b не меняется
+static int region_op(region_t* dst, const region_t* a, const region_t* b, int op) {
+    region_t out;
+    uint32_t ia = 0, ib = 0;
+    uint32_t prev_band = 0;
+    int32_t y = INT32_MIN;
+
+    region_init(&out);
+
+    while (ia < a->count || ib < b->count) {
+        if (op == REGION_OP_INTERSECT && (ia >= a->count || ib >= b->count)) break;
+        if (op == REGION_OP_SUBTRACT && ia >= a->count) break;
+
+        uint32_t ea = ia < a->count ? band_end(a, ia) : ia;
+        uint32_t eb = ib < b->count ? band_end(b, ib) : ib;
+        int32_t a_top = ia < a->count ? imax(a->rects[ia].y1, y) : INT32_MAX;
+        int32_t b_top = ib < b->count ? imax(b->rects[ib].y1, y) : INT32_MAX;
+        int32_t top = imin(a_top, b_top);
+        uint8_t in_a = ia < a->count && a_top == top;
+        uint8_t in_b = ib < b->count && b_top == top;
+        int32_t bottom = INT32_MAX;
+
+        // Слой кончается там, где кончается текущая полоса или начинается следующая
+        if (ia < a->count) bottom = imin(bottom, in_a ? a->rects[ia].y2 : a_top);
+        if (ib < b->count) bottom = imin(bottom, in_b ? b->rects[ib].y2 : b_top);
+
+        uint8_t emit = op == REGION_OP_UNION ? (in_a || in_b) :
+                       op == REGION_OP_INTERSECT ? (in_a && in_b) : in_a;
+
+        if (emit) {
+            uint32_t start = out.count;
+
+            if (band_combine(&out, in_a ? &a->rects[ia] : NULL, in_a ? ea - ia : 0,
+                             in_b ? &b->rects[ib] : NULL, in_b ? eb - ib : 0,
+                             top, bottom, op) != 0) {
+                region_free(&out);
+                return -1;
+            }
+            if (out.count > start) prev_band = coalesce(&out, prev_band, start);
+        }
+
+        y = bottom;
+        if (ia < a->count && a->rects[ia].y2 <= y) ia = ea;
+        if (ib < b->count && b->rects[ib].y2 <= y) ib = eb;
+    }
+
+    update_extents(&out);
+    region_free(dst);
+    *dst = out;
+    return 0;
+}
+
+int region_copy(region_t* dst, const region_t* src) {
+    if (dst == src) return 0;
+
+    region_clear(dst);
+    for (uint32_t i = 0; i < src->count; i++) {
+        const region_rect_t* r = &src->rects[i];
+        if (push_rect(dst, r->x1, r->y1, r->x2, r->y2) != 0) return -1;
+    }
+    dst->extents = src->extents;
+    return 0;
+}
+
+int region_set_rect(region_t* region, int32_t x, int32_t y, uint32_t w, uint32_t h) {
+    region_clear(region);
+    if (w == 0 || h == 0) return 0;
+
+    if (push_rect(region, x, y, x + (int32_t)w, y + (int32_t)h) != 0) return -1;
+    region->extents = region->rects[0];
+    return 0;
+}
+
+int region_union(region_t* dst, const region_t* a, const region_t* b) {
+    return region_op(dst, a, b, REGION_OP_UNION);
+}
+
+int region_intersect(region_t* dst, const region_t* a, const region_t* b) {
+    return region_op(dst, a, b, REGION_OP_INTERSECT);
+}
+
+int region_subtract(region_t* dst, const region_t* a, const region_t* b) {
+    return region_op(dst, a, b, REGION_OP_SUBTRACT);
+}
+
+// Прямоугольник как область из одного элемента на стеке, без выделения памяти
+static void rect_region(region_t* region, region_rect_t* rect, int32_t x, int32_t y, uint32_t w, uint32_t h) {
+    rect->x1 = x;
+    rect->y1 = y;
+    rect->x2 = x + (int32_t)w;
+    rect->y2 = y + (int32_t)h;
+
+    region->rects = rect;
+    region->count = (w && h) ? 1 : 0;
+    region->capacity = 1;
+    region->extents = *rect;
+}
+
+int region_union_rect(region_t* region, int32_t x, int32_t y, uint32_t w, uint32_t h) {
+    region_t r;
+    region_rect_t rect;
+
+    if (w == 0 || h == 0) return 0;
+    if (region->count == 0) return region_set_rect(region, x, y, w, h);
+
+    rect_region(&r, &rect, x, y, w, h);
+    return region_op(region, region, &r, REGION_OP_UNION);
+}
+
+int region_intersect_rect(region_t* region, int32_t x, int32_t y, uint32_t w, uint32_t h) {
+    region_t r;
+    region_rect_t rect;
+
+    rect_region(&r, &rect, x, y, w, h);
+    return region_op(region, region, &r, REGION_OP_INTERSECT);
+}
+
+int region_subtract_rect(region_t* region, int32_t x, int32_t y, uint32_t w, uint32_t h) {
+    region_t r;
+    region_rect_t rect;
+
+    if (w == 0 || h == 0 || region->count == 0) return 0;
+
+    rect_region(&r, &rect, x, y, w, h);
+    return region_op(region, region, &r, REGION_OP_SUBTRACT);
+}
+
+uint8_t region_is_empty(const region_t* region) {
+    return region->count == 0;
+}
+
+uint32_t region_area(const region_t* region) {
+    uint32_t area = 0;
+
+    for (uint32_t i = 0; i < region->count; i++) {
+        const region_rect_t* r = &region->rects[i];
+        area += (uint32_t)(r->x2 - r->x1) * (uint32_t)(r->y2 - r->y1);
+    }
+    return area;
+}
+
+uint8_t region_contains_point(const region_t* region, int32_t x, int32_t y) {
+    if (region->count == 0) return 0;
+    if (x < region->extents.x1 || x >= region->extents.x2 ||
+        y < region->extents.y1 || y >= region->extents.y2) return 0;
+
+    for (uint32_t i = 0; i < region->count; i++) {
+        const region_rect_t* r = &region->rects[i];
+        if (r->y1 > y) break;
+        if (y < r->y2 && x >= r->x1 && x < r->x2) return 1;
+    }
+    return 0;
+}